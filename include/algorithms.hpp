@@ -25,6 +25,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "algorithms/discrete_cosine_transform.hpp"
 #include "algorithms/edge_enhancement.hpp"
 #include "algorithms/flash_photography.hpp"
+#include "algorithms/multigrid_solver.hpp"
 #include "algorithms/poisson_filling.hpp"
 #include "algorithms/poisson_solver.hpp"
 #include "algorithms/poisson_image_editing.hpp"
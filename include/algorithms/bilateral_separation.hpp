@@ -20,6 +20,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "image.hpp"
 #include "filtering/filter_bilateral_2ds.hpp"
+#include "filtering/bilateral_grid.hpp"
 #include "util/math.hpp"
 
 namespace pic {
@@ -39,9 +40,11 @@ inline float powf10fe(float x)
  * @param imgIn
  * @param sigma_s
  * @param simga_r
+ * @param bGrid if true, the bilateral grid is used instead of
+ * the sampled bilateral filter.
  * @return
  */
-ImageVec* bilateralSeparation(Image *imgIn, float sigma_s = -1.0f, float sigma_r = 0.4f)
+ImageVec* bilateralSeparation(Image *imgIn, float sigma_s = -1.0f, float sigma_r = 0.4f, bool bGrid = false)
 {
     if(imgIn == NULL) {
         return NULL;
@@ -61,7 +64,14 @@ ImageVec* bilateralSeparation(Image *imgIn, float sigma_s = -1.0f, float sigma_r
 
     img_tmp->applyFunction(log10fPlusEpsilon);
 
-    Image *img_flt = FilterBilateral2DS::Execute(img_tmp, NULL, sigma_s, sigma_r);
+    Image *img_flt = NULL;
+
+    if(bGrid) {
+        BilateralGrid grid(sigma_s, sigma_r);
+        img_flt = grid.execute(img_tmp);
+    } else {
+        img_flt = FilterBilateral2DS::Execute(img_tmp, NULL, sigma_s, sigma_r);
+    }
 
     img_flt->applyFunction(powf10fe);
 
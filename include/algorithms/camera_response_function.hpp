@@ -189,6 +189,15 @@ public:
         Destroy();
     }
 
+    /**
+     * @brief getType
+     * @return It returns the type of linearization.
+     */
+    IMG_LIN getType()
+    {
+        return type_linearization;
+    }
+
     /**
      * @brief Remove linearizes a camera value using the inverse CRF.
      * @param x is an intensity value in [0,1].
@@ -19,11 +19,12 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_ALGORITHMS_CONNECTED_COMPONENTS_HPP
 
 #include <vector>
-#include <set>
-#include <map>
+#include <algorithm>
 
 #include "image.hpp"
 #include "filtering/filter_luminance.hpp"
+#include "util/array.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
@@ -67,223 +68,403 @@ public:
     }
 };
 
-
 /**
- * @brief computeConnectedComponents computes connected components in an image
- * @param img
- * @param ret
- * @param comp
- * @param channel
- * @return
+ * @brief The ConnectedComponent struct stores the statistics of
+ * a connected component.
  */
-Image *computeConnectedComponents(Image *img, std::vector<LabelOutput> &ret,
-                              Image *comp = NULL, float thr = 0.05f)
+struct ConnectedComponent
 {
-    //Check input paramters
-    if(img == NULL) {
-        return NULL;
+    int area;
+
+    //bounding box; x1 and y1 are excluded
+    int x0, y0, x1, y1;
+
+    //centroid
+    float x, y;
+
+    std::vector<float> mean;
+
+    ConnectedComponent()
+    {
+        area = 0;
+        x0 = y0 = x1 = y1 = 0;
+        x = y = 0.0f;
     }
+};
 
-    float *data  = img->data;
-    int width    = img->width;
-    int height   = img->height;
-    int channels = img->channels;
-    int n = height * width;
+/**
+ * @brief The ConnectedComponents class labels the 4-connected components
+ * of an image; two neighbors are connected if their distance is lower than
+ * thr times the larger of their norms. Horizontal strips of the image are
+ * labeled in parallel with a union-find (path compression and union by rank)
+ * over pixel indices, then strips are merged along their seams. A last pass
+ * computes compact labels, in raster order of first appearance, and
+ * the statistics of each component.
+ */
+class ConnectedComponents
+{
+protected:
+    float thr;
 
-    if(comp == NULL) {
-        comp = new Image(1, width, height, 1);
+    std::vector<int> parent;
+    std::vector<unsigned char> rank;
+    std::vector<float> norms;
+
+    std::vector<ConnectedComponent> components;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief find returns the root of i and it compresses its path.
+     * @param i
+     * @return
+     */
+    inline int find(int i)
+    {
+        int r = i;
+
+        while(parent[r] != r) {
+            r = parent[r];
+        }
+
+        while(parent[i] != r) {
+            int next = parent[i];
+            parent[i] = r;
+            i = next;
+        }
+
+        return r;
     }
 
-    comp->setZero();
+    /**
+     * @brief unite merges the sets of a and b.
+     * @param a
+     * @param b
+     */
+    inline void unite(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
 
-    //First pass: assigning basics labels
-    // and generating the list of neighbors
-    int label = 1;
+        if(a == b) {
+            return;
+        }
 
-    std::set<LabelInfo> labelEq;
-    std::set<LabelInfo>::iterator it;
+        if(rank[a] < rank[b]) {
+            std::swap(a, b);
+        }
 
-    for(int j = 0; j < height; j++) {
-        int indY = j * width;
+        parent[b] = a;
 
-        for(int i = 0; i < width; i++) {
-            int ind = (indY + i);
+        if(rank[a] == rank[b]) {
+            rank[a]++;
+        }
+    }
 
-            int ind_img = ind * channels;
+    /**
+     * @brief isConnected
+     * @param data
+     * @param i
+     * @param j
+     * @param channels
+     * @return
+     */
+    inline bool isConnected(float *data, int i, int j, int channels)
+    {
+        float dist = sqrtf(Array<float>::distanceSq(&data[i * channels], &data[j * channels], channels));
+        return dist <= (thr * MAX(norms[i], norms[j]));
+    }
 
-            //neighbors
-            int neighbors[2];
-            int nNeighbors = 0;
+    /**
+     * @brief labelStrip labels the rows [y0, y1); it only touches
+     * the union-find entries of these rows.
+     * @param img
+     * @param y0
+     * @param y1
+     */
+    void labelStrip(Image *img, int y0, int y1)
+    {
+        int width = img->width;
+        int channels = img->channels;
+        float *data = img->data;
+
+        for(int i = y0 * width; i < y1 * width; i++) {
+            norms[i] = Array<float>::norm(&data[i * channels], channels);
+            parent[i] = i;
+            rank[i] = 0;
+        }
 
-            if((i - 1) > -1) {
-                int ind_img_prev = ind_img - channels;
+        for(int j = y0; j < y1; j++) {
+            int ind = j * width;
 
-                float n1 = Array<float>::norm(&data[ind_img], channels);
-                float n2 = Array<float>::norm(&data[ind_img_prev], channels);
-                float dist = sqrtf(Array<float>::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
+            for(int i = 0; i < width; i++) {
+                if(i > 0 && isConnected(data, ind, ind - 1, channels)) {
+                    unite(ind, ind - 1);
+                }
 
-                if(dist <= (thr * MAX(n1, n2))) {
-                    neighbors[0] = ind - 1;
-                    nNeighbors++;
+                if(j > y0 && isConnected(data, ind, ind - width, channels)) {
+                    unite(ind, ind - width);
                 }
+
+                ind++;
             }
+        }
+    }
 
-            if((j - 1) > -1) {
-                int ind_img_prev = ind_img - (width * channels);
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
 
-                float n1 = Array<float>::norm(&data[ind_img], channels);
-                float n2 = Array<float>::norm(&data[ind_img_prev], channels);
-                float dist = sqrtf(Array<float>::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
+public:
 
-                if(dist <= (thr * MAX(n1, n2))) {
-                    neighbors[nNeighbors] = ind - width;
-                    nNeighbors++;
-                }
-            }
+    /**
+     * @brief ConnectedComponents
+     * @param thr
+     */
+    ConnectedComponents(float thr = 0.05f)
+    {
+        this->thr = thr;
 
-            //No neighbors?
-            if(nNeighbors == 0) {
-                comp->data[ind] = float(label);
-                label++;
-            }
+        pool = NULL;
+        nThreads = -1;
+    }
 
-            if(nNeighbors == 1) {
-                comp->data[ind] = comp->data[neighbors[0]];
-            }
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
 
-            if(nNeighbors == 2) {
-                //Assigning the label of neighbors
-                float minVal, t1, t2;
-                t1 = comp->data[neighbors[0]];
-                t2 = comp->data[neighbors[1]];
-                minVal = MIN(t1, t2);
-
-                //Tracking neighbors
-                LabelInfo tmpLI;
-                bool test = true;
-
-                while(test) {
-                    test = false;
-                    tmpLI.id = minVal;
-                    it = labelEq.find(tmpLI);
-
-                    if(it != labelEq.end()) {
-                        float tmpMinLabel = it->minLabel;
-
-                        if(minVal > tmpMinLabel) {
-                            minVal = tmpMinLabel;
-                            test = true;
-                        }
-                    }
-                }
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the labeling runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief setThreshold
+     * @param thr
+     */
+    void setThreshold(float thr)
+    {
+        this->thr = thr;
+    }
+
+    /**
+     * @brief execute labels the connected components of img.
+     * @param img
+     * @param labels is an array of img->width * img->height labels; if it is NULL,
+     * it is allocated.
+     * @return It returns the label of each pixel; labels are in [0, getNumComponents()).
+     */
+    int *execute(Image *img, int *labels = NULL)
+    {
+        if(img == NULL) {
+            return labels;
+        }
+
+        int width = img->width;
+        int height = img->height;
+        int channels = img->channels;
+        int n = width * height;
+
+        if(n < 1) {
+            return labels;
+        }
+
+        if(labels == NULL) {
+            labels = new int[n];
+        }
+
+        parent.resize(n);
+        rank.resize(n);
+        norms.resize(n);
+
+        //strips
+        int nStrips = 1;
 
-                comp->data[ind] = minVal;
-
-                //Tracking T1
-                test = true;
-                tmpLI.id = t1;
-                it = labelEq.find(tmpLI);
-
-                if(it != labelEq.end()) {
-                    LabelInfo tmp_it;
-                    tmp_it.id = it->id;
-                    tmp_it.minLabel = minVal;
-
-                    labelEq.erase(it);
-                    labelEq.insert(tmp_it);
-                } else {
-                    LabelInfo tmpLabelInfo;
-                    tmpLabelInfo.id = t1;
-                    tmpLabelInfo.minLabel = minVal;
-                    labelEq.insert(tmpLabelInfo);
+        if((nThreads == 1) || (height < 64)) {
+            labelStrip(img, 0, height);
+        } else {
+            ThreadPool *tp = getPool();
+            nStrips = MIN(tp->getNumThreads() * 2, height / 32);
+
+            tp->parallelForBlocks(0, height, nStrips, [this, img](int y0, int y1) {
+                labelStrip(img, y0, y1);
+            });
+        }
+
+        //seams
+        for(int s = 1; s < nStrips; s++) {
+            int j = int((long(height) * long(s)) / long(nStrips));
+            int ind = j * width;
+
+            for(int i = 0; i < width; i++) {
+                if(isConnected(img->data, ind, ind - width, channels)) {
+                    unite(ind, ind - width);
                 }
 
-                //T2
-                tmpLI.id = t2;
-                it = labelEq.find(tmpLI);
-
-                if(it != labelEq.end()) {
-                    LabelInfo tmp_it;
-                    tmp_it.id = it->id;
-                    tmp_it.minLabel = minVal;
-
-                    labelEq.erase(it);
-                    labelEq.insert(tmp_it);
-                } else {
-                    LabelInfo tmpLabelInfo;
-                    tmpLabelInfo.id = t2;
-                    tmpLabelInfo.minLabel = minVal;
-                    labelEq.insert(tmpLabelInfo);
+                ind++;
+            }
+        }
+
+        //roots; parent is read-only here
+        auto flatten = [this, labels](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                int r = i;
+
+                while(parent[r] != r) {
+                    r = parent[r];
                 }
+
+                labels[i] = r;
             }
+        };
+
+        if(nThreads == 1) {
+            flatten(0, n);
+        } else {
+            getPool()->parallelForBlocks(0, n, -1, flatten);
         }
-    }
 
-    //Label Search
-    LabelInfo tmpLI;
-    std::set<LabelInfo>::iterator it2;
+        //compact labels and statistics; a visited root r stores -1 - label
+        components.clear();
+        std::vector<double> sums;
+
+        for(int j = 0; j < height; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+                int r = labels[ind];
+
+                if(parent[r] == r) {
+                    parent[r] = -1 - int(components.size());
+
+                    ConnectedComponent cc;
+                    cc.x0 = i;
+                    cc.x1 = i + 1;
+                    cc.y0 = j;
+                    cc.y1 = j + 1;
+                    components.push_back(cc);
 
-    std::set<LabelInfo> labelEq_new;
+                    sums.resize(sums.size() + channels + 2, 0.0);
+                }
 
-    for(it2 = labelEq.begin() ; it2 != labelEq.end(); it2++) {
-        float minVal = it2->minLabel;
-        bool test = true;
+                int label = -1 - parent[r];
+                labels[ind] = label;
 
-        while(test) {
-            test = false;
-            tmpLI.id = minVal;
-            it = labelEq.find(tmpLI);
+                ConnectedComponent &cc = components[label];
+                cc.area++;
+                cc.x0 = MIN(cc.x0, i);
+                cc.x1 = MAX(cc.x1, i + 1);
+                cc.y1 = j + 1;
 
-            if(it != labelEq.end()) {
-                float tmpMinLabel = (*it).minLabel;
+                double *sum = &sums[label * (channels + 2)];
+                float *pixel = &img->data[ind * channels];
 
-                if(minVal > tmpMinLabel) {
-                    minVal = tmpMinLabel;
-                    test = true;
+                for(int k = 0; k < channels; k++) {
+                    sum[k] += pixel[k];
                 }
+
+                sum[channels] += i;
+                sum[channels + 1] += j;
+            }
+        }
+
+        for(unsigned int l = 0; l < components.size(); l++) {
+            ConnectedComponent &cc = components[l];
+            double *sum = &sums[l * (channels + 2)];
+            double area = double(cc.area);
+
+            cc.mean.resize(channels);
+
+            for(int k = 0; k < channels; k++) {
+                cc.mean[k] = float(sum[k] / area);
             }
+
+            cc.x = float(sum[channels] / area);
+            cc.y = float(sum[channels + 1] / area);
         }
 
-        LabelInfo tmp_it;
-        tmp_it.id = it2->id;
-        tmp_it.minLabel = minVal;
-        labelEq_new.insert(tmp_it);
+        return labels;
     }
 
-    //Second pass: using tracked neighbors
-    //for assigning the correct labels
-    //TO DO: optimizing outside this loop
-    std::set<float> unique;
-    std::set<float>::iterator uniqueIt;
-    std::map<float, int> mapping;
+    /**
+     * @brief getNumComponents
+     * @return
+     */
+    int getNumComponents()
+    {
+        return int(components.size());
+    }
 
-    int counter = 0;
+    /**
+     * @brief getComponents returns the statistics of the components
+     * of the last execution, indexed by label.
+     * @return
+     */
+    std::vector<ConnectedComponent> &getComponents()
+    {
+        return components;
+    }
+};
 
-    for(int i=0; i < n; i++) {
-        tmpLI.id = comp->data[i];
-        it = labelEq_new.find(tmpLI);
+/**
+ * @brief computeConnectedComponents computes connected components in an image
+ * @param img
+ * @param ret
+ * @param comp
+ * @param channel
+ * @return
+ */
+Image *computeConnectedComponents(Image *img, std::vector<LabelOutput> &ret,
+                              Image *comp = NULL, float thr = 0.05f)
+{
+    //Check input paramters
+    if(img == NULL) {
+        return NULL;
+    }
 
-        if(it != labelEq_new.end()) {
-            comp->data[i] = it->minLabel;
-        }
+    int width    = img->width;
+    int height   = img->height;
+    int n = height * width;
+
+    if(comp == NULL) {
+        comp = new Image(1, width, height, 1);
+    }
 
-        //Storing coordiantes of the connected components
-        float id = comp->data[i];
-        uniqueIt = unique.find(id);
+    ConnectedComponents cc(thr);
+    std::vector<int> labels(n);
+    cc.execute(img, &labels[0]);
 
-        if(uniqueIt != unique.end()) {
-            ret[mapping[id]].add(i);
-        } else {
-            std::pair<float, int> tmp = std::make_pair(id, counter);
-            mapping.insert(tmp);
+    //labels start from 1
+    std::vector<ConnectedComponent> &components = cc.getComponents();
 
-            LabelOutput tmpRet(id, i);
-            ret.push_back(tmpRet);
+    int offset = int(ret.size());
+    ret.resize(offset + components.size());
 
-            unique.insert(id);
-            counter++;
-        }
+    for(unsigned int i = 0; i < components.size(); i++) {
+        ret[offset + i].id = float(i + 1);
+        ret[offset + i].coords.reserve(components[i].area);
+    }
+
+    for(int i = 0; i < n; i++) {
+        comp->data[i] = float(labels[i] + 1);
+        ret[offset + labels[i]].add(i);
     }
+
     return comp;
 }
 
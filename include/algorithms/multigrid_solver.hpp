@@ -0,0 +1,801 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_ALGORITHMS_MULTIGRID_SOLVER_HPP
+#define PIC_ALGORITHMS_MULTIGRID_SOLVER_HPP
+
+#include <vector>
+#include <math.h>
+
+#include "base.hpp"
+#include "util/math.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The MultigridSolver class solves A x = b, where A is a symmetric
+ * positive definite five-point operator on a (masked) pixel grid:
+ *
+ *      (A x)_p = diag_p * x_p - sum_{n in N(p)} w_pn * x_n
+ *
+ * The operator is never assembled: only the diagonal and the weights
+ * towards the right and the bottom neighbours are stored. The system is
+ * solved by conjugate gradients preconditioned with a multigrid V-cycle.
+ * Coarse levels are built by aggregating 2x2 cells (Galerkin coarsening),
+ * so masked and irregular domains are handled at every level; smoothing is
+ * red-black Gauss-Seidel, and the coarsest level is solved directly.
+ * All channels of the right-hand side are solved together (interleaved as
+ * in Image::data), and each sweep runs in parallel on a ThreadPool.
+ */
+class MultigridSolver
+{
+protected:
+
+    /**
+     * @brief The Level struct stores the operator and the buffers of a level.
+     */
+    struct Level
+    {
+        int width, height;
+        std::vector<float> diag, wx, wy;
+        std::vector<unsigned char> active;
+        std::vector<float> x, b, r;
+    };
+
+    std::vector<Level *> levels;
+
+    //coarsest level: dense Cholesky factor on the active cells
+    std::vector<int> coarseIndex;
+    std::vector<double> coarseL;
+    int coarseN;
+
+    ThreadPool *pool;
+    int nThreads, channels;
+
+    /**
+     * @brief release frees the hierarchy.
+     */
+    void release()
+    {
+        for(unsigned int i = 0; i < levels.size(); i++) {
+            delete levels[i];
+        }
+
+        levels.clear();
+        coarseIndex.clear();
+        coarseL.clear();
+        coarseN = 0;
+    }
+
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief parallelRows runs func(row_start, row_end) on blocks of rows.
+     * @param height
+     * @param func
+     */
+    void parallelRows(int height, std::function<void(int, int)> func)
+    {
+        ThreadPool *tp = getPool();
+        int n = nThreads > 0 ? nThreads : tp->getNumThreads();
+
+        if((n < 2) || (height < 32)) {
+            func(0, height);
+        } else {
+            tp->parallelForBlocks(0, height, n * 2, func);
+        }
+    }
+
+    /**
+     * @brief coarsen builds the next level from l by aggregating 2x2 cells;
+     * the coarse operator is the Galerkin product P^T A P, where P is
+     * the piecewise constant prolongation.
+     * @param l
+     * @return
+     */
+    static Level *coarsen(Level *l)
+    {
+        Level *c = new Level();
+        c->width  = (l->width  + 1) >> 1;
+        c->height = (l->height + 1) >> 1;
+
+        int n = c->width * c->height;
+        c->diag.assign(n, 0.0f);
+        c->wx.assign(n, 0.0f);
+        c->wy.assign(n, 0.0f);
+        c->active.assign(n, 0);
+
+        int w = l->width;
+
+        for(int y = 0; y < l->height; y++) {
+            int cy = y >> 1;
+
+            for(int x = 0; x < w; x++) {
+                int p = y * w + x;
+
+                if(!l->active[p]) {
+                    continue;
+                }
+
+                int cx = x >> 1;
+                int cp = cy * c->width + cx;
+
+                c->active[cp] = 1;
+                c->diag[cp] += l->diag[p];
+
+                if(x < (w - 1)) {
+                    if((x & 1) == 0) {
+                        c->diag[cp] -= 2.0f * l->wx[p];
+                    } else {
+                        c->wx[cp] += l->wx[p];
+                    }
+                }
+
+                if(y < (l->height - 1)) {
+                    if((y & 1) == 0) {
+                        c->diag[cp] -= 2.0f * l->wy[p];
+                    } else {
+                        c->wy[cp] += l->wy[p];
+                    }
+                }
+            }
+        }
+
+        return c;
+    }
+
+    /**
+     * @brief setupCoarsest computes the dense Cholesky factor of the last level.
+     */
+    void setupCoarsest()
+    {
+        Level *l = levels.back();
+        int n = l->width * l->height;
+
+        coarseIndex.assign(n, -1);
+        coarseN = 0;
+
+        for(int i = 0; i < n; i++) {
+            if(l->active[i]) {
+                coarseIndex[i] = coarseN;
+                coarseN++;
+            }
+        }
+
+        coarseL.assign(coarseN * coarseN, 0.0);
+
+        for(int i = 0; i < n; i++) {
+            int a = coarseIndex[i];
+
+            if(a < 0) {
+                continue;
+            }
+
+            coarseL[a * coarseN + a] = l->diag[i];
+
+            if(((i % l->width) < (l->width - 1)) && (coarseIndex[i + 1] >= 0)) {
+                int b = coarseIndex[i + 1];
+                coarseL[a * coarseN + b] = -l->wx[i];
+                coarseL[b * coarseN + a] = -l->wx[i];
+            }
+
+            if(((i + l->width) < n) && (coarseIndex[i + l->width] >= 0)) {
+                int b = coarseIndex[i + l->width];
+                coarseL[a * coarseN + b] = -l->wy[i];
+                coarseL[b * coarseN + a] = -l->wy[i];
+            }
+        }
+
+        //in-place Cholesky decomposition (lower triangle)
+        for(int j = 0; j < coarseN; j++) {
+            double *Lj = &coarseL[j * coarseN];
+
+            double d = Lj[j];
+            for(int k = 0; k < j; k++) {
+                d -= Lj[k] * Lj[k];
+            }
+
+            d = d > 1e-12 ? sqrt(d) : 1e-6;
+            Lj[j] = d;
+
+            for(int i = j + 1; i < coarseN; i++) {
+                double *Li = &coarseL[i * coarseN];
+                double s = Li[j];
+
+                for(int k = 0; k < j; k++) {
+                    s -= Li[k] * Lj[k];
+                }
+
+                Li[j] = s / d;
+            }
+        }
+    }
+
+    /**
+     * @brief solveCoarsest solves the last level exactly.
+     * @param b
+     * @param x
+     */
+    void solveCoarsest(float *b, float *x)
+    {
+        Level *l = levels.back();
+        int n = l->width * l->height;
+
+        std::vector<double> y(coarseN);
+
+        for(int c = 0; c < channels; c++) {
+            for(int i = 0; i < n; i++) {
+                if(coarseIndex[i] >= 0) {
+                    y[coarseIndex[i]] = b[i * channels + c];
+                }
+            }
+
+            for(int i = 0; i < coarseN; i++) {
+                double *Li = &coarseL[i * coarseN];
+                double s = y[i];
+                for(int k = 0; k < i; k++) {
+                    s -= Li[k] * y[k];
+                }
+                y[i] = s / Li[i];
+            }
+
+            for(int i = coarseN - 1; i >= 0; i--) {
+                double s = y[i];
+                for(int k = i + 1; k < coarseN; k++) {
+                    s -= coarseL[k * coarseN + i] * y[k];
+                }
+                y[i] = s / coarseL[i * coarseN + i];
+            }
+
+            for(int i = 0; i < n; i++) {
+                x[i * channels + c] = coarseIndex[i] >= 0 ?
+                                      float(y[coarseIndex[i]]) : 0.0f;
+            }
+        }
+    }
+
+    /**
+     * @brief smooth runs a Gauss-Seidel sweep on the cells of a color.
+     * @param l
+     * @param b
+     * @param x
+     * @param color is 0 for red cells ((x + y) even), and 1 for black ones.
+     */
+    void smooth(Level *l, float *b, float *x, int color)
+    {
+        int w = l->width;
+        int h = l->height;
+        int ch = channels;
+
+        parallelRows(h, [l, b, x, color, w, h, ch](int y0, int y1) {
+            const float *diag = l->diag.data();
+            const float *wx = l->wx.data();
+            const float *wy = l->wy.data();
+            const unsigned char *active = l->active.data();
+
+            for(int y = y0; y < y1; y++) {
+                for(int i = (y + color) & 1; i < w; i += 2) {
+                    int p = y * w + i;
+
+                    if(!active[p]) {
+                        continue;
+                    }
+
+                    float wl = i > 0 ? wx[p - 1] : 0.0f;
+                    float wr = i < (w - 1) ? wx[p] : 0.0f;
+                    float wt = y > 0 ? wy[p - w] : 0.0f;
+                    float wb = y < (h - 1) ? wy[p] : 0.0f;
+
+                    const float *xl = i > 0 ? &x[(p - 1) * ch] : &x[p * ch];
+                    const float *xr = i < (w - 1) ? &x[(p + 1) * ch] : &x[p * ch];
+                    const float *xt = y > 0 ? &x[(p - w) * ch] : &x[p * ch];
+                    const float *xb = y < (h - 1) ? &x[(p + w) * ch] : &x[p * ch];
+
+                    float inv = 1.0f / diag[p];
+                    float *xp = &x[p * ch];
+                    const float *bp = &b[p * ch];
+
+                    for(int c = 0; c < ch; c++) {
+                        xp[c] = (bp[c] + wl * xl[c] + wr * xr[c] +
+                                         wt * xt[c] + wb * xb[c]) * inv;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief apply computes out = b - A x if b is not NULL, and out = A x otherwise.
+     * @param l
+     * @param b
+     * @param x
+     * @param out
+     */
+    void apply(Level *l, float *b, float *x, float *out)
+    {
+        int w = l->width;
+        int h = l->height;
+        int ch = channels;
+
+        parallelRows(h, [l, b, x, out, w, h, ch](int y0, int y1) {
+            const float *diag = l->diag.data();
+            const float *wx = l->wx.data();
+            const float *wy = l->wy.data();
+            const unsigned char *active = l->active.data();
+
+            for(int y = y0; y < y1; y++) {
+                for(int i = 0; i < w; i++) {
+                    int p = y * w + i;
+                    float *op = &out[p * ch];
+
+                    if(!active[p]) {
+                        for(int c = 0; c < ch; c++) {
+                            op[c] = 0.0f;
+                        }
+                        continue;
+                    }
+
+                    float wl = i > 0 ? wx[p - 1] : 0.0f;
+                    float wr = i < (w - 1) ? wx[p] : 0.0f;
+                    float wt = y > 0 ? wy[p - w] : 0.0f;
+                    float wb = y < (h - 1) ? wy[p] : 0.0f;
+
+                    const float *xl = i > 0 ? &x[(p - 1) * ch] : &x[p * ch];
+                    const float *xr = i < (w - 1) ? &x[(p + 1) * ch] : &x[p * ch];
+                    const float *xt = y > 0 ? &x[(p - w) * ch] : &x[p * ch];
+                    const float *xb = y < (h - 1) ? &x[(p + w) * ch] : &x[p * ch];
+                    const float *xp = &x[p * ch];
+
+                    for(int c = 0; c < ch; c++) {
+                        float ax = diag[p] * xp[c] - (wl * xl[c] + wr * xr[c] +
+                                                      wt * xt[c] + wb * xb[c]);
+                        op[c] = b != NULL ? b[p * ch + c] - ax : ax;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief vCycle approximates x = A^-1 b at level i starting from x = 0.
+     * Pre-smoothing sweeps red then black cells, and post-smoothing
+     * black then red ones; this keeps the cycle symmetric.
+     * @param i
+     * @param b
+     * @param x
+     */
+    void vCycle(int i, float *b, float *x)
+    {
+        Level *l = levels[i];
+
+        if(i == int(levels.size() - 1)) {
+            solveCoarsest(b, x);
+            return;
+        }
+
+        int w = l->width;
+        int h = l->height;
+        int ch = channels;
+        int n = w * h * ch;
+
+        for(int k = 0; k < n; k++) {
+            x[k] = 0.0f;
+        }
+
+        smooth(l, b, x, 0);
+        smooth(l, b, x, 1);
+
+        apply(l, b, x, l->r.data());
+
+        //restriction: sum of the residuals of the 2x2 children
+        Level *c = levels[i + 1];
+        float *cb = c->b.data();
+        float *cx = c->x.data();
+        float *r = l->r.data();
+
+        int cw = c->width;
+        parallelRows(c->height, [r, cb, w, h, cw, ch](int y0, int y1) {
+            for(int cy = y0; cy < y1; cy++) {
+                for(int cx = 0; cx < cw; cx++) {
+                    float *out = &cb[(cy * cw + cx) * ch];
+
+                    for(int k = 0; k < ch; k++) {
+                        out[k] = 0.0f;
+                    }
+
+                    for(int dy = 0; dy < 2; dy++) {
+                        int y = cy * 2 + dy;
+                        if(y >= h) {
+                            break;
+                        }
+
+                        for(int dx = 0; dx < 2; dx++) {
+                            int x = cx * 2 + dx;
+                            if(x >= w) {
+                                break;
+                            }
+
+                            float *in = &r[(y * w + x) * ch];
+                            for(int k = 0; k < ch; k++) {
+                                out[k] += in[k];
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        vCycle(i + 1, cb, cx);
+
+        //prolongation: piecewise constant; the Galerkin operator of
+        //a piecewise constant prolongation is twice as stiff as the
+        //rediscretized one, so the correction is scaled by 2 (this keeps
+        //the cycle symmetric, and it reduces CG iterations by ~3x)
+        const unsigned char *active = l->active.data();
+        parallelRows(h, [x, cx, active, w, cw, ch](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int i = 0; i < w; i++) {
+                    int p = y * w + i;
+
+                    if(!active[p]) {
+                        continue;
+                    }
+
+                    float *in = &cx[((y >> 1) * cw + (i >> 1)) * ch];
+                    float *out = &x[p * ch];
+
+                    for(int k = 0; k < ch; k++) {
+                        out[k] += 2.0f * in[k];
+                    }
+                }
+            }
+        });
+
+        smooth(l, b, x, 1);
+        smooth(l, b, x, 0);
+    }
+
+    /**
+     * @brief dot computes the per-channel dot product of a and b.
+     * @param a
+     * @param b
+     * @param out is an array of channels elements.
+     */
+    void dot(float *a, float *b, double *out)
+    {
+        Level *l = levels[0];
+        int w = l->width;
+        int h = l->height;
+        int ch = channels;
+
+        ThreadPool *tp = getPool();
+        int nBlocks = nThreads > 0 ? nThreads : tp->getNumThreads();
+        nBlocks = MAX(MIN(nBlocks * 2, h), 1);
+
+        std::vector<double> partial(nBlocks * ch, 0.0);
+
+        tp->parallelFor(nBlocks, [a, b, w, h, ch, nBlocks, &partial](int j) {
+            int y0 = int((long(h) * long(j)) / long(nBlocks));
+            int y1 = int((long(h) * long(j + 1)) / long(nBlocks));
+
+            double *acc = &partial[j * ch];
+            for(int k = y0 * w * ch; k < y1 * w * ch; k += ch) {
+                for(int c = 0; c < ch; c++) {
+                    acc[c] += double(a[k + c]) * double(b[k + c]);
+                }
+            }
+        });
+
+        for(int c = 0; c < ch; c++) {
+            out[c] = 0.0;
+
+            for(int j = 0; j < nBlocks; j++) {
+                out[c] += partial[j * ch + c];
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief MultigridSolver
+     */
+    MultigridSolver()
+    {
+        pool = NULL;
+        nThreads = -1;
+        channels = 1;
+        coarseN = 0;
+    }
+
+    ~MultigridSolver()
+    {
+        release();
+    }
+
+    /**
+     * @brief setThreadPool sets the pool used by the solver; by default
+     * the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of parallel blocks of a sweep.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief setup sets the operator and builds the multigrid hierarchy.
+     * @param width is the width of the grid.
+     * @param height is the height of the grid.
+     * @param diag is the diagonal of A (width * height values).
+     * @param wx is the weight between (x, y) and (x + 1, y).
+     * @param wy is the weight between (x, y) and (x, y + 1).
+     * @param active marks unknown cells; if it is NULL, all cells are unknown.
+     * Inactive cells are not solved, and weights towards them are ignored: their
+     * contribution has to be moved into b by the caller.
+     */
+    void setup(int width, int height, float *diag, float *wx, float *wy,
+               bool *active = NULL)
+    {
+        release();
+
+        if((width < 1) || (height < 1)) {
+            return;
+        }
+
+        int n = width * height;
+
+        Level *l = new Level();
+        l->width = width;
+        l->height = height;
+        l->diag.assign(diag, diag + n);
+        l->wx.assign(n, 0.0f);
+        l->wy.assign(n, 0.0f);
+        l->active.assign(n, 1);
+
+        int nActive = n;
+
+        if(active != NULL) {
+            nActive = 0;
+
+            for(int i = 0; i < n; i++) {
+                l->active[i] = active[i] ? 1 : 0;
+                nActive += l->active[i];
+            }
+        }
+
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                int p = y * width + x;
+
+                if(!l->active[p]) {
+                    continue;
+                }
+
+                if((x < (width - 1)) && l->active[p + 1]) {
+                    l->wx[p] = wx[p];
+                }
+
+                if((y < (height - 1)) && l->active[p + width]) {
+                    l->wy[p] = wy[p];
+                }
+            }
+        }
+
+        levels.push_back(l);
+
+        while((nActive > 256) && ((l->width > 1) || (l->height > 1))) {
+            l = coarsen(l);
+            levels.push_back(l);
+
+            nActive = 0;
+            for(unsigned int i = 0; i < l->active.size(); i++) {
+                nActive += l->active[i];
+            }
+        }
+
+        setupCoarsest();
+    }
+
+    /**
+     * @brief setupLaplacian sets A to the five-point Laplacian
+     * (4 on the diagonal, 1 for each neighbour), that is a Poisson problem with
+     * Dirichlet boundary conditions.
+     * @param width
+     * @param height
+     * @param active marks unknown cells; it can be NULL.
+     */
+    void setupLaplacian(int width, int height, bool *active = NULL)
+    {
+        int n = width * height;
+        std::vector<float> diag(n, 4.0f), w(n, 1.0f);
+        setup(width, height, diag.data(), w.data(), w.data(), active);
+    }
+
+    /**
+     * @brief solve solves A x = b.
+     * @param b is the right-hand side; width * height * channels values.
+     * @param x is the solution; only active cells are written.
+     * @param channels is the number of interleaved systems solved together.
+     * @param maxIterations is the maximum number of CG iterations.
+     * @param tolerance is the target relative residual, ||b - A x|| / ||b||.
+     * @param bWarmStart if it is true, x is used as initial guess.
+     * @return It returns the number of iterations.
+     */
+    int solve(float *b, float *x, int channels, int maxIterations = 100,
+              float tolerance = 1e-5f, bool bWarmStart = false)
+    {
+        if(levels.empty() || (b == NULL) || (x == NULL) || (channels < 1)) {
+            return 0;
+        }
+
+        if(channels != this->channels) {
+            this->channels = channels;
+
+            for(unsigned int i = 1; i < levels.size(); i++) {
+                Level *l = levels[i];
+                int n = l->width * l->height * channels;
+                l->x.assign(n, 0.0f);
+                l->b.assign(n, 0.0f);
+                l->r.assign(n, 0.0f);
+            }
+        }
+
+        for(unsigned int i = 1; i < levels.size(); i++) {
+            Level *l = levels[i];
+            int n = l->width * l->height * channels;
+
+            if(int(l->x.size()) != n) {
+                l->x.assign(n, 0.0f);
+                l->b.assign(n, 0.0f);
+                l->r.assign(n, 0.0f);
+            }
+        }
+
+        Level *l0 = levels[0];
+        int np = l0->width * l0->height;
+        int n = np * channels;
+
+        //X: solution, R: residual, Z: preconditioned residual,
+        //P: direction, Q: A P (and scratch residual of the V-cycle)
+        std::vector<float> X(n, 0.0f), R(n), Z(n), P(n);
+        l0->r.assign(n, 0.0f);
+        float *Q = l0->r.data();
+
+        for(int i = 0; i < np; i++) {
+            if(!l0->active[i]) {
+                continue;
+            }
+
+            for(int c = 0; c < channels; c++) {
+                int k = i * channels + c;
+                R[k] = b[k];
+
+                if(bWarmStart) {
+                    X[k] = x[k];
+                }
+            }
+        }
+
+        std::vector<double> bNorm(channels), rz(channels), rz_new(channels),
+                            pq(channels), rr(channels);
+        std::vector<float> alpha(channels), beta(channels);
+
+        dot(R.data(), R.data(), bNorm.data());
+
+        if(bWarmStart) {
+            apply(l0, R.data(), X.data(), R.data());
+        }
+
+        for(int c = 0; c < channels; c++) {
+            bNorm[c] = sqrt(bNorm[c]);
+        }
+
+        //Q is the residual buffer of level 0, so the V-cycle can run in place
+        vCycle(0, R.data(), Z.data());
+        P = Z;
+        dot(R.data(), Z.data(), rz.data());
+
+        int iter = 0;
+        for(; iter < maxIterations; iter++) {
+            dot(R.data(), R.data(), rr.data());
+
+            bool bConverged = true;
+            for(int c = 0; c < channels; c++) {
+                if(sqrt(rr[c]) > (double(tolerance) * bNorm[c])) {
+                    bConverged = false;
+                }
+            }
+
+            if(bConverged) {
+                break;
+            }
+
+            apply(l0, NULL, P.data(), Q);
+            dot(P.data(), Q, pq.data());
+
+            for(int c = 0; c < channels; c++) {
+                alpha[c] = pq[c] > 0.0 ? float(rz[c] / pq[c]) : 0.0f;
+            }
+
+            float *pX = X.data();
+            float *pR = R.data();
+            float *pP = P.data();
+            float *pAlpha = alpha.data();
+            int ch = channels;
+            int w = l0->width;
+
+            parallelRows(l0->height, [pX, pR, pP, Q, pAlpha, w, ch](int y0, int y1) {
+                for(int k = y0 * w * ch; k < y1 * w * ch; k += ch) {
+                    for(int c = 0; c < ch; c++) {
+                        pX[k + c] += pAlpha[c] * pP[k + c];
+                        pR[k + c] -= pAlpha[c] * Q[k + c];
+                    }
+                }
+            });
+
+            vCycle(0, R.data(), Z.data());
+            dot(R.data(), Z.data(), rz_new.data());
+
+            for(int c = 0; c < channels; c++) {
+                beta[c] = rz[c] > 0.0 ? float(rz_new[c] / rz[c]) : 0.0f;
+                rz[c] = rz_new[c];
+            }
+
+            float *pZ = Z.data();
+            float *pBeta = beta.data();
+            parallelRows(l0->height, [pP, pZ, pBeta, w, ch](int y0, int y1) {
+                for(int k = y0 * w * ch; k < y1 * w * ch; k += ch) {
+                    for(int c = 0; c < ch; c++) {
+                        pP[k + c] = pZ[k + c] + pBeta[c] * pP[k + c];
+                    }
+                }
+            });
+        }
+
+        for(int i = 0; i < np; i++) {
+            if(l0->active[i]) {
+                for(int c = 0; c < channels; c++) {
+                    x[i * channels + c] = X[i * channels + c];
+                }
+            }
+        }
+
+        return iter;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_ALGORITHMS_MULTIGRID_SOLVER_HPP */
@@ -18,25 +18,26 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_POISSON_IMAGE_EDITING_HPP
 #define PIC_ALGORITHMS_POISSON_IMAGE_EDITING_HPP
 
-#ifndef PIC_DISABLE_EIGEN
-
-#include "externals/Eigen/Sparse"
-#include "externals/Eigen/src/SparseCore/SparseMatrix.h"
-
 #include "image.hpp"
 #include "filtering/filter_laplacian.hpp"
+#include "algorithms/poisson_solver.hpp"
 
 namespace pic {
 
 /**
- * @brief computePoissonImageEditing
+ * @brief computePoissonImageEditing seamlessly clones source into target:
+ * inside the mask, the output has the Laplacian of source and, on the mask
+ * border, the values of target. The system is solved with a matrix-free
+ * multigrid solver; see computePoissonSolverMultigrid.
  * @param source
  * @param target
  * @param mask
  * @param ret
+ * @param bWarmStart if it is true, ret is used as initial guess.
  * @return
  */
-Image *computePoissonImageEditing(Image *source, Image *target, bool *mask, Image *ret = NULL)
+Image *computePoissonImageEditing(Image *source, Image *target, bool *mask,
+                                  Image *ret = NULL, bool bWarmStart = false)
 {
     if((source == NULL) || (target == NULL) || (mask == NULL)) {
         return NULL;
@@ -45,166 +46,26 @@ Image *computePoissonImageEditing(Image *source, Image *target, bool *mask, Imag
     //Allocating the output
     if(ret == NULL) {
         ret = target->clone();
+        bWarmStart = false;
     }
 
-    int width  = target->width;
-    int height = target->height;
-
-    #ifdef PIC_DEBUG
-        printf("Init matrix...");
-    #endif
-
     Image *lap_source = FilterLaplacian::Execute(source, NULL);
 
-    std::vector< Eigen::Triplet< double > > tL;
-
-    //indices pass
-    int *index = new int[width * height];
-    int count = 0;
-    for(int i = 0; i < height; i++) {
-        int tmpI = i * width;
+    computePoissonSolverMultigrid(lap_source, mask, target, ret, bWarmStart);
 
-        for(int j = 0; j < width; j++) {
-            int indI = tmpI + j;
+    delete lap_source;
 
-            if(mask[indI]) {
-                index[indI] = count;
-                count++;
-            } else {
-                index[indI] = 0;
-            }
-        }
-    }
+    int width  = target->width;
+    int height = target->height;
+    int channels = target->channels;
 
-    //matrix A pass
-    count = 0;
     for(int i = 0; i < height; i++) {
-        int tmpI = i * width;
-
         for(int j = 0; j < width; j++) {
-            int indI = tmpI + j;
-
-            if(mask[indI]) {
-
-                float n = 0.0f;
-
-                if((j + 1) < (width - 1)) {
-                    if(mask[indI + 1]) {
-                        n += 1.0f;
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI + 1], -1.0));
-                    }
-                }
-
-                if((j - 1) > -1) {
-                    if(mask[indI - 1]) {
-                        n += 1.0f;
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI - 1], -1.0));
-                    }
-                }
+            if(mask[i * width + j]) {
+                float *val = (*ret)(j, i);
 
-                if((i + 1) < (height - 1)) {
-                    if(mask[indI + width]) {
-                        n += 1.0f;
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI + width], -1.0));
-                    }
-                }
-
-                if((i - 1) > -1) {
-                    if(mask[indI - width]) {
-                        n += 1.0f;
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI - width], -1.0));
-                    }
-                }
-
-                tL.push_back(Eigen::Triplet< double > (count, count , 4.0));
-
-                count++;
-            }
-        }
-    }
-
-    int tot = count;
-    Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-    A.setFromTriplets(tL.begin(), tL.end());
-
-    #ifdef PIC_DEBUG
-        printf("Ok\n");
-    #endif
-
-    //Solving the system for each color channel
-    Eigen::SimplicialCholesky<Eigen::SparseMatrix<double> > solver(A);
-
-    for(int k=0; k< target->channels; k++) {
-
-        Eigen::VectorXd b, x;
-        b = Eigen::VectorXd::Zero(tot);
-
-        //assigning values to b
-        int count = 0;
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
-
-            for(int j = 0; j < width; j++) {
-                int indI = (tmpI + j);
-
-                if(mask[indI]) {
-
-                    b[count] = -(*lap_source)(j, i)[k];
-
-                    if((j + 1) < (width - 1)) {
-                        if(!mask[indI + 1]) {
-                            b[count] += (*target)(j + 1, i)[k];
-                        }
-                    }
-
-                    if((j - 1) > -1) {
-                        if(!mask[indI - 1]) {
-                            b[count] += (*target)(j - 1, i)[k];
-                        }
-                    }                        
-
-                    if((i + 1) < (height - 1)) {
-                        if(!mask[indI + width]) {
-                            b[count] += (*target)(j, i + 1)[k];
-                        }
-                    }
-
-                    if((i - 1) > -1) {
-                        if(!mask[indI - width]) {
-                           b[count] += (*target)(j, i - 1)[k];
-                        }
-                    }
-
-                    count++;
-                }
-            }
-        }
-
-        x = solver.solve(b);
-
-        if(solver.info() != Eigen::Success) {
-            #ifdef PIC_DEBUG
-                printf("SOLVER FAILED!\n");
-            #endif
-
-            return NULL;
-        }
-
-        #ifdef PIC_DEBUG
-            printf("SOLVER SUCCESS!\n");
-        #endif
-
-        count = 0;
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
-
-            for(int j = 0; j < width; j++) {
-                int indI = (tmpI + j);
-
-                if(mask[indI]) {
-                    float val = float(x(count));
-                    (*ret)(j, i)[k] = val > 0.0f ? val : 0.0f;
-                    count++;
+                for(int k = 0; k < channels; k++) {
+                    val[k] = val[k] > 0.0f ? val[k] : 0.0f;
                 }
             }
         }
@@ -215,7 +76,5 @@ Image *computePoissonImageEditing(Image *source, Image *target, bool *mask, Imag
 
 } // end namespace pic
 
-#endif
-
 #endif /* PIC_ALGORITHMS_POISSON_IMAGE_EDITING_HPP */
 
@@ -18,22 +18,332 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_POISSON_SOLVER_HPP
 #define PIC_ALGORITHMS_POISSON_SOLVER_HPP
 
-#ifndef PIC_DISABLE_EIGEN
+#include <vector>
 
+#ifndef PIC_DISABLE_EIGEN
 #include "externals/Eigen/Sparse"
 #include "externals/Eigen/src/SparseCore/SparseMatrix.h"
+#endif
 
 #include "image.hpp"
+#include "util/thread_pool.hpp"
+#include "util/fft.hpp"
+#include "algorithms/multigrid_solver.hpp"
 
 namespace pic {
 
 /**
- * @brief computePoissonSolver
+ * @brief poissonTransform1D computes, in place, the transform that
+ * diagonalizes the 1D discrete Laplacian of n samples: a DST-I for
+ * Dirichlet boundaries or a DCT-II (a DCT-III if bInverse) for Neumann ones.
+ * Both are computed with a real FFT of the odd or even extension of the
+ * samples; forward and inverse transforms are normalized such that their
+ * product is the identity.
+ * @param data is the first sample.
+ * @param n is the number of samples.
+ * @param stride is the distance between two samples.
+ * @param plan is a FFT plan of length 2 * (n + 1) for Dirichlet boundaries,
+ * and of length 2 * n for Neumann ones.
+ * @param shift is exp(-i pi k / (2 n)) for k in [0, n]; see poissonTransformShift.
+ * @param buf is a buffer of plan->getSize() floats.
+ * @param spectrum is a buffer of plan->getSize() / 2 + 1 values.
+ * @param work is a buffer of plan->getWorkSize() values.
+ * @param bNeumann
+ * @param bInverse
+ */
+void poissonTransform1D(float *data, int n, int stride, FFTPlan *plan, complexf *shift,
+                        float *buf, complexf *spectrum, complexf *work,
+                        bool bNeumann, bool bInverse)
+{
+    int len = plan->getSize();
+
+    if(!bNeumann) {
+        //DST-I: X_k = sum_j x_j sin(pi (j + 1) (k + 1) / (n + 1))
+        buf[0] = 0.0f;
+        buf[n + 1] = 0.0f;
+
+        for(int j = 0; j < n; j++) {
+            float v = data[j * stride];
+            buf[j + 1] = v;
+            buf[len - 1 - j] = -v;
+        }
+
+        plan->executeReal(buf, spectrum, 1, work);
+
+        float norm = bInverse ? -1.0f / float(n + 1) : -0.5f;
+        for(int k = 0; k < n; k++) {
+            data[k * stride] = spectrum[k + 1].imag() * norm;
+        }
+
+        return;
+    }
+
+    if(!bInverse) {
+        //DCT-II: X_k = sum_j x_j cos(pi (2j + 1) k / (2n))
+        for(int j = 0; j < n; j++) {
+            float v = data[j * stride];
+            buf[j] = v;
+            buf[len - 1 - j] = v;
+        }
+
+        plan->executeReal(buf, spectrum, 1, work);
+
+        for(int k = 0; k < n; k++) {
+            data[k * stride] = (spectrum[k] * shift[k]).real() * 0.5f;
+        }
+    } else {
+        //DCT-III: x_j = X_0 / n + (2 / n) sum_k X_k cos(pi (2j + 1) k / (2n))
+        for(int k = 0; k < n; k++) {
+            spectrum[k] = std::conj(shift[k]) * (2.0f * data[k * stride]);
+        }
+
+        spectrum[n] = complexf(0.0f, 0.0f);
+
+        plan->executeRealInverse(spectrum, buf, 1, work);
+
+        for(int j = 0; j < n; j++) {
+            data[j * stride] = buf[j];
+        }
+    }
+}
+
+/**
+ * @brief poissonTransformShift computes the phase shifts used by poissonTransform1D.
+ * @param n
+ * @return
+ */
+std::vector<complexf> poissonTransformShift(int n)
+{
+    std::vector<complexf> shift(n + 1);
+
+    for(int k = 0; k <= n; k++) {
+        double angle = -double(C_PI) * double(k) / double(2 * n);
+        shift[k] = complexf(float(cos(angle)), float(sin(angle)));
+    }
+
+    return shift;
+}
+
+/**
+ * @brief computePoissonSolverSpectral solves the Poisson equation
+ * lap(x) = f on the full image with a fast direct solver: the five-point
+ * Laplacian is diagonalized by a separable sine (Dirichlet) or cosine
+ * (Neumann) transform, so the solution is obtained dividing the transformed f
+ * by the eigenvalues of the Laplacian. Rows and columns are transformed in
+ * parallel with FFTs, and all channels are solved in the same passes.
+ * @param f is the Laplacian of the solution.
+ * @param ret is the solution.
+ * @param bNeumann if it is false, the boundary condition is x = 0 outside
+ * the image (the same system of computePoissonSolverCholesky); otherwise,
+ * it is zero gradient at the borders, and the solution has zero mean.
+ * @return
+ */
+Image *computePoissonSolverSpectral(Image *f, Image *ret = NULL, bool bNeumann = false)
+{
+    if(f == NULL) {
+        return NULL;
+    }
+
+    if(ret == NULL) {
+        ret = f->allocateSimilarOne();
+    }
+
+    int width = f->width;
+    int height = f->height;
+    int channels = f->channels;
+
+    //transforms are linear, so the solution is computed on -f
+    float *data = ret->data;
+    int n = width * height * channels;
+    for(int i = 0; i < n; i++) {
+        data[i] = -f->data[i];
+    }
+
+    FFTPlan *plan_x = FFTPlan::getPlan(bNeumann ? 2 * width  : 2 * (width + 1));
+    FFTPlan *plan_y = FFTPlan::getPlan(bNeumann ? 2 * height : 2 * (height + 1));
+
+    std::vector<complexf> shift_x = poissonTransformShift(width);
+    std::vector<complexf> shift_y = poissonTransformShift(height);
+
+    std::vector<double> eig_x(width), eig_y(height);
+    for(int i = 0; i < width; i++) {
+        double a = bNeumann ? C_PI * double(i) / double(width) :
+                              C_PI * double(i + 1) / double(width + 1);
+        eig_x[i] = 2.0 - 2.0 * cos(a);
+    }
+
+    for(int i = 0; i < height; i++) {
+        double a = bNeumann ? C_PI * double(i) / double(height) :
+                              C_PI * double(i + 1) / double(height + 1);
+        eig_y[i] = 2.0 - 2.0 * cos(a);
+    }
+
+    ThreadPool *tp = ThreadPool::getInstance();
+    int nBlocks = tp->getNumThreads() * 2;
+
+    auto rows = [&](bool bInverse) {
+        tp->parallelForBlocks(0, height * channels, nBlocks, [&](int i0, int i1) {
+            std::vector<float> buf(plan_x->getSize());
+            std::vector<complexf> spectrum(plan_x->getSize() / 2 + 1);
+            std::vector<complexf> work(plan_x->getWorkSize());
+
+            for(int i = i0; i < i1; i++) {
+                int y = i / channels;
+                int c = i % channels;
+                poissonTransform1D(&data[y * width * channels + c], width, channels,
+                                   plan_x, shift_x.data(), buf.data(), spectrum.data(),
+                                   work.data(), bNeumann, bInverse);
+            }
+        });
+    };
+
+    auto cols = [&](bool bInverse) {
+        tp->parallelForBlocks(0, width * channels, nBlocks, [&](int i0, int i1) {
+            std::vector<float> buf(plan_y->getSize());
+            std::vector<complexf> spectrum(plan_y->getSize() / 2 + 1);
+            std::vector<complexf> work(plan_y->getWorkSize());
+
+            for(int i = i0; i < i1; i++) {
+                poissonTransform1D(&data[i], height, width * channels,
+                                   plan_y, shift_y.data(), buf.data(), spectrum.data(),
+                                   work.data(), bNeumann, bInverse);
+            }
+        });
+    };
+
+    rows(false);
+    cols(false);
+
+    tp->parallelForBlocks(0, height, nBlocks, [&](int y0, int y1) {
+        for(int y = y0; y < y1; y++) {
+            for(int x = 0; x < width; x++) {
+                double lambda = eig_x[x] + eig_y[y];
+                float scale = lambda > 1e-12 ? float(1.0 / lambda) : 0.0f;
+                float *p = &data[(y * width + x) * channels];
+
+                for(int c = 0; c < channels; c++) {
+                    p[c] *= scale;
+                }
+            }
+        }
+    });
+
+    cols(true);
+    rows(true);
+
+    return ret;
+}
+
+/**
+ * @brief computePoissonSolverMultigrid solves the Poisson equation
+ * lap(x) = f on the pixels of a mask with multigrid-preconditioned
+ * conjugate gradients; pixels outside the mask are fixed to the values
+ * of boundary, and pixels outside the image are zero.
+ * @param f is the Laplacian of the solution.
+ * @param mask marks the unknown pixels; if it is NULL, all pixels are unknown.
+ * @param boundary contains the values of the known pixels; it can be NULL.
+ * @param ret is the solution; known pixels are copied from boundary.
+ * @param bWarmStart if it is true, ret is used as initial guess.
+ * @param maxIterations
+ * @param tolerance is the target relative residual.
+ * @return
+ */
+Image *computePoissonSolverMultigrid(Image *f, bool *mask, Image *boundary,
+                                     Image *ret = NULL, bool bWarmStart = false,
+                                     int maxIterations = 100, float tolerance = 1e-5f)
+{
+    if(f == NULL) {
+        return NULL;
+    }
+
+    if(ret == NULL) {
+        ret = f->allocateSimilarOne();
+        ret->setZero();
+        bWarmStart = false;
+    }
+
+    int width = f->width;
+    int height = f->height;
+    int channels = f->channels;
+
+    std::vector<float> b(width * height * channels);
+
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            int ind = y * width + x;
+            float *b_p = &b[ind * channels];
+            float *f_p = (*f)(x, y);
+
+            if((mask != NULL) && (!mask[ind])) {
+                float *ret_p = (*ret)(x, y);
+
+                for(int k = 0; k < channels; k++) {
+                    b_p[k] = 0.0f;
+                    ret_p[k] = boundary != NULL ? (*boundary)(x, y)[k] : 0.0f;
+                }
+
+                continue;
+            }
+
+            for(int k = 0; k < channels; k++) {
+                b_p[k] = -f_p[k];
+            }
+
+            if((mask == NULL) || (boundary == NULL)) {
+                continue;
+            }
+
+            //known neighbours are moved to the right-hand side
+            int nx[] = {x - 1, x + 1, x, x};
+            int ny[] = {y, y, y - 1, y + 1};
+
+            for(int j = 0; j < 4; j++) {
+                if((nx[j] < 0) || (nx[j] >= width) ||
+                   (ny[j] < 0) || (ny[j] >= height)) {
+                    continue;
+                }
+
+                if(!mask[ny[j] * width + nx[j]]) {
+                    float *bnd = (*boundary)(nx[j], ny[j]);
+
+                    for(int k = 0; k < channels; k++) {
+                        b_p[k] += bnd[k];
+                    }
+                }
+            }
+        }
+    }
+
+    MultigridSolver solver;
+    solver.setupLaplacian(width, height, mask);
+    solver.solve(b.data(), ret->data, channels, maxIterations, tolerance, bWarmStart);
+
+    return ret;
+}
+
+/**
+ * @brief computePoissonSolver solves the Poisson equation lap(x) = f
+ * with x = 0 outside the image.
+ * @param f is the Laplacian of the solution.
+ * @param ret is the solution.
+ * @return
+ */
+Image *computePoissonSolver(Image *f, Image *ret = NULL)
+{
+    return computePoissonSolverSpectral(f, ret, false);
+}
+
+#ifndef PIC_DISABLE_EIGEN
+
+/**
+ * @brief computePoissonSolverCholesky solves the same system of
+ * computePoissonSolver with a sparse Cholesky factorization; it is
+ * kept as a reference since its memory grows quickly with the image size.
  * @param f
  * @param ret
  * @return
  */
-Image *computePoissonSolver(Image *f, Image *ret = NULL)
+Image *computePoissonSolverCholesky(Image *f, Image *ret = NULL)
 {
     if(f == NULL) {
         return NULL;
@@ -125,6 +435,8 @@ Image *computePoissonSolver(Image *f, Image *ret = NULL)
     return ret;
 }
 
+#endif
+
 /**
  * @brief computePoissonSolverIterative
  * @param img
@@ -187,7 +499,5 @@ Image *computePoissonSolverIterative(Image *img, Image *laplacian,
 
 } // end namespace pic
 
-#endif
-
 #endif /* PIC_ALGORITHMS_POISSON_SOLVER_HPP */
 
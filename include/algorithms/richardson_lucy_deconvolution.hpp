@@ -24,7 +24,10 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 namespace pic {
 
 /**
- * @brief computeRichardsonLucyDeconvolution
+ * @brief computeRichardsonLucyDeconvolution deconvolves imgIn with the
+ * Richardson-Lucy algorithm. Each iteration runs two convolutions; large PSFs
+ * are convolved in the frequency domain, and the PSF spectra are computed
+ * only once for all iterations.
  * @param imgIn
  * @param psf
  * @param nIterations
@@ -55,7 +58,8 @@ Image *computeRichardsonLucyDeconvolution(Image *imgIn, Image *psf, int nIterati
     Image *img_est_conv = NULL;
     Image *img_err = NULL;
 
-    FilterConv2D flt_conv;
+    //one filter per kernel, so each one keeps its kernel spectrum
+    FilterConv2D flt_conv, flt_conv_err;
     ImageVec vec = Double(imgOut, psf);
     ImageVec vec_err = Double(img_rel_blur, psf_hat);
 
@@ -70,12 +74,15 @@ Image *computeRichardsonLucyDeconvolution(Image *imgIn, Image *psf, int nIterati
         img_rel_blur->assign(imgIn);
         *img_rel_blur /= *img_est_conv;
 
-        img_err = flt_conv.ProcessP(vec_err, img_err);
+        img_err = flt_conv_err.ProcessP(vec_err, img_err);
 
         *imgOut *= *img_err;
     }
 
     delete img_est_conv;
+    delete img_err;
+    delete img_rel_blur;
+    delete psf_hat;
 
     return imgOut;
 }
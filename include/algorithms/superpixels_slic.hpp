@@ -18,33 +18,74 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP
 #define PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP
 
+#include <vector>
+#include <algorithm>
+#include <functional>
+
 #include "image.hpp"
 #include "filtering/filter_laplacian.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
 /**
- * @brief The SlicoCenter struct
- */
-struct SlicoCenter {
-    float			*value;
-    unsigned int	x, y;
-};
-
-/**
- * @brief The Slic class
+ * @brief The Slic class computes SLIC superpixels with an adaptive
+ * color normalization (SLICO). The assignment step runs on image tiles:
+ * each tile only visits the centers whose 2Sx2S window overlaps it, and
+ * it writes only its own pixels. The update step runs on centers: each center
+ * only reads the window it has been assigned from. Both steps are race-free
+ * and their output does not depend on the number of threads.
  */
 class Slic
 {
 protected:
 
-    int             nSuperPixels;
-    Image           *labels_distance, *lap_img;
-    SlicoCenter     *centers;
-    unsigned int    *prevX, *prevY, *counter;
-    float           *col_values, *mPixel;
+    int             nSuperPixels, S;
     int             width, height, channels;
 
+    //per-pixel label, normalized distance, and color distance
+    std::vector<int>    labels;
+    std::vector<float>  distance, distance_color;
+
+    //centers: positions, mean colors, and color normalizers
+    std::vector<float>  center_x, center_y, center_values, mPixel, shift;
+
+    //centers bucketed into a grid of SxS cells
+    std::vector<int>    grid_offsets, grid_indices;
+    int                 grid_width, grid_height;
+
+    Image           *lap_img;
+
+    int             tileSize, maxIterations, warmIterations;
+
+    ThreadPool      *pool;
+    int             nThreads;
+
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief run runs func(i) for i in [0, n).
+     * @param n
+     * @param func
+     */
+    void run(int n, std::function<void(int)> func)
+    {
+        if(nThreads == 1) {
+            for(int i = 0; i < n; i++) {
+                func(i);
+            }
+        } else {
+            getPool()->parallelFor(n, func);
+        }
+    }
+
     /**
      * @brief distanceC
      * @param a1
@@ -65,192 +106,335 @@ protected:
     }
 
     /**
-     * @brief distanceS
-     * @param x1
-     * @param y1
-     * @param x2
-     * @param y2
-     * @return
+     * @brief getCenter returns the pixel closest to the i-th center.
+     * @param i
+     * @param cx
+     * @param cy
      */
-    inline int distanceS(int x1, int y1, int x2, int y2)
+    inline void getCenter(int i, int &cx, int &cy)
     {
-        int tx = x1 - x2;
-        int ty = y1 - y2;
-        return tx * tx + ty * ty;
+        cx = CLAMPi(int(center_x[i] + 0.5f), 0, width - 1);
+        cy = CLAMPi(int(center_y[i] + 0.5f), 0, height - 1);
     }
 
     /**
-     * @brief pass
-     * @param img
-     * @param S
-     * @return
+     * @brief buildGrid buckets centers into SxS cells; the centers of
+     * a cell are sorted by index.
      */
-    bool pass(Image *img, int S)
+    void buildGrid()
     {
-        float Sf = float(S);
-        float Sf2 = Sf * Sf;
+        grid_width = (width + S - 1) / S;
+        grid_height = (height + S - 1) / S;
+
+        grid_offsets.assign(grid_width * grid_height + 1, 0);
+        grid_indices.resize(nSuperPixels);
+
+        std::vector<int> cell(nSuperPixels);
 
         for(int i = 0; i < nSuperPixels; i++) {
-            prevX[i] = centers[i].x;
-            prevY[i] = centers[i].y;
+            int cx, cy;
+            getCenter(i, cx, cy);
+            cell[i] = (cy / S) * grid_width + (cx / S);
+            grid_offsets[cell[i] + 1]++;
+        }
+
+        for(int i = 0; i < (grid_width * grid_height); i++) {
+            grid_offsets[i + 1] += grid_offsets[i];
         }
 
-        //for each cluster
+        std::vector<int> pos(grid_offsets.begin(), grid_offsets.end() - 1);
+
         for(int i = 0; i < nSuperPixels; i++) {
-            float i_f = float(i);
+            grid_indices[pos[cell[i]]++] = i;
+        }
+    }
+
+    /**
+     * @brief assignTile assigns the pixels of [x0, x1) x [y0, y1) to
+     * the centers whose window overlaps the tile.
+     * @param img
+     * @param x0
+     * @param y0
+     * @param x1
+     * @param y1
+     */
+    void assignTile(Image *img, int x0, int y0, int x1, int y1)
+    {
+        for(int y = y0; y < y1; y++) {
+            std::fill(distance.begin() + (y * width + x0),
+                      distance.begin() + (y * width + x1), FLT_MAX);
+        }
 
-            //Search in Sx2 radius
-            for(int j = -S; j < S; j++) {
-                int vY = centers[i].y + j;
+        //a window [cx - S, cx + S) overlaps the tile if cx is in (x0 - S, x1 + S)
+        int gx0 = MAX((x0 - S + 1) / S, 0);
+        int gy0 = MAX((y0 - S + 1) / S, 0);
+        int gx1 = MIN((x1 + S - 1) / S, grid_width - 1);
+        int gy1 = MIN((y1 + S - 1) / S, grid_height - 1);
 
-                for(int k = -S; k < S; k++) {
-                    int vX = centers[i].x + k;
+        std::vector<int> candidates;
 
-                    float *pixel = (*img)(vX, vY);
-                    float *l_d   = (*labels_distance)(vX, vY);
+        for(int gy = gy0; gy <= gy1; gy++) {
+            for(int gx = gx0; gx <= gx1; gx++) {
+                int cell = gy * grid_width + gx;
 
-                    float dS = float(distanceS(vX, vY, centers[i].x, centers[i].y)) / Sf2;
-                    float dC = distanceC(pixel, centers[i].value, img->channels) / mPixel[i];
-                    float D = dC + dS;
+                for(int j = grid_offsets[cell]; j < grid_offsets[cell + 1]; j++) {
+                    int i = grid_indices[j];
 
-                    if(D < l_d[1]) {
-                        l_d[0] = i_f;
-                        l_d[1] = D;
-                        l_d[2] = dC;
+                    int cx, cy;
+                    getCenter(i, cx, cy);
+
+                    if(((cx - S) < x1) && ((cx + S) > x0) &&
+                       ((cy - S) < y1) && ((cy + S) > y0)) {
+                        candidates.push_back(i);
                     }
                 }
             }
         }
 
-        //update mPixel
-        for(int i = 0; i < labels_distance->size(); i += labels_distance->channels) {
-            int label = int(labels_distance->data[i]);
+        //the same visiting order, and so the same ties, of a serial pass
+        std::sort(candidates.begin(), candidates.end());
 
-            if(label < 0) {
-                continue;
-            }
+        float inv_S2 = 1.0f / float(S * S);
 
-            if(mPixel[label] < labels_distance->data[i + 2]) {
-                mPixel[label] = labels_distance->data[i + 2];
-            }
-        }
+        for(unsigned int c = 0; c < candidates.size(); c++) {
+            int i = candidates[c];
 
-        //update clusters
-        for(int i = 0; i < nSuperPixels; i++) {
-            centers[i].x = 0;
-            centers[i].y = 0;
-            counter[i]   = 0;
+            int cx, cy;
+            getCenter(i, cx, cy);
 
-            int ind = i * img->channels;
+            int wx0 = MAX(cx - S, x0);
+            int wx1 = MIN(cx + S, x1);
+            int wy0 = MAX(cy - S, y0);
+            int wy1 = MIN(cy + S, y1);
 
-            for(int j = 0; j < img->channels; j++) {
-                col_values[ind + j] = 0.0f;
-            }
-        }
+            float *value = &center_values[i * channels];
+            float inv_mPixel = 1.0f / mPixel[i];
 
-        for(int j = 0; j < img->height; j++) {
-            for(int k = 0; k < img->width; k++) {
-                float *l_d = (*labels_distance)(k, j);
-                int label = int(l_d[0]);
+            for(int y = wy0; y < wy1; y++) {
+                float dy = float(y) - center_y[i];
+                float dy2 = dy * dy;
 
-                if(label > -1) {
-                    centers[label].x += k;
-                    centers[label].y += j;
-                    counter[label]++;
+                int ind = y * width + wx0;
+                float *pixel = &img->data[ind * channels];
 
-                    int ind = label * img->channels;
-                    float *col = (*img)(k, j);
+                for(int x = wx0; x < wx1; x++) {
+                    float dx = float(x) - center_x[i];
 
-                    for(int p = 0; p < img->channels; p++) {
-                        col_values[ind + p] += col[p];
+                    float dC = distanceC(pixel, value, channels);
+                    float D = dC * inv_mPixel + (dx * dx + dy2) * inv_S2;
+
+                    if(D < distance[ind]) {
+                        labels[ind] = i;
+                        distance[ind] = D;
+                        distance_color[ind] = dC;
                     }
+
+                    ind++;
+                    pixel += channels;
                 }
             }
         }
+    }
 
-        float E = 0.0f;
+    /**
+     * @brief updateCenter moves the i-th center to the mean of its pixels,
+     * which lie in the window the center had during the assignment.
+     * @param img
+     * @param i
+     */
+    void updateCenter(Image *img, int i)
+    {
+        int cx, cy;
+        getCenter(i, cx, cy);
 
-        for(int i = 0; i < nSuperPixels; i++) {
-            if(counter[i] <= 0) {
-                continue;
-            }
+        int wx0 = MAX(cx - S, 0);
+        int wx1 = MIN(cx + S, width);
+        int wy0 = MAX(cy - S, 0);
+        int wy1 = MIN(cy + S, height);
+
+        std::vector<double> acc(channels + 2, 0.0);
+        int counter = 0;
+        float maxC = mPixel[i];
 
-            centers[i].x /= counter[i];
-            centers[i].y /= counter[i];
-            int ind = i * img->channels;
+        for(int y = wy0; y < wy1; y++) {
+            int ind = y * width + wx0;
+
+            for(int x = wx0; x < wx1; x++) {
+                if(labels[ind] == i) {
+                    float *pixel = &img->data[ind * channels];
+
+                    for(int k = 0; k < channels; k++) {
+                        acc[k] += pixel[k];
+                    }
 
-            for(int j = 0; j < img->channels; j++) {
-                centers[i].value[j] = col_values[ind + j] / float(counter[i]);
+                    acc[channels] += x;
+                    acc[channels + 1] += y;
+                    counter++;
+
+                    maxC = MAX(maxC, distance_color[ind]);
+                }
+
+                ind++;
             }
+        }
+
+        mPixel[i] = maxC;
 
-            //Error
-            int tx = prevX[i] - centers[i].x;
-            int ty = prevY[i] - centers[i].y;
-            float tmpErr = sqrtf(float(tx * tx + ty * ty));
-            E += tmpErr;
+        if(counter < 1) {
+            shift[i] = 0.0f;
+            return;
         }
 
-        return (E > (0.0001f * float(nSuperPixels)));
-    }
+        double counter_d = double(counter);
+
+        for(int k = 0; k < channels; k++) {
+            center_values[i * channels + k] = float(acc[k] / counter_d);
+        }
 
+        center_x[i] = float(acc[channels] / counter_d);
+        center_y[i] = float(acc[channels + 1] / counter_d);
 
+        //converged when the pixels of the centers, and so the windows, stay
+        int ncx, ncy;
+        getCenter(i, ncx, ncy);
+
+        int tx = ncx - cx;
+        int ty = ncy - cy;
+        shift[i] = sqrtf(float(tx * tx + ty * ty));
+    }
 
     /**
-     * @brief allocate
-     * @param nSuperPixels
-     * @param channels
+     * @brief pass runs an assignment and an update step.
+     * @param img
+     * @return It returns true if the centers have not converged yet.
      */
-    void allocate(int nSuperPixels, int channels)
+    bool pass(Image *img)
     {
+        buildGrid();
 
-        this->nSuperPixels = nSuperPixels;
+        int tx = (width + tileSize - 1) / tileSize;
+        int ty = (height + tileSize - 1) / tileSize;
 
-        release();
+        run(tx * ty, [this, img, tx](int t) {
+            int x0 = (t % tx) * tileSize;
+            int y0 = (t / tx) * tileSize;
+            assignTile(img, x0, y0, MIN(x0 + tileSize, width), MIN(y0 + tileSize, height));
+        });
 
-        centers		= new SlicoCenter[nSuperPixels];
-        prevX		= new unsigned int [nSuperPixels];
-        prevY		= new unsigned int [nSuperPixels];
-        counter		= new unsigned int [nSuperPixels];
-        mPixel		= new float [nSuperPixels];
-        col_values	= new float [nSuperPixels * channels];
+        run(nSuperPixels, [this, img](int i) {
+            updateCenter(img, i);
+        });
+
+        float E = 0.0f;
+
+        for(int i = 0; i < nSuperPixels; i++) {
+            E += shift[i];
+        }
+
+        return (E > (0.0001f * float(nSuperPixels)));
     }
 
     /**
-     * @brief release
+     * @brief setCenterValues sets the color of each center as the mean
+     * of the SxS box around it.
+     * @param img
      */
-    void release()
+    void setCenterValues(Image *img)
     {
-        if(lap_img != NULL) {
-            delete lap_img;
-        }
+        int S_half = S >> 1;
 
-        if(labels_distance != NULL) {
-            delete labels_distance;
-        }
+        for(int i = 0; i < nSuperPixels; i++) {
+            int cx, cy;
+            getCenter(i, cx, cy);
 
-        if(centers != NULL) {
-            delete[] centers;
-        }
+            BBox box(cx - S_half, cx + S_half + 1,
+                     cy - S_half, cy + S_half + 1);
 
-        if(prevX != NULL) {
-            delete[] prevX;
+            img->getMeanVal(&box, &center_values[i * channels]);
         }
+    }
 
-        if(prevY != NULL) {
-            delete[] prevY;
-        }
+    /**
+     * @brief seed places the centers on a regular grid, and it moves each one
+     * to the lowest gradient position in its 3x3 neighborhood.
+     * @param img
+     */
+    void seed(Image *img)
+    {
+        FilterLaplacian lap;
+        lap_img = lap.ProcessP(Single(img), lap_img);
 
-        if(counter != NULL) {
-            delete[] counter;
-        }
+        center_x.clear();
+        center_y.clear();
 
-        if(col_values != NULL) {
-            delete[] col_values;
-        }
+        int S_half = S >> 1;
+
+        for(int i = S_half; i < (height - S_half + 1); i += S) {
+            for(int j = S_half; j < (width - S_half + 1); j += S) {
+
+                float bValue = FLT_MAX;
+                int bX = j;
+                int bY = i;
+
+                for(int y = -1; y <= 1; y++) {
+                    for(int x = -1; x <= 1; x++) {
+                        int ix = (j + x);
+                        int iy = (i + y);
+                        float *data = (*lap_img)(ix, iy);
+
+                        float acc = 0.0f;
+
+                        for(int c = 0; c < channels; c++) {
+                            acc += fabsf(data[c]);
+                        }
+
+                        if(acc < bValue) {
+                            bValue = acc;
+                            bX = ix;
+                            bY = iy;
+                        }
+                    }
+                }
 
-        if(mPixel != NULL) {
-            delete[] mPixel;
+                center_x.push_back(float(bX));
+                center_y.push_back(float(bY));
+            }
         }
+
+        nSuperPixels = int(center_x.size());
+
+        center_values.resize(nSuperPixels * channels);
+        setCenterValues(img);
+
+        mPixel.assign(nSuperPixels, 0.35f * 0.35f);
+        shift.assign(nSuperPixels, 0.0f);
+
+        labels.assign(width * height, -1);
+        distance.assign(width * height, FLT_MAX);
+        distance_color.assign(width * height, FLT_MAX);
+    }
+
+    /**
+     * @brief init
+     */
+    void init()
+    {
+        nSuperPixels = 0;
+        S = 0;
+        width = 0;
+        height = 0;
+        channels = 0;
+        grid_width = 0;
+        grid_height = 0;
+
+        lap_img = NULL;
+
+        tileSize = 64;
+        maxIterations = 20;
+        warmIterations = 3;
+
+        pool = NULL;
+        nThreads = -1;
     }
 
 public:
@@ -260,14 +444,7 @@ public:
      */
     Slic()
     {
-        lap_img = NULL;
-        labels_distance = NULL;
-        centers = NULL;
-        prevX = NULL;
-        prevY = NULL;
-        counter = NULL;
-        col_values = NULL;
-        mPixel = NULL;
+        init();
     }
 
     /**
@@ -277,29 +454,75 @@ public:
      */
     Slic(Image *img, int nSuperPixels = 64)
     {
-        lap_img = NULL;
-        labels_distance = NULL;
-        centers = NULL;
-        prevX = NULL;
-        prevY = NULL;
-        counter = NULL;
-        col_values = NULL;
-        mPixel = NULL;
+        init();
 
         execute(img, nSuperPixels);
     }
 
     ~Slic()
     {
-        release();
+        if(lap_img != NULL) {
+            delete lap_img;
+        }
     }
-    
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * superpixels are computed serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief setTileSize sets the side of the tiles of the assignment step.
+     * @param tileSize
+     */
+    void setTileSize(int tileSize)
+    {
+        this->tileSize = MAX(tileSize, 8);
+    }
+
+    /**
+     * @brief setMaxIterations sets the maximum number of iterations
+     * of an execution from scratch; at least 12 iterations are run.
+     * @param maxIterations
+     */
+    void setMaxIterations(int maxIterations)
+    {
+        this->maxIterations = MAX(maxIterations, 12);
+    }
+
+    /**
+     * @brief setWarmIterations sets the maximum number of iterations
+     * of a warm-started execution.
+     * @param warmIterations
+     */
+    void setWarmIterations(int warmIterations)
+    {
+        this->warmIterations = MAX(warmIterations, 1);
+    }
+
     /**
      * @brief execute
      * @param img
      * @param nSuperPixels
+     * @param bWarmStart if true and the previous call had an image of
+     * the same size, centers start from the previous ones and only a few
+     * iterations are run; e.g., for temporally coherent superpixels of a video.
      */
-    void execute(Image *img, int nSuperPixels = 64)
+    void execute(Image *img, int nSuperPixels = 64, bool bWarmStart = false)
     {
         if(img == NULL) {
             return;
@@ -312,88 +535,46 @@ public:
             return;
         }
 
-        nSuperPixels = (img->width / S) * (img->height / S);
-
-        allocate(nSuperPixels, img->channels);
-
-        if(labels_distance == NULL) {
-            labels_distance = new Image(1, img->width, img->height, 3);
-        }
-
-        for(int i = 0; i < labels_distance->size(); i += labels_distance->channels) {
-            labels_distance->data[i    ] = -1.0f;
-            labels_distance->data[i + 1] = FLT_MAX;
-            labels_distance->data[i + 2] = FLT_MAX;
-        }
+        bWarmStart = bWarmStart && (this->nSuperPixels > 0) && (this->S == S) &&
+                     (width == img->width) && (height == img->height) &&
+                     (channels == img->channels);
 
+        this->S = S;
         width = img->width;
         height = img->height;
         channels = img->channels;
 
-        FilterLaplacian lap;
-        lap_img = lap.ProcessP(Single(img), lap_img);
+        int iter = 0;
 
-        for(int i = 0; i < nSuperPixels; i++) {
-            mPixel[i] = 0.35f * 0.35f;    //10.0f*10.0f;
-        }
+        if(bWarmStart) {
+            //previous positions and normalizers, current colors
+            setCenterValues(img);
 
-        #ifdef PIC_DEBUG
-            printf("nSuperPixels: %d S: %d\n", nSuperPixels, S);
-        #endif
-        
-        int ind = 0;
-        int S_half = S >> 1;
+            bool bCheck = true;
 
-        for(int i = S_half; i < (img->height - S_half + 1); i += S) {
-            for(int j = S_half; j < (img->width - S_half + 1); j += S) {
-
-                float bValue = FLT_MAX;
-                int bX, bY;
+            while(bCheck && (iter < warmIterations)) {
+                bCheck = pass(img);
+                iter++;
+            }
+        } else {
+            seed(img);
 
-                for(int y = -1; y <= 1; y++) {
-                    for(int x = -1; x <= 1; x++) {
-                        int ix = (j + x);
-                        int iy = (i + y);
-                        float *data = (*lap_img)(ix, iy);
+            #ifdef PIC_DEBUG
+                printf("nSuperPixels: %d S: %d\n", this->nSuperPixels, S);
+            #endif
 
-                        float acc = 0.0f;
+            //For each pass
+            bool bCheck = true;
 
-                        for(int c = 0; c < img->channels; c++) {
-                            acc += fabsf(data[c]);
-                        }
+            while(bCheck && (iter < maxIterations)) {
+                bCheck = pass(img);
 
-                        if(acc < bValue) {
-                            bValue = acc;
-                            bX = ix;
-                            bY = iy;
-                        }
-                    }
+                if(!bCheck && iter <= 10) {
+                    bCheck = true;
                 }
 
-                centers[ind].x = bX;
-                centers[ind].y = bY;
-                centers[ind].value = new float [img->channels];
-
-                BBox box(centers[ind].x - S_half, centers[ind].x + S_half + 1,
-                         centers[ind].y - S_half, centers[ind].y + S_half + 1);
-
-                img->getMeanVal(&box, centers[ind].value);
-                ind++;
-            }
-        }
-
-        //For each pass
-        int iter = 0;
-        bool bCheck = true;
-
-        while(bCheck) {
-            bCheck = pass(img, S);
-
-            if(!bCheck && iter <= 10) {
-                bCheck = true;
+                iter++;
             }
-
-            iter++;
         }
 
         #ifdef PIC_DEBUG
@@ -401,6 +582,15 @@ public:
         #endif
     }
 
+    /**
+     * @brief getNumSuperPixels
+     * @return
+     */
+    int getNumSuperPixels()
+    {
+        return nSuperPixels;
+    }
+
     /**
      * @brief getLabelsBuffer
      * @param out
@@ -408,11 +598,7 @@ public:
      */
     int *getLabelsBuffer(int *out = NULL)
     {
-        if(labels_distance == NULL) {
-            return NULL;
-        }
-
-        int size = labels_distance->width * labels_distance->height;
+        int size = int(labels.size());
 
         if(size < 1) {
             return NULL;
@@ -422,9 +608,7 @@ public:
             out = new int[size];
         }
 
-        for(int i = 0; i < size; i++) {
-            out[i] = int(labels_distance->data[i << 1]);
-        }
+        std::copy(labels.begin(), labels.end(), out);
 
         return out;
     }
@@ -436,21 +620,22 @@ public:
      */
     Image *getMeanImage(Image *imgOut)
     {
+        if(labels.empty()) {
+            return imgOut;
+        }
+
         if(imgOut == NULL) {
             imgOut = new Image(1, width, height, channels);
         }
 
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                float *pixel = (*imgOut)(j, i);
-                float *l_d   = (*labels_distance)(j, i);
+        for(int i = 0; i < (width * height); i++) {
+            int label = labels[i];
 
-                int label = int(l_d[0]);
+            if(label > -1) {
+                float *pixel = &imgOut->data[i * channels];
 
-                if(label > -1) {
-                    for(int k = 0; k < channels; k++) {
-                        pixel[k] = centers[label].value[k];
-                    }
+                for(int k = 0; k < channels; k++) {
+                    pixel[k] = center_values[label * channels + k];
                 }
             }
         }
@@ -462,4 +647,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP */
-
@@ -31,6 +31,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "colors/color_conv_xyz_to_cielab.hpp"
 #include "colors/color_conv_xyz_to_hdrlab.hpp"
 
+#include "colors/color_conv_chain.hpp"
+
 #include "colors/saturation.hpp"
 
 #include "colors/rgbe.hpp"
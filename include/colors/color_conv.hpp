@@ -18,8 +18,118 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_COLORS_COLOR_CONV_HPP
 #define PIC_COLORS_COLOR_CONV_HPP
 
+#include <vector>
+
 namespace pic {
 
+class ColorConv;
+
+enum COLOR_CONV_OP_TYPE {CCO_AFFINE, CCO_CURVE, CCO_GENERIC};
+
+/**
+ * @brief The ColorConvOp struct is a stage of a color conversion
+ * that ColorConvChain can compile:
+ * - CCO_AFFINE: out = mtx * in + offset;
+ * - CCO_CURVE: for each channel,
+ *   out = x > threshold ? out_scale * (in_scale * x + in_offset)^gamma + out_offset :
+ *                         lin_scale * x + lin_offset;
+ * - CCO_GENERIC: out = f->transform(in, bDirection).
+ */
+struct ColorConvOp
+{
+    COLOR_CONV_OP_TYPE type;
+
+    //CCO_AFFINE
+    float mtx[9], offset[3];
+
+    //CCO_CURVE
+    float threshold, in_scale, in_offset, gamma, out_scale, out_offset;
+    float lin_scale, lin_offset;
+
+    //CCO_GENERIC
+    ColorConv *f;
+    bool bDirection;
+
+    /**
+     * @brief affine
+     * @param mtx is a 3x3 row-major matrix.
+     * @param offset is an offset; it can be NULL.
+     * @return
+     */
+    static ColorConvOp affine(const float *mtx, const float *offset = NULL)
+    {
+        ColorConvOp op;
+        op.type = CCO_AFFINE;
+
+        for(int i = 0; i < 9; i++) {
+            op.mtx[i] = mtx[i];
+        }
+
+        for(int i = 0; i < 3; i++) {
+            op.offset[i] = (offset != NULL) ? offset[i] : 0.0f;
+        }
+
+        return op;
+    }
+
+    /**
+     * @brief scale
+     * @param s is a vector of three scaling factors.
+     * @return It returns an affine op with a diagonal matrix.
+     */
+    static ColorConvOp scale(const float *s)
+    {
+        float mtx[] = {s[0], 0.0f, 0.0f,
+                       0.0f, s[1], 0.0f,
+                       0.0f, 0.0f, s[2]};
+        return affine(mtx);
+    }
+
+    /**
+     * @brief curve
+     * @param threshold
+     * @param in_scale
+     * @param in_offset
+     * @param gamma
+     * @param out_scale
+     * @param out_offset
+     * @param lin_scale
+     * @param lin_offset
+     * @return
+     */
+    static ColorConvOp curve(float threshold, float in_scale, float in_offset,
+                             float gamma, float out_scale, float out_offset,
+                             float lin_scale, float lin_offset)
+    {
+        ColorConvOp op;
+        op.type = CCO_CURVE;
+        op.threshold = threshold;
+        op.in_scale = in_scale;
+        op.in_offset = in_offset;
+        op.gamma = gamma;
+        op.out_scale = out_scale;
+        op.out_offset = out_offset;
+        op.lin_scale = lin_scale;
+        op.lin_offset = lin_offset;
+        return op;
+    }
+
+    /**
+     * @brief generic
+     * @param f
+     * @param bDirection
+     * @return
+     */
+    static ColorConvOp generic(ColorConv *f, bool bDirection)
+    {
+        ColorConvOp op;
+        op.type = CCO_GENERIC;
+        op.f = f;
+        op.bDirection = bDirection;
+        return op;
+    }
+};
+
 /**
  * @brief The ColorConv class
  */
@@ -62,6 +172,17 @@ public:
         }
     }
 
+    /**
+     * @brief getOps appends the stages of the conversion to ops;
+     * a conversion without a closed form uses a single CCO_GENERIC stage.
+     * @param bDirection
+     * @param ops
+     */
+    virtual void getOps(bool bDirection, std::vector<ColorConvOp> &ops)
+    {
+        ops.push_back(ColorConvOp::generic(this, bDirection));
+    }
+
     /**
      * @brief apply
      * @param mtx
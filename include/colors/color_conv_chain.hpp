@@ -0,0 +1,485 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_COLORS_COLOR_CONV_CHAIN_HPP
+#define PIC_COLORS_COLOR_CONV_CHAIN_HPP
+
+#include <vector>
+#include <string.h>
+#include <math.h>
+
+#include "base.hpp"
+#include "util/simd.hpp"
+#include "colors/color_conv.hpp"
+
+namespace pic {
+
+struct ColorConvTransform
+{
+    ColorConv *f;
+    bool bDirection;
+};
+
+/**
+ * @brief The ColorConvChain class compiles a chain of ColorConv objects
+ * into a short program of ColorConvOp stages:
+ * - adjacent affine stages (e.g. RGB to XYZ followed by the white point
+ *   normalization of CIELAB) are merged into a single 3x3 matrix plus offset;
+ * - power curves are evaluated with a piecewise quadratic LUT indexed by the
+ *   exponent and the 6 most significant mantissa bits of the input (64 segments
+ *   per octave, relative error below 1e-6); cubes are evaluated exactly;
+ * - conversions without a closed form (e.g. LogLuv) call ColorConv::transform.
+ * The program runs on blocks of pixels in planar layout, so the affine stages
+ * use SIMDFloat.
+ */
+class ColorConvChain
+{
+protected:
+
+    struct CurveLUT
+    {
+        //[c0, c1, c2, x0] per segment; f(x) = c0 + d * (c1 + d * c2), d = x - x0
+        std::vector<float> coeff;
+        unsigned int bits_min, bits_max;
+    };
+
+    std::vector<ColorConvTransform> list;
+    std::vector<ColorConvOp> ops;
+    std::vector<CurveLUT> luts;
+    bool bCompiled;
+
+    static const int BLOCK_SIZE = 256;
+    static const unsigned int LUT_SHIFT = 17;
+
+    /**
+     * @brief evalCurve evaluates a curve stage with the exact formula.
+     * @param op
+     * @param x
+     * @return
+     */
+    static inline float evalCurve(const ColorConvOp &op, float x)
+    {
+        if(x > op.threshold) {
+            return op.out_scale * powf(op.in_scale * x + op.in_offset, op.gamma) + op.out_offset;
+        } else {
+            return op.lin_scale * x + op.lin_offset;
+        }
+    }
+
+    /**
+     * @brief evalCurveDouble
+     * @param op
+     * @param x
+     * @return
+     */
+    static double evalCurveDouble(const ColorConvOp &op, double x)
+    {
+        return double(op.out_scale) * pow(double(op.in_scale) * x + double(op.in_offset),
+                                          double(op.gamma)) + double(op.out_offset);
+    }
+
+    /**
+     * @brief getBits
+     * @param x
+     * @return
+     */
+    static inline unsigned int getBits(float x)
+    {
+        unsigned int bits;
+        memcpy(&bits, &x, sizeof(float));
+        return bits;
+    }
+
+    /**
+     * @brief getFloat
+     * @param bits
+     * @return
+     */
+    static inline float getFloat(unsigned int bits)
+    {
+        float x;
+        memcpy(&x, &bits, sizeof(float));
+        return x;
+    }
+
+    /**
+     * @brief buildLUT fits a quadratic per segment for inputs in
+     * (threshold, 2^32); the other inputs use the exact formula.
+     * @param op
+     * @param lut
+     */
+    static void buildLUT(const ColorConvOp &op, CurveLUT &lut)
+    {
+        lut.coeff.clear();
+
+        float x_min = MAX(op.threshold, 1e-20f);
+
+        //first segment which is fully above the threshold
+        lut.bits_min = (getBits(x_min) >> LUT_SHIFT) + 1;
+        lut.bits_max = getBits(4294967296.0f) >> LUT_SHIFT;
+
+        if(lut.bits_min >= lut.bits_max) {
+            lut.bits_max = lut.bits_min;
+            return;
+        }
+
+        unsigned int n = lut.bits_max - lut.bits_min;
+        lut.coeff.resize(n * 4);
+
+        for(unsigned int i = 0; i < n; i++) {
+            double x0 = double(getFloat((lut.bits_min + i) << LUT_SHIFT));
+            double x1 = double(getFloat((lut.bits_min + i + 1) << LUT_SHIFT));
+            double h = x1 - x0;
+
+            double f0 = evalCurveDouble(op, x0);
+            double fm = evalCurveDouble(op, x0 + h * 0.5);
+            double f1 = evalCurveDouble(op, x1);
+
+            float *c = &lut.coeff[i * 4];
+            c[0] = float(f0);
+            c[1] = float((4.0 * fm - 3.0 * f0 - f1) / h);
+            c[2] = float(2.0 * (f1 - 2.0 * fm + f0) / (h * h));
+            c[3] = float(x0);
+        }
+    }
+
+    /**
+     * @brief applyAffine
+     * @param op
+     * @param p is a planar block with three channels.
+     * @param n is the number of pixels of the block rounded up to SIMDFloat::width.
+     */
+    static void applyAffine(const ColorConvOp &op, float *p[3], int n)
+    {
+        SIMDFloat m[9], o[3];
+
+        for(int k = 0; k < 9; k++) {
+            m[k] = SIMDFloat::set1(op.mtx[k]);
+        }
+
+        for(int k = 0; k < 3; k++) {
+            o[k] = SIMDFloat::set1(op.offset[k]);
+        }
+
+        for(int i = 0; i < n; i += SIMDFloat::width) {
+            SIMDFloat c0 = SIMDFloat::load(p[0] + i);
+            SIMDFloat c1 = SIMDFloat::load(p[1] + i);
+            SIMDFloat c2 = SIMDFloat::load(p[2] + i);
+
+            SIMDFloat::fmadd(c0, m[0], SIMDFloat::fmadd(c1, m[1], SIMDFloat::fmadd(c2, m[2], o[0]))).store(p[0] + i);
+            SIMDFloat::fmadd(c0, m[3], SIMDFloat::fmadd(c1, m[4], SIMDFloat::fmadd(c2, m[5], o[1]))).store(p[1] + i);
+            SIMDFloat::fmadd(c0, m[6], SIMDFloat::fmadd(c1, m[7], SIMDFloat::fmadd(c2, m[8], o[2]))).store(p[2] + i);
+        }
+    }
+
+    /**
+     * @brief applyCurve
+     * @param op
+     * @param lut
+     * @param p is a planar block with three channels.
+     * @param n is the number of pixels of the block.
+     */
+    static void applyCurve(const ColorConvOp &op, const CurveLUT &lut, float *p[3], int n)
+    {
+        float thr = op.threshold;
+        float ls = op.lin_scale;
+        float lo = op.lin_offset;
+
+        if(op.gamma == 3.0f || op.gamma == 1.0f) {
+            bool bCube = op.gamma == 3.0f;
+
+            for(int k = 0; k < 3; k++) {
+                float *c = p[k];
+
+                for(int i = 0; i < n; i++) {
+                    float x = c[i];
+
+                    if(x > thr) {
+                        float v = op.in_scale * x + op.in_offset;
+                        c[i] = op.out_scale * (bCube ? v * v * v : v) + op.out_offset;
+                    } else {
+                        c[i] = ls * x + lo;
+                    }
+                }
+            }
+
+            return;
+        }
+
+        const float *coeff = lut.coeff.data();
+        unsigned int bits_min = lut.bits_min;
+        unsigned int range = lut.bits_max - lut.bits_min;
+
+        for(int k = 0; k < 3; k++) {
+            float *c = p[k];
+
+            for(int i = 0; i < n; i++) {
+                float x = c[i];
+
+                //negative values and NaNs map outside the range
+                unsigned int index = (getBits(x) >> LUT_SHIFT) - bits_min;
+
+                if(index < range) {
+                    const float *s = &coeff[index << 2];
+                    float d = x - s[3];
+                    c[i] = s[0] + d * (s[1] + d * s[2]);
+                } else {
+                    c[i] = evalCurve(op, x);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief applyGeneric
+     * @param op
+     * @param p is a planar block with three channels.
+     * @param n is the number of pixels of the block.
+     */
+    static void applyGeneric(const ColorConvOp &op, float *p[3], int n)
+    {
+        float colIn[3], colOut[3];
+
+        for(int i = 0; i < n; i++) {
+            colIn[0] = p[0][i];
+            colIn[1] = p[1][i];
+            colIn[2] = p[2][i];
+
+            op.f->transform(colIn, colOut, op.bDirection);
+
+            p[0][i] = colOut[0];
+            p[1][i] = colOut[1];
+            p[2][i] = colOut[2];
+        }
+    }
+
+    /**
+     * @brief isIdentity
+     * @param op
+     * @return
+     */
+    static bool isIdentity(const ColorConvOp &op)
+    {
+        if(op.type != CCO_AFFINE) {
+            return false;
+        }
+
+        for(int i = 0; i < 9; i++) {
+            if(op.mtx[i] != ((i % 4) == 0 ? 1.0f : 0.0f)) {
+                return false;
+            }
+        }
+
+        return (op.offset[0] == 0.0f) && (op.offset[1] == 0.0f) && (op.offset[2] == 0.0f);
+    }
+
+    /**
+     * @brief mergeAffine computes b(a(x)) in double precision.
+     * @param a
+     * @param b
+     * @return
+     */
+    static ColorConvOp mergeAffine(const ColorConvOp &a, const ColorConvOp &b)
+    {
+        float mtx[9], offset[3];
+
+        for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 3; j++) {
+                double sum = 0.0;
+                for(int k = 0; k < 3; k++) {
+                    sum += double(b.mtx[i * 3 + k]) * double(a.mtx[k * 3 + j]);
+                }
+                mtx[i * 3 + j] = float(sum);
+            }
+
+            double sum = double(b.offset[i]);
+            for(int k = 0; k < 3; k++) {
+                sum += double(b.mtx[i * 3 + k]) * double(a.offset[k]);
+            }
+            offset[i] = float(sum);
+        }
+
+        return ColorConvOp::affine(mtx, offset);
+    }
+
+public:
+
+    /**
+     * @brief ColorConvChain
+     */
+    ColorConvChain()
+    {
+        bCompiled = false;
+    }
+
+    /**
+     * @brief add appends a conversion to the chain.
+     * @param f
+     * @param bDirection
+     */
+    void add(ColorConv *f, bool bDirection)
+    {
+        if(f == NULL) {
+            return;
+        }
+
+        ColorConvTransform entry;
+        entry.f = f;
+        entry.bDirection = bDirection;
+        list.push_back(entry);
+
+        bCompiled = false;
+    }
+
+    /**
+     * @brief clear removes all conversions.
+     */
+    void clear()
+    {
+        list.clear();
+        ops.clear();
+        luts.clear();
+        bCompiled = false;
+    }
+
+    /**
+     * @brief isCompiled
+     * @return
+     */
+    bool isCompiled()
+    {
+        return bCompiled;
+    }
+
+    /**
+     * @brief getNumOps
+     * @return It returns the number of stages of the compiled chain.
+     */
+    int getNumOps()
+    {
+        return int(ops.size());
+    }
+
+    /**
+     * @brief compile builds the program; it has to be called after
+     * the last add and before apply.
+     */
+    void compile()
+    {
+        std::vector<ColorConvOp> tmp;
+
+        for(unsigned int i = 0; i < list.size(); i++) {
+            list[i].f->getOps(list[i].bDirection, tmp);
+        }
+
+        ops.clear();
+
+        for(unsigned int i = 0; i < tmp.size(); i++) {
+            if(tmp[i].type == CCO_AFFINE && !ops.empty() && ops.back().type == CCO_AFFINE) {
+                ops.back() = mergeAffine(ops.back(), tmp[i]);
+            } else {
+                ops.push_back(tmp[i]);
+            }
+
+            if(isIdentity(ops.back())) {
+                ops.pop_back();
+            }
+        }
+
+        luts.clear();
+        luts.resize(ops.size());
+
+        for(unsigned int i = 0; i < ops.size(); i++) {
+            if(ops[i].type == CCO_CURVE && ops[i].gamma != 3.0f && ops[i].gamma != 1.0f) {
+                buildLUT(ops[i], luts[i]);
+            }
+        }
+
+        bCompiled = true;
+    }
+
+    /**
+     * @brief apply converts the first three channels of nPixels interleaved pixels;
+     * the other channels are copied. dataIn and dataOut can be the same buffer.
+     * The chain is thread-safe once compiled, as long as its ColorConv objects are.
+     * @param dataIn
+     * @param dataOut
+     * @param nPixels
+     * @param channels has to be greater or equal than 3.
+     */
+    void apply(float *dataIn, float *dataOut, int nPixels, int channels)
+    {
+        if(!bCompiled || channels < 3) {
+            return;
+        }
+
+        float buffer[3 * BLOCK_SIZE];
+        float *p[3] = {buffer, buffer + BLOCK_SIZE, buffer + 2 * BLOCK_SIZE};
+
+        for(int start = 0; start < nPixels; start += BLOCK_SIZE) {
+            int n = MIN(BLOCK_SIZE, nPixels - start);
+            int n_simd = ((n + SIMDFloat::width - 1) / SIMDFloat::width) * SIMDFloat::width;
+
+            float *in = &dataIn[start * channels];
+            float *out = &dataOut[start * channels];
+
+            for(int i = 0; i < n; i++) {
+                p[0][i] = in[i * channels    ];
+                p[1][i] = in[i * channels + 1];
+                p[2][i] = in[i * channels + 2];
+            }
+
+            for(int i = n; i < n_simd; i++) {
+                p[0][i] = p[1][i] = p[2][i] = 0.0f;
+            }
+
+            for(unsigned int k = 0; k < ops.size(); k++) {
+                switch(ops[k].type) {
+                case CCO_AFFINE:
+                    applyAffine(ops[k], p, n_simd);
+                    break;
+
+                case CCO_CURVE:
+                    applyCurve(ops[k], luts[k], p, n);
+                    break;
+
+                case CCO_GENERIC:
+                    applyGeneric(ops[k], p, n);
+                    break;
+                }
+            }
+
+            for(int i = 0; i < n; i++) {
+                float *pOut = &out[i * channels];
+                pOut[0] = p[0][i];
+                pOut[1] = p[1][i];
+                pOut[2] = p[2][i];
+
+                if(in != out) {
+                    for(int l = 3; l < channels; l++) {
+                        pOut[l] = in[i * channels + l];
+                    }
+                }
+            }
+        }
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_COLORS_COLOR_CONV_CHAIN_HPP */
+
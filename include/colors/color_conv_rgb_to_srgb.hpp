@@ -75,6 +75,22 @@ public:
             }
         }
     }
+
+    /**
+     * @brief getOps
+     * @param bDirection
+     * @param ops
+     */
+    void getOps(bool bDirection, std::vector<ColorConvOp> &ops)
+    {
+        if(bDirection) {
+            ops.push_back(ColorConvOp::curve(0.0031308f, 1.0f, 0.0f, gamma_inv,
+                                             a_plus_1, -a, 12.92f, 0.0f));
+        } else {
+            ops.push_back(ColorConvOp::curve(0.04045f, 1.0f / a_plus_1, a / a_plus_1, gamma,
+                                             1.0f, 0.0f, 1.0f / 12.92f, 0.0f));
+        }
+    }
 };
 
 } // end namespace pic
@@ -65,6 +65,16 @@ public:
     {
         apply(mtxXYZtoRGB, colIn, colOut);
     }
+
+    /**
+     * @brief getOps
+     * @param bDirection
+     * @param ops
+     */
+    void getOps(bool bDirection, std::vector<ColorConvOp> &ops)
+    {
+        ops.push_back(ColorConvOp::affine(bDirection ? mtxRGBtoXYZ : mtxXYZtoRGB));
+    }
 };
 
 } // end namespace pic
@@ -79,6 +79,40 @@ public:
         colOut[2] = white_point[2] * f_inv(tmp - colIn[2] / 200.0f);
     }
 
+    /**
+     * @brief getOps
+     * @param bDirection
+     * @param ops
+     */
+    void getOps(bool bDirection, std::vector<ColorConvOp> &ops)
+    {
+        if(bDirection) {
+            float wp_inv[] = {1.0f / white_point[0], 1.0f / white_point[1], 1.0f / white_point[2]};
+            ops.push_back(ColorConvOp::scale(wp_inv));
+
+            ops.push_back(ColorConvOp::curve(C_SIX_OVER_TWENTY_NINE_CUBIC, 1.0f, 0.0f, 1.0f / 3.0f,
+                                             1.0f, 0.0f, C_CIELAB_C1, C_FOUR_OVER_TWENTY_NINE));
+
+            float mtx[] = {0.0f,    116.0f,    0.0f,
+                           500.0f, -500.0f,    0.0f,
+                           0.0f,    200.0f, -200.0f};
+            float offset[] = {-16.0f, 0.0f, 0.0f};
+            ops.push_back(ColorConvOp::affine(mtx, offset));
+        } else {
+            float mtx[] = {1.0f / 116.0f, 1.0f / 500.0f,  0.0f,
+                           1.0f / 116.0f, 0.0f,           0.0f,
+                           1.0f / 116.0f, 0.0f,          -1.0f / 200.0f};
+            float offset[] = {16.0f / 116.0f, 16.0f / 116.0f, 16.0f / 116.0f};
+            ops.push_back(ColorConvOp::affine(mtx, offset));
+
+            ops.push_back(ColorConvOp::curve(C_SIX_OVER_TWENTY_NINE, 1.0f, 0.0f, 3.0f,
+                                             1.0f, 0.0f, C_CIELAB_C1_INV,
+                                             -C_FOUR_OVER_TWENTY_NINE * C_CIELAB_C1_INV));
+
+            ops.push_back(ColorConvOp::scale(white_point));
+        }
+    }
+
     /**
      * @brief f
      * @param t
@@ -25,6 +25,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "features_matching/harris_corner_detector.hpp"
 #include "features_matching/susan_corner_detector.hpp"
 #include "features_matching/fast_corner_detector.hpp"
+#include "features_matching/pyramid_corner_detector.hpp"
 
 //Edge descriptors
 #include "features_matching/canny_edge_detector.hpp"
@@ -42,6 +43,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "features_matching/motion_estimation.hpp"
 
 //binary feature matcher
+#include "features_matching/binary_descriptor_matrix.hpp"
 #include "features_matching/binary_feature_matcher.hpp"
 #include "features_matching/binary_feature_brute_force_matcher.hpp"
 #include "features_matching/binary_feature_lsh_matcher.hpp"
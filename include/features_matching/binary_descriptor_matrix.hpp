@@ -0,0 +1,198 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FEATURES_MATCHING_BINARY_DESCRIPTOR_MATRIX_HPP
+#define PIC_FEATURES_MATCHING_BINARY_DESCRIPTOR_MATRIX_HPP
+
+#include <vector>
+
+#include "util/math.hpp"
+#include "util/simd.hpp"
+
+//Hamming kernels: AVX-512 VPOPCNTDQ, AVX2 (nibble lookup), or 64-bit popcount
+#if defined(PIC_SIMD_AVX512) && defined(__AVX512VPOPCNTDQ__)
+    #define PIC_HAMMING_AVX512
+#elif (defined(PIC_SIMD_AVX512) || defined(PIC_SIMD_AVX)) && defined(__AVX2__)
+    #define PIC_HAMMING_AVX2
+#endif
+
+namespace pic {
+
+/**
+ * @brief The BinaryDescriptorMatrix class stores binary descriptors
+ * (e.g., BRIEF, ORB) as the rows of a contiguous and aligned matrix.
+ * Rows are padded with zeros to a multiple of the SIMD width, so the Hamming
+ * distance between two rows runs without tails.
+ */
+class BinaryDescriptorMatrix
+{
+protected:
+    std::vector<unsigned int> buffer;
+    unsigned int *data;
+    unsigned int desc_size, stride, nRows;
+
+public:
+
+#ifdef PIC_HAMMING_AVX512
+    static const unsigned int BLOCK_WORDS = 16;
+#else
+    static const unsigned int BLOCK_WORDS = 8;
+#endif
+
+    BinaryDescriptorMatrix()
+    {
+        data = NULL;
+        desc_size = 0;
+        stride = 0;
+        nRows = 0;
+    }
+
+    /**
+     * @brief allocate allocates a matrix set to zero.
+     * @param nRows is the number of descriptors.
+     * @param desc_size is the number of 32-bit words of a descriptor.
+     */
+    void allocate(unsigned int nRows, unsigned int desc_size)
+    {
+        this->nRows = nRows;
+        this->desc_size = desc_size;
+        this->stride = ((desc_size + BLOCK_WORDS - 1) / BLOCK_WORDS) * BLOCK_WORDS;
+
+        //16 extra words to align the first row to 64 bytes
+        buffer.assign(nRows * stride + 16, 0);
+
+        unsigned int offset = (unsigned int) (((size_t) &buffer[0]) & 63) / sizeof(unsigned int);
+        data = &buffer[(16 - offset) & 15];
+    }
+
+    /**
+     * @brief set copies descriptors into the matrix.
+     * @param descs is a vector of descriptors; NULL descriptors are set to zero.
+     * @param desc_size is the number of 32-bit words of a descriptor.
+     */
+    void set(std::vector<unsigned int *> &descs, unsigned int desc_size)
+    {
+        allocate((unsigned int) descs.size(), desc_size);
+
+        for(unsigned int i = 0; i < nRows; i++) {
+            setRow(i, descs[i]);
+        }
+    }
+
+    /**
+     * @brief setRow copies a descriptor into the i-th row.
+     * @param i
+     * @param desc
+     */
+    void setRow(unsigned int i, const unsigned int *desc)
+    {
+        if(desc == NULL) {
+            return;
+        }
+
+        unsigned int *row = getRow(i);
+        for(unsigned int k = 0; k < desc_size; k++) {
+            row[k] = desc[k];
+        }
+    }
+
+    /**
+     * @brief getRow
+     * @param i
+     * @return
+     */
+    inline unsigned int *getRow(unsigned int i)
+    {
+        return &data[i * stride];
+    }
+
+    /**
+     * @brief size
+     * @return
+     */
+    unsigned int size()
+    {
+        return nRows;
+    }
+
+    /**
+     * @brief getStride returns the number of 32-bit words of a row.
+     * @return
+     */
+    unsigned int getStride()
+    {
+        return stride;
+    }
+
+    /**
+     * @brief distance computes the Hamming distance between two padded rows.
+     * @param a
+     * @param b
+     * @param stride is the number of 32-bit words of a row;
+     * it has to be a multiple of BLOCK_WORDS.
+     * @return
+     */
+    static inline unsigned int distance(const unsigned int *a, const unsigned int *b, unsigned int stride)
+    {
+#if defined(PIC_HAMMING_AVX512)
+        __m512i acc = _mm512_setzero_si512();
+
+        for(unsigned int i = 0; i < stride; i += 16) {
+            __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void *) &a[i]),
+                                         _mm512_loadu_si512((const void *) &b[i]));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+        }
+
+        return (unsigned int) _mm512_reduce_add_epi64(acc);
+
+#elif defined(PIC_HAMMING_AVX2)
+        //bit count of each nibble
+        const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+
+        __m256i acc = _mm256_setzero_si256();
+
+        for(unsigned int i = 0; i < stride; i += 8) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) &a[i]),
+                                         _mm256_loadu_si256((const __m256i *) &b[i]));
+
+            __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, mask));
+            __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+        }
+
+        return (unsigned int) (_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+                               _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+#else
+        unsigned int ret = 0;
+
+        for(unsigned int i = 0; i < stride; i += 2) {
+            unsigned long long x = ((unsigned long long) (a[i] ^ b[i]) << 32) |
+                                   (unsigned long long) (a[i + 1] ^ b[i + 1]);
+            ret += bitCount64(x);
+        }
+
+        return ret;
+#endif
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FEATURES_MATCHING_BINARY_DESCRIPTOR_MATRIX_HPP */
@@ -20,15 +20,93 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <vector>
 
+#include "util/thread_pool.hpp"
+
+#include "features_matching/binary_descriptor_matrix.hpp"
 #include "features_matching/binary_feature_matcher.hpp"
 
 namespace pic{
 
 /**
- * @brief The BinaryFeatureBruteForceMatcher class
+ * @brief The BinaryFeatureBruteForceMatcher class matches binary descriptors
+ * against all descriptors of a database. The database is copied into a
+ * contiguous BinaryDescriptorMatrix at construction. getMatches processes
+ * blocks of queries against blocks of the database in parallel, keeping
+ * the two best scores of each query for the ratio test.
  */
 class BinaryFeatureBruteForceMatcher : public BinaryFeatureMatcher
 {
+protected:
+    BinaryDescriptorMatrix database;
+    unsigned int nBits;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    static const int QUERY_BLOCK = 64;
+    static const int DATABASE_BLOCK = 1024;
+
+    /**
+     * @brief matchBlock matches a block of queries against the database.
+     * @param queries is the matrix of the queries.
+     * @param q0 is the first query of the block.
+     * @param q1 is the last query of the block (excluded).
+     * @param matched_j
+     * @param dist_1
+     */
+    void matchBlock(BinaryDescriptorMatrix &queries, int q0, int q1,
+                    int *matched_j, unsigned int *dist_1)
+    {
+        unsigned int stride = database.getStride();
+        int nDatabase = int(database.size());
+
+        unsigned int dist_2[QUERY_BLOCK];
+
+        for(int q = q0; q < q1; q++) {
+            matched_j[q] = -1;
+            dist_1[q] = 0;
+            dist_2[q - q0] = 0;
+        }
+
+        for(int j0 = 0; j0 < nDatabase; j0 += DATABASE_BLOCK) {
+            int j1 = MIN(j0 + DATABASE_BLOCK, nDatabase);
+
+            for(int q = q0; q < q1; q++) {
+                unsigned int *desc = queries.getRow(q);
+
+                unsigned int d1 = dist_1[q];
+                unsigned int d2 = dist_2[q - q0];
+                int mj = matched_j[q];
+
+                for(int j = j0; j < j1; j++) {
+                    //the score is the number of equal bits
+                    unsigned int dist = nBits - BinaryDescriptorMatrix::distance(desc, database.getRow(j), stride);
+
+                    if(dist > d1) {
+                        d2 = d1;
+                        d1 = dist;
+                        mj = j;
+                    } else {
+                        if(dist > d2) {
+                            d2 = dist;
+                        }
+                    }
+                }
+
+                dist_1[q] = d1;
+                dist_2[q - q0] = d2;
+                matched_j[q] = mj;
+            }
+        }
+
+        //ratio test
+        for(int q = q0; q < q1; q++) {
+            if(!((dist_1[q] * 100 > dist_2[q - q0] * 105) && matched_j[q] != -1)) {
+                matched_j[q] = -1;
+            }
+        }
+    }
+
 public:
 
     /**
@@ -38,6 +116,31 @@ public:
      */
     BinaryFeatureBruteForceMatcher(std::vector<unsigned int *> *descs, unsigned int desc_size) : BinaryFeatureMatcher(descs, desc_size)
     {
+        database.set(*descs, desc_size);
+        nBits = desc_size * sizeof(unsigned int) * 8;
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    /**
+     * @brief setThreadPool sets the pool used by getMatches; by default
+     * the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * getMatches runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
     }
 
     /**
@@ -49,27 +152,60 @@ public:
      */
     bool getMatch(unsigned int *desc, int &matched_j, unsigned int &dist_1)
     {
-        unsigned int dist_2 = 0;
+        BinaryDescriptorMatrix query;
+        query.allocate(1, desc_size);
+        query.setRow(0, desc);
 
-        dist_1 = 0;
+        matchBlock(query, 0, 1, &matched_j, &dist_1);
 
-        matched_j = -1;
+        return matched_j != -1;
+    }
 
-        for(unsigned int j = 0; j < descs->size(); j++) {
-            unsigned int dist = BRIEFDescriptor::match(desc, descs->at(j), desc_size);
+    /**
+     * @brief getMatches matches a set of descriptors.
+     * @param descs0 is the set of descriptors to be matched.
+     * @param matched_j is the index of the match of each descriptor of descs0,
+     * or -1 if the descriptor is not matched.
+     * @param dist_1 is the score of each match.
+     */
+    void getMatches(std::vector<unsigned int *> &descs0, std::vector<int> &matched_j, std::vector<unsigned int> &dist_1)
+    {
+        int n = int(descs0.size());
 
-            if(dist > dist_1) {
-                dist_2 = dist_1;
-                dist_1 = dist;
-                matched_j = j;
-             } else {
-                if(dist > dist_2) {
-                    dist_2 = dist;
-                }
+        matched_j.assign(n, -1);
+        dist_1.assign(n, 0);
+
+        if(n == 0) {
+            return;
+        }
+
+        BinaryDescriptorMatrix queries;
+        queries.set(descs0, desc_size);
+
+        int nBlocks = (n + QUERY_BLOCK - 1) / QUERY_BLOCK;
+
+        int *mj = &matched_j[0];
+        unsigned int *d1 = &dist_1[0];
+
+        auto func = [this, &queries, n, mj, d1](int b) {
+            int q0 = b * QUERY_BLOCK;
+            matchBlock(queries, q0, MIN(q0 + QUERY_BLOCK, n), mj, d1);
+        };
+
+        if((nThreads == 1) || (nBlocks == 1)) {
+            for(int b = 0; b < nBlocks; b++) {
+                func(b);
             }
+        } else {
+            ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+            tp->parallelFor(nBlocks, func);
         }
 
-        return ((dist_1 * 100 > dist_2 * 105) && matched_j != -1);
+        for(int i = 0; i < n; i++) {
+            if(matched_j[i] == -1) {
+                dist_1[i] = 0;
+            }
+        }
     }
 };
 
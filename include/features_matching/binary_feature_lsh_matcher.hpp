@@ -20,25 +20,61 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <vector>
 
+#include "util/thread_pool.hpp"
+
 #include "features_matching/hash_table_lsh.hpp"
 #include "features_matching/binary_feature_matcher.hpp"
 
 namespace pic {
 
 /**
- * @brief The LSH class
+ * @brief The LSH class matches binary descriptors using a set of LSH tables.
+ * With multi-probing, each table is also searched in the buckets whose
+ * address differs by one or two bits from the one of the query, so fewer
+ * tables are needed for the same recall.
  */
 class BinaryFeatureLSHMatcher: public BinaryFeatureMatcher
 {
 protected:
     std::vector< HashTableLSH* > tables;
+    unsigned int probe_radius;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief getMatchPadded
+     * @param desc is the query, padded as a row of a BinaryDescriptorMatrix.
+     * @param matched_j
+     * @param dist_1
+     * @return
+     */
+    bool getMatchPadded(const unsigned int *desc, int &matched_j, unsigned int &dist_1)
+    {
+        unsigned int dist_2 = 0;
+
+        dist_1 = R;
+        matched_j = -1;
+
+        for(unsigned int i=0; i<tables.size(); i++) {
+            tables[i]->getNearestPadded(desc, matched_j, dist_1, dist_2, probe_radius);
+        }
+
+        return (matched_j != -1);// && (dist_1 * 100 > dist_2 * 105);
+    }
 
 public:
 
     /**
      * @brief LSH
+     * @param descs
+     * @param desc_size
+     * @param nTables
+     * @param hash_size
+     * @param probe_radius is the maximum number of bits (0, 1, or 2) flipped
+     * in the address of a query for multi-probing.
      */
-    BinaryFeatureLSHMatcher(std::vector< unsigned int *> *descs, unsigned int desc_size, unsigned int nTables = 32, unsigned int hash_size = 8) : BinaryFeatureMatcher(descs, desc_size)
+    BinaryFeatureLSHMatcher(std::vector< unsigned int *> *descs, unsigned int desc_size, unsigned int nTables = 32, unsigned int hash_size = 8, unsigned int probe_radius = 0) : BinaryFeatureMatcher(descs, desc_size)
     {
         std::mt19937 m_rnd(1);
 
@@ -48,6 +84,51 @@ public:
             HashTableLSH *tmp = new HashTableLSH(hash_size, g_f, descs, desc_size);
             tables.push_back(tmp);
         }
+
+        setProbeRadius(probe_radius);
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    ~BinaryFeatureLSHMatcher()
+    {
+        for(unsigned int i = 0; i < tables.size(); i++) {
+            delete[] tables[i]->g_f;
+            delete tables[i];
+        }
+
+        tables.clear();
+    }
+
+    /**
+     * @brief setProbeRadius
+     * @param probe_radius is the maximum number of bits (0, 1, or 2) flipped
+     * in the address of a query for multi-probing.
+     */
+    void setProbeRadius(unsigned int probe_radius)
+    {
+        this->probe_radius = MIN(probe_radius, 2);
+    }
+
+    /**
+     * @brief setThreadPool sets the pool used by getMatches; by default
+     * the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * getMatches runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
     }
 
     /**
@@ -90,16 +171,52 @@ public:
      */
     bool getMatch(unsigned int *desc, int &matched_j, unsigned int &dist_1)
     {
-        unsigned int dist_2 = 0;
+        BinaryDescriptorMatrix query;
+        query.allocate(1, desc_size);
+        query.setRow(0, desc);
 
-        dist_1 = R;
-        matched_j = -1;
+        return getMatchPadded(query.getRow(0), matched_j, dist_1);
+    }
 
-        for(unsigned int i=0; i<tables.size(); i++) {
-            tables[i]->getNearest(desc, matched_j, dist_1, dist_2);
+    /**
+     * @brief getMatches matches a set of descriptors in parallel.
+     * @param descs0 is the set of descriptors to be matched.
+     * @param matched_j is the index of the match of each descriptor of descs0,
+     * or -1 if the descriptor is not matched.
+     * @param dist_1 is the score of each match.
+     */
+    void getMatches(std::vector<unsigned int *> &descs0, std::vector<int> &matched_j, std::vector<unsigned int> &dist_1)
+    {
+        int n = int(descs0.size());
+
+        matched_j.assign(n, -1);
+        dist_1.assign(n, 0);
+
+        if(n == 0) {
+            return;
         }
 
-        return (matched_j != -1);// && (dist_1 * 100 > dist_2 * 105);
+        BinaryDescriptorMatrix queries;
+        queries.set(descs0, desc_size);
+
+        int *mj = &matched_j[0];
+        unsigned int *d1 = &dist_1[0];
+
+        auto func = [this, &queries, mj, d1](int q0, int q1) {
+            for(int q = q0; q < q1; q++) {
+                if(!getMatchPadded(queries.getRow(q), mj[q], d1[q])) {
+                    mj[q] = -1;
+                    d1[q] = 0;
+                }
+            }
+        };
+
+        if(nThreads == 1) {
+            func(0, n);
+        } else {
+            ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+            tp->parallelForBlocks(0, n, (n + 63) / 64, func);
+        }
     }
 };
 
@@ -58,17 +58,42 @@ public:
         return false;
     }
 
+    /**
+     * @brief getMatches matches a set of descriptors.
+     * @param descs0 is the set of descriptors to be matched.
+     * @param matched_j is the index of the match of each descriptor of descs0,
+     * or -1 if the descriptor is not matched.
+     * @param dist_1 is the score of each match.
+     */
+    virtual void getMatches(std::vector<unsigned int *> &descs0, std::vector<int> &matched_j, std::vector<unsigned int> &dist_1)
+    {
+        matched_j.assign(descs0.size(), -1);
+        dist_1.assign(descs0.size(), 0);
+
+        for(unsigned int i = 0; i < descs0.size(); i++) {
+            int j;
+            unsigned int d;
+
+            if(getMatch(descs0.at(i), j, d)) {
+                matched_j[i] = j;
+                dist_1[i] = d;
+            }
+        }
+    }
+
 #ifndef PIC_DISABLE_EIGEN
     void getAllMatches(std::vector<unsigned int *> &descs0, std::vector< Eigen::Vector3i > &matches)
     {
         matches.clear();
 
-        for(unsigned int i = 0; i< descs0.size(); i++) {
-            int matched_j;
-            unsigned int dist_1;
+        std::vector<int> matched_j;
+        std::vector<unsigned int> dist_1;
+
+        getMatches(descs0, matched_j, dist_1);
 
-            if(getMatch(descs0.at(i), matched_j, dist_1)) {
-                matches.push_back(Eigen::Vector3i(i, matched_j, dist_1));
+        for(unsigned int i = 0; i< descs0.size(); i++) {
+            if(matched_j[i] != -1) {
+                matches.push_back(Eigen::Vector3i(i, matched_j[i], dist_1[i]));
             }
         }
     }
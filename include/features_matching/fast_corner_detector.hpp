@@ -43,6 +43,92 @@ protected:
     int       radius;
 
 public:
+    /**
+     * @brief segmentTest runs the FAST segment test at (x, y): a pixel is a corner
+     * if at least 12 contiguous pixels of the circle of radius 3 around it
+     * are all brighter or all darker than it by a threshold.
+     * @param data is a single channel image.
+     * @param width is the width of data.
+     * @param x is the horizontal coordinate; it has to be in [3, width - 4].
+     * @param y is the vertical coordinate; it has to be in [3, height - 4].
+     * @param threshold
+     * @param bAdaptiveThreshold if true, the threshold is 20% of the mean of
+     * the circle, or threshold when this is zero.
+     * @param score is the strength of the corner.
+     * @return It returns true if (x, y) is a corner.
+     */
+    static bool segmentTest(const float *data, int width, int x, int y,
+                            float threshold, bool bAdaptiveThreshold, float &score)
+    {
+        static const int x_ring[] = {0, 1, 2, 3, 3,  3,  2,  1,  0, -1, -2, -3, -3, -3, -2, -1};
+        static const int y_ring[] = {3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1,  0,  1,  2,  3};
+
+        const float *data_p = &data[y * width + x];
+        float p = data_p[0];
+
+        float v[16];
+        float sum = p;
+
+        for(int k = 0; k < 16; k++) {
+            v[k] = data_p[y_ring[k] * width + x_ring[k]];
+            sum += v[k];
+        }
+
+        //computing the threshold
+        float thr = threshold;
+        if(bAdaptiveThreshold) {
+            thr = 0.2f * sum / 16.0f;
+            thr = (thr > 1e-9f ) ? thr : threshold;
+        }
+
+        float p_thr_dark   = p - thr;
+        float p_thr_bright = p + thr;
+
+        //first test: 0, 4, 8, 12
+        int cDark   = (v[0] <= p_thr_dark) + (v[4] <= p_thr_dark) +
+                      (v[8] <= p_thr_dark) + (v[12] <= p_thr_dark);
+        int cBright = (v[0] >= p_thr_bright) + (v[4] >= p_thr_bright) +
+                      (v[8] >= p_thr_bright) + (v[12] >= p_thr_bright);
+
+        if((cDark < 3) && (cBright < 3)) {
+            return false;
+        }
+
+        //second test: 12 contiguous darker or brighter values on the circle
+        int counter_dark   = 0;
+        int counter_bright = 0;
+        bool bCorner = false;
+
+        for(int k = 0; (k < 27) && !bCorner; k++) {
+            float value = v[k & 15];
+
+            counter_dark   = (value <= p_thr_dark)   ? (counter_dark + 1)   : 0;
+            counter_bright = (value >= p_thr_bright) ? (counter_bright + 1) : 0;
+
+            bCorner = (counter_dark > 11) || (counter_bright > 11);
+        }
+
+        if(!bCorner) {
+            return false;
+        }
+
+        //computing the V function
+        float V_dark   = 0.0f;
+        float V_bright = 0.0f;
+        for(int k = 0; k < 16; k++) {
+            if(v[k] <= p_thr_dark) {
+                V_dark += (p - v[k]) - thr;
+            }
+
+            if(v[k] >= p_thr_bright) {
+                V_bright += (v[k] - p) - thr;
+            }
+        }
+
+        score = MAX(V_bright, V_dark);
+        return true;
+    }
+
     /**
      * @brief FastCornerDetector
      * @param sigma
@@ -129,9 +215,6 @@ public:
         FilterGaussian2D flt(sigma);
         lum_flt = flt.ProcessP(Single(lum), lum_flt);
 
-        int x[] = {0, 1, 2, 3, 3,  3,  2,  1,  0, -1, -2, -3, -3, -3, -2, -1};
-        int y[] = {3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1,  0,  1,  2,  3};
-
         int width  = lum_flt->width;
         int height = lum_flt->height;
 
@@ -146,85 +229,10 @@ public:
             for(int j=3; j<(width - 3); j++) {
                 int ind = i * width + j;
 
-                float p = lum_flt->data[ind];
-
-                bool bDark[16];
-                bool bBright[16];
-                float v[16];
-
-                float sum = p;
-
-                for(int k=0; k<16; k++){
-                    float value = (*lum_flt)(j + x[k], i + y[k])[0];
-                    v[k] = value;
-                    sum += value;
-                }
-
-                //computing the threshold
-                float thr;
-                if(bexecuteThreshold) {
-                    thr = 0.2f * sum / 16.0f;
-                    thr = (thr > 1e-9f ) ? thr : threshold;
-
-                } else {
-                    thr = threshold;
-                }
-
-                //testing
-                float p_thr_dark   = p - thr;
-                float p_thr_bright = p + thr;
-
-                for(int k=0; k<16; k++){
-                    bDark[k]   = v[k] <= p_thr_dark;
-                    bBright[k] = v[k] >= p_thr_bright;
-                }
-
-                //first test: 0, 4, 8, 12
-                int cDark   = bDark[0]   + bDark[4]   + bDark[8]   + bDark[12];
-                int cBright = bBright[0] + bBright[4] + bBright[8] + bBright[12];
-
-                if((cDark < 3) && (cBright < 3) ){
-                    //corners_map[ind] = false;
-                    continue;
-                }
-
-                //second test: check for 12 continuous true values in bDark or cBright
-                int counter_dark   = 0;
-                int counter_bright = 0;
-
-                //corners_map[ind] = false;
-                for(int k=0; k<16; k++){
-                    if(bDark[k]){
-                        counter_dark++;
-                    } else {
-                        counter_dark = 0;
-                    }
-
-                    if(bBright[k]){
-                        counter_bright++;
-                    } else {
-                        counter_dark = 0;
-                    }
-
-                    if((counter_bright > 11) || (counter_dark > 11)) {
-                        corners_map[ind] = true;
-
-                        //Computing V function
-                        float V_dark   = 0.0f;
-                        float V_bright = 0.0f;
-                        for(int k=0; k<16; k++){
-                            if(bDark[k]) {
-                                V_bright += fabsf(v[k] - p) - thr;
-                            }
-
-                            if(bBright[k]) {
-                                V_dark += fabsf(p - v[k]) - thr;
-                            }
-                        }
-                        V.data[ind] = MAX(V_bright, V_dark);
-
-                        break;
-                    }
+                float score;
+                if(segmentTest(lum_flt->data, width, j, i, threshold, bexecuteThreshold, score)) {
+                    corners_map[ind] = true;
+                    V.data[ind] = score;
                 }
             }
         }
@@ -287,6 +295,9 @@ public:
 
             }
         }
+
+        delete[] indices;
+        delete[] corners_map;
     }
 };
 
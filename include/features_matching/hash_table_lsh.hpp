@@ -23,11 +23,16 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <set>
 
 #include "features_matching/brief_descriptor.hpp"
+#include "features_matching/binary_descriptor_matrix.hpp"
 
 namespace pic {
 
 /**
- * @brief The Hash class
+ * @brief The HashTableLSH class hashes binary descriptors by sampling
+ * hash_size of their bits. Buckets are stored in CSR form: the entries of
+ * bucket a are in [offsets[a], offsets[a + 1]), and for each entry both the
+ * index of the descriptor and a copy of the descriptor are stored contiguously,
+ * so scanning a bucket reads memory sequentially.
  */
 class HashTableLSH
 {
@@ -35,9 +40,11 @@ public:
     unsigned int *g_f;
 
     std::vector< unsigned int *> *descs;
-    std::vector< unsigned int > *table;
     unsigned int    nTable;
-    unsigned int    hash_size, desc_size, size_ui;
+    unsigned int    hash_size, desc_size, size_ui, nBits;
+
+    std::vector< unsigned int > offsets, indices;
+    BinaryDescriptorMatrix bucket_descs;
 
     HashTableLSH(unsigned int hash_size, unsigned int *g_f, std::vector< unsigned int *> *descs, unsigned int desc_size)
     {
@@ -47,7 +54,6 @@ public:
         this->hash_size = hash_size;
 
         nTable = 1 << hash_size;
-        table = new std::vector< unsigned int >[nTable];
 
         //hash function
         this->g_f = g_f;
@@ -56,10 +62,32 @@ public:
         this->descs = descs;
         this->desc_size = desc_size;
         size_ui = sizeof(unsigned int) * 8;
+        nBits = desc_size * size_ui;
+
+        unsigned int n = (unsigned int) descs->size();
+
+        std::vector< unsigned int > address(n);
+        offsets.assign(nTable + 1, 0);
+
+        for(unsigned int i = 0; i < n;  i++) {
+            address[i] = getAddress(descs->at(i));
+            offsets[address[i] + 1]++;
+        }
 
-        for(unsigned int i = 0; i < descs->size();  i++) {
-            unsigned int address = getAddress(descs->at(i));
-            table[address].push_back(i);
+        for(unsigned int i = 0; i < nTable; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        //stable counting sort: buckets keep the insertion order
+        std::vector< unsigned int > pos(offsets.begin(), offsets.end() - 1);
+
+        indices.resize(n);
+        bucket_descs.allocate(n, desc_size);
+
+        for(unsigned int i = 0; i < n;  i++) {
+            unsigned int k = pos[address[i]]++;
+            indices[k] = i;
+            bucket_descs.setRow(k, descs->at(i));
         }
     }
 
@@ -88,24 +116,24 @@ public:
     }
 
     /**
-     * @brief getNearest
-     * @param desc
+     * @brief searchBucket scans a bucket.
+     * @param desc is the query, padded as a row of bucket_descs.
+     * @param address
      * @param matched_j
      * @param dist_1
      * @param dist_2
      */
-    void getNearest(unsigned int * desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2)
+    void searchBucket(const unsigned int *desc, unsigned int address, int &matched_j, unsigned int &dist_1, unsigned int &dist_2)
     {
-        unsigned int address = getAddress(desc);
+        unsigned int stride = bucket_descs.getStride();
 
-        for(unsigned int i=0; i<table[address].size(); i++) {
-            unsigned int j = table[address].at(i);
-            unsigned int dist = BRIEFDescriptor::match(desc, descs->at(j), desc_size);
+        for(unsigned int k = offsets[address]; k < offsets[address + 1]; k++) {
+            unsigned int dist = nBits - BinaryDescriptorMatrix::distance(desc, bucket_descs.getRow(k), stride);
 
             if(dist > dist_1) {
                 dist_2 = dist_1;
                 dist_1 = dist;
-                matched_j = j;
+                matched_j = indices[k];
              } else {
                 if(dist > dist_2) {
                     dist_2 = dist;
@@ -113,8 +141,61 @@ public:
             }
         }
     }
-};
 
+    /**
+     * @brief getNearest searches the bucket of desc and, with multi-probing,
+     * the buckets whose address differs from it by up to probe_radius bits.
+     * @param desc is the query; it has desc_size words.
+     * @param matched_j
+     * @param dist_1
+     * @param dist_2
+     * @param probe_radius is 0, 1, or 2.
+     */
+    void getNearest(const unsigned int *desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2, unsigned int probe_radius = 0)
+    {
+        std::vector< unsigned int > row(bucket_descs.getStride(), 0);
+
+        for(unsigned int k = 0; k < desc_size; k++) {
+            row[k] = desc[k];
+        }
+
+        getNearestPadded(&row[0], matched_j, dist_1, dist_2, probe_radius);
+    }
+
+    /**
+     * @brief getNearestPadded is getNearest without copying the query.
+     * @param desc is the query, padded with zeros as a row of bucket_descs
+     * (getStride() words).
+     * @param matched_j
+     * @param dist_1
+     * @param dist_2
+     * @param probe_radius is 0, 1, or 2.
+     */
+    void getNearestPadded(const unsigned int *desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2, unsigned int probe_radius = 0)
+    {
+        unsigned int address = getAddress((unsigned int *) desc);
+
+        searchBucket(desc, address, matched_j, dist_1, dist_2);
+
+        if(probe_radius < 1) {
+            return;
+        }
+
+        for(unsigned int a = 0; a < hash_size; a++) {
+            unsigned int address_a = address ^ (1 << a);
+
+            searchBucket(desc, address_a, matched_j, dist_1, dist_2);
+
+            if(probe_radius < 2) {
+                continue;
+            }
+
+            for(unsigned int b = a + 1; b < hash_size; b++) {
+                searchBucket(desc, address_a ^ (1 << b), matched_j, dist_1, dist_2);
+            }
+        }
+    }
+};
 
 } // end namespace pic
 
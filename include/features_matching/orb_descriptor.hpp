@@ -103,23 +103,15 @@ public:
     }
 
     /**
-     * @brief get computes a descriptor at position (x0,y0) with size n.
+     * @brief getOrientation computes the orientation of the patch at (x0, y0)
+     * from its moments.
      * @param img
      * @param x0
      * @param y0
-     * @param desc
-     * @return
+     * @return It returns an angle in [0, 2 * pi].
      */
-    unsigned int *get(Image *img, int x0, int y0, unsigned int *desc = NULL)
+    float getOrientation(Image *img, int x0, int y0)
     {
-        if(img == NULL){
-            return NULL;
-        }
-
-        if(!img->checkCoordinates(x0, y0)) {
-            return NULL;
-        }
-
         float grad[2];
 
         img->getMomentsVal(x0, y0, S, grad);
@@ -130,6 +122,29 @@ public:
             theta = CLAMPi(C_PI_2 + theta, 0.0f, C_PI_2);
         }
 
+        return theta;
+    }
+
+    /**
+     * @brief getOriented computes a descriptor at position (x0,y0) with size n,
+     * given the orientation of the patch (e.g., from a keypoint detector).
+     * @param img
+     * @param x0
+     * @param y0
+     * @param theta is an angle in [0, 2 * pi].
+     * @param desc
+     * @return
+     */
+    unsigned int *getOriented(Image *img, int x0, int y0, float theta, unsigned int *desc = NULL)
+    {
+        if(img == NULL){
+            return NULL;
+        }
+
+        if(!img->checkCoordinates(x0, y0)) {
+            return NULL;
+        }
+
         float theta_nor = CLAMPi(theta / C_PI_2, 0.0f, 1.0f);
 
         int n = x_theta.size() - 1;
@@ -139,6 +154,27 @@ public:
 
         return getAux(img, x0, y0, x_theta[index], y_theta[index], desc);
     }
+
+    /**
+     * @brief get computes a descriptor at position (x0,y0) with size n.
+     * @param img
+     * @param x0
+     * @param y0
+     * @param desc
+     * @return
+     */
+    unsigned int *get(Image *img, int x0, int y0, unsigned int *desc = NULL)
+    {
+        if(img == NULL){
+            return NULL;
+        }
+
+        if(!img->checkCoordinates(x0, y0)) {
+            return NULL;
+        }
+
+        return getOriented(img, x0, y0, getOrientation(img, x0, y0), desc);
+    }
 };
 
 } // end namespace pic
@@ -0,0 +1,596 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FEATURES_MATCHING_PYRAMID_CORNER_DETECTOR_HPP
+#define PIC_FEATURES_MATCHING_PYRAMID_CORNER_DETECTOR_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "image.hpp"
+#include "util/thread_pool.hpp"
+#include "filtering/filter_luminance.hpp"
+#include "filtering/filter_gaussian_2d.hpp"
+#include "algorithms/pyramid.hpp"
+#include "features_matching/fast_corner_detector.hpp"
+#include "features_matching/orb_descriptor.hpp"
+
+namespace pic {
+
+#ifndef PIC_DISABLE_EIGEN
+
+/**
+ * @brief The PYRAMID_CORNER_TYPE enum
+ */
+enum PYRAMID_CORNER_TYPE {PCT_FAST, PCT_HARRIS};
+
+/**
+ * @brief The PyramidKeypoint struct is a keypoint detected at a level
+ * of a pyramid.
+ */
+struct PyramidKeypoint
+{
+    float x, y;             //coordinates at the first level
+    int x_level, y_level;   //coordinates at its level
+    int level;
+    float scale;            //2^level
+    float angle;            //orientation in [0, 2 * pi]
+    float score;
+};
+
+/**
+ * @brief The PyramidCornerDetector class detects FAST or Harris corners
+ * at every level of a Gaussian Pyramid of the luminance. Each level is split
+ * into tiles; scores, non-maximal suppression and a per-tile budget of the
+ * strongest corners are computed in parallel over tiles. The number of
+ * keypoints of a level is proportional to its area, and each keypoint
+ * is oriented with the intensity centroid of its patch, so descriptors can be
+ * computed with ORBDescriptor::getOriented on getLevel(level).
+ */
+class PyramidCornerDetector
+{
+protected:
+    PYRAMID_CORNER_TYPE type;
+
+    int nLevels, maxKeypoints, tileSize;
+    int radius, patch_radius;
+    float sigma, threshold;
+
+    Image *lum, *lum_flt, *score, *gradients, *gradients_flt;
+    Pyramid *pyramid;
+    int pyramid_width, pyramid_height, pyramid_levels;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    static bool compareScore(const PyramidKeypoint &a, const PyramidKeypoint &b)
+    {
+        return a.score > b.score;
+    }
+
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief parallelTiles runs func(x0, y0, x1, y1, tile) for each tile
+     * of a width x height grid.
+     * @param width
+     * @param height
+     * @param func
+     */
+    void parallelTiles(int width, int height, std::function<void(int, int, int, int, int)> func)
+    {
+        int tx = (width + tileSize - 1) / tileSize;
+        int ty = (height + tileSize - 1) / tileSize;
+
+        auto tile_func = [this, tx, width, height, &func](int t) {
+            int x0 = (t % tx) * tileSize;
+            int y0 = (t / tx) * tileSize;
+            func(x0, y0, MIN(x0 + tileSize, width), MIN(y0 + tileSize, height), t);
+        };
+
+        if(nThreads == 1) {
+            for(int t = 0; t < (tx * ty); t++) {
+                tile_func(t);
+            }
+        } else {
+            getPool()->parallelFor(tx * ty, tile_func);
+        }
+    }
+
+    /**
+     * @brief computeScores computes the corner score of each pixel of a level
+     * at least border pixels away from its boundary; other pixels are set to zero.
+     * @param img
+     * @param border
+     */
+    void computeScores(Image *img, int border)
+    {
+        int width = img->width;
+        int height = img->height;
+
+        if(score == NULL) {
+            score = new Image(1, width, height, 1);
+        } else {
+            if((score->width != width) || (score->height != height)) {
+                delete score;
+                score = new Image(1, width, height, 1);
+            }
+        }
+
+        score->setZero();
+
+        if(type == PCT_HARRIS) {
+            //structure tensor: Ix^2, Iy^2, Ix * Iy
+            if(gradients != NULL) {
+                if((gradients->width != width) || (gradients->height != height)) {
+                    delete gradients;
+                    gradients = NULL;
+                }
+            }
+
+            if(gradients == NULL) {
+                gradients = new Image(1, width, height, 3);
+            }
+
+            float *data = img->data;
+            float *grad = gradients->data;
+
+            parallelTiles(width, height, [data, grad, width, height](int x0, int y0, int x1, int y1, int) {
+                for(int j = y0; j < y1; j++) {
+                    int jm = MAX(j - 1, 0) * width;
+                    int jp = MIN(j + 1, height - 1) * width;
+
+                    for(int i = x0; i < x1; i++) {
+                        int ind = j * width + i;
+
+                        float gx = data[j * width + MIN(i + 1, width - 1)] - data[j * width + MAX(i - 1, 0)];
+                        float gy = data[jp + i] - data[jm + i];
+
+                        grad[ind * 3    ] = gx * gx;
+                        grad[ind * 3 + 1] = gy * gy;
+                        grad[ind * 3 + 2] = gx * gy;
+                    }
+                }
+            });
+
+            if(gradients_flt != NULL) {
+                if(!gradients_flt->isSimilarType(gradients)) {
+                    delete gradients_flt;
+                    gradients_flt = NULL;
+                }
+            }
+
+            FilterGaussian2D flt(sigma);
+            flt.setThreadPool(pool);
+            flt.setNumThreads(nThreads);
+            gradients_flt = flt.ProcessP(Single(gradients), gradients_flt);
+
+            float *tensor = gradients_flt->data;
+            float *out = score->data;
+            float thr = threshold;
+
+            parallelTiles(width, height, [tensor, out, width, height, border, thr](int x0, int y0, int x1, int y1, int) {
+                const float eps = 2.2204e-16f;
+
+                for(int j = MAX(y0, border); j < MIN(y1, height - border); j++) {
+                    for(int i = MAX(x0, border); i < MIN(x1, width - border); i++) {
+                        int ind = j * width + i;
+
+                        float x2 = tensor[ind * 3    ];
+                        float y2 = tensor[ind * 3 + 1];
+                        float xy = tensor[ind * 3 + 2];
+
+                        float R = (x2 * y2 - xy * xy) / (x2 + y2 + eps);
+                        out[ind] = (R > thr) ? R : 0.0f;
+                    }
+                }
+            });
+        } else {
+            float *data = img->data;
+            float *out = score->data;
+            float thr = threshold;
+            int b = MAX(border, 3);
+
+            parallelTiles(width, height, [data, out, width, height, b, thr](int x0, int y0, int x1, int y1, int) {
+                for(int j = MAX(y0, b); j < MIN(y1, height - b); j++) {
+                    for(int i = MAX(x0, b); i < MIN(x1, width - b); i++) {
+                        float value;
+
+                        if(FastCornerDetector::segmentTest(data, width, i, j, thr, true, value)) {
+                            out[j * width + i] = MAX(value, 1e-12f);
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    /**
+     * @brief selectTile runs the non-maximal suppression in a tile and
+     * it keeps its budget strongest corners.
+     * @param x0
+     * @param y0
+     * @param x1
+     * @param y1
+     * @param budget
+     * @param out
+     */
+    void selectTile(int x0, int y0, int x1, int y1, int budget, std::vector<PyramidKeypoint> &out)
+    {
+        int width = score->width;
+        int height = score->height;
+        float *data = score->data;
+
+        for(int j = y0; j < y1; j++) {
+            for(int i = x0; i < x1; i++) {
+                int ind = j * width + i;
+                float s = data[ind];
+
+                if(s <= 0.0f) {
+                    continue;
+                }
+
+                //ties are won by the first pixel in scanline order
+                bool bMax = true;
+
+                for(int k = MAX(j - radius, 0); (k <= MIN(j + radius, height - 1)) && bMax; k++) {
+                    for(int l = MAX(i - radius, 0); l <= MIN(i + radius, width - 1); l++) {
+                        int ind_kl = k * width + l;
+                        float s_kl = data[ind_kl];
+
+                        if((s_kl > s) || ((s_kl == s) && (ind_kl < ind))) {
+                            bMax = false;
+                            break;
+                        }
+                    }
+                }
+
+                if(bMax) {
+                    PyramidKeypoint kp;
+                    kp.x_level = i;
+                    kp.y_level = j;
+                    kp.score = s;
+                    out.push_back(kp);
+                }
+            }
+        }
+
+        if((budget > 0) && (int(out.size()) > budget)) {
+            std::nth_element(out.begin(), out.begin() + budget, out.end(), compareScore);
+            out.resize(budget);
+        }
+    }
+
+    /**
+     * @brief release
+     */
+    void release()
+    {
+        if(lum != NULL) {
+            delete lum;
+        }
+
+        if(lum_flt != NULL) {
+            delete lum_flt;
+        }
+
+        if(score != NULL) {
+            delete score;
+        }
+
+        if(gradients != NULL) {
+            delete gradients;
+        }
+
+        if(gradients_flt != NULL) {
+            delete gradients_flt;
+        }
+
+        if(pyramid != NULL) {
+            delete pyramid;
+        }
+
+        lum = NULL;
+        lum_flt = NULL;
+        score = NULL;
+        gradients = NULL;
+        gradients_flt = NULL;
+        pyramid = NULL;
+    }
+
+public:
+
+    /**
+     * @brief PyramidCornerDetector
+     * @param type is the corner detector.
+     * @param nLevels is the maximum number of levels of the pyramid.
+     * @param maxKeypoints is the maximum number of keypoints; if it is lower
+     * than 1, all corners are kept.
+     * @param threshold is the threshold of the Harris response, or the
+     * threshold of FAST for flat patches (FAST uses an adaptive threshold).
+     * @param radius is the radius of the non-maximal suppression.
+     * @param sigma is the Gaussian pre-filtering for FAST, or the window of
+     * the structure tensor for Harris.
+     * @param patch_radius is the radius of the patch for the orientation;
+     * corners closer than it to the boundary of a level are discarded.
+     */
+    PyramidCornerDetector(PYRAMID_CORNER_TYPE type = PCT_FAST, int nLevels = 4,
+                          int maxKeypoints = 2000, float threshold = 0.001f,
+                          int radius = 1, float sigma = 1.0f, int patch_radius = 15)
+    {
+        this->type = type;
+        this->nLevels = MAX(nLevels, 1);
+        this->maxKeypoints = maxKeypoints;
+        this->threshold = threshold;
+        this->radius = MAX(radius, 1);
+        this->sigma = sigma > 0.0f ? sigma : 1.0f;
+        this->patch_radius = MAX(patch_radius, 1);
+
+        tileSize = 128;
+
+        lum = NULL;
+        lum_flt = NULL;
+        score = NULL;
+        gradients = NULL;
+        gradients_flt = NULL;
+        pyramid = NULL;
+        pyramid_width = -1;
+        pyramid_height = -1;
+        pyramid_levels = -1;
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    ~PyramidCornerDetector()
+    {
+        release();
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the detector runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief setTileSize
+     * @param tileSize
+     */
+    void setTileSize(int tileSize)
+    {
+        this->tileSize = MAX(tileSize, 16);
+    }
+
+    /**
+     * @brief getNumLevels
+     * @return It returns the number of levels of the last pyramid.
+     */
+    int getNumLevels()
+    {
+        return pyramid != NULL ? MIN(nLevels, pyramid->size()) : 0;
+    }
+
+    /**
+     * @brief getLevel
+     * @param level
+     * @return It returns the image of a level of the last pyramid.
+     */
+    Image *getLevel(int level)
+    {
+        if((pyramid == NULL) || (level < 0) || (level >= pyramid->size())) {
+            return NULL;
+        }
+
+        return pyramid->get(level);
+    }
+
+    /**
+     * @brief getPyramid
+     * @return It returns the last pyramid.
+     */
+    Pyramid *getPyramid()
+    {
+        return pyramid;
+    }
+
+    /**
+     * @brief execute
+     * @param img
+     * @param keypoints are sorted by decreasing score.
+     */
+    void execute(Image *img, std::vector< PyramidKeypoint > *keypoints)
+    {
+        if((img == NULL) || (keypoints == NULL)) {
+            return;
+        }
+
+        keypoints->clear();
+
+        //luminance and pyramid
+        Image *L = img;
+        if(img->channels > 1) {
+            lum = FilterLuminance::Execute(img, lum, LT_CIE_LUMINANCE);
+            L = lum;
+        }
+
+        if(type == PCT_FAST) {
+            FilterGaussian2D flt(sigma);
+            flt.setThreadPool(pool);
+            flt.setNumThreads(nThreads);
+            lum_flt = flt.ProcessP(Single(L), lum_flt);
+            L = lum_flt;
+        }
+
+        if((pyramid == NULL) || (pyramid_width != L->width) ||
+           (pyramid_height != L->height) || (pyramid_levels != nLevels)) {
+            if(pyramid != NULL) {
+                delete pyramid;
+            }
+
+            int limitLevel = int(floorf(log2f(float(MIN(L->width, L->height))))) - (nLevels - 1);
+            pyramid = new Pyramid(L, false, MAX(limitLevel, 1));
+
+            pyramid_width = L->width;
+            pyramid_height = L->height;
+            pyramid_levels = nLevels;
+        } else {
+            pyramid->update(L);
+        }
+
+        int levels = getNumLevels();
+
+        //the budget of a level is proportional to its area
+        float total_area = 0.0f;
+        for(int l = 0; l < levels; l++) {
+            total_area += float(pyramid->get(l)->nPixels());
+        }
+
+        for(int l = 0; l < levels; l++) {
+            Image *level = pyramid->get(l);
+
+            int width = level->width;
+            int height = level->height;
+
+            if((width <= (patch_radius * 2)) || (height <= (patch_radius * 2))) {
+                break;
+            }
+
+            computeScores(level, patch_radius);
+
+            int budget = -1, tile_budget = -1;
+            if(maxKeypoints > 0) {
+                budget = MAX(int(float(maxKeypoints) * float(level->nPixels()) / total_area), 1);
+                tile_budget = MAX(int(2.0f * float(budget) * float(tileSize * tileSize) / float(level->nPixels())), 4);
+            }
+
+            int tx = (width + tileSize - 1) / tileSize;
+            int ty = (height + tileSize - 1) / tileSize;
+            std::vector< std::vector< PyramidKeypoint > > tiles(tx * ty);
+
+            parallelTiles(width, height, [this, &tiles, tile_budget](int x0, int y0, int x1, int y1, int t) {
+                selectTile(x0, y0, x1, y1, tile_budget, tiles[t]);
+            });
+
+            std::vector< PyramidKeypoint > kps;
+            for(unsigned int t = 0; t < tiles.size(); t++) {
+                kps.insert(kps.end(), tiles[t].begin(), tiles[t].end());
+            }
+
+            if((budget > 0) && (int(kps.size()) > budget)) {
+                std::nth_element(kps.begin(), kps.begin() + budget, kps.end(), compareScore);
+                kps.resize(budget);
+            }
+
+            //coordinates and orientation
+            float scale = float(1 << l);
+            int n = int(kps.size());
+            int pr = patch_radius;
+            PyramidKeypoint *kp = n > 0 ? &kps[0] : NULL;
+
+            auto orient = [kp, level, scale, l, pr](int k0, int k1) {
+                for(int k = k0; k < k1; k++) {
+                    kp[k].level = l;
+                    kp[k].scale = scale;
+                    kp[k].x = (float(kp[k].x_level) + 0.5f) * scale - 0.5f;
+                    kp[k].y = (float(kp[k].y_level) + 0.5f) * scale - 0.5f;
+
+                    float m[2];
+                    level->getMomentsVal(kp[k].x_level, kp[k].y_level, pr, m);
+
+                    float theta = atan2f(m[1], m[0]);
+                    if(theta < 0.0f) {
+                        theta = CLAMPi(C_PI_2 + theta, 0.0f, C_PI_2);
+                    }
+
+                    kp[k].angle = theta;
+                }
+            };
+
+            if((nThreads == 1) || (n < 256)) {
+                orient(0, n);
+            } else {
+                getPool()->parallelForBlocks(0, n, -1, orient);
+            }
+
+            keypoints->insert(keypoints->end(), kps.begin(), kps.end());
+        }
+
+        std::sort(keypoints->begin(), keypoints->end(), compareScore);
+    }
+
+    /**
+     * @brief getORBDescriptors computes ORB descriptors of keypoints in parallel,
+     * at the level of each keypoint and with its orientation.
+     * @param orb
+     * @param keypoints
+     * @param descs are allocated with new[].
+     */
+    void getORBDescriptors(ORBDescriptor *orb, std::vector< PyramidKeypoint > &keypoints,
+                           std::vector< unsigned int * > &descs)
+    {
+        int n = int(keypoints.size());
+
+        descs.assign(n, NULL);
+
+        if((orb == NULL) || (pyramid == NULL) || (n == 0)) {
+            return;
+        }
+
+        unsigned int **out = &descs[0];
+        PyramidKeypoint *kp = &keypoints[0];
+        Pyramid *pyr = pyramid;
+
+        auto func = [orb, out, kp, pyr](int k0, int k1) {
+            for(int k = k0; k < k1; k++) {
+                out[k] = orb->getOriented(pyr->get(kp[k].level), kp[k].x_level, kp[k].y_level, kp[k].angle);
+            }
+        };
+
+        if((nThreads == 1) || (n < 256)) {
+            func(0, n);
+        } else {
+            getPool()->parallelForBlocks(0, n, -1, func);
+        }
+    }
+};
+
+#endif
+
+} // end namespace pic
+
+#endif /* PIC_FEATURES_MATCHING_PYRAMID_CORNER_DETECTOR_HPP */
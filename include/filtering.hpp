@@ -34,9 +34,13 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "filtering/filter_bilateral_1d.hpp"
 #include "filtering/filter_bilateral_2das.hpp"
 #include "filtering/filter_bilateral_2df.hpp"
+#include "filtering/bilateral_grid.hpp"
 #include "filtering/filter_bilateral_2dg.hpp"
 #include "filtering/filter_bilateral_2ds.hpp"
 #include "filtering/filter_bilateral_2dsp.hpp"
+#include "filtering/filter_bilateral_3das.hpp"
+#include "filtering/filter_bilateral_3ds.hpp"
+#include "filtering/filter_bilateral_3dsp.hpp"
 #include "filtering/filter_channel.hpp"
 #include "filtering/filter_color_conv.hpp"
 #include "filtering/filter_color_distance.hpp"
@@ -64,6 +68,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "filtering/filter_luminance.hpp"
 #include "filtering/filter_max.hpp"
 #include "filtering/filter_mean.hpp"
+#include "filtering/filter_rank.hpp"
 #include "filtering/filter_med.hpp"
 #include "filtering/filter_min.hpp"
 #include "filtering/filter_mosaic.hpp"
@@ -85,6 +90,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "filtering/filter_wls.hpp"
 #include "filtering/filter_grow_cut.hpp"
 #include "filtering/filter_deform_grid.hpp"
+#include "filtering/temporal_window.hpp"
 
 #endif /* PIC_FILTERING_HPP */
 
@@ -0,0 +1,461 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_BILATERAL_GRID_HPP
+#define PIC_FILTERING_BILATERAL_GRID_HPP
+
+#include <vector>
+#include <functional>
+
+#include "image.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The BilateralGrid class is a CPU bilateral grid: values of a base
+ * image are splatted into a (x, y, edge) grid with a homogeneous weight,
+ * the grid is blurred with a separable 5-tap binomial kernel, and it is
+ * sliced with trilinear interpolation at the edge values of each output pixel.
+ * The edge (or guide) image may be larger than the base image; in this case,
+ * the output has the size of the edge image (cross-bilateral upsampling).
+ * The grid is stored as [y][x][edge][channel], so the splatting is split
+ * by grid rows: each thread owns a set of rows and no write is shared.
+ */
+class BilateralGrid
+{
+protected:
+    float sigma_s, sigma_r;
+
+    //grid size; gc is the number of base channels plus the weight
+    int gw, gh, gr, gc;
+
+    //sampling rates and the minimum edge value
+    float s_S, s_R, E_min;
+
+    std::vector<float> grid, grid_tmp;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief runBlocks runs func(y0, y1) on blocks of [0, n).
+     * @param n
+     * @param func
+     */
+    void runBlocks(int n, std::function<void(int, int)> func)
+    {
+        if(nThreads == 1) {
+            func(0, n);
+        } else {
+            ThreadPool *tp = (pool != NULL) ? pool : ThreadPool::getInstance();
+            tp->parallelForBlocks(0, n, -1, func);
+        }
+    }
+
+    /**
+     * @brief getEdge returns the mean of the channels of a pixel.
+     * @param data
+     * @param channels
+     * @return
+     */
+    static inline float getEdge(const float *data, int channels)
+    {
+        float E = 0.0f;
+
+        for(int k = 0; k < channels; k++) {
+            E += data[k];
+        }
+
+        return E / float(channels);
+    }
+
+    /**
+     * @brief getEdgeRange computes the minimum and maximum edge values.
+     * @param edge
+     * @param E_min
+     * @param E_max
+     */
+    void getEdgeRange(Image *edge, float &E_min, float &E_max)
+    {
+        int height = edge->height;
+        int n = edge->width * edge->channels;
+        int channels = edge->channels;
+
+        std::vector<float> row_min(height), row_max(height);
+
+        runBlocks(height, [edge, n, channels, &row_min, &row_max](int y0, int y1) {
+            for(int j = y0; j < y1; j++) {
+                float *row = &edge->data[j * n];
+                float E0 = FLT_MAX;
+                float E1 = -FLT_MAX;
+
+                for(int i = 0; i < n; i += channels) {
+                    float E = getEdge(&row[i], channels);
+                    E0 = MIN(E0, E);
+                    E1 = MAX(E1, E);
+                }
+
+                row_min[j] = E0;
+                row_max[j] = E1;
+            }
+        });
+
+        E_min = FLT_MAX;
+        E_max = -FLT_MAX;
+
+        for(int j = 0; j < height; j++) {
+            E_min = MIN(E_min, row_min[j]);
+            E_max = MAX(E_max, row_max[j]);
+        }
+    }
+
+    /**
+     * @brief blurSlice computes the i-th of n consecutive slices of size
+     * floats blurred along the slice index: sum_k w_k * src[i + k - 2],
+     * with zero boundaries.
+     * @param out
+     * @param src
+     * @param i
+     * @param n
+     * @param size
+     */
+    static void blurSlice(float *out, const float *src, int i, int n, int size)
+    {
+        const float w[] = {1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f};
+        const int W = SIMDFloat::width;
+
+        int k0 = MAX(0, 2 - i);
+        int k1 = MIN(5, n + 2 - i);
+
+        int t = 0;
+        for(; t <= (size - W); t += W) {
+            SIMDFloat acc = SIMDFloat::set1(w[k0]) * SIMDFloat::load(&src[(i + k0 - 2) * size + t]);
+
+            for(int k = k0 + 1; k < k1; k++) {
+                acc = SIMDFloat::fmadd(SIMDFloat::set1(w[k]),
+                                       SIMDFloat::load(&src[(i + k - 2) * size + t]), acc);
+            }
+
+            acc.store(out + t);
+        }
+
+        for(; t < size; t++) {
+            float acc = 0.0f;
+
+            for(int k = k0; k < k1; k++) {
+                acc += w[k] * src[(i + k - 2) * size + t];
+            }
+
+            out[t] = acc;
+        }
+    }
+
+    /**
+     * @brief sliceRow slices a row of the output.
+     * @param out
+     * @param edge
+     * @param j
+     */
+    template<int GC>
+    void sliceRow(Image *out, Image *edge, int j)
+    {
+        const int nc = (GC > 0) ? GC : gc;
+        int channels = edge->channels;
+        float *row = &edge->data[j * edge->width * channels];
+        float *dst = &out->data[j * out->width * out->channels];
+
+        float fy = float(j) * s_S;
+        int y0 = MIN(int(fy), gh - 1);
+        int y1 = MIN(y0 + 1, gh - 1);
+        float ay = fy - float(y0);
+
+        float res_fixed[GC > 0 ? GC : 1];
+        std::vector<float> res_vec;
+        float *res = res_fixed;
+
+        if(GC == 0) {
+            res_vec.resize(nc);
+            res = &res_vec[0];
+        }
+
+        for(int i = 0; i < edge->width; i++) {
+            float fx = float(i) * s_S;
+            int x0 = MIN(int(fx), gw - 1);
+            int x1 = MIN(x0 + 1, gw - 1);
+            float ax = fx - float(x0);
+
+            float fz = (getEdge(&row[i * channels], channels) - E_min) * s_R;
+            fz = MAX(MIN(fz, float(gr - 1)), 0.0f);
+            int z0 = MIN(int(fz), gr - 1);
+            int z1 = MIN(z0 + 1, gr - 1);
+            float az = fz - float(z0);
+
+            const float *c00 = &grid[((y0 * gw + x0) * gr) * nc];
+            const float *c01 = &grid[((y0 * gw + x1) * gr) * nc];
+            const float *c10 = &grid[((y1 * gw + x0) * gr) * nc];
+            const float *c11 = &grid[((y1 * gw + x1) * gr) * nc];
+
+            for(int c = 0; c < nc; c++) {
+                //along the edge axis, then x, then y
+                float a = c00[z0 * nc + c] + az * (c00[z1 * nc + c] - c00[z0 * nc + c]);
+                float b = c01[z0 * nc + c] + az * (c01[z1 * nc + c] - c01[z0 * nc + c]);
+                float d = c10[z0 * nc + c] + az * (c10[z1 * nc + c] - c10[z0 * nc + c]);
+                float e = c11[z0 * nc + c] + az * (c11[z1 * nc + c] - c11[z0 * nc + c]);
+
+                float ab = a + ax * (b - a);
+                float de = d + ax * (e - d);
+
+                res[c] = ab + ay * (de - ab);
+            }
+
+            float weight = res[nc - 1];
+            float *pixel = &dst[i * (nc - 1)];
+
+            if(weight > 0.0f) {
+                float inv_weight = 1.0f / weight;
+
+                for(int c = 0; c < (nc - 1); c++) {
+                    pixel[c] = res[c] * inv_weight;
+                }
+            } else {
+                for(int c = 0; c < (nc - 1); c++) {
+                    pixel[c] = 0.0f;
+                }
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief BilateralGrid
+     * @param sigma_s is the spatial sigma in pixels of the edge image.
+     * @param sigma_r is the range sigma in edge units.
+     */
+    BilateralGrid(float sigma_s = 16.0f, float sigma_r = 0.1f)
+    {
+        update(sigma_s, sigma_r);
+
+        gw = gh = gr = gc = 0;
+        s_S = s_R = 1.0f;
+        E_min = 0.0f;
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    /**
+     * @brief update
+     * @param sigma_s
+     * @param sigma_r
+     */
+    void update(float sigma_s, float sigma_r)
+    {
+        this->sigma_s = MAX(sigma_s, 1e-3f);
+        this->sigma_r = MAX(sigma_r, 1e-6f);
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the grid runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief splat allocates the grid and splats base into it.
+     * @param base
+     * @param edge is the edge image; if it is NULL, base is used.
+     */
+    void splat(Image *base, Image *edge = NULL)
+    {
+        if(edge == NULL) {
+            edge = base;
+        }
+
+        float E_max;
+        getEdgeRange(edge, E_min, E_max);
+
+        s_S = 1.0f / sigma_s;
+        s_R = 1.0f / sigma_r;
+
+        gw = int(ceilf(edge->widthf  * s_S)) + 1;
+        gh = int(ceilf(edge->heightf * s_S)) + 1;
+        gr = int(ceilf((E_max - E_min) * s_R)) + 1;
+        gc = base->channels + 1;
+
+        grid.assign(gw * gh * gr * gc, 0.0f);
+
+        //base pixels in edge coordinates
+        float scale_x = edge->widthf  / base->widthf;
+        float scale_y = edge->heightf / base->heightf;
+
+        runBlocks(gh, [this, base, edge, scale_x, scale_y](int gy0, int gy1) {
+            int channels = base->channels;
+            int edge_channels = edge->channels;
+
+            for(int j = 0; j < base->height; j++) {
+                float ey = float(j) * scale_y;
+                int y = int(lround(ey * s_S));
+
+                if(y < gy0 || y >= gy1) {
+                    continue;
+                }
+
+                int ej = MIN(int(ey), edge->height - 1);
+                float *row_edge = &edge->data[ej * edge->width * edge_channels];
+                float *row_base = &base->data[j * base->width * channels];
+
+                for(int i = 0; i < base->width; i++) {
+                    float ex = float(i) * scale_x;
+                    int ei = MIN(int(ex), edge->width - 1);
+
+                    float E = getEdge(&row_edge[ei * edge_channels], edge_channels);
+
+                    int x = int(lround(ex * s_S));
+                    int z = int(lround((E - E_min) * s_R));
+
+                    float *cell = &grid[(((y * gw + x) * gr) + z) * gc];
+                    float *pixel = &row_base[i * channels];
+
+                    for(int k = 0; k < channels; k++) {
+                        cell[k] += pixel[k];
+                    }
+
+                    cell[channels] += 1.0f;
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief blur blurs the grid along the edge axis, x, and y.
+     */
+    void blur()
+    {
+        int size_z = gr * gc;
+        int size_y = gw * size_z;
+
+        grid_tmp.resize(grid.size());
+
+        float *g = &grid[0];
+        float *t = &grid_tmp[0];
+
+        //edge axis and x within each grid row
+        runBlocks(gh, [this, g, t, size_z, size_y](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < gw; x++) {
+                    int ind = y * size_y + x * size_z;
+
+                    for(int z = 0; z < gr; z++) {
+                        blurSlice(&t[ind + z * gc], &g[ind], z, gr, gc);
+                    }
+                }
+
+                for(int x = 0; x < gw; x++) {
+                    blurSlice(&g[y * size_y + x * size_z], &t[y * size_y], x, gw, size_z);
+                }
+            }
+        });
+
+        //y; each row only reads its neighbors
+        runBlocks(gh, [this, g, t, size_y](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                blurSlice(&t[y * size_y], g, y, gh, size_y);
+            }
+        });
+
+        grid.swap(grid_tmp);
+    }
+
+    /**
+     * @brief slice slices the grid at the edge values of edge.
+     * @param edge
+     * @param imgOut
+     * @return It returns an image with the size of edge and the channels of base.
+     */
+    Image *slice(Image *edge, Image *imgOut = NULL)
+    {
+        if(edge == NULL || grid.empty()) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = new Image(1, edge->width, edge->height, gc - 1);
+        }
+
+        runBlocks(edge->height, [this, imgOut, edge](int y0, int y1) {
+            for(int j = y0; j < y1; j++) {
+                switch(gc) {
+                case 2:
+                    sliceRow<2>(imgOut, edge, j);
+                    break;
+
+                case 4:
+                    sliceRow<4>(imgOut, edge, j);
+                    break;
+
+                default:
+                    sliceRow<0>(imgOut, edge, j);
+                    break;
+                }
+            }
+        });
+
+        return imgOut;
+    }
+
+    /**
+     * @brief execute filters base with the edges of edge.
+     * @param base
+     * @param edge is the edge (or guide) image; if it is NULL, base is used.
+     * @param imgOut
+     * @return
+     */
+    Image *execute(Image *base, Image *edge = NULL, Image *imgOut = NULL)
+    {
+        if(base == NULL) {
+            return imgOut;
+        }
+
+        if(edge == NULL) {
+            edge = base;
+        }
+
+        splat(base, edge);
+        blur();
+        return slice(edge, imgOut);
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_BILATERAL_GRID_HPP */
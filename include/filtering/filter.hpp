@@ -21,15 +21,11 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "image_vec.hpp"
 #include "util/tile_list.hpp"
 #include "util/string.hpp"
-
-
-#ifndef PIC_DISABLE_THREAD
-#include <thread>
-#endif
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
-//This depends on the architecture!
+//The tile size used when adaptive tiling is disabled; see Filter::setTileSize.
 #define TILE_SIZE 64
 
 /**
@@ -57,6 +53,60 @@ protected:
      */
     virtual Image *SetupAux(ImageVec imgIn, Image *imgOut);
 
+    ThreadPool *pool;
+    int nThreads;
+    int tileSize;
+
+    /**
+     * @brief getKernelFootprint returns the support of the kernel; it is
+     * used for computing the tile size.
+     * @param imgIn
+     * @param footprintX is the horizontal support in pixels.
+     * @param footprintY is the vertical support in pixels.
+     * @param footprintZ is the temporal support in frames.
+     */
+    virtual void getKernelFootprint(ImageVec, int &footprintX, int &footprintY,
+                                    int &footprintZ)
+    {
+        footprintX = 1;
+        footprintY = 1;
+        footprintZ = 1;
+    }
+
+    /**
+     * @brief isFrameAware returns true if ProcessBBox processes only
+     * the frames in [box->z0, box->z1). In this case, ProcessP splits
+     * temporal/volumetric images into 3D tiles (x, y, t bricks); otherwise,
+     * each tile covers all frames.
+     * @return
+     */
+    virtual bool isFrameAware()
+    {
+        return false;
+    }
+
+    /**
+     * @brief isRowStrip returns true if the current pass works better
+     * with tiles as wide as the image; e.g. horizontal separable passes.
+     * @return
+     */
+    virtual bool isRowStrip()
+    {
+        return false;
+    }
+
+    /**
+     * @brief getTileSize computes the tile size for ProcessP.
+     * @param imgIn
+     * @param imgOut
+     * @param numThreads
+     * @param tileWidth
+     * @param tileHeight
+     * @param tileFrames
+     */
+    virtual void getTileSize(ImageVec imgIn, Image *imgOut, int numThreads,
+                             int &tileWidth, int &tileHeight, int &tileFrames);
+
 public:
     bool cachedOnly;
     std::vector<Filter *> filters;
@@ -68,12 +118,86 @@ public:
     {
         cachedOnly = false;
         scale = 1.0f;
+
+        pool = NULL;
+        nThreads = -1;
+        tileSize = -1;
     }
 
     ~Filter()
     {
     }
 
+    /**
+     * @brief setThreadPool sets the pool used by ProcessP; this setting
+     * is propagated to sub-filters.
+     * @param pool is the pool. If it is NULL, the process-wide pool,
+     * ThreadPool::getInstance(), is used.
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+
+        for(unsigned int i = 0; i < filters.size(); i++) {
+            filters[i]->setThreadPool(pool);
+        }
+    }
+
+    /**
+     * @brief setNumThreads sets the maximum number of threads used by ProcessP;
+     * this setting is propagated to sub-filters.
+     * @param nThreads is the number of threads. If it is lower than 1,
+     * all threads of the pool are used.
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+
+        for(unsigned int i = 0; i < filters.size(); i++) {
+            filters[i]->setNumThreads(nThreads);
+        }
+    }
+
+    /**
+     * @brief setTileSize sets a fixed tile size for ProcessP; this setting
+     * is propagated to sub-filters.
+     * @param tileSize is the width and height of a tile in pixels (e.g. TILE_SIZE).
+     * If it is lower than 1, tiles are computed at runtime from the image size,
+     * the number of channels, the kernel footprint, and the L2 cache size.
+     */
+    void setTileSize(int tileSize)
+    {
+        this->tileSize = tileSize;
+
+        for(unsigned int i = 0; i < filters.size(); i++) {
+            filters[i]->setTileSize(tileSize);
+        }
+    }
+
+    /**
+     * @brief getThreadPool returns the pool used by ProcessP.
+     * @return This function returns the pool used by ProcessP.
+     */
+    ThreadPool *getThreadPool()
+    {
+        return (pool != NULL) ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief getNumThreads returns the number of threads used by ProcessP.
+     * @return This function returns the number of threads used by ProcessP.
+     */
+    int getNumThreads()
+    {
+        int numThreads = getThreadPool()->getNumThreads();
+
+        if((nThreads > 0) && (nThreads < numThreads)) {
+            numThreads = nThreads;
+        }
+
+        return numThreads;
+    }
+
     /**
      * @brief ChangePass changes the pass direction.
      * @param pass
@@ -229,6 +353,41 @@ PIC_INLINE Image *Filter::CachedProcess(ImageVec imgIn, Image *imgOut,
     }
 }
 
+PIC_INLINE void Filter::getTileSize(ImageVec imgIn, Image *imgOut, int numThreads,
+                                    int &tileWidth, int &tileHeight, int &tileFrames)
+{
+    bool bFrames = isFrameAware() && (imgOut->frames > 1);
+
+    if(tileSize > 0) {
+        tileWidth  = tileSize;
+        tileHeight = tileSize;
+        tileFrames = bFrames ? tileSize : imgOut->frames;
+        return;
+    }
+
+    int channels = imgOut->channels;
+
+    for(unsigned int i = 0; i < imgIn.size(); i++) {
+        if(imgIn[i] != NULL) {
+            channels = MAX(channels, imgIn[i]->channels);
+        }
+    }
+
+    int footprintX, footprintY, footprintZ;
+    getKernelFootprint(imgIn, footprintX, footprintY, footprintZ);
+
+    if(bFrames) {
+        TileList::computeTileSize(imgOut->width, imgOut->height, imgOut->frames, channels,
+                                  footprintX, footprintY, footprintZ, numThreads, isRowStrip(),
+                                  tileWidth, tileHeight, tileFrames);
+    } else {
+        TileList::computeTileSize(imgOut->width, imgOut->height, channels,
+                                  footprintX, footprintY, numThreads, isRowStrip(),
+                                  tileWidth, tileHeight);
+        tileFrames = imgOut->frames;
+    }
+}
+
 PIC_INLINE Image *Filter::Process(ImageVec imgIn, Image *imgOut)
 {
     if(imgIn[0] == NULL) {
@@ -255,8 +414,6 @@ PIC_INLINE void Filter::ProcessPAux(ImageVec imgIn, Image *imgOut,
 
         if(currentTile < tiles->tiles.size()) {
             tiles->genBBox(currentTile, &box);
-            box.z0 = 0;
-            box.z1 = imgOut->frames;
             ProcessBBox(imgOut, imgIn, &box);
         } else {
             state = false;
@@ -271,33 +428,32 @@ PIC_INLINE Image *Filter::ProcessP(ImageVec imgIn, Image *imgOut)
         return NULL;
     }
 
+    ThreadPool *tp = getThreadPool();
+
+    int numThreads = getNumThreads();
+
     imgOut = SetupAux(imgIn, imgOut);
 
-    if((imgOut->width < TILE_SIZE) &&
-       (imgOut->height < TILE_SIZE)) {
-        BBox box(imgOut->width, imgOut->height);
+    int tileWidth, tileHeight, tileFrames;
+    getTileSize(imgIn, imgOut, numThreads, tileWidth, tileHeight, tileFrames);
+
+    if(((imgOut->width <= tileWidth) &&
+        (imgOut->height <= tileHeight) &&
+        (imgOut->frames <= tileFrames)) || (numThreads < 2)) {
+        BBox box(imgOut->width, imgOut->height, imgOut->frames);
 
         ProcessBBox(imgOut, imgIn, &box);
         return imgOut;
     }
 
-    //Create threads
-    int numCores = std::thread::hardware_concurrency();
+    TileList lst(tileWidth, tileHeight, tileFrames,
+                 imgOut->width, imgOut->height, imgOut->frames);
 
-    std::thread **thrd = new std::thread*[numCores];
-    TileList lst(TILE_SIZE, imgOut->width, imgOut->height);
+    int nTasks = MIN(numThreads, int(lst.tiles.size()));
 
-    for(int i = 0; i < numCores; i++) {
-        thrd[i] = new std::thread(
-            std::bind(&Filter::ProcessPAux, this, imgIn, imgOut, &lst));
-    }
-
-    //Threads join
-    for(int i = 0; i < numCores; i++) {
-        thrd[i]->join();
-        delete thrd[i];
-    }
-    delete[] thrd;
+    tp->parallelFor(nTasks, [this, &imgIn, imgOut, &lst](int) {
+        this->ProcessPAux(imgIn, imgOut, &lst);
+    });
 
     return imgOut;
 #else
@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 #define PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 
+#include <vector>
+
 #include "filtering/filter.hpp"
 
 #include "algorithms/camera_response_function.hpp"
@@ -36,7 +38,12 @@ namespace pic {
 enum HDR_REC_DOMAIN {HRD_LOG, HRD_LIN, HRD_SQ};
 
 /**
- * @brief The FilterAssembleHDR class
+ * @brief The FilterAssembleHDR class merges a stack of LDR exposures into
+ * an HDR image. The inverse CRF (or its logarithm in the HRD_LOG domain)
+ * and the weight function are tabulated once per Process call, so each
+ * sample costs a table lookup; the mean of the channels and the weight
+ * of a pixel are computed once per exposure and shared by all channels.
+ * Rows are accumulated exposure by exposure in contiguous buffers.
  */
 class FilterAssembleHDR: public Filter
 {
@@ -46,6 +53,90 @@ protected:
     CRF_WEIGHT              weight_type;
     float                   delta_value;
 
+    /**
+     * @brief The LUT struct is a table of a function on [0, 1]: it is sampled
+     * at the nearest entry (for 8-bit CRFs), or linearly interpolated.
+     * The identity is not tabulated.
+     */
+    struct LUT
+    {
+        std::vector<float> values;
+        float scale;
+        int last;
+        bool bNearest, bIdentity;
+
+        /**
+         * @brief lookup
+         * @param x
+         * @return
+         */
+        inline float lookup(float x) const
+        {
+            if(bIdentity) {
+                return x;
+            }
+
+            float f = CLAMPi(x, 0.0f, 1.0f) * scale;
+
+            if(bNearest) {
+                return values[int(f + 0.5f)];
+            }
+
+            int i = MIN(int(f), last - 1);
+            float t = f - float(i);
+            return values[i] + t * (values[i + 1] - values[i]);
+        }
+    };
+
+    std::vector<LUT> lut_value;
+    LUT lut_weight;
+
+    static const int LUT_SIZE = 65536;
+
+    /**
+     * @brief setupLUTs tabulates the inverse CRF, in the log domain if
+     * required, and the weight function.
+     * @param channels
+     */
+    void setupLUTs(int channels)
+    {
+        IMG_LIN type = (crf != NULL) ? crf->getType() : IL_LIN;
+        bool bLUT8bit = (type == IL_LUT_8_BIT);
+
+        lut_value.resize(channels);
+
+        for(int k = 0; k < channels; k++) {
+            LUT &lut = lut_value[k];
+
+            lut.bIdentity = (type == IL_LIN) && (domain != HRD_LOG);
+            if(lut.bIdentity) {
+                continue;
+            }
+
+            lut.bNearest = bLUT8bit;
+            lut.last = bLUT8bit ? 255 : LUT_SIZE;
+            lut.scale = float(lut.last);
+            lut.values.resize(lut.last + 1);
+
+            for(int i = 0; i <= lut.last; i++) {
+                float x = float(i) / lut.scale;
+                float x_lin = (crf != NULL) ? crf->Remove(x, k) : x;
+
+                lut.values[i] = (domain == HRD_LOG) ? logf(x_lin + delta_value) : x_lin;
+            }
+        }
+
+        lut_weight.bNearest = false;
+        lut_weight.bIdentity = false;
+        lut_weight.last = LUT_SIZE;
+        lut_weight.scale = float(LUT_SIZE);
+        lut_weight.values.resize(LUT_SIZE + 1);
+
+        for(int i = 0; i <= LUT_SIZE; i++) {
+            lut_weight.values[i] = weightFunction(float(i) / float(LUT_SIZE), weight_type);
+        }
+    }
+
     /**
      * @brief ProcessBBox
      * @param dst
@@ -54,103 +145,114 @@ protected:
      */
     void ProcessBBox(Image *dst, ImageVec src, BBox *box)
     {
-        int width = dst->width;
         int channels = dst->channels;
 
         unsigned int n = src.size();
 
         float t_min = FLT_MAX;
-        int index = -1;
+        unsigned int index = 0;
         for(unsigned int j = 0; j < n; j++) {
             if(src[j]->exposure < t_min) {
                 t_min = src[j]->exposure;
                 index = j;
             }
-        }        
+        }
 
-        float channelsf = float(channels);
+        float inv_channels = 1.0f / float(channels);
 
-        float *acc = new float[channels];
-        float *totWeight = new float[channels];
+        //per exposure factors of the merge
+        std::vector<float> weight_scale(n), value_scale(n), value_offset(n);
 
-        for(int j = box->y0; j < box->y1; j++) {
-            int ind = j * width;
+        for(unsigned int l = 0; l < n; l++) {
+            float t = src[l]->exposure;
 
-            for(int i = box->x0; i < box->x1; i++) {
-                int c = (ind + i) * channels;
+            weight_scale[l] = (domain == HRD_SQ) ? (t * t) : 1.0f;
+            value_scale[l] = 1.0f;
+            value_offset[l] = 0.0f;
 
-                for(int k = 0; k < channels; k++) {
-                    acc[k] = 0.0f;
-                    totWeight[k] = 0.0f;
-                }
+            switch(domain) {
+                case HRD_LIN: {
+                    value_scale[l] = 1.0f / t;
+                } break;
+
+                case HRD_LOG: {
+                    value_offset[l] = -logf(t);
+                } break;
+
+                case HRD_SQ: {
+                    value_scale[l] = t;
+                } break;
+            }
+        }
 
-                float max_val_saturation = 1.0f;
+        int len = box->x1 - box->x0;
 
-                //for each exposure...
-                for(unsigned int l = 0; l < n; l++) {
+        std::vector<float> acc(len * channels);
+        std::vector<float> totWeight(len), saturation(len);
 
-                    float x = 0.0f;
-                    for(int k = 0; k < channels; k++) {
-                        x += src[l]->data[c + k];
-                    }
-                    x /= channelsf;
+        for(int j = box->y0; j < box->y1; j++) {
 
+            for(int i = 0; i < (len * channels); i++) {
+                acc[i] = 0.0f;
+            }
 
-                    if(l == index) {
-                        max_val_saturation = x / t_min;
-                    }
+            for(int i = 0; i < len; i++) {
+                totWeight[i] = 0.0f;
+            }
 
-                    float weight = weightFunction(x, weight_type);
+            //for each exposure...
+            for(unsigned int l = 0; l < n; l++) {
+                float *row = (*src[l])(box->x0, j);
 
-                    if(domain == HRD_SQ) {
-                        weight *= (src[l]->exposure * src[l]->exposure);
-                    }
+                float w_scale = weight_scale[l];
+                float v_scale = value_scale[l];
+                float v_offset = value_offset[l];
+                bool bMin = (l == index);
 
-                    for(int k = 0; k < channels; k++) {
-                        float x_lin = crf->Remove(src[l]->data[c + k], k);
+                for(int i = 0; i < len; i++) {
+                    float *pixel = &row[i * channels];
 
-                        //merge HDR pixels
-                        switch(domain) {
-                            case HRD_LIN: {
-                                acc[k] += (weight * x_lin) / src[l]->exposure;
-                            } break;
+                    float x = 0.0f;
+                    for(int k = 0; k < channels; k++) {
+                        x += pixel[k];
+                    }
+                    x *= inv_channels;
 
-                            case HRD_LOG: {
-                                acc[k] += weight * (logf(x_lin + delta_value) - logf(src[l]->exposure));
-                            } break;
+                    if(bMin) {
+                        saturation[i] = x / t_min;
+                    }
 
-                            case HRD_SQ: {
-                                acc[k] += (weight * x_lin) * src[l]->exposure;
-                            } break;
-                        }
+                    float weight = lut_weight.lookup(x) * w_scale;
+                    totWeight[i] += weight;
 
-                        totWeight[k] += weight;
+                    float *acc_i = &acc[i * channels];
+                    for(int k = 0; k < channels; k++) {
+                        float value = lut_value[k].lookup(pixel[k]) * v_scale + v_offset;
+                        acc_i[k] += weight * value;
                     }
                 }
+            }
 
-                bool bSaturated = false;
-                for(int k = 0; k < channels; k++) {
-                    bSaturated = bSaturated || (totWeight[k] < 1e-4f);
-                }
+            float *out = (*dst)(box->x0, j);
+
+            for(int i = 0; i < len; i++) {
+                float *out_i = &out[i * channels];
+
+                if(totWeight[i] >= 1e-4f) {
+                    float inv_weight = 1.0f / totWeight[i];
+                    float *acc_i = &acc[i * channels];
 
-                if(!bSaturated) {
                     for(int k = 0; k < channels; k++) {
-                        acc[k] /= totWeight[k];
-                        if(domain == HRD_LOG) {
-                            acc[k] = expf(acc[k]);
-                        }
-                        dst->data[c + k] = acc[k];
+                        float value = acc_i[k] * inv_weight;
+                        out_i[k] = (domain == HRD_LOG) ? expf(value) : value;
                     }
                 } else {
                     for(int k = 0; k < channels; k++) {
-                        dst->data[c + k] = max_val_saturation;
+                        out_i[k] = saturation[i];
                     }
                 }
             }
         }
-
-        delete[] totWeight;
-        delete[] acc;
     }
 
 public:
@@ -172,6 +274,38 @@ public:
         //a numerical stability value when assembling images in the log-domain
         this->delta_value = 1.0 / 65536.0f;
     }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if(imgIn.empty() || (imgIn[0] == NULL)) {
+            return imgOut;
+        }
+
+        setupLUTs(imgIn[0]->channels);
+        return Filter::Process(imgIn, imgOut);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessP(ImageVec imgIn, Image *imgOut)
+    {
+        if(imgIn.empty() || (imgIn[0] == NULL)) {
+            return imgOut;
+        }
+
+        setupLUTs(imgIn[0]->channels);
+        return Filter::ProcessP(imgIn, imgOut);
+    }
 };
 
 } // end namespace pic
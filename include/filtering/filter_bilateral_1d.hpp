@@ -39,6 +39,15 @@ protected:
      */
     void ProcessBBox(Image *dst, ImageVec src, BBox *box);
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
     float sigma_s, sigma_r;
 
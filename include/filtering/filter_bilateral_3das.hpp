@@ -0,0 +1,207 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_BILATERAL_3DAS_HPP
+#define PIC_FILTERING_FILTER_BILATERAL_3DAS_HPP
+
+#include "filtering/filter_bilateral_3ds.hpp"
+#include "filtering/filter_sampling_map.hpp"
+#include "image_samplers/image_sampler_bilinear.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterBilateral3DAS class is a stochastic spatio-temporal
+ * bilateral filter with adaptive sampling: the number of samples of a pixel
+ * depends on the sampling map (FilterSamplingMap) of its frame; i.e.
+ * flat areas use fewer samples than edges.
+ */
+class FilterBilateral3DAS: public FilterBilateral3DS
+{
+protected:
+    FilterSamplingMap		fsm;
+    ImageSamplerBilinear	isb;
+
+    //a sampling map per frame
+    ImageVec				maps;
+    float					inv_width, inv_height;
+
+    /**
+     * @brief getNumSamples
+     * @param ps
+     * @param i
+     * @param j
+     * @param t
+     * @return
+     */
+    int getNumSamples(RandomSampler<3> *ps, int i, int j, int t)
+    {
+        //the sampling map has three channels (FilterGradient)
+        float valOut[3];
+        isb.SampleImage(maps[t], float(i) * inv_width, float(j) * inv_height, valOut);
+
+        int levelsRsize = int(ps->levelsR.size());
+        float levelVal = CLAMPi(1.0f - valOut[0], 0.0f, 0.9f) * float(levelsRsize);
+        int levelInt = int(floorf(levelVal));
+
+        int nSamples = ps->levelsR[levelInt];
+
+        if(levelInt < (levelsRsize - 1)) {
+            float tmp = levelVal - float(levelInt);
+
+            if(tmp > 0.0f) {
+                nSamples += int(float(ps->levelsR[levelInt + 1] - nSamples) * tmp);
+            }
+        }
+
+        return nSamples / 3;
+    }
+
+    /**
+     * @brief computeSamplingMaps computes the sampling map of each frame
+     * of the edge image.
+     * @param imgIn
+     */
+    void computeSamplingMaps(ImageVec imgIn);
+
+public:
+
+    /**
+     * @brief FilterBilateral3DAS
+     * @param sigma_s is the spatial sigma in pixels.
+     * @param sigma_r is the range sigma.
+     * @param sigma_t is the temporal sigma in frames.
+     * @param type
+     * @param mult is a multiplier (mult > 0) or a divisor (mult < 0) of
+     * the number of samples.
+     */
+    FilterBilateral3DAS(float sigma_s, float sigma_r, float sigma_t,
+                        SAMPLER_TYPE type = ST_BRIDSON, int mult = 1);
+
+    ~FilterBilateral3DAS();
+
+    /**
+     * @brief Signature
+     * @return
+     */
+    std::string Signature()
+    {
+        return GenBilString("3DAS", sigma_s, sigma_r) + "_St_" + fromNumberToString(sigma_t);
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        computeSamplingMaps(imgIn);
+        return FilterBilateral3DS::Process(imgIn, imgOut);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessP(ImageVec imgIn, Image *imgOut)
+    {
+        computeSamplingMaps(imgIn);
+        return FilterBilateral3DS::ProcessP(imgIn, imgOut);
+    }
+
+    /**
+     * @brief Execute
+     * @param imgIn is a video; i.e. an image with frames > 1.
+     * @param imgOut
+     * @param sigma_s
+     * @param sigma_r
+     * @param sigma_t
+     * @return
+     */
+    static Image *Execute(Image *imgIn, Image *imgOut,
+                          float sigma_s, float sigma_r, float sigma_t)
+    {
+        FilterBilateral3DAS filter(sigma_s, sigma_r, sigma_t);
+        return filter.ProcessP(Single(imgIn), imgOut);
+    }
+};
+
+PIC_INLINE FilterBilateral3DAS::FilterBilateral3DAS(float sigma_s, float sigma_r,
+        float sigma_t, SAMPLER_TYPE type, int mult) : FilterBilateral3DS(), fsm(sigma_s)
+{
+    int halfKernelSize = PrecomputedGaussian::getKernelSize(sigma_s) >> 1;
+
+    int nSamples;
+    if(mult > 0) {
+        nSamples = halfKernelSize * mult;
+    } else {
+        nSamples = MAX(halfKernelSize / MAX(-mult, 1), 1);
+    }
+
+    Init(type, sigma_s, sigma_r, sigma_t, nSamples, 3);
+}
+
+PIC_INLINE FilterBilateral3DAS::~FilterBilateral3DAS()
+{
+    for(unsigned int i = 0; i < maps.size(); i++) {
+        delete maps[i];
+    }
+
+    maps.clear();
+}
+
+PIC_INLINE void FilterBilateral3DAS::computeSamplingMaps(ImageVec imgIn)
+{
+    Image *edge = (imgIn.size() > 1) ? imgIn[1] : imgIn[0];
+
+    if(edge == NULL) {
+        return;
+    }
+
+    for(int t = int(maps.size()); t < edge->frames; t++) {
+        maps.push_back(NULL);
+    }
+
+    inv_width = 1.0f / edge->widthf;
+    inv_height = 1.0f / edge->heightf;
+
+    fsm.setThreadPool(pool);
+    fsm.setNumThreads(nThreads);
+
+    for(int t = 0; t < edge->frames; t++) {
+        Image frame(1, edge->width, edge->height, edge->channels,
+                    edge->data + t * edge->tstride);
+
+        maps[t] = fsm.ProcessP(Single(&frame), maps[t]);
+
+        std::vector<float> maxVal(maps[t]->channels);
+        maps[t]->getMaxVal(NULL, &maxVal[0]);
+
+        if(maxVal[0] > 0.0f) {
+            *maps[t] /= maxVal[0];
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_BILATERAL_3DAS_HPP */
+
@@ -0,0 +1,444 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_BILATERAL_3DS_HPP
+#define PIC_FILTERING_FILTER_BILATERAL_3DS_HPP
+
+#include <random>
+
+#include "filtering/filter.hpp"
+#include "filtering/temporal_window.hpp"
+#include "util/precomputed_gaussian.hpp"
+#include "point_samplers/sampler_random_m.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterBilateral3DS class is a stochastic spatio-temporal
+ * bilateral filter for videos. A video can be filtered at once (an Image
+ * with frames > 1) or streamed frame by frame (pushFrame/flushFrame); in
+ * the latter case, only the frames of the temporal window are kept in memory.
+ */
+class FilterBilateral3DS: public Filter
+{
+protected:
+    float					sigma_s, sigma_r, sigma_t;
+    PrecomputedGaussian		*pg, *pg_t;
+
+    MRSamplers<3>			*ms;
+
+    //sampler selection per pixel (a SHIFTER_SIZE x SHIFTER_SIZE tile)
+    std::vector<unsigned int> shifter;
+
+    TemporalWindow			window_base, window_edge;
+    bool					bStreaming;
+
+    static const int SHIFTER_SIZE = 64;
+
+    /**
+     * @brief FilterBilateral3DS
+     */
+    FilterBilateral3DS()
+    {
+        pg = NULL;
+        pg_t = NULL;
+        ms = NULL;
+        bStreaming = false;
+    }
+
+    /**
+     * @brief Init
+     * @param type
+     * @param sigma_s
+     * @param sigma_r
+     * @param sigma_t
+     * @param nSamples
+     * @param nLevels
+     */
+    void Init(SAMPLER_TYPE type, float sigma_s, float sigma_r, float sigma_t,
+              int nSamples, int nLevels);
+
+    /**
+     * @brief getNumSamples
+     * @param ps
+     * @param i
+     * @param j
+     * @param t
+     * @return It returns the number of samples of ps to use for the pixel
+     * (i, j) of the frame t.
+     */
+    virtual int getNumSamples(RandomSampler<3> *ps, int, int, int)
+    {
+        return int(ps->samplesR.size() / 3);
+    }
+
+    /**
+     * @brief getFrameData
+     * @param img
+     * @param window
+     * @param t
+     * @param offset
+     * @return It returns the frame t + offset of img, or of the window
+     * when streaming.
+     */
+    float *getFrameData(Image *img, TemporalWindow *window, int t, int offset)
+    {
+        if(bStreaming) {
+            return window->getFrame(offset)->data;
+        } else {
+            return img->data + CLAMP(t + offset, img->frames) * img->tstride;
+        }
+    }
+
+    /**
+     * @brief ProcessBBox
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBox(Image *dst, ImageVec src, BBox *box);
+
+    /**
+     * @brief ProcessWindow filters the center frame of the window.
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessWindow(Image *imgOut);
+
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
+    /**
+     * @brief getKernelFootprint
+     * @param imgIn
+     * @param footprintX
+     * @param footprintY
+     * @param footprintZ
+     */
+    void getKernelFootprint(ImageVec, int &footprintX, int &footprintY,
+                            int &footprintZ)
+    {
+        footprintX = pg->kernelSize;
+        footprintY = pg->kernelSize;
+        footprintZ = pg_t->kernelSize;
+    }
+
+public:
+
+    /**
+     * @brief FilterBilateral3DS
+     * @param sigma_s is the spatial sigma in pixels.
+     * @param sigma_r is the range sigma.
+     * @param sigma_t is the temporal sigma in frames.
+     * @param type
+     * @param mult is a multiplier of the number of samples.
+     */
+    FilterBilateral3DS(float sigma_s, float sigma_r, float sigma_t,
+                       SAMPLER_TYPE type = ST_BRIDSON, int mult = 1);
+
+    ~FilterBilateral3DS();
+
+    /**
+     * @brief Signature
+     * @return
+     */
+    std::string Signature()
+    {
+        return GenBilString("3DS", sigma_s, sigma_r) + "_St_" + fromNumberToString(sigma_t);
+    }
+
+    /**
+     * @brief getTemporalRadius
+     * @return It returns the number of frames before and after a frame
+     * used for filtering it; i.e. the latency of pushFrame.
+     */
+    int getTemporalRadius()
+    {
+        return pg_t->halfKernelSize;
+    }
+
+    /**
+     * @brief pushFrame adds the next frame of a stream.
+     * @param frame is the next frame.
+     * @param edge is the next frame of the edge stream for cross bilateral
+     * filtering; it is NULL otherwise.
+     * @param imgOut
+     * @return It returns the filtered frame number (pushed - getTemporalRadius() - 1)
+     * when it is available; NULL otherwise.
+     */
+    Image *pushFrame(Image *frame, Image *edge, Image *imgOut);
+
+    /**
+     * @brief flushFrame has to be called after the last pushFrame, until
+     * it returns NULL, to get the remaining filtered frames. After that,
+     * a new stream can be pushed.
+     * @param imgOut
+     * @return
+     */
+    Image *flushFrame(Image *imgOut);
+
+    /**
+     * @brief resetStream discards the frames of the current stream.
+     */
+    void resetStream()
+    {
+        window_base.reset();
+        window_edge.reset();
+    }
+
+    /**
+     * @brief Execute
+     * @param imgIn is a video; i.e. an image with frames > 1.
+     * @param imgOut
+     * @param sigma_s
+     * @param sigma_r
+     * @param sigma_t
+     * @return
+     */
+    static Image *Execute(Image *imgIn, Image *imgOut,
+                          float sigma_s, float sigma_r, float sigma_t)
+    {
+        FilterBilateral3DS filter(sigma_s, sigma_r, sigma_t);
+        return filter.ProcessP(Single(imgIn), imgOut);
+    }
+};
+
+PIC_INLINE FilterBilateral3DS::FilterBilateral3DS(float sigma_s, float sigma_r,
+        float sigma_t, SAMPLER_TYPE type, int mult)
+{
+    pg = NULL;
+    pg_t = NULL;
+    ms = NULL;
+    bStreaming = false;
+
+    int kernelSize = PrecomputedGaussian::getKernelSize(sigma_s);
+    int kernelSizeTime = PrecomputedGaussian::getKernelSize(sigma_t);
+
+    Init(type, sigma_s, sigma_r, sigma_t,
+         2 * MAX(kernelSize, kernelSizeTime) * MAX(mult, 1), 1);
+}
+
+PIC_INLINE FilterBilateral3DS::~FilterBilateral3DS()
+{
+    if(pg != NULL) {
+        delete pg;
+    }
+
+    if(pg_t != NULL) {
+        delete pg_t;
+    }
+
+    if(ms != NULL) {
+        delete ms;
+    }
+}
+
+PIC_INLINE void FilterBilateral3DS::Init(SAMPLER_TYPE type, float sigma_s,
+        float sigma_r, float sigma_t, int nSamples, int nLevels)
+{
+    //protected values are assigned/computed
+    this->sigma_s = sigma_s;
+    this->sigma_r = sigma_r;
+    this->sigma_t = sigma_t;
+
+    //Precomputation of the Gaussian kernels
+    pg = new PrecomputedGaussian(sigma_s);
+    pg_t = new PrecomputedGaussian(sigma_t);
+
+    //Poisson samples
+    Vec<3, int> window = Vec<3, int>(pg->halfKernelSize, pg->halfKernelSize,
+                                     pg_t->halfKernelSize);
+
+    int nMaxSamples = pg->kernelSize * pg->kernelSize * pg_t->kernelSize;
+    nSamples = MIN(nSamples, nMaxSamples);
+
+    ms = new MRSamplers<3>(type, window, nSamples, nLevels, 64);
+
+    //Sampler per pixel
+    std::mt19937 m(1);
+    shifter.resize(SHIFTER_SIZE * SHIFTER_SIZE);
+    for(unsigned int i = 0; i < shifter.size(); i++) {
+        shifter[i] = m();
+    }
+
+    window_base.setRadius(pg_t->halfKernelSize);
+    window_edge.setRadius(pg_t->halfKernelSize);
+}
+
+PIC_INLINE Image *FilterBilateral3DS::ProcessWindow(Image *imgOut)
+{
+    Image *base = window_base.getFrame(0);
+
+    ImageVec src;
+    if(window_edge.getNumPushed() > 0) {
+        src = Double(base, window_edge.getFrame(0));
+    } else {
+        src = Single(base);
+    }
+
+    bStreaming = true;
+    imgOut = ProcessP(src, imgOut);
+    bStreaming = false;
+
+    window_base.next();
+    window_edge.next();
+
+    return imgOut;
+}
+
+PIC_INLINE Image *FilterBilateral3DS::pushFrame(Image *frame, Image *edge,
+        Image *imgOut)
+{
+    if(frame == NULL) {
+        return NULL;
+    }
+
+    window_base.push(frame);
+
+    if(edge != NULL) {
+        window_edge.push(edge);
+    }
+
+    if(!window_base.isReady()) {
+        return NULL;
+    }
+
+    return ProcessWindow(imgOut);
+}
+
+PIC_INLINE Image *FilterBilateral3DS::flushFrame(Image *imgOut)
+{
+    window_base.finish();
+    window_edge.finish();
+
+    if(!window_base.isReady()) {
+        resetStream();
+        return NULL;
+    }
+
+    return ProcessWindow(imgOut);
+}
+
+PIC_INLINE void FilterBilateral3DS::ProcessBBox(Image *dst, ImageVec src,
+        BBox *box)
+{
+    Image *base = src[0];
+    Image *edge = (src.size() > 1) ? src[1] : src[0];
+    TemporalWindow *w_edge = (window_edge.getNumPushed() > 0) ? &window_edge : &window_base;
+
+    int width = dst->width;
+    int height = dst->height;
+    int channels = dst->channels;
+    int edgeChannels = edge->channels;
+
+    int hks = pg->halfKernelSize;
+    int hks_t = pg_t->halfKernelSize;
+
+    float sigma_r2 = sigma_r * sigma_r * 2.0f;
+
+    std::vector<float *> base_frames(pg_t->kernelSize), edge_frames(pg_t->kernelSize);
+    std::vector<float> tmpC(channels);
+
+    for(int t = box->z0; t < box->z1; t++) {
+        for(int k = 0; k < pg_t->kernelSize; k++) {
+            base_frames[k] = getFrameData(base, &window_base, t, k - hks_t);
+            edge_frames[k] = getFrameData(edge, w_edge, t, k - hks_t);
+        }
+
+        float *dst_t = bStreaming ? dst->data : (dst->data + t * dst->tstride);
+        float *edge_t = edge_frames[hks_t];
+        float *base_t = base_frames[hks_t];
+
+        for(int j = box->y0; j < box->y1; j++) {
+            unsigned int *shifter_row = &shifter[(j % SHIFTER_SIZE) * SHIFTER_SIZE];
+
+            for(int i = box->x0; i < box->x1; i++) {
+                int c = (j * width + i);
+                float *ref = &edge_t[c * edgeChannels];
+
+                for(int l = 0; l < channels; l++) {
+                    tmpC[l] = 0.0f;
+                }
+
+                float sum = 0.0f;
+
+                RandomSampler<3> *ps = ms->getSampler(shifter_row[i % SHIFTER_SIZE]);
+                int *samples = ps->samplesR.data();
+                int nSamples = getNumSamples(ps, i, j, t) * 3;
+
+                for(int k = 0; k < nSamples; k += 3) {
+                    int sx = samples[k    ];
+                    int sy = samples[k + 1];
+                    int st = samples[k + 2] + hks_t;
+
+                    //Spatio-temporal Gaussian kernel
+                    float Gauss1 = pg->coeff[sx + hks] * pg->coeff[sy + hks] *
+                                   pg_t->coeff[st];
+
+                    //Address
+                    int ci = CLAMPi(i + sx, 0, width - 1);
+                    int cj = CLAMPi(j + sy, 0, height - 1);
+                    int c2 = cj * width + ci;
+
+                    //Range Gaussian kernel
+                    float *cur_edge = &edge_frames[st][c2 * edgeChannels];
+
+                    float tmp = 0.0f;
+                    for(int l = 0; l < edgeChannels; l++) {
+                        float tmp3 = cur_edge[l] - ref[l];
+                        tmp += tmp3 * tmp3;
+                    }
+
+                    //Weight
+                    float tmp2 = Gauss1 * expf(-tmp / sigma_r2);
+                    sum += tmp2;
+
+                    //Filtering
+                    float *cur_base = &base_frames[st][c2 * channels];
+                    for(int l = 0; l < channels; l++) {
+                        tmpC[l] += cur_base[l] * tmp2;
+                    }
+                }
+
+                //Normalization
+                float *out = &dst_t[c * channels];
+                float *in = &base_t[c * channels];
+
+                if(sum > 0.0f) {
+                    for(int l = 0; l < channels; l++) {
+                        out[l] = tmpC[l] / sum;
+                    }
+                } else {
+                    for(int l = 0; l < channels; l++) {
+                        out[l] = in[l];
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_BILATERAL_3DS_HPP */
+
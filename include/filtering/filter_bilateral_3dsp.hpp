@@ -0,0 +1,316 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_BILATERAL_3DSP_HPP
+#define PIC_FILTERING_FILTER_BILATERAL_3DSP_HPP
+
+#include "filtering/filter_bilateral_1d.hpp"
+#include "filtering/filter_npasses.hpp"
+#include "filtering/temporal_window.hpp"
+#include "util/precomputed_gaussian.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterBilateral3DSP class is a separable approximation of the
+ * spatio-temporal bilateral filter: two spatial 1D passes followed by a
+ * temporal 1D pass. A video can be filtered at once (an Image with frames > 1)
+ * or streamed frame by frame (pushFrame/flushFrame); in the latter case,
+ * only the spatially filtered frames of the temporal window are kept in memory.
+ */
+class FilterBilateral3DSP: public FilterNPasses
+{
+protected:
+    FilterBilateral1D	filterS;
+    FilterBilateral1D	filterT;
+
+    //streaming
+    FilterNPasses		spatial;
+    Image				*imgSpatial;
+    PrecomputedGaussian	*pg_t;
+    TemporalWindow		window_base, window_edge;
+
+    /**
+     * @brief ProcessTemporal applies the temporal pass to the center frame
+     * of the window for the rows in [j0, j1).
+     * @param dst
+     * @param j0
+     * @param j1
+     */
+    void ProcessTemporal(Image *dst, int j0, int j1);
+
+    /**
+     * @brief ProcessWindow filters the center frame of the window.
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessWindow(Image *imgOut);
+
+public:
+
+    /**
+     * @brief FilterBilateral3DSP
+     * @param sigma_s is the spatial sigma in pixels.
+     * @param sigma_r is the range sigma.
+     * @param sigma_t is the temporal sigma in frames.
+     */
+    FilterBilateral3DSP(float sigma_s, float sigma_r, float sigma_t) :
+        filterS(sigma_s, sigma_r), filterT(sigma_t, sigma_r)
+    {
+        imgSpatial = NULL;
+        pg_t = NULL;
+
+        InsertFilter(&filterS);
+        InsertFilter(&filterS);
+        InsertFilter(&filterT);
+
+        spatial.InsertFilter(&filterS);
+        spatial.InsertFilter(&filterS);
+
+        Update(sigma_s, sigma_r, sigma_t);
+    }
+
+    ~FilterBilateral3DSP()
+    {
+        if(imgSpatial != NULL) {
+            delete imgSpatial;
+        }
+
+        if(pg_t != NULL) {
+            delete pg_t;
+        }
+    }
+
+    /**
+     * @brief Update
+     * @param sigma_s
+     * @param sigma_r
+     * @param sigma_t
+     */
+    void Update(float sigma_s, float sigma_r, float sigma_t)
+    {
+        filterS.Update(sigma_s, sigma_r);
+        filterT.Update(sigma_t, sigma_r);
+
+        if(pg_t != NULL) {
+            delete pg_t;
+        }
+
+        pg_t = new PrecomputedGaussian(sigma_t);
+
+        window_base.setRadius(pg_t->halfKernelSize);
+        window_edge.setRadius(pg_t->halfKernelSize);
+    }
+
+    /**
+     * @brief Signature
+     * @return
+     */
+    std::string Signature()
+    {
+        return GenBilString("3DSP", filterS.sigma_s, filterS.sigma_r) + "_St_" +
+               fromNumberToString(filterT.sigma_s);
+    }
+
+    /**
+     * @brief getTemporalRadius
+     * @return It returns the number of frames before and after a frame
+     * used for filtering it; i.e. the latency of pushFrame.
+     */
+    int getTemporalRadius()
+    {
+        return pg_t->halfKernelSize;
+    }
+
+    /**
+     * @brief pushFrame adds the next frame of a stream.
+     * @param frame is the next frame.
+     * @param edge is the next frame of the edge stream for cross bilateral
+     * filtering; it is NULL otherwise.
+     * @param imgOut
+     * @return It returns the filtered frame number (pushed - getTemporalRadius() - 1)
+     * when it is available; NULL otherwise.
+     */
+    Image *pushFrame(Image *frame, Image *edge, Image *imgOut);
+
+    /**
+     * @brief flushFrame has to be called after the last pushFrame, until
+     * it returns NULL, to get the remaining filtered frames. After that,
+     * a new stream can be pushed.
+     * @param imgOut
+     * @return
+     */
+    Image *flushFrame(Image *imgOut);
+
+    /**
+     * @brief resetStream discards the frames of the current stream.
+     */
+    void resetStream()
+    {
+        window_base.reset();
+        window_edge.reset();
+    }
+
+    /**
+     * @brief Execute
+     * @param imgIn is a video; i.e. an image with frames > 1.
+     * @param imgOut
+     * @param sigma_s
+     * @param sigma_r
+     * @param sigma_t
+     * @return
+     */
+    static Image *Execute(Image *imgIn, Image *imgOut, float sigma_s,
+                          float sigma_r, float sigma_t)
+    {
+        FilterBilateral3DSP filter(sigma_s, sigma_r, sigma_t);
+        return filter.ProcessP(Single(imgIn), imgOut);
+    }
+};
+
+PIC_INLINE Image *FilterBilateral3DSP::pushFrame(Image *frame, Image *edge,
+        Image *imgOut)
+{
+    if(frame == NULL) {
+        return NULL;
+    }
+
+    spatial.setThreadPool(pool);
+    spatial.setNumThreads(nThreads);
+
+    if(edge != NULL) {
+        imgSpatial = spatial.ProcessP(Double(frame, edge), imgSpatial);
+        window_edge.push(edge);
+    } else {
+        imgSpatial = spatial.ProcessP(Single(frame), imgSpatial);
+    }
+
+    window_base.push(imgSpatial);
+
+    if(!window_base.isReady()) {
+        return NULL;
+    }
+
+    return ProcessWindow(imgOut);
+}
+
+PIC_INLINE Image *FilterBilateral3DSP::flushFrame(Image *imgOut)
+{
+    window_base.finish();
+    window_edge.finish();
+
+    if(!window_base.isReady()) {
+        resetStream();
+        return NULL;
+    }
+
+    return ProcessWindow(imgOut);
+}
+
+PIC_INLINE Image *FilterBilateral3DSP::ProcessWindow(Image *imgOut)
+{
+    Image *center = window_base.getFrame(0);
+
+    if(imgOut == NULL) {
+        imgOut = center->allocateSimilarOne();
+    } else {
+        if(!center->isSimilarType(imgOut)) {
+            imgOut = center->allocateSimilarOne();
+        }
+    }
+
+    int height = imgOut->height;
+
+    if(getNumThreads() > 1) {
+        getThreadPool()->parallelForBlocks(0, height, getNumThreads(),
+            [this, imgOut](int j0, int j1) {
+                this->ProcessTemporal(imgOut, j0, j1);
+            });
+    } else {
+        ProcessTemporal(imgOut, 0, height);
+    }
+
+    window_base.next();
+    window_edge.next();
+
+    return imgOut;
+}
+
+PIC_INLINE void FilterBilateral3DSP::ProcessTemporal(Image *dst, int j0, int j1)
+{
+    TemporalWindow *w_edge = (window_edge.getNumPushed() > 0) ? &window_edge : &window_base;
+
+    int width = dst->width;
+    int channels = dst->channels;
+    int hks_t = pg_t->halfKernelSize;
+
+    float sigma_r = filterT.sigma_r;
+    float inv_sigma_r2 = 1.0f / (2.0f * sigma_r * sigma_r);
+
+    std::vector<float *> base_frames(pg_t->kernelSize), edge_frames(pg_t->kernelSize);
+
+    for(int k = 0; k < pg_t->kernelSize; k++) {
+        base_frames[k] = window_base.getFrame(k - hks_t)->data;
+        edge_frames[k] = w_edge->getFrame(k - hks_t)->data;
+    }
+
+    float *edge_t = edge_frames[hks_t];
+
+    for(int c = j0 * width; c < j1 * width; c++) {
+        float *tmpDst = &dst->data[c * channels];
+        float *tmpEdge = &edge_t[c * channels];
+
+        for(int l = 0; l < channels; l++) {
+            tmpDst[l] = 0.0f;
+        }
+
+        float sum = 0.0f;
+
+        for(int k = 0; k < pg_t->kernelSize; k++) {
+            //Range filtering
+            float *curEdge = &edge_frames[k][c * channels];
+
+            float tmp = 0.0f;
+            for(int l = 0; l < channels; l++) {
+                float diff = curEdge[l] - tmpEdge[l];
+                tmp += diff * diff;
+            }
+
+            //Weight
+            tmp = pg_t->coeff[k] * expf(-tmp * inv_sigma_r2);
+
+            //Filtering
+            float *curBase = &base_frames[k][c * channels];
+            for(int l = 0; l < channels; l++) {
+                tmpDst[l] += curBase[l] * tmp;
+            }
+
+            sum += tmp;
+        }
+
+        //Normalization
+        bool sumTest = sum > 0.0f;
+        for(int l = 0; l < channels; l++) {
+            tmpDst[l] = sumTest ? tmpDst[l] / sum : 0.0f;
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_BILATERAL_3DSP_HPP */
+
@@ -69,6 +69,15 @@ protected:
 
     int channel;
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
 
     /**
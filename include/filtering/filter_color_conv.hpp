@@ -20,20 +20,16 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "filtering/filter.hpp"
 #include "colors/color_conv.hpp"
+#include "colors/color_conv_chain.hpp"
 #include "colors/color_conv_rgb_to_xyz.hpp"
 #include "colors/color_conv_xyz_to_logluv.hpp"
 #include "colors/color_conv_xyz_to_cielab.hpp"
 
 namespace pic {
 
-struct ColorConvTransform
-{
-    ColorConv *f;
-    bool bDirection;
-};
-
 /**
- * @brief The FilterColorConv class
+ * @brief The FilterColorConv class applies a chain of color conversions;
+ * the chain is compiled (see ColorConvChain) before processing.
  */
 class FilterColorConv: public Filter
 {
@@ -42,6 +38,9 @@ protected:
     bool bDirection;
     unsigned int n;
 
+    ColorConvChain chain;
+    bool bChainDirection;
+
     /**
      * @brief ProcessBBox
      * @param dst
@@ -55,44 +54,54 @@ protected:
         }
 
         int channels = src[0]->channels;
+        int width = box->x1 - box->x0;
 
-        float *tmpCol = new float [channels];
-        float *tmp[2];
-
-        tmp[1] = tmpCol;
-
-        bool bEven = (n % 2) == 0;
+        for(int k = box->z0; k < box->z1; k++) {
+            for(int j = box->y0; j < box->y1; j++) {
+                float *dataIn  = (*src[0])(box->x0, j, k);
+                float *dataOut = (*dst)   (box->x0, j, k);
 
-        for(int j = box->y0; j < box->y1; j++) {
-
-            for(int i = box->x0; i < box->x1; i++) {
+                chain.apply(dataIn, dataOut, width, channels);
+            }
+        }
+    }
 
-                float *dataIn  = (*src[0]) (i, j);
-                float *dataOut = (*dst)    (i, j);
+    /**
+     * @brief SetupAux compiles the chain when the list or the direction
+     * have been changed.
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *SetupAux(ImageVec imgIn, Image *imgOut)
+    {
+        if(!chain.isCompiled() || (bChainDirection != bDirection)) {
+            chain.clear();
 
-                if(bEven) {
-                    tmp[1] = dataOut;
-                    tmp[0] = tmpCol;
-                } else {
-                    tmp[0] = dataOut;
-                    tmp[1] = tmpCol;
+            if(bDirection) {
+                for(unsigned int k = 0; k < n; k++) {
+                    chain.add(list[k].f, list[k].bDirection);
                 }
-
-                if(bDirection) { //direct color transform
-                    list[0].f->transform(dataIn, tmp[0], list[0].bDirection);
-                    for(unsigned int k = 1; k < n; k++) {
-                        list[k].f->transform(tmp[(k + 1) % 2], tmp[k % 2], list[k].bDirection);
-                    }
-                } else { //inverse color transform
-                    list[n - 1].f->transform(dataIn, tmp[0], !list[n - 1].bDirection);
-                    for(unsigned int k = 1; k < n; k++) {
-                        list[n - k - 1].f->transform(tmp[(k + 1) % 2], tmp[k % 2], !list[n - k - 1].bDirection);
-                    }
+            } else {
+                for(unsigned int k = 0; k < n; k++) {
+                    chain.add(list[n - k - 1].f, !list[n - k - 1].bDirection);
                 }
             }
+
+            chain.compile();
+            bChainDirection = bDirection;
         }
 
-        delete[] tmpCol;
+        return Filter::SetupAux(imgIn, imgOut);
+    }
+
+    /**
+     * @brief isRowStrip
+     * @return
+     */
+    bool isRowStrip()
+    {
+        return true;
     }
 
 public:
@@ -103,7 +112,8 @@ public:
     FilterColorConv()
     {
         this->bDirection = true;
-        n = -1;
+        bChainDirection = true;
+        n = 0;
     }
 
     /**
@@ -119,6 +129,7 @@ public:
             entry.bDirection = bDirection;
 
             list.push_back(entry);
+            chain.clear();
         }
 
         n = list.size();
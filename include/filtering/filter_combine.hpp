@@ -45,6 +45,15 @@ protected:
      */
     Image *SetupAux(ImageVec imgIn, Image *imgOut);
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
 
     /**
@@ -20,6 +20,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "filtering/filter.hpp"
 #include "util/precomputed_gaussian.hpp"
+#include "util/simd.hpp"
 
 namespace pic {
 
@@ -41,6 +42,207 @@ protected:
      */
     void ProcessBBox(Image *dst, ImageVec src, BBox *box);
 
+    /**
+     * @brief isSymmetric checks if the kernel is odd and symmetric.
+     * @return
+     */
+    bool isSymmetric()
+    {
+        if((n % 2) == 0) {
+            return false;
+        }
+
+        for(int k = 0; k < (n >> 1); k++) {
+            if(data[k] != data[n - 1 - k]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief convolveLine computes out[i] = sum_k kernel[k] * taps[k][i] for
+     * i in [0, len). All lines are contiguous, so the same code filters any
+     * direction and any number of channels; the inner loop runs on SIMD registers.
+     * @param out
+     * @param taps is an array of nTaps pointers.
+     * @param kernel
+     * @param nTaps
+     * @param len
+     */
+    template<bool bSymmetric>
+    static void convolveLine(float *out, const float **taps, const float *kernel,
+                             int nTaps, int len)
+    {
+        const int W = SIMDFloat::width;
+        int half = nTaps >> 1;
+
+        int i = 0;
+        for(; i <= (len - W); i += W) {
+            SIMDFloat acc;
+
+            if(bSymmetric) {
+                //taps k and nTaps - 1 - k share the same weight
+                acc = SIMDFloat::set1(kernel[half]) * SIMDFloat::load(taps[half] + i);
+
+                for(int k = 0; k < half; k++) {
+                    SIMDFloat sum = SIMDFloat::load(taps[k] + i) +
+                                    SIMDFloat::load(taps[nTaps - 1 - k] + i);
+                    acc = SIMDFloat::fmadd(SIMDFloat::set1(kernel[k]), sum, acc);
+                }
+            } else {
+                acc = SIMDFloat::set1(kernel[0]) * SIMDFloat::load(taps[0] + i);
+
+                for(int k = 1; k < nTaps; k++) {
+                    acc = SIMDFloat::fmadd(SIMDFloat::set1(kernel[k]),
+                                           SIMDFloat::load(taps[k] + i), acc);
+                }
+            }
+
+            acc.store(out + i);
+        }
+
+        for(; i < len; i++) {
+            float acc = 0.0f;
+
+            for(int k = 0; k < nTaps; k++) {
+                acc += kernel[k] * taps[k][i];
+            }
+
+            out[i] = acc;
+        }
+    }
+
+    /**
+     * @brief convolveMarginX filters the pixels of a row in [x0, x1) along
+     * x with clamped coordinates; it is used only close to the borders.
+     * @param out is the pixel x0 of the output row.
+     * @param row is the first pixel of the input row.
+     * @param x0
+     * @param x1
+     * @param width is the width of the row.
+     * @param channels is the number of channels; CH > 0 fixes it at compile time.
+     */
+    template<int CH>
+    void convolveMarginX(float *out, const float *row, int x0, int x1,
+                         int width, int channels)
+    {
+        if(CH > 0) {
+            channels = CH;
+        }
+
+        int half = n >> 1;
+
+        for(int x = x0; x < x1; x++) {
+            float *tmpDst = out + (x - x0) * channels;
+
+            for(int l = 0; l < channels; l++) {
+                tmpDst[l] = 0.0f;
+            }
+
+            for(int k = 0; k < n; k++) {
+                int cx = CLAMP(x + k - half, width);
+                const float *tmpSource = row + cx * channels;
+
+                for(int l = 0; l < channels; l++) {
+                    tmpDst[l] += tmpSource[l] * data[k];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessRowX filters a row segment along x: margins use
+     * convolveMarginX, and the interior convolveLine with no clamping.
+     * @param out is the pixel x0 of the output row.
+     * @param row is the first pixel of the input row.
+     * @param x0
+     * @param x1
+     * @param width
+     * @param channels
+     * @param taps is a buffer of n pointers.
+     * @param bSymmetric
+     */
+    void ProcessRowX(float *out, const float *row, int x0, int x1, int width,
+                     int channels, const float **taps, bool bSymmetric)
+    {
+        int half = n >> 1;
+
+        //interior pixels: all taps are inside the row
+        int xi0 = MIN(MAX(x0, half), x1);
+        int xi1 = MAX(MIN(x1, width - (n - 1 - half)), xi0);
+
+        switch(channels) {
+        case 1:
+            convolveMarginX<1>(out, row, x0, xi0, width, channels);
+            convolveMarginX<1>(out + (xi1 - x0), row, xi1, x1, width, channels);
+            break;
+        case 3:
+            convolveMarginX<3>(out, row, x0, xi0, width, channels);
+            convolveMarginX<3>(out + (xi1 - x0) * 3, row, xi1, x1, width, channels);
+            break;
+        case 4:
+            convolveMarginX<4>(out, row, x0, xi0, width, channels);
+            convolveMarginX<4>(out + (xi1 - x0) * 4, row, xi1, x1, width, channels);
+            break;
+        default:
+            convolveMarginX<0>(out, row, x0, xi0, width, channels);
+            convolveMarginX<0>(out + (xi1 - x0) * channels, row, xi1, x1, width, channels);
+            break;
+        }
+
+        if(xi1 <= xi0) {
+            return;
+        }
+
+        for(int k = 0; k < n; k++) {
+            taps[k] = row + (xi0 + k - half) * channels;
+        }
+
+        float *outInterior = out + (xi0 - x0) * channels;
+        int len = (xi1 - xi0) * channels;
+
+        if(bSymmetric) {
+            convolveLine<true>(outInterior, taps, data, n, len);
+        } else {
+            convolveLine<false>(outInterior, taps, data, n, len);
+        }
+    }
+
+    /**
+     * @brief getKernelFootprint
+     * @param imgIn
+     * @param footprintX
+     * @param footprintY
+     * @param footprintZ
+     */
+    void getKernelFootprint(ImageVec, int &footprintX, int &footprintY,
+                            int &footprintZ)
+    {
+        footprintX = (dirs[1] == 1) ? n : 1;
+        footprintY = (dirs[0] == 1) ? n : 1;
+        footprintZ = (dirs[2] == 1) ? n : 1;
+    }
+
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
+    /**
+     * @brief isRowStrip returns true for the horizontal pass.
+     * @return
+     */
+    bool isRowStrip()
+    {
+        return (dirs[1] == 1);
+    }
+
 public:
 
     /**
@@ -205,35 +407,55 @@ void FilterConv1D::ProcessBBox(Image *dst, ImageVec src, BBox *box)
 
     Image *source = src[0];
 
+    if((n < 1) || (data == NULL)) {
+        for(int m = box->z0; m < box->z1; m++) {
+            for(int j = box->y0; j < box->y1; j++) {
+                float *tmpDst = (*dst)(box->x0, j, m);
+
+                for(int i = 0; i < ((box->x1 - box->x0) * channels); i++) {
+                    tmpDst[i] = 0.0f;
+                }
+            }
+        }
+
+        return;
+    }
+
     int halfKernelSize = n >> 1;
+    bool bSymmetric = isSymmetric();
+
+    std::vector<const float *> taps(n);
+    int len = (box->x1 - box->x0) * channels;
 
     for(int m = box->z0; m < box->z1; m++) {
 
         for(int j = box->y0; j < box->y1; j++) {
+            float *tmpDst = (*dst)(box->x0, j, m);
+
+            if(dirs[1] == 1) {
+                //horizontal pass
+                float *row = (*source)(0, j, m);
+                ProcessRowX(tmpDst, row, box->x0, box->x1, source->width,
+                            channels, taps.data(), bSymmetric);
+                continue;
+            }
 
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmpDst = (*dst)(i, j, m);
-
-                for(int l = 0; l < channels; l++) {
-                    tmpDst[l] = 0.0f;
-                }
-
-                for(int k = 0; k < n; k++) { //1D Filtering
-                    int tmpCoord = k - halfKernelSize;
+            //vertical and temporal passes: each tap is a clamped row
+            for(int k = 0; k < n; k++) {
+                int tmpCoord = k - halfKernelSize;
 
-                    //Address cj
-                    int cj = j + tmpCoord * dirs[0];
-                    //Address ci
-                    int ci = i + tmpCoord * dirs[1];
-                    //Address cm
-                    int cm = m + tmpCoord * dirs[2];
+                //Address cj
+                int cj = j + tmpCoord * dirs[0];
+                //Address cm
+                int cm = m + tmpCoord * dirs[2];
 
-                    float *tmpSource = (*source)(ci, cj, cm);
+                taps[k] = (*source)(box->x0, cj, cm);
+            }
 
-                    for(int l = 0; l < channels; l++) {
-                        tmpDst[l] += tmpSource[l] * data[k];
-                    }
-                }
+            if(bSymmetric) {
+                convolveLine<true>(tmpDst, taps.data(), data, n, len);
+            } else {
+                convolveLine<false>(tmpDst, taps.data(), data, n, len);
             }
         }
     }
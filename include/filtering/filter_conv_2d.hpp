@@ -18,17 +18,46 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_CONV_2D_HPP
 #define PIC_FILTERING_FILTER_CONV_2D_HPP
 
+#include <vector>
+
 #include "filtering/filter.hpp"
+#include "filtering/filter_conv_1d.hpp"
+#include "util/fft.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterConv2D class
+ * @brief The CONV2D_MODE enum selects how FilterConv2D evaluates a convolution.
+ * CONV2D_AUTO picks the cheapest of the other modes for the kernel size.
+ */
+enum CONV2D_MODE {CONV2D_AUTO, CONV2D_DIRECT, CONV2D_SEPARABLE, CONV2D_FFT};
+
+/**
+ * @brief The FilterConv2D class convolves an image with a kernel (the first
+ * channel of the second input image). The convolution is evaluated directly,
+ * as two 1D passes when the kernel is separable (rank 1), or in the frequency
+ * domain on tiles (overlap-save) for large kernels; borders are clamped in
+ * all modes. The kernel spectrum is cached, so it is computed only once
+ * while the kernel does not change.
  */
 class FilterConv2D: public Filter
 {
 protected:
 
+    CONV2D_MODE mode, modeCurrent;
+
+    //separable mode
+    std::vector<float> kernel_x, kernel_y;
+
+    //FFT mode
+    int fft_nx, fft_ny;
+    int kernel_width, kernel_height;
+
+    //the kernel and the FFT size of kernel_spectrum
+    std::vector<float> kernel_taps;
+    int spectrum_nx, spectrum_ny;
+    std::vector<complexf> kernel_spectrum;
+
     /**
      * @brief ProcessBBox
      * @param dst
@@ -41,6 +70,11 @@ protected:
             return;
         }
 
+        if(modeCurrent == CONV2D_FFT) {
+            ProcessBBoxFFT(dst, src, box);
+            return;
+        }
+
         Image *img  = src[0];
         Image *conv = src[1];
 
@@ -76,14 +110,378 @@ protected:
         }
     }
 
+    /**
+     * @brief ProcessBBoxFFT computes the output of a box on tiles of
+     * (fft_nx - kernel_width + 1) x (fft_ny - kernel_height + 1) pixels: the
+     * input region of a tile, kernel margins included, is transformed,
+     * multiplied by the kernel spectrum, and transformed back; only the samples
+     * that are not affected by the circular wrap are kept.
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBoxFFT(Image *dst, ImageVec src, BBox *box)
+    {
+        Image *img = src[0];
+
+        int channels = dst->channels;
+        int c_width_h  = kernel_width >> 1;
+        int c_height_h = kernel_height >> 1;
+
+        int tw = fft_nx - kernel_width + 1;
+        int th = fft_ny - kernel_height + 1;
+
+        FFTPlanND plan(fft_nx, fft_ny);
+        plan.setNumThreads(1);
+
+        int n = fft_nx * fft_ny;
+        std::vector<float> block(n * channels);
+        std::vector<float> out(n);
+        std::vector<complexf> spectrum(plan.getSpectrumSize());
+
+        for(int y0 = box->y0; y0 < box->y1; y0 += th) {
+            for(int x0 = box->x0; x0 < box->x1; x0 += tw) {
+
+                for(int v = 0; v < fft_ny; v++) {
+                    for(int u = 0; u < fft_nx; u++) {
+                        float *img_data = (*img)(x0 - c_width_h + u, y0 - c_height_h + v);
+                        float *block_data = &block[(v * fft_nx + u) * channels];
+
+                        for(int c = 0; c < channels; c++) {
+                            block_data[c] = img_data[c];
+                        }
+                    }
+                }
+
+                int x1 = MIN(x0 + tw, box->x1);
+                int y1 = MIN(y0 + th, box->y1);
+
+                for(int c = 0; c < channels; c++) {
+                    plan.executeReal(block.data(), channels, c, spectrum.data());
+
+                    for(unsigned int i = 0; i < spectrum.size(); i++) {
+                        spectrum[i] *= kernel_spectrum[i];
+                    }
+
+                    plan.executeRealInverse(spectrum.data(), out.data(), 1, 0);
+
+                    for(int y = y0; y < y1; y++) {
+                        float *out_row = &out[(y - y0) * fft_nx];
+
+                        for(int x = x0; x < x1; x++) {
+                            (*dst)(x, y)[c] = out_row[x - x0];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief getKernelFootprint
+     * @param imgIn
+     * @param footprintX
+     * @param footprintY
+     * @param footprintZ
+     */
+    void getKernelFootprint(ImageVec imgIn, int &footprintX, int &footprintY,
+                            int &footprintZ)
+    {
+        if(imgIn.size() == 2) {
+            footprintX = imgIn[1]->width;
+            footprintY = imgIn[1]->height;
+        } else {
+            footprintX = 1;
+            footprintY = 1;
+        }
+
+        footprintZ = 1;
+    }
+
+    /**
+     * @brief getTileSize returns the FFT tiles in CONV2D_FFT mode.
+     * @param imgIn
+     * @param imgOut
+     * @param numThreads
+     * @param tileWidth
+     * @param tileHeight
+     * @param tileFrames
+     */
+    void getTileSize(ImageVec imgIn, Image *imgOut, int numThreads,
+                     int &tileWidth, int &tileHeight, int &tileFrames)
+    {
+        if(modeCurrent == CONV2D_FFT) {
+            tileWidth  = fft_nx - kernel_width + 1;
+            tileHeight = fft_ny - kernel_height + 1;
+            tileFrames = imgOut->frames;
+        } else {
+            Filter::getTileSize(imgIn, imgOut, numThreads, tileWidth, tileHeight,
+                                tileFrames);
+        }
+    }
+
+    /**
+     * @brief isSeparable checks if conv is the outer product of two 1D kernels.
+     * @param conv
+     * @param kx is the horizontal kernel.
+     * @param ky is the vertical kernel.
+     * @return
+     */
+    static bool isSeparable(Image *conv, std::vector<float> &kx, std::vector<float> &ky)
+    {
+        int w = conv->width;
+        int h = conv->height;
+
+        //the largest value selects the row and the column of the factors
+        int px = 0, py = 0;
+        float maxVal = 0.0f;
+        for(int y = 0; y < h; y++) {
+            for(int x = 0; x < w; x++) {
+                float val = fabsf((*conv)(x, y)[0]);
+
+                if(val > maxVal) {
+                    maxVal = val;
+                    px = x;
+                    py = y;
+                }
+            }
+        }
+
+        if(maxVal <= 0.0f) {
+            return false;
+        }
+
+        float pivot = (*conv)(px, py)[0];
+        kx.resize(w);
+        ky.resize(h);
+
+        for(int x = 0; x < w; x++) {
+            kx[x] = (*conv)(x, py)[0];
+        }
+
+        for(int y = 0; y < h; y++) {
+            ky[y] = (*conv)(px, y)[0] / pivot;
+        }
+
+        for(int y = 0; y < h; y++) {
+            for(int x = 0; x < w; x++) {
+                float err = fabsf((*conv)(x, y)[0] - kx[x] * ky[y]);
+
+                if(err > (maxVal * 1e-5f)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief getFFTCost estimates the cost per pixel of CONV2D_FFT.
+     * @param kw
+     * @param kh
+     * @param nx
+     * @param ny
+     * @return
+     */
+    static float getFFTCost(int kw, int kh, int nx, int ny)
+    {
+        float n = float(nx * ny);
+        float valid = float((nx - kw + 1) * (ny - kh + 1));
+        return 2.5f * n * log2f(n) / valid;
+    }
+
+    /**
+     * @brief getFFTSize computes the FFT length of a dimension.
+     * @param k is the kernel size.
+     * @param size is the image size.
+     * @return
+     */
+    static int getFFTSize(int k, int size)
+    {
+        int n = FFTPlan::getFastSize(MIN(MAX(8 * (k - 1), 64), 1024));
+        n = MAX(n, FFTPlan::getFastSize(2 * k));
+        return MIN(n, FFTPlan::getFastSize(size + k - 1));
+    }
+
+    /**
+     * @brief selectMode
+     * @param imgIn
+     * @return It returns the mode for the current inputs.
+     */
+    CONV2D_MODE selectMode(ImageVec imgIn)
+    {
+        Image *img = imgIn[0];
+        Image *conv = imgIn[1];
+
+        int kw = conv->width;
+        int kh = conv->height;
+
+        //even kernels are only handled by the direct evaluation
+        if(((kw % 2) == 0) || ((kh % 2) == 0) || (mode == CONV2D_DIRECT)) {
+            return CONV2D_DIRECT;
+        }
+
+        fft_nx = getFFTSize(kw, img->width);
+        fft_ny = getFFTSize(kh, img->height);
+
+        bool bSeparable = false;
+        if((mode == CONV2D_SEPARABLE) || (mode == CONV2D_AUTO)) {
+            bSeparable = isSeparable(conv, kernel_x, kernel_y);
+        }
+
+        if(mode == CONV2D_SEPARABLE) {
+            return bSeparable ? CONV2D_SEPARABLE : CONV2D_DIRECT;
+        }
+
+        if(mode == CONV2D_FFT) {
+            return CONV2D_FFT;
+        }
+
+        float cost_direct = float(kw * kh);
+        float cost_sep = bSeparable ? float(kw + kh) : cost_direct;
+        float cost_fft = getFFTCost(kw, kh, fft_nx, fft_ny);
+
+        if((cost_fft < cost_sep) && (cost_fft < cost_direct)) {
+            return CONV2D_FFT;
+        }
+
+        return cost_sep < cost_direct ? CONV2D_SEPARABLE : CONV2D_DIRECT;
+    }
+
+    /**
+     * @brief setupFFT computes the spectrum of the kernel, if the kernel or
+     * the FFT size changed since the last call.
+     * @param conv
+     */
+    void setupFFT(Image *conv)
+    {
+        int kw = conv->width;
+        int kh = conv->height;
+
+        std::vector<float> taps(kw * kh);
+        for(int y = 0; y < kh; y++) {
+            for(int x = 0; x < kw; x++) {
+                taps[y * kw + x] = (*conv)(x, y)[0];
+            }
+        }
+
+        if((kernel_width == kw) && (kernel_height == kh) &&
+           (spectrum_nx == fft_nx) && (spectrum_ny == fft_ny) &&
+           (taps == kernel_taps)) {
+            return;
+        }
+
+        kernel_width = kw;
+        kernel_height = kh;
+        kernel_taps.swap(taps);
+        spectrum_nx = fft_nx;
+        spectrum_ny = fft_ny;
+
+        FFTPlanND plan(fft_nx, fft_ny);
+
+        std::vector<float> kernel(fft_nx * fft_ny, 0.0f);
+        for(int y = 0; y < kh; y++) {
+            for(int x = 0; x < kw; x++) {
+                kernel[y * fft_nx + x] = kernel_taps[y * kw + x];
+            }
+        }
+
+        //the filter is a correlation, so the spectrum is conjugated
+        kernel_spectrum.resize(plan.getSpectrumSize());
+        plan.executeReal(kernel.data(), 1, 0, kernel_spectrum.data());
+
+        for(unsigned int i = 0; i < kernel_spectrum.size(); i++) {
+            kernel_spectrum[i] = std::conj(kernel_spectrum[i]);
+        }
+    }
+
+    /**
+     * @brief ProcessAux
+     * @param imgIn
+     * @param imgOut
+     * @param bParallel
+     * @return
+     */
+    Image *ProcessAux(ImageVec imgIn, Image *imgOut, bool bParallel)
+    {
+        if((imgIn.size() != 2) || (imgIn[0] == NULL) || (imgIn[1] == NULL)) {
+            modeCurrent = CONV2D_DIRECT;
+            return bParallel ? Filter::ProcessP(imgIn, imgOut) :
+                               Filter::Process(imgIn, imgOut);
+        }
+
+        modeCurrent = selectMode(imgIn);
+
+        if(modeCurrent == CONV2D_SEPARABLE) {
+            FilterConv1D flt(kernel_x.data(), int(kernel_x.size()), 0);
+            flt.setThreadPool(pool);
+            flt.setNumThreads(bParallel ? nThreads : 1);
+
+            flt.ChangePass(1, 0, 0);
+            Image *tmp = flt.ProcessP(Single(imgIn[0]), NULL);
+
+            flt.Init(kernel_y.data(), int(kernel_y.size()), 0);
+            flt.ChangePass(0, 1, 0);
+            imgOut = flt.ProcessP(Single(tmp), SetupAux(imgIn, imgOut));
+
+            delete tmp;
+            return imgOut;
+        }
+
+        if(modeCurrent == CONV2D_FFT) {
+            setupFFT(imgIn[1]);
+        }
+
+        return bParallel ? Filter::ProcessP(imgIn, imgOut) :
+                           Filter::Process(imgIn, imgOut);
+    }
+
 public:
 
     /**
      * @brief FilterConv2D
+     * @param mode
      */
-    FilterConv2D()
+    FilterConv2D(CONV2D_MODE mode = CONV2D_AUTO)
     {
+        this->mode = mode;
+        modeCurrent = CONV2D_DIRECT;
+
+        fft_nx = fft_ny = 0;
+        kernel_width = kernel_height = 0;
+        spectrum_nx = spectrum_ny = 0;
+    }
 
+    /**
+     * @brief setMode
+     * @param mode
+     */
+    void setMode(CONV2D_MODE mode)
+    {
+        this->mode = mode;
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, false);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessP(ImageVec imgIn, Image *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, true);
     }
 
     /**
@@ -41,6 +41,15 @@ protected:
      */
     void ProcessBBox(Image *dst, ImageVec src, BBox *box);
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
 
     /**
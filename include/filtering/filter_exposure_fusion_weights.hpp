@@ -76,10 +76,10 @@ protected:
                 float tmpL = src[0]->data[ind] - mu;
                 float pExp = expf(-(tmpL * tmpL) / sigma2);
 
-                //Final weights
-                dst->data[ind] =  powf(pCon, wC) *
-                                  powf(pExp, wE) *
-                                  powf(pSat, wS);
+                //Final weights; powf is skipped for unit exponents
+                dst->data[ind] = (wC == 1.0f ? pCon : powf(pCon, wC)) *
+                                 (wE == 1.0f ? pExp : powf(pExp, wE)) *
+                                 (wS == 1.0f ? pSat : powf(pSat, wS));
             }
         }
     }
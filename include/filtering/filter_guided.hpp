@@ -22,43 +22,70 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "util/math.hpp"
 
+#include <functional>
+
 namespace pic {
 
 /**
- * @brief The FilterGuided class
+ * @brief The FilterGuided class implements the guided filter of He et al.
+ * Local means and covariances are computed with O(1)-per-pixel box filters
+ * (running sums), so the cost does not depend on the radius. A subsampled
+ * variant (He and Sun's fast guided filter) computes the linear coefficients
+ * at a lower resolution and upsamples them bilinearly.
  */
 class FilterGuided: public Filter
 {
 protected:
 
-    int		radius;
-    float	e_regularization, nPixels;
+    int		radius, subsampling;
+    float	e_regularization;
 
     /**
-     * @brief Process1Channel
-     * @param I
-     * @param p
-     * @param q
-     * @param box
+     * @brief BoxFilter computes the mean over a (2 * radius + 1)^2 window
+     * of an interleaved buffer; borders are clamped.
+     * @param buf is the input buffer; it is overwritten with the horizontal sums.
+     * @param out is the output buffer.
+     * @param width
+     * @param height
+     * @param channels
+     * @param radius
+     * @param parallel
      */
-    void Process1Channel(Image *I, Image *p, Image *q, BBox *box);
+    void BoxFilter(float *buf, float *out, int width, int height, int channels,
+                   int radius, bool parallel);
 
     /**
-     * @brief Process3Channel
-     * @param I
-     * @param p
-     * @param q
-     * @param box
+     * @brief Downsample computes the box average of subsampling x subsampling blocks.
+     * @param img
+     * @param width
+     * @param height
+     * @return
+     */
+    Image *Downsample(Image *img, int width, int height);
+
+    /**
+     * @brief ProcessAux
+     * @param imgIn
+     * @param imgOut
+     * @param parallel
+     * @return
      */
-    void Process3Channel(Image *I, Image *p, Image *q, BBox *box);
+    Image *ProcessAux(ImageVec imgIn, Image *imgOut, bool parallel);
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief runRows runs func on blocks of rows.
+     * @param height
+     * @param parallel
+     * @param func
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box);
+    void runRows(int height, bool parallel, std::function<void(int, int)> func)
+    {
+        if(parallel) {
+            getThreadPool()->parallelForBlocks(0, height, getNumThreads(), func);
+        } else {
+            func(0, height);
+        }
+    }
 
 public:
 
@@ -67,25 +94,50 @@ public:
      */
     FilterGuided()
     {
-        Update(3, 0.1f);
+        Update(3, 0.1f, 1);
     }
 
     /**
      * @brief FilterGuided
      * @param radius
      * @param e_regularization
+     * @param subsampling is the subsampling factor of the fast guided filter;
+     * 1 means no subsampling.
      */
-    FilterGuided(int radius, float e_regularization)
+    FilterGuided(int radius, float e_regularization, int subsampling = 1)
     {
-        Update(radius, e_regularization);
+        Update(radius, e_regularization, subsampling);
     }
 
     /**
      * @brief Update
      * @param radius
      * @param e_regularization
+     * @param subsampling
+     */
+    void Update(int radius, float e_regularization, int subsampling = 1);
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, false);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
      */
-    void Update(int radius, float e_regularization);
+    Image *ProcessP(ImageVec imgIn, Image *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, true);
+    }
 
     /**
      * @brief Execute
@@ -94,165 +146,377 @@ public:
      * @param imgOut
      * @param radius
      * @param e_regularization
+     * @param subsampling
      * @return
      */
     static Image *Execute(Image *imgIn, Image *guide, Image *imgOut,
-                             int radius, float e_regularization)
+                             int radius, float e_regularization,
+                             int subsampling = 1)
     {
-        FilterGuided filter(radius, e_regularization);
+        FilterGuided filter(radius, e_regularization, subsampling);
         return filter.ProcessP(Double(imgIn, guide), imgOut);
     }
 };
 
-void FilterGuided::Update(int radius, float e_regularization)
+PIC_INLINE void FilterGuided::Update(int radius, float e_regularization, int subsampling)
 {
-    this->radius = radius;
+    this->radius = MAX(radius, 1);
     this->e_regularization = e_regularization;
-    nPixels = float(radius * radius * 4);
+    this->subsampling = MAX(subsampling, 1);
 }
 
-void FilterGuided::Process1Channel(Image *I, Image *p, Image *q,
-                                   BBox *box)
+PIC_INLINE void FilterGuided::BoxFilter(float *buf, float *out, int width, int height,
+                                        int channels, int radius, bool parallel)
 {
-    float I_mean, I_var;
-    float *p_mean = new float [p->channels];
+    int stride = width * channels;
+    float norm = 1.0f / float((2 * radius + 1) * (2 * radius + 1));
+
+    //horizontal running sums (in-place)
+    runRows(height, parallel, [=](int y0, int y1) {
+        std::vector<float> row(stride);
+        std::vector<double> acc(channels);
+
+        for(int j = y0; j < y1; j++) {
+            float *line = &buf[j * stride];
+            memcpy(&row[0], line, stride * sizeof(float));
+
+            for(int c = 0; c < channels; c++) {
+                acc[c] = 0.0;
+            }
+
+            for(int t = -radius; t <= radius; t++) {
+                int ind = CLAMP(t, width) * channels;
+
+                for(int c = 0; c < channels; c++) {
+                    acc[c] += row[ind + c];
+                }
+            }
+
+            for(int c = 0; c < channels; c++) {
+                line[c] = float(acc[c]);
+            }
+
+            for(int i = 1; i < width; i++) {
+                int ind_add = CLAMP(i + radius, width) * channels;
+                int ind_sub = CLAMP(i - radius - 1, width) * channels;
+                float *tmp = &line[i * channels];
 
-    for(int j = box->y0; j < box->y1; j++) {
-        for(int i = box->x0; i < box->x1; i++) {
-            float *tmpQ = (*q)(i, j);
-            float *tmpI   = (*I)(i, j);
+                for(int c = 0; c < channels; c++) {
+                    acc[c] += row[ind_add + c] - row[ind_sub + c];
+                    tmp[c] = float(acc[c]);
+                }
+            }
+        }
+    });
+
+    //vertical running sums
+    runRows(height, parallel, [=](int y0, int y1) {
+        std::vector<double> acc(stride, 0.0);
+
+        for(int t = -radius; t <= radius; t++) {
+            float *line = &buf[CLAMP(y0 + t, height) * stride];
+
+            for(int k = 0; k < stride; k++) {
+                acc[k] += line[k];
+            }
+        }
 
-            BBox tmpBox(i - radius, i + radius, j - radius, j + radius);
+        for(int j = y0; j < y1; j++) {
+            if(j > y0) {
+                float *line_add = &buf[CLAMP(j + radius, height) * stride];
+                float *line_sub = &buf[CLAMP(j - radius - 1, height) * stride];
 
-            I->getMeanVal(&tmpBox, &I_mean);
-            I->getVarianceVal(&I_mean, &tmpBox, &I_var);
+                for(int k = 0; k < stride; k++) {
+                    acc[k] += line_add[k] - line_sub[k];
+                }
+            }
 
-            p->getMeanVal(&tmpBox, p_mean);
+            float *line_out = &out[j * stride];
 
-            for(int c = 0; c < p->channels; c++) {
-                float I_mean_p_mean = I_mean * p_mean[c];
-                float a = 0.0f;
+            for(int k = 0; k < stride; k++) {
+                line_out[k] = float(acc[k]) * norm;
+            }
+        }
+    });
+}
 
-                for(int k = -radius; k < radius; k++) {
-                    for(int l = -radius; l < radius; l++) {
-                        float *I_i = (*I)(i + l, j + k);
-                        float *p_i = (*p)(i + l, j + k);
-                        a += I_i[0] * p_i[c] - I_mean_p_mean;
+PIC_INLINE Image *FilterGuided::Downsample(Image *img, int width, int height)
+{
+    Image *ret = new Image(1, width, height, img->channels);
+
+    int s = subsampling;
+    int channels = img->channels;
+
+    for(int j = 0; j < height; j++) {
+        for(int i = 0; i < width; i++) {
+            float *tmp_ret = (*ret)(i, j);
+
+            for(int c = 0; c < channels; c++) {
+                tmp_ret[c] = 0.0f;
+            }
+
+            int y1 = MIN((j + 1) * s, img->height);
+            int x1 = MIN((i + 1) * s, img->width);
+
+            for(int y = j * s; y < y1; y++) {
+                for(int x = i * s; x < x1; x++) {
+                    float *tmp_img = (*img)(x, y);
+
+                    for(int c = 0; c < channels; c++) {
+                        tmp_ret[c] += tmp_img[c];
                     }
                 }
+            }
 
-                a /= (nPixels * (I_var + e_regularization));
-                float b = p_mean[c] - a * I_mean;
-                tmpQ[c] = a * tmpI[0] + b;
+            float n = float((y1 - j * s) * (x1 - i * s));
+
+            for(int c = 0; c < channels; c++) {
+                tmp_ret[c] /= n;
             }
         }
     }
 
-    delete[] p_mean;
+    return ret;
 }
 
-PIC_INLINE void FilterGuided::Process3Channel(Image *I, Image *p,
-        Image *q, BBox *box)
+PIC_INLINE Image *FilterGuided::ProcessAux(ImageVec imgIn, Image *imgOut,
+                                          bool parallel)
 {
-    int channels = p->channels;
+    if(imgIn.size() < 1) {
+        return imgOut;
+    }
+
+    if(imgIn[0] == NULL) {
+        return imgOut;
+    }
 
-    float *buf = new float [channels * 4];
+    Image *I, *p;
 
-    float *I_mean	= &buf[0];
-    float *p_mean	= &buf[channels    ];
-    float *a		= &buf[channels * 2];
-    float *tmp_A	= &buf[channels * 3];
+    p = imgIn[0];
 
-    Matrix3x3 cov, inv;
+    if((imgIn.size() == 2) && (imgIn[1] != NULL)) {
+        I = imgIn[1];
+    } else {
+        I = imgIn[0];
+    }
 
-    for(int j = box->y0; j < box->y1; j++) {
-        for(int i = box->x0; i < box->x1; i++) {
-            float *tmpQ = (*q)(i, j);
-            float *tmpI = (*I)(i, j);
+    imgOut = SetupAux(imgIn, imgOut);
 
-            BBox tmpBox(i - radius, i + radius, j - radius, j + radius);
+    int cI = I->channels;
 
-            I->getMeanVal(&tmpBox, I_mean);
-            I->getCovMtxVal(I_mean, &tmpBox, cov.data);
+    if((cI != 1) && (cI != 3)) {
+        return imgOut;
+    }
 
-            //regularization
-            cov.Add(e_regularization);
-            //invert matrix
-            cov.Inverse(&inv);
+    //low resolution guide and input
+    Image *I_l = I;
+    Image *p_l = p;
+    int r = radius;
+    bool bSub = subsampling > 1;
 
-            p->getMeanVal(&tmpBox, p_mean);
+    if(bSub) {
+        int width_l  = (I->width  + subsampling - 1) / subsampling;
+        int height_l = (I->height + subsampling - 1) / subsampling;
 
-            for(int c = 0; c < channels; c++) {
+        I_l = Downsample(I, width_l, height_l);
+        p_l = (p == I) ? I_l : Downsample(p, width_l, height_l);
+        r = MAX(radius / subsampling, 1);
+    }
 
-                for(int n = 0; n < channels; n++) {
-                    tmp_A[n] = 0.0f;
-                }
+    int width  = I_l->width;
+    int height = I_l->height;
+    int nPixels = width * height;
+    int cp = p->channels;
 
-                for(int k = -radius; k < radius; k++) {
-                    for(int l = -radius; l < radius; l++) {
-                        float *I_i = (*I)(i + l, j + k);
-                        float *p_i = (*p)(i + l, j + k);
+    //guide statistics: mean of I and of its products (upper triangle)
+    int nCov = (cI * (cI + 1)) / 2;
+    int nG = cI + nCov;
+    //per channel: p and I * p, then the coefficients a and b
+    int nA = cI + 1;
 
-                        for(int n = 0; n < channels; n++) {
-                            tmp_A[n] += I_i[n] * p_i[c] - I_mean[n] * p_mean[c];
-                        }
-                    }
+    float *bufG = new float[nPixels * nG];
+    float *stat = new float[nPixels * nG];
+    float *bufA = new float[nPixels * nA];
+    float *bufB = new float[nPixels * nA];
+
+    float eps = e_regularization;
+
+    runRows(height, parallel, [=](int y0, int y1) {
+        for(int ind = y0 * width; ind < y1 * width; ind++) {
+            float *tmp_I = &I_l->data[ind * cI];
+            float *tmp_G = &bufG[ind * nG];
+
+            int k = cI;
+            for(int n = 0; n < cI; n++) {
+                tmp_G[n] = tmp_I[n];
+
+                for(int m = n; m < cI; m++) {
+                    tmp_G[k] = tmp_I[n] * tmp_I[m];
+                    k++;
                 }
+            }
+        }
+    });
+
+    BoxFilter(bufG, stat, width, height, nG, r, parallel);
+
+    //covariance regularization and inversion; stat stores mean_I and
+    //the upper triangle of (Sigma + eps * Id)^-1
+    runRows(height, parallel, [=](int y0, int y1) {
+        for(int ind = y0 * width; ind < y1 * width; ind++) {
+            float *tmp = &stat[ind * nG];
+
+            if(cI == 1) {
+                float var = tmp[1] - tmp[0] * tmp[0];
+                tmp[1] = 1.0f / (var + eps);
+            } else {
+                float *mu = tmp;
+                double s00 = tmp[3] - mu[0] * mu[0] + eps;
+                double s01 = tmp[4] - mu[0] * mu[1];
+                double s02 = tmp[5] - mu[0] * mu[2];
+                double s11 = tmp[6] - mu[1] * mu[1] + eps;
+                double s12 = tmp[7] - mu[1] * mu[2];
+                double s22 = tmp[8] - mu[2] * mu[2] + eps;
+
+                double i00 = s11 * s22 - s12 * s12;
+                double i01 = s02 * s12 - s01 * s22;
+                double i02 = s01 * s12 - s02 * s11;
+                double i11 = s00 * s22 - s02 * s02;
+                double i12 = s01 * s02 - s00 * s12;
+                double i22 = s00 * s11 - s01 * s01;
+
+                double det = s00 * i00 + s01 * i01 + s02 * i02;
+                det = (fabs(det) > 1e-20) ? (1.0 / det) : 0.0;
+
+                tmp[3] = float(i00 * det);
+                tmp[4] = float(i01 * det);
+                tmp[5] = float(i02 * det);
+                tmp[6] = float(i11 * det);
+                tmp[7] = float(i12 * det);
+                tmp[8] = float(i22 * det);
+            }
+        }
+    });
+
+    float scale_x = float(width)  / float(imgOut->width);
+    float scale_y = float(height) / float(imgOut->height);
 
-                for(int n = 0; n < channels; n++) {
-                    tmp_A[n] /= nPixels;
+    for(int c = 0; c < cp; c++) {
+        //p and I * p
+        runRows(height, parallel, [=](int y0, int y1) {
+            for(int ind = y0 * width; ind < y1 * width; ind++) {
+                float *tmp_I = &I_l->data[ind * cI];
+                float *tmp_A = &bufA[ind * nA];
+                float val = p_l->data[ind * cp + c];
+
+                tmp_A[0] = val;
+
+                for(int n = 0; n < cI; n++) {
+                    tmp_A[n + 1] = tmp_I[n] * val;
                 }
+            }
+        });
 
-                //multiply for inverted matrix
-                inv.Mul(tmp_A, a);
+        BoxFilter(bufA, bufB, width, height, nA, r, parallel);
 
-                float a_dot_I_mean = 0.0f;
+        //coefficients: bufA = [a_0, ..., a_(cI - 1), b]
+        runRows(height, parallel, [=](int y0, int y1) {
+            float cov[3];
 
-                for(int n = 0; n < channels; n++) {
-                    a_dot_I_mean += a[n] * I_mean[n];
+            for(int ind = y0 * width; ind < y1 * width; ind++) {
+                float *tmp_B = &bufB[ind * nA];
+                float *tmp_S = &stat[ind * nG];
+                float *tmp_A = &bufA[ind * nA];
+
+                float p_mean = tmp_B[0];
+
+                for(int n = 0; n < cI; n++) {
+                    cov[n] = tmp_B[n + 1] - tmp_S[n] * p_mean;
                 }
 
-                float b = p_mean[c] - a_dot_I_mean;
+                if(cI == 1) {
+                    tmp_A[0] = cov[0] * tmp_S[1];
+                } else {
+                    float *inv = &tmp_S[3];
+                    tmp_A[0] = inv[0] * cov[0] + inv[1] * cov[1] + inv[2] * cov[2];
+                    tmp_A[1] = inv[1] * cov[0] + inv[3] * cov[1] + inv[4] * cov[2];
+                    tmp_A[2] = inv[2] * cov[0] + inv[4] * cov[1] + inv[5] * cov[2];
+                }
 
-                float a_dot_I = 0.0f;
+                float b = p_mean;
 
-                for(int n = 0; n < channels; n++) {
-                    a_dot_I += a[n] * tmpI[n];
+                for(int n = 0; n < cI; n++) {
+                    b -= tmp_A[n] * tmp_S[n];
                 }
 
-                tmpQ[c] = a_dot_I + b;
+                tmp_A[cI] = b;
             }
-        }
-    }
+        });
+
+        BoxFilter(bufA, bufB, width, height, nA, r, parallel);
+
+        //output: q = mean_a * I + mean_b
+        runRows(imgOut->height, parallel, [=](int y0, int y1) {
+            float coeff[4];
+
+            for(int j = y0; j < y1; j++) {
+                for(int i = 0; i < imgOut->width; i++) {
+                    float *tmp_B;
+
+                    if(bSub) {
+                        float x = MAX((float(i) + 0.5f) * scale_x - 0.5f, 0.0f);
+                        float y = MAX((float(j) + 0.5f) * scale_y - 0.5f, 0.0f);
+
+                        int ix = MIN(int(x), width - 1);
+                        int iy = MIN(int(y), height - 1);
+                        int ix1 = MIN(ix + 1, width - 1);
+                        int iy1 = MIN(iy + 1, height - 1);
+                        float dx = x - float(ix);
+                        float dy = y - float(iy);
+
+                        float *b00 = &bufB[(iy  * width + ix ) * nA];
+                        float *b10 = &bufB[(iy  * width + ix1) * nA];
+                        float *b01 = &bufB[(iy1 * width + ix ) * nA];
+                        float *b11 = &bufB[(iy1 * width + ix1) * nA];
+
+                        for(int n = 0; n < nA; n++) {
+                            float t0 = b00[n] + (b10[n] - b00[n]) * dx;
+                            float t1 = b01[n] + (b11[n] - b01[n]) * dx;
+                            coeff[n] = t0 + (t1 - t0) * dy;
+                        }
 
-    delete[] buf;
-}
+                        tmp_B = coeff;
+                    } else {
+                        tmp_B = &bufB[(j * width + i) * nA];
+                    }
 
-PIC_INLINE void FilterGuided::ProcessBBox(Image *dst, ImageVec src,
-        BBox *box)
-{
-    Image *I, *p;
+                    float *tmp_I = (*I)(i, j);
+                    float val = tmp_B[cI];
 
-    if(src.size() == 2) {
-        p = src[0];
+                    for(int n = 0; n < cI; n++) {
+                        val += tmp_B[n] * tmp_I[n];
+                    }
 
-        if(src[1] != NULL) {
-            I = src[1];
-        } else {
-            I = src[0];
-        }
-    } else {
-        I = src[0];
-        p = src[0];
+                    (*imgOut)(i, j)[c] = val;
+                }
+            }
+        });
     }
 
-    if(I->channels == 1) {
-        Process1Channel(I, p, dst, box);
-    }
+    delete[] bufG;
+    delete[] stat;
+    delete[] bufA;
+    delete[] bufB;
 
-    if(I->channels == 3) {
-        Process3Channel(I, p, dst, box);
+    if(bSub) {
+        if(p_l != I_l) {
+            delete p_l;
+        }
+
+        delete I_l;
     }
+
+    return imgOut;
 }
 
 } // end namespace pic
@@ -180,6 +180,15 @@ protected:
         delete[] buf;
     }
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
     /**
      * @brief FilterKuwahara
@@ -18,65 +18,22 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_MAX_HPP
 #define PIC_FILTERING_FILTER_MAX_HPP
 
-#include "filtering/filter.hpp"
+#include "filtering/filter_rank.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterMax class
+ * @brief The FilterMax class computes the maximum of a square window.
  */
-class FilterMax: public Filter
+class FilterMax: public FilterRank
 {
-protected:
-    int halfSize;
-
-    /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
-     */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
-    {
-        int width = dst->width;
-        int channels = dst->channels;
-
-        float *data = src[0]->data;
-        
-        for(int j = box->y0; j < box->y1; j++) {
-            int ind = j * width;
-
-            for(int i = box->x0; i < box->x1; i++) {
-                //Central weight
-                int c = (ind + i) * channels;
-
-                for(int ch = 0; ch < channels; ch++) {
-                    float maxVal = -FLT_MAX;
-
-                    for(int k = -halfSize; k <= halfSize; k++) {
-                        int ci = CLAMP((i + k), dst->width);
-
-                        for(int l = -halfSize; l <= halfSize; l++) {
-                            int cj = CLAMP((j + l), dst->height);
-                            float tmp = data[(cj * width + ci) * channels + ch];
-                            maxVal = maxVal > tmp ? maxVal : tmp;
-                        }
-                    }
-
-                    dst->data[c + ch] = maxVal;
-                }
-            }
-        }
-    }
-
 public:
     /**
      * @brief FilterMax
      * @param size
      */
-    FilterMax(int size)
+    FilterMax(int size) : FilterRank(size, RT_MAX)
     {
-        this->halfSize = checkHalfSize(size);
     }
 
     /**
@@ -111,4 +68,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FILTERING_FILTER_MAX_HPP */
-
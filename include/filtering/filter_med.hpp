@@ -18,71 +18,22 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_MED_HPP
 #define PIC_FILTERING_FILTER_MED_HPP
 
-#include "filtering/filter.hpp"
+#include "filtering/filter_rank.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterMed class
+ * @brief The FilterMed class computes the median of a square window.
  */
-class FilterMed: public Filter
+class FilterMed: public FilterRank
 {
-protected:
-    int halfSize;
-
-    /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
-     */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
-    {
-        int width = dst->width;
-        int i, j, k, l, ch, c, c2;
-        int ci, cj;
-
-        float *data = src[0]->data;
-        int areaKernel = (halfSize * 2 + 1) * (halfSize * 2 + 1);
-        float *values = new float[areaKernel];
-
-        int channels = dst->channels;
-
-        for(j = box->y0; j < box->y1; j++) {
-            for(i = box->x0; i < box->x1; i++) {
-                //Central weight
-                c = (j * width + i) * channels;
-
-                for(ch = 0; ch < channels; ch++) {
-                    c2 = 0;
-
-                    for(k = -halfSize; k <= halfSize; k++) {
-                        ci = CLAMP((i + k), dst->width);
-
-                        for(l = -halfSize; l <= halfSize; l++) {
-                            cj = CLAMP((j + l), dst->height);
-                            values[c2] = data[(cj * width + ci) * channels + ch];
-                            c2++;
-                        }
-                    }
-
-                    std::sort(values, values + areaKernel);
-                    dst->data[c + ch] = values[areaKernel >> 1];
-                }
-            }
-        }
-
-        delete[] values;
-    }
-
 public:
     /**
      * @brief FilterMed
      * @param size
      */
-    FilterMed(int size)
+    FilterMed(int size) : FilterRank(size, RT_MEDIAN)
     {
-        this->halfSize = checkHalfSize(size);
     }
 
     /**
@@ -117,4 +68,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FILTERING_FILTER_MED_HPP */
-
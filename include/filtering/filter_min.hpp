@@ -18,63 +18,22 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_MIN_HPP
 #define PIC_FILTERING_FILTER_MIN_HPP
 
-#include "filtering/filter.hpp"
+#include "filtering/filter_rank.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterMin class
+ * @brief The FilterMin class computes the minimum of a square window.
  */
-class FilterMin: public Filter
+class FilterMin: public FilterRank
 {
-protected:
-    int halfSize;
-
-    /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
-     */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
-    {
-        int width = dst->width;
-        int channels = dst->channels;
-
-        float *data = src[0]->data;
-
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                int c = (j * width + i) * channels;
-
-                for(int ch = 0; ch < channels; ch++) {
-                    float minVal = FLT_MAX;
-
-                    for(int k = -halfSize; k <= halfSize; k++) {
-                        int ci = CLAMP((i + k), dst->width);
-
-                        for(int l = -halfSize; l <= halfSize; l++) {
-                            int cj = CLAMP((j + l), dst->height);
-                            float tmp = data[(cj * width + ci) * channels + ch];
-                            minVal = minVal > tmp ? tmp : minVal;
-                        }
-                    }
-
-                    dst->data[c + ch] = minVal;
-                }
-            }
-        }
-    }
-
 public:
-
     /**
      * @brief FilterMin
      * @param size
      */
-    FilterMin(int size)
+    FilterMin(int size) : FilterRank(size, RT_MIN)
     {
-        this->halfSize = checkHalfSize(size);
     }
 
     /**
@@ -86,7 +45,7 @@ public:
      */
     static Image *Execute(Image *imgIn, Image *imgOut, int size)
     {
-        FilterMed filter(size);
+        FilterMin filter(size);
         return filter.ProcessP(Single(imgIn), imgOut);
     }
 
@@ -109,4 +68,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FILTERING_FILTER_MIN_HPP */
-
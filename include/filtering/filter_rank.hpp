@@ -0,0 +1,496 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_RANK_HPP
+#define PIC_FILTERING_FILTER_RANK_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "filtering/filter.hpp"
+
+namespace pic {
+
+//the maximum number of distinct values for using histograms
+#define PIC_RANK_MAX_LEVELS 256
+
+enum RANK_TYPE {RT_MIN, RT_MEDIAN, RT_MAX};
+
+/**
+ * @brief The FilterRank class is the engine of rank filters over
+ * a (2 * halfSize + 1)^2 window with clamped borders:
+ * \li \c RT_MIN and RT_MAX use van Herk/Gil-Werman running extrema;
+ * i.e. three comparisons per pixel and pass independently of the radius.
+ * \li \c RT_MEDIAN uses sliding column histograms (Perreault and Hebert)
+ * when a channel has at most PIC_RANK_MAX_LEVELS distinct values (e.g. LDR images);
+ * the cost per pixel does not depend on the radius. Otherwise (e.g. HDR images),
+ * it keeps the window in a sorted order-statistic tree (Fenwick tree over ranks),
+ * which costs O(r log r) per pixel instead of O(r^2 log r).
+ *
+ * Images are processed in full-height column strips, so the histograms
+ * and the scratch buffers are set up once per strip.
+ */
+class FilterRank: public Filter
+{
+protected:
+    int halfSize;
+    RANK_TYPE type;
+
+    //distinct values of each channel; empty if there are too many.
+    std::vector< std::vector<float> > levels;
+
+    /**
+     * @brief computeLevels collects the distinct values of each channel.
+     * @param img
+     */
+    void computeLevels(Image *img)
+    {
+        levels.clear();
+
+        if(type != RT_MEDIAN) {
+            return;
+        }
+
+        int channels = img->channels;
+        int n = img->width * img->height;
+
+        levels.resize(channels);
+
+        for(int c = 0; c < channels; c++) {
+            std::vector<float> &lev = levels[c];
+
+            for(int i = 0; i < n; i++) {
+                float val = img->data[i * channels + c];
+
+                std::vector<float>::iterator it = std::lower_bound(lev.begin(), lev.end(), val);
+
+                if((it == lev.end()) || (*it != val)) {
+                    if(lev.size() >= PIC_RANK_MAX_LEVELS) {
+                        lev.clear();
+                        break;
+                    }
+
+                    lev.insert(it, val);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief getTileSize splits the image into full-height column strips.
+     * @param imgIn
+     * @param imgOut
+     * @param numThreads
+     * @param tileWidth
+     * @param tileHeight
+     * @param tileFrames
+     */
+    void getTileSize(ImageVec, Image *imgOut, int numThreads,
+                     int &tileWidth, int &tileHeight, int &tileFrames)
+    {
+        int nStrips = MAX(numThreads * 2, 1);
+        int minWidth = MAX(halfSize * 2, 16);
+
+        tileWidth  = MAX((imgOut->width + nStrips - 1) / nStrips, minWidth);
+        tileHeight = imgOut->height;
+        tileFrames = imgOut->frames;
+    }
+
+    /**
+     * @brief RunningExtrema1D computes the running maximum (or minimum) of
+     * a window of size w with the van Herk/Gil-Werman algorithm.
+     * @param f is the input array of size n + w - 1.
+     * @param g is the output array of size n.
+     * @param n
+     * @param w
+     * @param L is a buffer of size n + w - 1.
+     * @param R is a buffer of size n + w - 1.
+     * @param bMax
+     */
+    static void RunningExtrema1D(float *f, float *g, int n, int w,
+                                 float *L, float *R, bool bMax)
+    {
+        int m = n + w - 1;
+
+        for(int b = 0; b < m; b += w) {
+            int e = MIN(b + w, m);
+
+            R[b] = f[b];
+            for(int k = b + 1; k < e; k++) {
+                R[k] = bMax ? MAX(R[k - 1], f[k]) : MIN(R[k - 1], f[k]);
+            }
+
+            L[e - 1] = f[e - 1];
+            for(int k = e - 2; k >= b; k--) {
+                L[k] = bMax ? MAX(L[k + 1], f[k]) : MIN(L[k + 1], f[k]);
+            }
+        }
+
+        for(int i = 0; i < n; i++) {
+            float a = L[i];
+            float b = R[i + w - 1];
+            g[i] = bMax ? MAX(a, b) : MIN(a, b);
+        }
+    }
+
+    /**
+     * @brief ProcessExtrema
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessExtrema(Image *dst, Image *src, BBox *box)
+    {
+        int r = halfSize;
+        int w = 2 * r + 1;
+        int channels = dst->channels;
+        bool bMax = (type == RT_MAX);
+
+        int bw = box->x1 - box->x0;
+        int bh = box->y1 - box->y0;
+        int bh_p = bh + 2 * r;
+
+        int n = MAX(bw, bh) + 2 * r;
+        std::vector<float> buf(n * 4);
+        float *f = &buf[0];
+        float *g = &buf[n];
+        float *L = &buf[n * 2];
+        float *R = &buf[n * 3];
+
+        //horizontal pass on the rows needed by the vertical pass
+        std::vector<float> H(bh_p * bw * channels);
+
+        for(int y = 0; y < bh_p; y++) {
+            int sy = CLAMP(box->y0 - r + y, src->height);
+
+            for(int c = 0; c < channels; c++) {
+                for(int k = 0; k < (bw + 2 * r); k++) {
+                    int sx = CLAMP(box->x0 - r + k, src->width);
+                    f[k] = src->data[(sy * src->width + sx) * src->channels + c];
+                }
+
+                RunningExtrema1D(f, g, bw, w, L, R, bMax);
+
+                for(int i = 0; i < bw; i++) {
+                    H[(y * bw + i) * channels + c] = g[i];
+                }
+            }
+        }
+
+        //vertical pass
+        for(int i = 0; i < bw; i++) {
+            for(int c = 0; c < channels; c++) {
+                for(int k = 0; k < bh_p; k++) {
+                    f[k] = H[(k * bw + i) * channels + c];
+                }
+
+                RunningExtrema1D(f, g, bh, w, L, R, bMax);
+
+                for(int j = 0; j < bh; j++) {
+                    dst->data[((box->y0 + j) * dst->width + box->x0 + i) * channels + c] = g[j];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessMedianHistogram computes the median of a channel
+     * with sliding column histograms.
+     * @param dst
+     * @param src
+     * @param box
+     * @param c
+     */
+    void ProcessMedianHistogram(Image *dst, Image *src, BBox *box, int c)
+    {
+        std::vector<float> &lev = levels[c];
+
+        int r = halfSize;
+        int nLevels = int(lev.size());
+        int nFine = 16;
+        int nCoarse = (nLevels + nFine - 1) / nFine;
+        int medianIndex = ((2 * r + 1) * (2 * r + 1)) >> 1;
+
+        int width = src->width;
+        int channels = src->channels;
+        int bw = box->x1 - box->x0;
+        int nCols = bw + 2 * r;
+
+        //quantized values of the strip: columns [x0 - r, x1 + r)
+        std::vector<int> hist(nCols * nLevels, 0);
+        std::vector<int> kernelFine(nLevels);
+        std::vector<int> kernelCoarse(nCoarse);
+
+        std::vector<int> colIndex(nCols);
+        for(int k = 0; k < nCols; k++) {
+            colIndex[k] = CLAMP(box->x0 - r + k, width);
+        }
+
+        int *data_hist = &hist[0];
+
+        //level of a value
+        auto getLevel = [&lev, nLevels](float val) {
+            return int(std::lower_bound(lev.begin(), lev.end(), val) - lev.begin());
+        };
+
+        auto updateRow = [&](int y, int delta) {
+            int sy = CLAMP(y, src->height);
+            float *row = &src->data[sy * width * channels];
+
+            for(int k = 0; k < nCols; k++) {
+                int l = getLevel(row[colIndex[k] * channels + c]);
+                data_hist[k * nLevels + l] += delta;
+            }
+        };
+
+        //column histograms for the first row
+        for(int t = -r; t <= r; t++) {
+            updateRow(box->y0 + t, 1);
+        }
+
+        for(int j = box->y0; j < box->y1; j++) {
+            if(j > box->y0) {
+                updateRow(j - r - 1, -1);
+                updateRow(j + r, 1);
+            }
+
+            //kernel histogram
+            std::fill(kernelFine.begin(), kernelFine.end(), 0);
+            std::fill(kernelCoarse.begin(), kernelCoarse.end(), 0);
+
+            for(int k = 0; k < (2 * r + 1); k++) {
+                int *h = &data_hist[k * nLevels];
+
+                for(int l = 0; l < nLevels; l++) {
+                    kernelFine[l] += h[l];
+                    kernelCoarse[l / nFine] += h[l];
+                }
+            }
+
+            float *dst_row = &dst->data[j * dst->width * dst->channels];
+
+            for(int i = 0; i < bw; i++) {
+                if(i > 0) {
+                    int *h_add = &data_hist[(i + 2 * r) * nLevels];
+                    int *h_sub = &data_hist[(i - 1) * nLevels];
+
+                    for(int l = 0; l < nLevels; l++) {
+                        int d = h_add[l] - h_sub[l];
+                        kernelFine[l] += d;
+                        kernelCoarse[l / nFine] += d;
+                    }
+                }
+
+                //coarse-to-fine search of the median
+                int count = 0;
+                int cb = 0;
+
+                while((cb < (nCoarse - 1)) && ((count + kernelCoarse[cb]) <= medianIndex)) {
+                    count += kernelCoarse[cb];
+                    cb++;
+                }
+
+                int l = cb * nFine;
+                int l_end = MIN(l + nFine, nLevels) - 1;
+
+                while((l < l_end) && ((count + kernelFine[l]) <= medianIndex)) {
+                    count += kernelFine[l];
+                    l++;
+                }
+
+                dst_row[(box->x0 + i) * dst->channels + c] = lev[l];
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessMedianSorted computes the median of a channel keeping the
+     * window in a Fenwick tree over the ranks of the values of the current rows.
+     * @param dst
+     * @param src
+     * @param box
+     * @param c
+     */
+    void ProcessMedianSorted(Image *dst, Image *src, BBox *box, int c)
+    {
+        int r = halfSize;
+        int w = 2 * r + 1;
+        int medianIndex = (w * w) >> 1;
+
+        int width = src->width;
+        int channels = src->channels;
+        int bw = box->x1 - box->x0;
+        int nCols = bw + 2 * r;
+        int n = nCols * w;
+
+        std::vector<float> values(n);
+        std::vector<float> sorted(n);
+        std::vector<int> order(n);
+        std::vector<int> rank(n);
+        std::vector<int> tree(n + 1);
+
+        int logN = 1;
+        while((1 << logN) <= n) {
+            logN++;
+        }
+
+        std::vector<int> colIndex(nCols);
+        for(int k = 0; k < nCols; k++) {
+            colIndex[k] = CLAMP(box->x0 - r + k, width);
+        }
+
+        for(int j = box->y0; j < box->y1; j++) {
+            //values of the rows [j - r, j + r]; element (k, t) is at k * w + t
+            for(int t = 0; t < w; t++) {
+                int sy = CLAMP(j - r + t, src->height);
+                float *row = &src->data[sy * width * channels];
+
+                for(int k = 0; k < nCols; k++) {
+                    values[k * w + t] = row[colIndex[k] * channels + c];
+                }
+            }
+
+            for(int e = 0; e < n; e++) {
+                order[e] = e;
+            }
+
+            std::sort(order.begin(), order.end(), [&values](int a, int b) {
+                return values[a] < values[b];
+            });
+
+            for(int e = 0; e < n; e++) {
+                rank[order[e]] = e + 1;
+                sorted[e] = values[order[e]];
+            }
+
+            std::fill(tree.begin(), tree.end(), 0);
+
+            auto update = [&tree, n](int pos, int delta) {
+                for(; pos <= n; pos += pos & (-pos)) {
+                    tree[pos] += delta;
+                }
+            };
+
+            auto updateColumn = [&](int k, int delta) {
+                int *rk = &rank[k * w];
+
+                for(int t = 0; t < w; t++) {
+                    update(rk[t], delta);
+                }
+            };
+
+            for(int k = 0; k < w; k++) {
+                updateColumn(k, 1);
+            }
+
+            float *dst_row = &dst->data[j * dst->width * dst->channels];
+
+            for(int i = 0; i < bw; i++) {
+                if(i > 0) {
+                    updateColumn(i - 1, -1);
+                    updateColumn(i + 2 * r, 1);
+                }
+
+                //the (medianIndex + 1)-th element in the tree
+                int pos = 0;
+                int rem = medianIndex + 1;
+
+                for(int step = 1 << (logN - 1); step > 0; step >>= 1) {
+                    int next = pos + step;
+
+                    if((next <= n) && (tree[next] < rem)) {
+                        pos = next;
+                        rem -= tree[next];
+                    }
+                }
+
+                dst_row[(box->x0 + i) * dst->channels + c] = sorted[pos];
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessBBox
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    {
+        if(type != RT_MEDIAN) {
+            ProcessExtrema(dst, src[0], box);
+            return;
+        }
+
+        for(int c = 0; c < dst->channels; c++) {
+            if(levels[c].size() > 0) {
+                ProcessMedianHistogram(dst, src[0], box, c);
+            } else {
+                ProcessMedianSorted(dst, src[0], box, c);
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief FilterRank
+     * @param size
+     * @param type
+     */
+    FilterRank(int size, RANK_TYPE type)
+    {
+        this->halfSize = checkHalfSize(size);
+        this->type = type;
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if(imgIn[0] == NULL) {
+            return imgOut;
+        }
+
+        computeLevels(imgIn[0]);
+        return Filter::Process(imgIn, imgOut);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *ProcessP(ImageVec imgIn, Image *imgOut)
+    {
+        if(imgIn[0] == NULL) {
+            return imgOut;
+        }
+
+        computeLevels(imgIn[0]);
+        return Filter::ProcessP(imgIn, imgOut);
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_RANK_HPP */
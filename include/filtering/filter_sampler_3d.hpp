@@ -47,6 +47,15 @@ protected:
      */
     Image *SetupAux(ImageVec imgIn, Image *imgOut);
 
+    /**
+     * @brief isFrameAware
+     * @return
+     */
+    bool isFrameAware()
+    {
+        return true;
+    }
+
 public:
     /**
      * @brief FilterSampler3D
@@ -19,17 +19,131 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_FILTERING_FILTER_WLS_HPP
 
 #include "filtering/filter.hpp"
+#include "algorithms/multigrid_solver.hpp"
 
 #ifndef PIC_DISABLE_EIGEN
-
 #include "externals/Eigen/Sparse"
 #include "externals/Eigen/src/SparseCore/SparseMatrix.h"
+#endif
 
 namespace pic {
 
+/**
+ * @brief The WLS_SOLVER enum selects how the WLS system is solved.
+ * WLS_AUTO uses the sparse Cholesky factorization for small images, and the
+ * iterative solver otherwise (or when Eigen is disabled).
+ */
+enum WLS_SOLVER {WLS_AUTO, WLS_CHOLESKY, WLS_ITERATIVE};
+
+/**
+ * @brief The FilterWLS class implements the weighted least squares
+ * edge-aware smoothing of Farbman et al. 2008.
+ */
 class FilterWLS: public Filter
 {
 protected:
+
+    /**
+     * @brief Iterative solves the WLS system with multigrid-preconditioned
+     * conjugate gradients. The five-point operator is stored as a diagonal and
+     * two weight planes in float, and it is never assembled; all channels
+     * are solved together.
+     * @param imgIn
+     * @param imgOut
+     * @param bInitialGuess if it is true, imgOut is the initial guess.
+     * @return
+     */
+    Image *Iterative(ImageVec imgIn, Image *imgOut, bool bInitialGuess)
+    {
+        Image *img = imgIn[0];
+
+        int width  = img->width;
+        int height = img->height;
+        int channels = img->channels;
+        int tot = width * height;
+
+        std::vector<float> diag(tot), wx(tot, 0.0f), wy(tot, 0.0f);
+
+        //the smoothness weight is lambda / (|dL|^alpha + epsilon); for
+        //color images |dL| is the Euclidean distance of the colors
+        float exponent = channels == 1 ? alpha : alpha * 0.5f;
+        float *data = img->data;
+        float lambda = this->lambda;
+        float epsilon = this->epsilon;
+
+        auto weight = [data, channels, exponent, lambda, epsilon](int p, int q) {
+            float *c0 = &data[p * channels];
+            float *c1 = &data[q * channels];
+
+            if(channels == 1) {
+                return lambda / (powf(fabsf(c1[0] - c0[0]), exponent) + epsilon);
+            }
+
+            float diff = 0.0f;
+            for(int k = 0; k < channels; k++) {
+                float tmp = c1[k] - c0[k];
+                diff += tmp * tmp;
+            }
+
+            return lambda / (powf(diff, exponent) + epsilon);
+        };
+
+        ThreadPool *tp = getThreadPool();
+        int nBlocks = (nThreads > 0 ? nThreads : tp->getNumThreads()) * 2;
+
+        tp->parallelForBlocks(0, height, nBlocks, [&](int y0, int y1) {
+            for(int i = y0; i < y1; i++) {
+                for(int j = 0; j < width; j++) {
+                    int p = i * width + j;
+
+                    if((j + 1) < width) {
+                        wx[p] = weight(p, p + 1);
+                    }
+
+                    if((i + 1) < height) {
+                        wy[p] = weight(p, p + width);
+                    }
+                }
+            }
+        });
+
+        tp->parallelForBlocks(0, height, nBlocks, [&](int y0, int y1) {
+            for(int i = y0; i < y1; i++) {
+                for(int j = 0; j < width; j++) {
+                    int p = i * width + j;
+                    float sum = wx[p] + wy[p];
+
+                    if(j > 0) {
+                        sum += wx[p - 1];
+                    }
+
+                    if(i > 0) {
+                        sum += wy[p - width];
+                    }
+
+                    diag[p] = 1.0f + sum;
+                }
+            }
+        });
+
+        MultigridSolver solver;
+        solver.setThreadPool(tp);
+        solver.setNumThreads(nThreads);
+        solver.setup(width, height, diag.data(), wx.data(), wy.data());
+
+        int iter = solver.solve(img->data, imgOut->data, channels, maxIterations,
+                                tolerance, bInitialGuess);
+
+        #ifdef PIC_DEBUG
+            printf("WLS: %d iterations\n", iter);
+        #else
+            (void) iter;
+        #endif
+
+        return imgOut;
+    }
+
+#ifndef PIC_DISABLE_EIGEN
     /**
      * @brief SingleChannel applies WLS smoothing filter for gray-scale images.
      * @param imgIn
@@ -147,7 +261,7 @@ protected:
         int height = img->height;
         int tot    = height * width;
 
-        alpha /= 2.0f;
+        float alpha = this->alpha / 2.0f;
 
         int stridex = width * img->channels;
 
@@ -274,9 +388,15 @@ protected:
 
         return imgOut;
     }
+#endif
 
     float alpha, lambda, epsilon;
 
+    WLS_SOLVER solverType;
+    int maxIterations;
+    float tolerance;
+    bool bWarmStart;
+
 public:
 
     /**
@@ -284,6 +404,7 @@ public:
      */
     FilterWLS()
     {
+        setSolver(WLS_AUTO);
         Update(1.2f, 1.0f);
     }
 
@@ -294,9 +415,27 @@ public:
      */
     FilterWLS(float alpha, float lambda)
     {
+        setSolver(WLS_AUTO);
         Update(alpha, lambda);
     }
 
+    /**
+     * @brief setSolver sets how the system is solved.
+     * @param solverType
+     * @param maxIterations is the maximum number of iterations of WLS_ITERATIVE.
+     * @param tolerance is the target relative residual of WLS_ITERATIVE.
+     * @param bWarmStart if it is true, WLS_ITERATIVE starts from the values of
+     * imgOut; e.g. the output of the previous frame of a video.
+     */
+    void setSolver(WLS_SOLVER solverType, int maxIterations = 200,
+                   float tolerance = 1e-4f, bool bWarmStart = false)
+    {
+        this->solverType = solverType;
+        this->maxIterations = maxIterations > 0 ? maxIterations : 200;
+        this->tolerance = tolerance > 0.0f ? tolerance : 1e-4f;
+        this->bWarmStart = bWarmStart;
+    }
+
     /**
      * @brief Update
      * @param alpha
@@ -334,14 +473,33 @@ public:
             return imgOut;
         }
 
+        bool bOutput = (imgOut != NULL) && imgOut->isSimilarType(imgIn[0]);
+
         imgOut = SetupAux(imgIn, imgOut);
 
-        //Convolution
+        WLS_SOLVER type = solverType;
+
+#ifdef PIC_DISABLE_EIGEN
+        type = WLS_ITERATIVE;
+#endif
+
+        if(type == WLS_AUTO) {
+            type = (imgIn[0]->nPixels() > (512 * 512)) ? WLS_ITERATIVE : WLS_CHOLESKY;
+        }
+
+        if(type == WLS_ITERATIVE) {
+            return Iterative(imgIn, imgOut, bWarmStart && bOutput);
+        }
+
+#ifndef PIC_DISABLE_EIGEN
         if(imgIn[0]->channels == 1) {
             return SingleChannel(imgIn, imgOut);
         } else {
             return MultiChannel(imgIn, imgOut);
         }
+#else
+        return imgOut;
+#endif
     }
 
     /**
@@ -391,4 +549,3 @@ public:
 
 #endif /* PIC_FILTERING_FILTER_WLS_HPP */
 
-#endif
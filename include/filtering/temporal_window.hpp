@@ -0,0 +1,198 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_TEMPORAL_WINDOW_HPP
+#define PIC_FILTERING_TEMPORAL_WINDOW_HPP
+
+#include <vector>
+
+#include "image.hpp"
+
+namespace pic {
+
+/**
+ * @brief The TemporalWindow class is a ring of frames for streaming
+ * a video through a temporal filter. Only the 2 * radius + 1 frames
+ * around the current (center) frame are kept in memory. Frames outside
+ * the stream are clamped to the first and the last frame, as Image::operator()
+ * does for the frames of a video.
+ */
+class TemporalWindow
+{
+protected:
+    std::vector<Image *> slots;
+    int radius, nPushed, center;
+    bool bFinished;
+
+    /**
+     * @brief release frees the ring.
+     */
+    void release()
+    {
+        for(unsigned int i = 0; i < slots.size(); i++) {
+            if(slots[i] != NULL) {
+                delete slots[i];
+            }
+        }
+
+        slots.clear();
+    }
+
+public:
+
+    /**
+     * @brief TemporalWindow
+     * @param radius is the number of frames before and after the center frame.
+     */
+    TemporalWindow(int radius = 0)
+    {
+        this->radius = -1;
+        setRadius(radius);
+    }
+
+    ~TemporalWindow()
+    {
+        release();
+    }
+
+    /**
+     * @brief setRadius sets the radius of the window and starts a new stream.
+     * @param radius
+     */
+    void setRadius(int radius)
+    {
+        radius = MAX(radius, 0);
+
+        if(radius != this->radius) {
+            release();
+            this->radius = radius;
+            slots.assign(2 * radius + 1, NULL);
+        }
+
+        reset();
+    }
+
+    /**
+     * @brief reset starts a new stream; the allocated frames are reused.
+     */
+    void reset()
+    {
+        nPushed = 0;
+        center = 0;
+        bFinished = false;
+    }
+
+    /**
+     * @brief push copies a frame at the end of the stream. The oldest frame
+     * of the ring is overwritten, so the current center frame has to be
+     * consumed (next) before pushing more than radius frames ahead of it.
+     * @param frame
+     */
+    void push(Image *frame)
+    {
+        if(frame == NULL || bFinished) {
+            return;
+        }
+
+        int i = nPushed % int(slots.size());
+
+        if(slots[i] == NULL) {
+            slots[i] = new Image();
+        }
+
+        slots[i]->assign(frame);
+        nPushed++;
+    }
+
+    /**
+     * @brief finish marks the end of the stream; the remaining center frames
+     * become ready using the last frame as boundary.
+     */
+    void finish()
+    {
+        bFinished = true;
+    }
+
+    /**
+     * @brief isReady
+     * @return It returns true if the center frame and all its neighbours are
+     * in the window.
+     */
+    bool isReady()
+    {
+        if(center >= nPushed) {
+            return false;
+        }
+
+        return bFinished || ((center + radius) < nPushed);
+    }
+
+    /**
+     * @brief next moves the center to the next frame.
+     */
+    void next()
+    {
+        center++;
+    }
+
+    /**
+     * @brief getFrame
+     * @param offset is the offset from the center frame in [-radius, radius].
+     * @return It returns the frame at center + offset, clamped to the stream.
+     */
+    Image *getFrame(int offset)
+    {
+        if(nPushed < 1) {
+            return NULL;
+        }
+
+        int i = CLAMPi(center + offset, 0, nPushed - 1);
+        return slots[i % int(slots.size())];
+    }
+
+    /**
+     * @brief getCenter
+     * @return It returns the index in the stream of the center frame.
+     */
+    int getCenter()
+    {
+        return center;
+    }
+
+    /**
+     * @brief getNumPushed
+     * @return It returns the number of frames pushed in the current stream.
+     */
+    int getNumPushed()
+    {
+        return nPushed;
+    }
+
+    /**
+     * @brief getRadius
+     * @return
+     */
+    int getRadius()
+    {
+        return radius;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_TEMPORAL_WINDOW_HPP */
+
@@ -33,6 +33,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/buffer.hpp"
 #include "util/low_dynamic_range.hpp"
 #include "util/math.hpp"
+#include "image_expr.hpp"
 
 //IO formats
 #include "io/bmp.hpp"
@@ -72,6 +73,22 @@ protected:
      */
     void setNULL();
 
+    /**
+     * @brief evaluate assigns an expression to the image; the image is
+     * reallocated if it does not match the shape of the expression.
+     * @param e
+     */
+    template<class E>
+    void evaluate(const E &e);
+
+    /**
+     * @brief evaluateInPlace assigns an expression to the image without
+     * changing its shape; nothing is done if the expression does not match it.
+     * @param e
+     */
+    template<class E>
+    void evaluateInPlace(const E &e);
+
     //applied rendering values
     bool flippedEXR;
     int  readerCounter;
@@ -128,6 +145,17 @@ public:
      */
     Image(Image *imgIn, bool deepCopy);
 
+    /**
+     * @brief Image evaluates an expression; e.g. Image c = a * b + 1.0f;
+     * @param e
+     */
+    template<class E>
+    Image(const ImageExpr<E> &e)
+    {
+        setNULL();
+        evaluate(e.self());
+    }
+
     /**
     * @brief Image loads an Image from a file on the disk.
     * @param nameFile is the file name.
@@ -690,82 +718,79 @@ public:
     void operator =(const float &a);
 
     /**
-     * @brief operator +=
-     * @param a
+     * @brief operator = evaluates an expression in a single pass;
+     * the image is reallocated if it does not match the shape of the expression.
+     * @param e
      */
-    void operator +=(const float &a);
-
-    /**
-     * @brief operator +
-     * @param a
-     * @return it returns (this + a)
-     */
-    Image operator +(const float &a) const;
+    template<class E>
+    void operator =(const ImageExpr<E> &e)
+    {
+        evaluate(e.self());
+    }
 
     /**
      * @brief operator +=
-     * @param a
+     * @param e
      */
-    void operator +=(const Image &a);
+    template<class E>
+    void operator +=(const ImageExpr<E> &e);
 
     /**
-     * @brief operator +
-     * @param a
-     * @return it returns (this + a)
+     * @brief operator -=
+     * @param e
      */
-    Image operator +(const Image &a) const;
+    template<class E>
+    void operator -=(const ImageExpr<E> &e);
 
     /**
      * @brief operator *=
-     * @param a
+     * @param e
      */
-    void operator *=(const float &a);
+    template<class E>
+    void operator *=(const ImageExpr<E> &e);
 
     /**
-     * @brief operator *
-     * @param a
-     * @return it returns (this * a)
+     * @brief operator /=
+     * @param e
      */
-    Image operator *(const float &a) const;
+    template<class E>
+    void operator /=(const ImageExpr<E> &e);
 
     /**
-     * @brief operator *=
+     * @brief operator +=
      * @param a
      */
-    void operator *=(const Image &a);
+    void operator +=(const float &a);
 
     /**
-     * @brief operator *
+     * @brief operator +=
      * @param a
-     * @return it returns (this * a)
      */
-    Image operator *(const Image &a) const;
+    void operator +=(const Image &a);
 
     /**
-     * @brief operator -=
+     * @brief operator *=
      * @param a
      */
-    void operator -=(const float &a);
+    void operator *=(const float &a);
 
     /**
-     * @brief operator -
+     * @brief operator *=
      * @param a
-     * @return it returns (this - a)
      */
-    Image operator -(const float &a) const;
+    void operator *=(const Image &a);
 
     /**
      * @brief operator -=
      * @param a
      */
-    void operator -=(const Image &a);
+    void operator -=(const float &a);
 
     /**
-     * @brief operator -
+     * @brief operator -=
      * @param a
-     * @return it returns (this - a)
      */
-    Image operator -(const Image &a) const;
+    void operator -=(const Image &a);
 
     /**
      * @brief operator /=
@@ -773,27 +798,85 @@ public:
      */
     void operator /=(const float &a);
 
-    /**
-     * @brief operator /
-     * @param a
-     * @return it returns (this / a)
-     */
-    Image operator /(const float &a) const;
-
     /**
      * @brief operator /=
      * @param a
      */
     void operator /=(const Image &a);
 
-    /**
-     * @brief operator /
-     * @param a
-     * @return it returns (this / a)
-     */
-    Image operator /(const Image &a) const;
 };
 
+template<>
+struct ImageExprOperand<Image>
+{
+    typedef ImageExprLeaf type;
+    static const bool bScalar = false;
+    static type get(const Image &a)
+    {
+        return ImageExprLeaf(a.data, a.width, a.height, a.frames, a.channels);
+    }
+};
+
+template<class E>
+void Image::evaluate(const E &e)
+{
+    int w = 0, h = 0, f = 0, c = 0;
+    e.getShape(w, h, f, c);
+
+    if(c < 1 || !e.isValid(w * h * f, c)) {
+        #ifdef PIC_DEBUG
+            printf("Image::evaluate: the images of the expression do not match.\n");
+        #endif
+        return;
+    }
+
+    if((data != NULL) && (width == w) && (height == h) && (frames == f) && (channels == c)) {
+        evaluateImageExpr(e, data, w * h * f, c);
+    } else {
+        //the expression may read this image
+        Image tmp(f, w, h, c);
+        evaluateImageExpr(e, tmp.data, w * h * f, c);
+        assign(&tmp);
+    }
+}
+
+template<class E>
+void Image::evaluateInPlace(const E &e)
+{
+    if((data == NULL) || !e.isValid(nPixels(), channels)) {
+        #ifdef PIC_DEBUG
+            printf("Image::evaluateInPlace: the images of the expression do not match.\n");
+        #endif
+        return;
+    }
+
+    evaluateImageExpr(e, data, nPixels(), channels);
+}
+
+template<class E>
+void Image::operator +=(const ImageExpr<E> &e)
+{
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) + e.self());
+}
+
+template<class E>
+void Image::operator -=(const ImageExpr<E> &e)
+{
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) - e.self());
+}
+
+template<class E>
+void Image::operator *=(const ImageExpr<E> &e)
+{
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) * e.self());
+}
+
+template<class E>
+void Image::operator /=(const ImageExpr<E> &e)
+{
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) / e.self());
+}
+
 PIC_INLINE void Image::setNULL()
 {
     nameFile = "";
@@ -1889,7 +1972,7 @@ PIC_INLINE Image *Image::clone() const
     ret->alpha = alpha;
     ret->typeLoad = typeLoad;
 
-    memcpy(ret->data, data, width * height * channels * sizeof(float));
+    memcpy(ret->data, data, frames * width * height * channels * sizeof(float));
 
     return ret;
 }
@@ -1936,123 +2019,42 @@ PIC_INLINE void Image::operator =(const float &a)
 
 PIC_INLINE void Image::operator +=(const float &a)
 {
-    Buffer<float>::add(data, size(), a);
-}
-
-PIC_INLINE Image Image::operator +(const float &a) const
-{
-    Image *out = this->clone();
-    *out += a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) + a);
 }
 
 PIC_INLINE void Image::operator +=(const Image &a)
 {
-    if(isSimilarType(&a)) {
-        Buffer<float>::add(data, a.data, size());
-    } else {
-        if((nPixels() == a.nPixels()) && (a.channels == 1)) {
-            Buffer<float>::addS(data, a.data, nPixels(), channels);
-        }
-    }
-
-}
-
-PIC_INLINE Image Image::operator +(const Image &a) const
-{
-    Image *out = this->clone();
-    *out += a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) + a);
 }
 
 PIC_INLINE void Image::operator *=(const float &a)
 {
-    Buffer<float>::mul(data, size(), a);
-}
-
-PIC_INLINE Image Image::operator *(const float &a) const
-{
-    Image *out = this->clone();
-    *out *= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) * a);
 }
 
 PIC_INLINE void Image::operator *=(const Image &a)
 {
-    if(isSimilarType(&a)) {
-        Buffer<float>::mul(data, a.data, size());
-    } else {
-        if((nPixels() == a.nPixels()) && (a.channels == 1)) {
-            Buffer<float>::mulS(data, a.data, nPixels(), channels);
-        }
-    }
-}
-
-PIC_INLINE Image Image::operator *(const Image &a) const
-{
-    Image *out = this->clone();
-    *out *= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) * a);
 }
 
 PIC_INLINE void Image::operator -=(const float &a)
 {
-    Buffer<float>::sub(data, size(), a);
-}
-
-PIC_INLINE Image Image::operator -(const float &a) const
-{
-    Image *out = this->clone();
-    *out -= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) - a);
 }
 
 PIC_INLINE void Image::operator -=(const Image &a)
 {
-    if(isSimilarType(&a)) {
-        Buffer<float>::sub(data, a.data, size());
-    } else {
-        if((nPixels() == a.nPixels()) && (a.channels == 1)) {
-            Buffer<float>::subS(data, a.data, nPixels(), channels);
-        }
-    }
-}
-
-PIC_INLINE Image Image::operator -(const Image &a) const
-{
-    Image *out = this->clone();
-    *out -= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) - a);
 }
 
 PIC_INLINE void Image::operator /=(const float &a)
 {
-    Buffer<float>::div(data, size(), a);
-}
-
-PIC_INLINE Image Image::operator /(const float &a) const
-{
-    Image *out = this->clone();
-    *out /= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) / a);
 }
 
 PIC_INLINE void Image::operator /=(const Image &a)
 {
-    if(isSimilarType(&a)) {
-        Buffer<float>::div(data, a.data, size());
-    } else {
-        if((nPixels() == a.nPixels()) && (a.channels == 1)) {
-            Buffer<float>::divS(data, a.data, nPixels(), channels);
-        }
-    }
-}
-
-PIC_INLINE Image Image::operator /(const Image &a) const
-{
-    Image *out = this->clone();
-    *out /= a;
-    return Image(out, false);
+    evaluateInPlace(ImageExprOperand<Image>::get(*this) / a);
 }
 } // end namespace pic
 
@@ -0,0 +1,369 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_IMAGE_EXPR_HPP
+#define PIC_IMAGE_EXPR_HPP
+
+#include "base.hpp"
+#include "util/math.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ImageExprAdd struct
+ */
+struct ImageExprAdd
+{
+    static inline float apply(float a, float b) { return a + b; }
+    static inline SIMDFloat apply(const SIMDFloat &a, const SIMDFloat &b) { return a + b; }
+};
+
+/**
+ * @brief The ImageExprSub struct
+ */
+struct ImageExprSub
+{
+    static inline float apply(float a, float b) { return a - b; }
+    static inline SIMDFloat apply(const SIMDFloat &a, const SIMDFloat &b) { return a - b; }
+};
+
+/**
+ * @brief The ImageExprMul struct
+ */
+struct ImageExprMul
+{
+    static inline float apply(float a, float b) { return a * b; }
+    static inline SIMDFloat apply(const SIMDFloat &a, const SIMDFloat &b) { return a * b; }
+};
+
+/**
+ * @brief The ImageExprDiv struct
+ */
+struct ImageExprDiv
+{
+    static inline float apply(float a, float b) { return a / b; }
+    static inline SIMDFloat apply(const SIMDFloat &a, const SIMDFloat &b) { return a / b; }
+};
+
+/**
+ * @brief The ImageExpr class is the base class of a lazy expression over
+ * images (e.g. a * b + c). An expression does not compute anything until it is
+ * assigned to an Image; then it is evaluated in a single loop, which is
+ * vectorized and multithreaded.
+ * Each node provides:
+ * - eval(pixel, i): the value of the element i, which is a channel of the pixel;
+ * - evalSIMD(i): the values of the elements [i, i + SIMDFloat::width);
+ * - isFlat(channels): true if every image has the given number of channels;
+ * - isValid(nPixels, channels): true if every image has nPixels pixels
+ *   and channels or 1 channel; a 1-channel image is broadcast across channels
+ *   as Buffer::addS and Buffer::mulS do;
+ * - getShape(width, height, frames, channels): the shape of the image with
+ *   most channels.
+ * An expression keeps pointers to the images; they have to be alive
+ * when the expression is assigned.
+ */
+template<class E>
+class ImageExpr
+{
+public:
+    const E &self() const
+    {
+        return static_cast<const E &>(*this);
+    }
+};
+
+/**
+ * @brief The ImageExprLeaf class is an image in an expression.
+ */
+class ImageExprLeaf: public ImageExpr<ImageExprLeaf>
+{
+public:
+    float *data;
+    int width, height, frames, channels;
+
+    ImageExprLeaf(float *data, int width, int height, int frames, int channels) :
+        data(data), width(width), height(height), frames(frames), channels(channels)
+    {
+    }
+
+    inline float eval(int pixel, int i) const
+    {
+        return (channels == 1) ? data[pixel] : data[i];
+    }
+
+    inline SIMDFloat evalSIMD(int i) const
+    {
+        return SIMDFloat::load(data + i);
+    }
+
+    bool isFlat(int channels) const
+    {
+        return this->channels == channels;
+    }
+
+    bool isValid(int nPixels, int channels) const
+    {
+        return (data != NULL) && ((width * height * frames) == nPixels) &&
+               ((this->channels == channels) || (this->channels == 1));
+    }
+
+    void getShape(int &width, int &height, int &frames, int &channels) const
+    {
+        if(this->channels > channels) {
+            width = this->width;
+            height = this->height;
+            frames = this->frames;
+            channels = this->channels;
+        }
+    }
+};
+
+/**
+ * @brief The ImageExprScalar class is a constant in an expression.
+ */
+class ImageExprScalar: public ImageExpr<ImageExprScalar>
+{
+public:
+    float value;
+
+    ImageExprScalar(float value) : value(value)
+    {
+    }
+
+    inline float eval(int, int) const
+    {
+        return value;
+    }
+
+    inline SIMDFloat evalSIMD(int) const
+    {
+        return SIMDFloat::set1(value);
+    }
+
+    bool isFlat(int) const
+    {
+        return true;
+    }
+
+    bool isValid(int, int) const
+    {
+        return true;
+    }
+
+    void getShape(int &, int &, int &, int &) const
+    {
+    }
+};
+
+/**
+ * @brief The ImageExprBinary class is an operator applied element-wise
+ * to two expressions.
+ */
+template<class L, class R, class Op>
+class ImageExprBinary: public ImageExpr<ImageExprBinary<L, R, Op> >
+{
+public:
+    L l;
+    R r;
+
+    ImageExprBinary(const L &l, const R &r) : l(l), r(r)
+    {
+    }
+
+    inline float eval(int pixel, int i) const
+    {
+        return Op::apply(l.eval(pixel, i), r.eval(pixel, i));
+    }
+
+    inline SIMDFloat evalSIMD(int i) const
+    {
+        return Op::apply(l.evalSIMD(i), r.evalSIMD(i));
+    }
+
+    bool isFlat(int channels) const
+    {
+        return l.isFlat(channels) && r.isFlat(channels);
+    }
+
+    bool isValid(int nPixels, int channels) const
+    {
+        return l.isValid(nPixels, channels) && r.isValid(nPixels, channels);
+    }
+
+    void getShape(int &width, int &height, int &frames, int &channels) const
+    {
+        l.getShape(width, height, frames, channels);
+        r.getShape(width, height, frames, channels);
+    }
+};
+
+/**
+ * @brief The ImageExprOperand struct maps the operands of the arithmetic
+ * operators to expression nodes; types without a specialization (e.g. ImageGL)
+ * do not take part in the operators of this file.
+ */
+template<class T>
+struct ImageExprOperand
+{
+};
+
+template<>
+struct ImageExprOperand<float>
+{
+    typedef ImageExprScalar type;
+    static const bool bScalar = true;
+    static type get(float a) { return ImageExprScalar(a); }
+};
+
+template<>
+struct ImageExprOperand<double>
+{
+    typedef ImageExprScalar type;
+    static const bool bScalar = true;
+    static type get(double a) { return ImageExprScalar(float(a)); }
+};
+
+template<>
+struct ImageExprOperand<int>
+{
+    typedef ImageExprScalar type;
+    static const bool bScalar = true;
+    static type get(int a) { return ImageExprScalar(float(a)); }
+};
+
+template<>
+struct ImageExprOperand<ImageExprLeaf>
+{
+    typedef ImageExprLeaf type;
+    static const bool bScalar = false;
+    static const type &get(const type &a) { return a; }
+};
+
+template<class L, class R, class Op>
+struct ImageExprOperand<ImageExprBinary<L, R, Op> >
+{
+    typedef ImageExprBinary<L, R, Op> type;
+    static const bool bScalar = false;
+    static const type &get(const type &a) { return a; }
+};
+
+/**
+ * @brief The ImageExprResult struct is the type of an operator applied
+ * to A and B; it is defined only if at least one of them is not a scalar.
+ */
+template<class A, class B, class Op,
+         bool bEnabled = !(ImageExprOperand<A>::bScalar && ImageExprOperand<B>::bScalar)>
+struct ImageExprResult
+{
+};
+
+template<class A, class B, class Op>
+struct ImageExprResult<A, B, Op, true>
+{
+    typedef ImageExprBinary<typename ImageExprOperand<A>::type,
+                            typename ImageExprOperand<B>::type, Op> type;
+
+    static type get(const A &a, const B &b)
+    {
+        return type(ImageExprOperand<A>::get(a), ImageExprOperand<B>::get(b));
+    }
+};
+
+template<class A, class B>
+inline typename ImageExprResult<A, B, ImageExprAdd>::type operator +(const A &a, const B &b)
+{
+    return ImageExprResult<A, B, ImageExprAdd>::get(a, b);
+}
+
+template<class A, class B>
+inline typename ImageExprResult<A, B, ImageExprSub>::type operator -(const A &a, const B &b)
+{
+    return ImageExprResult<A, B, ImageExprSub>::get(a, b);
+}
+
+template<class A, class B>
+inline typename ImageExprResult<A, B, ImageExprMul>::type operator *(const A &a, const B &b)
+{
+    return ImageExprResult<A, B, ImageExprMul>::get(a, b);
+}
+
+template<class A, class B>
+inline typename ImageExprResult<A, B, ImageExprDiv>::type operator /(const A &a, const B &b)
+{
+    return ImageExprResult<A, B, ImageExprDiv>::get(a, b);
+}
+
+/**
+ * @brief evaluateImageExpr evaluates an expression into a buffer in a single
+ * loop. The buffer can be one of the images of the expression.
+ * @param e
+ * @param out is a buffer of nPixels * channels floats.
+ * @param nPixels
+ * @param channels
+ */
+template<class E>
+void evaluateImageExpr(const E &e, float *out, int nPixels, int channels)
+{
+    //small images are not worth a parallel job
+    const int minPixelsPerBlock = 16384;
+
+    bool bFlat = e.isFlat(channels);
+
+    auto func = [&e, out, channels, bFlat](int p0, int p1) {
+        if(bFlat) {
+            int i = p0 * channels;
+            int i1 = p1 * channels;
+
+            for(; i <= (i1 - SIMDFloat::width); i += SIMDFloat::width) {
+                e.evalSIMD(i).store(out + i);
+            }
+
+            for(; i < i1; i++) {
+                out[i] = e.eval(i / channels, i);
+            }
+        } else {
+            for(int p = p0; p < p1; p++) {
+                int i = p * channels;
+
+                for(int c = 0; c < channels; c++) {
+                    out[i + c] = e.eval(p, i + c);
+                }
+            }
+        }
+    };
+
+    int nBlocks = nPixels / minPixelsPerBlock;
+
+#ifndef PIC_DISABLE_THREAD
+    ThreadPool *pool = ThreadPool::getInstance();
+    nBlocks = MIN(nBlocks, pool->getNumThreads());
+
+    if(nBlocks > 1) {
+        pool->parallelForBlocks(0, nPixels, nBlocks, func);
+        return;
+    }
+#endif
+
+    func(0, nPixels);
+}
+
+} // end namespace pic
+
+#endif /* PIC_IMAGE_EXPR_HPP */
+
@@ -22,6 +22,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "metrics/log_rmse.hpp"
 #include "metrics/m_psnr.hpp"
 #include "metrics/mae.hpp"
+#include "metrics/metric_evaluator.hpp"
 #include "metrics/maximum_error.hpp"
 #include "metrics/mse.hpp"
 #include "metrics/psnr.hpp"
@@ -0,0 +1,634 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_METRICS_METRIC_EVALUATOR_HPP
+#define PIC_METRICS_METRIC_EVALUATOR_HPP
+
+#include <math.h>
+#include <vector>
+#include <atomic>
+#include <limits>
+
+#include "image.hpp"
+#include "util/array.hpp"
+#include "util/thread_pool.hpp"
+#include "tone_mapping/get_all_exposures.hpp"
+#include "metrics/base.hpp"
+#include "metrics/m_psnr.hpp"
+
+namespace pic {
+
+enum METRIC_TYPE {MT_MSE, MT_RMSE, MT_PSNR, MT_RPSNR, MT_MAE, MT_MAXIMUM_ERROR,
+                  MT_RELATIVE_ERROR, MT_LOG_RMSE, MT_SNR, MT_MPSNR, MT_NUMBER_OF_METRICS};
+
+/**
+ * @brief The MetricEvaluator class computes a set of metrics between two
+ * images in a single parallel pass; values match MSE, RMSE, PSNR, rPSNR, MAE,
+ * MaximumError, RelativeError, logRMSE, SNR, and mPSNR. Thresholds can be
+ * set on metrics; since the partial sums of all metrics only grow, a pass
+ * stops as soon as the pixels processed so far already fail a threshold.
+ */
+class MetricEvaluator
+{
+protected:
+
+    struct Partial
+    {
+        double mse, mae, rel, rpsnr, log_rmse, snr, max_err;
+        long long mse_count, mae_count, rel_count, rpsnr_count, log_count;
+        unsigned long long mpsnr;
+
+        Partial()
+        {
+            mse = mae = rel = rpsnr = log_rmse = snr = max_err = 0.0;
+            mse_count = mae_count = rel_count = rpsnr_count = log_count = 0;
+            mpsnr = 0;
+        }
+
+        void add(const Partial &p)
+        {
+            mse += p.mse;
+            mae += p.mae;
+            rel += p.rel;
+            rpsnr += p.rpsnr;
+            log_rmse += p.log_rmse;
+            snr += p.snr;
+            max_err = MAX(max_err, p.max_err);
+
+            mse_count += p.mse_count;
+            mae_count += p.mae_count;
+            rel_count += p.rel_count;
+            rpsnr_count += p.rpsnr_count;
+            log_count += p.log_count;
+
+            mpsnr += p.mpsnr;
+        }
+    };
+
+    //values per chunk
+    static const int CHUNK_SIZE = 65536;
+
+    bool bRequested[MT_NUMBER_OF_METRICS];
+    bool bThreshold[MT_NUMBER_OF_METRICS];
+    double threshold[MT_NUMBER_OF_METRICS];
+    double values[MT_NUMBER_OF_METRICS];
+
+    //values for threshold tests; PSNR and SNR report sentinels as psnr.hpp
+    //and snr.hpp do, but perfect matches have to pass the thresholds
+    double values_test[MT_NUMBER_OF_METRICS];
+
+    bool bLargeDifferences, bComplete;
+
+    //mPSNR
+    MULTI_EXPOSURE_TYPE mpsnr_type;
+    int minFstop, maxFstop;
+    float gamma;
+    std::vector<float> mpsnr_scale;
+    double mpsnr_divisor;
+
+    double nValues, nPixels;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief processChunk accumulates the requested terms of [i0, i1).
+     * @param ori
+     * @param cmp
+     * @param i0
+     * @param i1
+     * @param p
+     */
+    void processChunk(float *ori, float *cmp, int i0, int i1, Partial &p)
+    {
+        double largeDifferences = bLargeDifferences ? C_LARGE_DIFFERENCES : FLT_MAX;
+
+        if(bRequested[MT_MSE] || bRequested[MT_RMSE] || bRequested[MT_PSNR]) {
+            double acc = 0.0;
+            long long count = 0;
+
+            for(int i = i0; i < i1; i++) {
+                double delta = ori[i] - cmp[i];
+
+                if(delta <= largeDifferences) {
+                    acc += delta * delta;
+                    count++;
+                }
+            }
+
+            p.mse = acc;
+            p.mse_count = count;
+        }
+
+        if(bRequested[MT_MAE]) {
+            double acc = 0.0;
+            long long count = 0;
+
+            for(int i = i0; i < i1; i++) {
+                double delta = fabs(double(ori[i]) - double(cmp[i]));
+
+                if(delta <= largeDifferences) {
+                    acc += delta;
+                    count++;
+                }
+            }
+
+            p.mae = acc;
+            p.mae_count = count;
+        }
+
+        if(bRequested[MT_MAXIMUM_ERROR]) {
+            double maxVal = 0.0;
+
+            for(int i = i0; i < i1; i++) {
+                double delta = fabs(ori[i] - cmp[i]);
+
+                if((delta < C_LARGE_DIFFERENCES) && (maxVal < delta)) {
+                    maxVal = delta;
+                }
+            }
+
+            p.max_err = maxVal;
+        }
+
+        if(bRequested[MT_RELATIVE_ERROR]) {
+            double acc = 0.0;
+            long long count = 0;
+
+            for(int i = i0; i < i1; i++) {
+                double valO = double(ori[i]);
+                double delta = fabs(valO - double(cmp[i]));
+
+                if(delta <= largeDifferences) {
+                    count++;
+
+                    if(valO > C_SINGULARITY) {
+                        acc += delta / valO;
+                    }
+                }
+            }
+
+            p.rel = acc;
+            p.rel_count = count;
+        }
+
+        if(bRequested[MT_RPSNR]) {
+            double acc = 0.0;
+            long long count = 0;
+
+            for(int i = i0; i < i1; i++) {
+                double valO = ori[i];
+                double valC = cmp[i];
+                double delta = valO - valC;
+                double maxOC = MAX(valO, valC);
+
+                if(delta <= largeDifferences) {
+                    count++;
+
+                    if(maxOC > C_SINGULARITY) {
+                        double tmp = delta / maxOC;
+                        acc += tmp * tmp;
+                    }
+                }
+            }
+
+            p.rpsnr = acc;
+            p.rpsnr_count = count;
+        }
+
+        if(bRequested[MT_LOG_RMSE]) {
+            double acc = 0.0;
+            long long count = 0;
+
+            for(int i = i0; i < i1; i++) {
+                if(ori[i] > 0.0f && cmp[i] > 0.0f) {
+                    double val = log(ori[i] / cmp[i]);
+                    acc += val * val;
+                    count++;
+                }
+            }
+
+            p.log_rmse = acc;
+            p.log_count = count;
+        }
+
+        if(bRequested[MT_SNR]) {
+            double acc = 0.0;
+
+            for(int i = i0; i < i1; i++) {
+                double valO = double(ori[i]);
+
+                if(valO > 1e-3) {
+                    acc += fabs(valO - double(cmp[i])) / valO;
+                }
+            }
+
+            p.snr = acc;
+        }
+
+        if(bRequested[MT_MPSNR]) {
+            //one power per value; exposures become scale factors
+            float invGamma = 1.0f / gamma;
+            int nExposures = int(mpsnr_scale.size());
+            unsigned long long acc = 0;
+
+            for(int i = i0; i < i1; i++) {
+                float po = powf(ori[i], invGamma);
+                float pc = powf(cmp[i], invGamma);
+
+                for(int k = 0; k < nExposures; k++) {
+                    int oriLDR = int(po * mpsnr_scale[k]);
+                    int cmpLDR = int(pc * mpsnr_scale[k]);
+
+                    oriLDR = CLAMPi(oriLDR, 0, 255);
+                    cmpLDR = CLAMPi(cmpLDR, 0, 255);
+
+                    int delta = cmpLDR - oriLDR;
+                    acc += delta * delta;
+                }
+            }
+
+            p.mpsnr = acc;
+        }
+    }
+
+    /**
+     * @brief isFailed checks whether partial sums, over nValues values at most,
+     * already fail a threshold.
+     * @param p
+     * @return
+     */
+    bool isFailed(const Partial &p)
+    {
+        double n = nValues;
+
+        if(bThreshold[MT_MSE] && (p.mse / n) > threshold[MT_MSE]) {
+            return true;
+        }
+
+        if(bThreshold[MT_RMSE] && (p.mse / n) > (threshold[MT_RMSE] * threshold[MT_RMSE])) {
+            return true;
+        }
+
+        if(bThreshold[MT_PSNR] && (p.mse / n) > pow(10.0, -threshold[MT_PSNR] / 10.0)) {
+            return true;
+        }
+
+        if(bThreshold[MT_RPSNR] && (p.rpsnr / n) > pow(10.0, -threshold[MT_RPSNR] / 10.0)) {
+            return true;
+        }
+
+        if(bThreshold[MT_MAE] && (p.mae / n) > threshold[MT_MAE]) {
+            return true;
+        }
+
+        if(bThreshold[MT_MAXIMUM_ERROR] && p.max_err > threshold[MT_MAXIMUM_ERROR]) {
+            return true;
+        }
+
+        if(bThreshold[MT_RELATIVE_ERROR] && (p.rel / n) > threshold[MT_RELATIVE_ERROR]) {
+            return true;
+        }
+
+        if(bThreshold[MT_LOG_RMSE] && (p.log_rmse / n) > (threshold[MT_LOG_RMSE] * threshold[MT_LOG_RMSE])) {
+            return true;
+        }
+
+        if(bThreshold[MT_SNR] && (p.snr / n) > pow(10.0, -threshold[MT_SNR] / 20.0)) {
+            return true;
+        }
+
+        if(bThreshold[MT_MPSNR]) {
+            double aMSE = double(p.mpsnr) / nPixels / mpsnr_divisor;
+            double MSEconst = (nValues / nPixels) * 65025.0;
+
+            if(aMSE > (MSEconst / pow(10.0, threshold[MT_MPSNR] / 10.0))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief setValues computes the metrics from sums.
+     * @param p
+     */
+    void setValues(const Partial &p)
+    {
+        double mse = p.mse / double(p.mse_count);
+        values[MT_MSE] = mse;
+        values[MT_RMSE] = sqrt(mse);
+        values[MT_PSNR] = (mse > 0.0) ? (10.0 * log10(1.0 / mse)) : -3.0;
+        values[MT_RPSNR] = -10.0 * log10(p.rpsnr / double(p.rpsnr_count));
+        values[MT_MAE] = float(p.mae / double(p.mae_count));
+        values[MT_MAXIMUM_ERROR] = p.max_err;
+        values[MT_RELATIVE_ERROR] = (p.rel_count > 0) ? (p.rel / double(p.rel_count)) : -3.0;
+        values[MT_LOG_RMSE] = (p.log_count > 0) ? sqrt(p.log_rmse / double(p.log_count)) : -3.0;
+
+        float snr = float(-20.0 * log10(p.snr / nValues));
+        values[MT_SNR] = (snr > 200.0 || snr < 1.0) ? -1.0f : snr;
+
+        double aMSE = double(p.mpsnr) / nPixels / mpsnr_divisor;
+        double MSEconst = (nValues / nPixels) * 65025.0;
+        values[MT_MPSNR] = float(10.0 * log10(MSEconst / aMSE));
+
+        for(int i = 0; i < MT_NUMBER_OF_METRICS; i++) {
+            values_test[i] = values[i];
+        }
+
+        //mse == 0 or p.snr == 0 give +inf
+        values_test[MT_PSNR] = (mse > 0.0) ? values[MT_PSNR] : std::numeric_limits<double>::infinity();
+        values_test[MT_SNR] = (p.snr > 0.0) ? (-20.0 * log10(p.snr / nValues)) : std::numeric_limits<double>::infinity();
+    }
+
+    /**
+     * @brief setupMPSNR computes the exposures of ori as mPSNR does.
+     * @param ori
+     */
+    void setupMPSNR(Image *ori)
+    {
+        std::vector<float> exposures;
+        int minF = minFstop;
+        int maxF = maxFstop;
+
+        switch(mpsnr_type) {
+            case MET_HISTOGRAM: {
+                exposures = getAllExposures(ori);
+            } break;
+
+            case MET_MIN_MAX: {
+                if(minF == maxF) {
+                    getMinMaxFstops(ori, minF, maxF);
+                }
+
+                Array<float>::genRange(float(minF), 1.0f, float(maxF), exposures);
+            } break;
+        }
+
+        //(ori * 2^fstop)^(1 / gamma) = ori^(1 / gamma) * 2^(fstop / gamma)
+        float invGamma = 1.0f / gamma;
+        mpsnr_scale.resize(exposures.size());
+
+        for(unsigned int i = 0; i < exposures.size(); i++) {
+            mpsnr_scale[i] = 255.0f * powf(powf(2.0f, exposures[i]), invGamma);
+        }
+
+        mpsnr_divisor = double(maxF - minF + 1);
+    }
+
+public:
+
+    /**
+     * @brief MetricEvaluator
+     * @param bLargeDifferences, if true, skips big differences for stability.
+     */
+    MetricEvaluator(bool bLargeDifferences = false)
+    {
+        this->bLargeDifferences = bLargeDifferences;
+
+        for(int i = 0; i < MT_NUMBER_OF_METRICS; i++) {
+            bRequested[i] = false;
+            bThreshold[i] = false;
+            threshold[i] = 0.0;
+            values[i] = 0.0;
+        }
+
+        bComplete = false;
+
+        mpsnr_type = MET_MIN_MAX;
+        minFstop = 0;
+        maxFstop = 0;
+        gamma = 2.2f;
+        mpsnr_divisor = 1.0;
+
+        nValues = 0.0;
+        nPixels = 0.0;
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the evaluation runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief add requests a metric.
+     * @param type
+     */
+    void add(METRIC_TYPE type)
+    {
+        bRequested[type] = true;
+    }
+
+    /**
+     * @brief setThreshold requests a metric and it sets its pass threshold:
+     * PSNR, rPSNR, SNR, and mPSNR pass when greater or equal to it; all
+     * other metrics pass when lower or equal to it.
+     * @param type
+     * @param value
+     */
+    void setThreshold(METRIC_TYPE type, double value)
+    {
+        bRequested[type] = true;
+        bThreshold[type] = true;
+        threshold[type] = value;
+    }
+
+    /**
+     * @brief setMultiExposure sets the parameters of mPSNR.
+     * @param type
+     * @param minFstop
+     * @param maxFstop
+     */
+    void setMultiExposure(MULTI_EXPOSURE_TYPE type, int minFstop = 0, int maxFstop = 0)
+    {
+        this->mpsnr_type = type;
+        this->minFstop = minFstop;
+        this->maxFstop = maxFstop;
+    }
+
+    /**
+     * @brief execute computes the requested metrics between ori and cmp.
+     * @param ori is the original image.
+     * @param cmp is the distorted image.
+     * @return It returns true if all thresholds pass. If a threshold fails
+     * before the end of the pass, the evaluation stops and isComplete()
+     * returns false.
+     */
+    bool execute(Image *ori, Image *cmp)
+    {
+        bComplete = false;
+
+        if(ori == NULL || cmp == NULL) {
+            return false;
+        }
+
+        if(!ori->isSimilarType(cmp)) {
+            return false;
+        }
+
+        int size = ori->width * ori->height * ori->channels;
+        nValues = double(size);
+        nPixels = double(ori->width * ori->height);
+
+        if(bRequested[MT_MPSNR]) {
+            setupMPSNR(ori);
+        }
+
+        int nChunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        std::vector<Partial> partials(nChunks);
+
+        //a chunk publishes its partial sums through its flag
+        std::vector< std::atomic<bool> > done(nChunks);
+        for(int i = 0; i < nChunks; i++) {
+            done[i].store(false);
+        }
+
+        std::atomic<bool> bFailed(false);
+
+        auto chunk_func = [this, ori, cmp, size, nChunks, &partials, &done, &bFailed](int c) {
+            if(bFailed.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            int i0 = c * CHUNK_SIZE;
+            int i1 = MIN(i0 + CHUNK_SIZE, size);
+            processChunk(ori->data, cmp->data, i0, i1, partials[c]);
+            done[c].store(true, std::memory_order_release);
+
+            Partial running;
+            for(int i = 0; i < nChunks; i++) {
+                if(done[i].load(std::memory_order_acquire)) {
+                    running.add(partials[i]);
+                }
+            }
+
+            if(isFailed(running)) {
+                bFailed.store(true);
+            }
+        };
+
+        bool bAnyThreshold = false;
+        for(int i = 0; i < MT_NUMBER_OF_METRICS; i++) {
+            bAnyThreshold = bAnyThreshold || bThreshold[i];
+        }
+
+        if(!bAnyThreshold) {
+            //no early-out; partials are reduced only at the end
+            auto plain_func = [this, ori, cmp, size, &partials](int c) {
+                int i0 = c * CHUNK_SIZE;
+                processChunk(ori->data, cmp->data, i0, MIN(i0 + CHUNK_SIZE, size), partials[c]);
+            };
+
+            if(nThreads == 1) {
+                for(int c = 0; c < nChunks; c++) {
+                    plain_func(c);
+                }
+            } else {
+                getPool()->parallelFor(nChunks, plain_func);
+            }
+        } else {
+            if(nThreads == 1) {
+                for(int c = 0; c < nChunks; c++) {
+                    chunk_func(c);
+                }
+            } else {
+                getPool()->parallelFor(nChunks, chunk_func);
+            }
+        }
+
+        //reduction in chunk order, so values do not depend on threads
+        Partial total;
+        for(int c = 0; c < nChunks; c++) {
+            total.add(partials[c]);
+        }
+
+        setValues(total);
+
+        if(bFailed.load()) {
+            return false;
+        }
+
+        bComplete = true;
+
+        for(int i = 0; i < MT_NUMBER_OF_METRICS; i++) {
+            if(!bThreshold[i]) {
+                continue;
+            }
+
+            bool bHigherIsBetter = (i == MT_PSNR) || (i == MT_RPSNR) ||
+                                   (i == MT_SNR) || (i == MT_MPSNR);
+
+            if(bHigherIsBetter ? (values_test[i] < threshold[i]) : (values_test[i] > threshold[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief getValue returns the value of a requested metric; after an
+     * early exit, it is computed on the processed pixels only.
+     * @param type
+     * @return
+     */
+    double getValue(METRIC_TYPE type)
+    {
+        return values[type];
+    }
+
+    /**
+     * @brief isComplete returns true if the last execution processed
+     * all pixels.
+     * @return
+     */
+    bool isComplete()
+    {
+        return bComplete;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_METRICS_METRIC_EVALUATOR_HPP */
@@ -19,10 +19,15 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_METRICS_SSIM_INDEX_HPP
 
 #include <math.h>
+#include <vector>
+#include <functional>
 
 #include "image.hpp"
 #include "metrics/base.hpp"
 #include "util/indexed_array.hpp"
+#include "util/precomputed_gaussian.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
 
 #include "filtering/filter_luminance.hpp"
 #include "filtering/filter_gaussian_2d.hpp"
@@ -31,6 +36,540 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 namespace pic {
 
+/**
+ * @brief The SSIMEngine class computes the SSIM index and the multi-scale
+ * SSIM (MS-SSIM) index on the luminance of two images. The five local
+ * moments (means, variances, and covariance) are computed in a single sweep
+ * over horizontal strips: each input row is converted to luminance and
+ * blurred horizontally into a ring of kernelSize rows, which are then blurred
+ * vertically and turned into SSIM values, so no full-size temporary is stored.
+ */
+class SSIMEngine
+{
+protected:
+    float K0, K1, dynamic_range;
+    PrecomputedGaussian pg;
+
+    //luminance pyramids for MS-SSIM; levels are kept between calls
+    std::vector<Image *> pyramid_ori, pyramid_cmp;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief getPool
+     * @return
+     */
+    ThreadPool *getPool()
+    {
+        return pool != NULL ? pool : ThreadPool::getInstance();
+    }
+
+    /**
+     * @brief runBlocks runs func(y0, y1) on blocks of [0, n).
+     * @param n
+     * @param func
+     */
+    void runBlocks(int n, std::function<void(int, int)> func)
+    {
+        if(nThreads == 1) {
+            func(0, n);
+        } else {
+            ThreadPool *tp = getPool();
+            int nBlocks = MAX(MIN(tp->getNumThreads() * 2, n / 16), 1);
+            tp->parallelForBlocks(0, n, nBlocks, func);
+        }
+    }
+
+    /**
+     * @brief getLuminanceRow computes the luminance of a row as FilterLuminance;
+     * images with less than three channels use their first channel.
+     * @param img
+     * @param y
+     * @param out
+     */
+    static void getLuminanceRow(Image *img, int y, float *out)
+    {
+        int width = img->width;
+        int channels = img->channels;
+        float *row = &img->data[y * width * channels];
+
+        if(channels >= 3) {
+            for(int x = 0; x < width; x++) {
+                float *p = &row[x * channels];
+                float sum = 0.0f;
+                sum += p[0] * 0.213f;
+                sum += p[1] * 0.715f;
+                sum += p[2] * 0.072f;
+                out[x] = sum;
+            }
+        } else {
+            for(int x = 0; x < width; x++) {
+                out[x] = row[x * channels];
+            }
+        }
+    }
+
+    /**
+     * @brief getDynamicRange computes the ratio between the maximum
+     * and the minimum positive luminance of img.
+     * @param img
+     * @return
+     */
+    float getDynamicRange(Image *img)
+    {
+        int width = img->width;
+        int height = img->height;
+
+        std::vector<float> row_max(height), row_min(height);
+
+        runBlocks(height, [this, img, width, &row_max, &row_min](int y0, int y1) {
+            std::vector<float> L(width);
+
+            for(int y = y0; y < y1; y++) {
+                getLuminanceRow(img, y, &L[0]);
+
+                float max_val = -FLT_MAX;
+                float min_val = FLT_MAX;
+
+                for(int x = 0; x < width; x++) {
+                    max_val = MAX(max_val, L[x]);
+
+                    if(L[x] > 0.0f) {
+                        min_val = MIN(min_val, L[x]);
+                    }
+                }
+
+                row_max[y] = max_val;
+                row_min[y] = min_val;
+            }
+        });
+
+        float max_val = -FLT_MAX;
+        float min_val = FLT_MAX;
+
+        for(int y = 0; y < height; y++) {
+            max_val = MAX(max_val, row_max[y]);
+            min_val = MIN(min_val, row_min[y]);
+        }
+
+        if(min_val == FLT_MAX) {
+            min_val = 1.0f / 255.0f;
+        }
+
+        return max_val / min_val;
+    }
+
+    /**
+     * @brief blurRow blurs horizontally a row padded by halfKernelSize
+     * pixels on each side.
+     * @param out
+     * @param padded
+     * @param width
+     */
+    void blurRow(float *out, const float *padded, int width)
+    {
+        const int W = SIMDFloat::width;
+        int half = pg.halfKernelSize;
+        int n = pg.kernelSize;
+        const float *c = pg.coeff;
+
+        int x = 0;
+        for(; x <= (width - W); x += W) {
+            const float *p = &padded[x];
+            SIMDFloat acc = SIMDFloat::set1(c[half]) * SIMDFloat::load(p + half);
+
+            for(int k = 0; k < half; k++) {
+                SIMDFloat sum = SIMDFloat::load(p + k) + SIMDFloat::load(p + n - 1 - k);
+                acc = SIMDFloat::fmadd(SIMDFloat::set1(c[k]), sum, acc);
+            }
+
+            acc.store(out + x);
+        }
+
+        for(; x < width; x++) {
+            const float *p = &padded[x];
+            float acc = c[half] * p[half];
+
+            for(int k = 0; k < half; k++) {
+                acc += c[k] * (p[k] + p[n - 1 - k]);
+            }
+
+            out[x] = acc;
+        }
+    }
+
+    /**
+     * @brief accumulateRow computes acc += w * src.
+     * @param acc
+     * @param src
+     * @param w
+     * @param n
+     */
+    static void accumulateRow(float *acc, const float *src, float w, int n)
+    {
+        const int W = SIMDFloat::width;
+        SIMDFloat w_v = SIMDFloat::set1(w);
+
+        int x = 0;
+        for(; x <= (n - W); x += W) {
+            SIMDFloat::fmadd(w_v, SIMDFloat::load(src + x), SIMDFloat::load(acc + x)).store(acc + x);
+        }
+
+        for(; x < n; x++) {
+            acc[x] += w * src[x];
+        }
+    }
+
+    /**
+     * @brief sweep computes the SSIM map of the luminance of ori and cmp.
+     * @param ori
+     * @param cmp
+     * @param C0
+     * @param C1
+     * @param ssim_map is a single channel image; it can be NULL.
+     * @param mean_ssim is the mean of SSIM values.
+     * @param mean_cs is the mean of the contrast-structure terms.
+     */
+    void sweep(Image *ori, Image *cmp, float C0, float C1, Image *ssim_map,
+               double &mean_ssim, double &mean_cs)
+    {
+        int width = ori->width;
+        int height = ori->height;
+
+        //per-row sums, so the result does not depend on the strips
+        std::vector<double> row_ssim(height), row_cs(height);
+
+        runBlocks(height, [this, ori, cmp, C0, C1, ssim_map, width, height,
+                           &row_ssim, &row_cs](int y0, int y1) {
+            int half = pg.halfKernelSize;
+            int n = pg.kernelSize;
+            int pw = width + 2 * half;
+
+            //padded luminance rows and their products
+            std::vector<float> pad(pw * 5);
+            float *pa = &pad[0];
+            float *pb = &pad[pw];
+            float *paa = &pad[pw * 2];
+            float *pbb = &pad[pw * 3];
+            float *pab = &pad[pw * 4];
+
+            //horizontally blurred moments of the last n rows
+            std::vector<float> ring(n * 5 * width);
+            std::vector<float> acc(5 * width);
+
+            for(int yy = (y0 - half); yy < (y1 + half); yy++) {
+                int sy = CLAMPi(yy, 0, height - 1);
+
+                getLuminanceRow(ori, sy, pa + half);
+                getLuminanceRow(cmp, sy, pb + half);
+
+                for(int k = 0; k < half; k++) {
+                    pa[k] = pa[half];
+                    pb[k] = pb[half];
+                    pa[half + width + k] = pa[half + width - 1];
+                    pb[half + width + k] = pb[half + width - 1];
+                }
+
+                for(int x = 0; x < pw; x++) {
+                    paa[x] = pa[x] * pa[x];
+                    pbb[x] = pb[x] * pb[x];
+                    pab[x] = pa[x] * pb[x];
+                }
+
+                float *slot = &ring[((yy - y0 + half) % n) * 5 * width];
+
+                for(int m = 0; m < 5; m++) {
+                    blurRow(slot + m * width, &pad[m * pw], width);
+                }
+
+                if(yy < (y0 + half)) {
+                    continue;
+                }
+
+                //vertical blur of the rows [y - half, y + half]
+                int y = yy - half;
+
+                std::fill(acc.begin(), acc.end(), 0.0f);
+
+                for(int k = 0; k < n; k++) {
+                    float w = pg.coeff[k];
+                    float *src = &ring[((y - half + k - y0 + half) % n) * 5 * width];
+
+                    accumulateRow(&acc[0], src, w, 5 * width);
+                }
+
+                float *mu1 = &acc[0];
+                float *mu2 = &acc[width];
+                float *s11 = &acc[width * 2];
+                float *s22 = &acc[width * 3];
+                float *s12 = &acc[width * 4];
+
+                float *out = (ssim_map != NULL) ? &ssim_map->data[y * width] : NULL;
+
+                double sum_ssim = 0.0;
+                double sum_cs = 0.0;
+
+                for(int x = 0; x < width; x++) {
+                    float mu1_sq = mu1[x] * mu1[x];
+                    float mu2_sq = mu2[x] * mu2[x];
+                    float mu1_mu2 = mu1[x] * mu2[x];
+
+                    float sigma1_sq = s11[x] - mu1_sq;
+                    float sigma2_sq = s22[x] - mu2_sq;
+                    float sigma1_sigma2 = s12[x] - mu1_mu2;
+
+                    float cs = (sigma1_sigma2 * 2.0f + C1) /
+                               (sigma1_sq + sigma2_sq + C1);
+
+                    float l = (mu1_mu2 * 2.0f + C0) /
+                              (mu1_sq + mu2_sq + C0);
+
+                    float ssim = l * cs;
+
+                    if(out != NULL) {
+                        out[x] = ssim;
+                    }
+
+                    sum_ssim += ssim;
+                    sum_cs += cs;
+                }
+
+                row_ssim[y] = sum_ssim;
+                row_cs[y] = sum_cs;
+            }
+        });
+
+        mean_ssim = 0.0;
+        mean_cs = 0.0;
+
+        for(int y = 0; y < height; y++) {
+            mean_ssim += row_ssim[y];
+            mean_cs += row_cs[y];
+        }
+
+        double n = double(width) * double(height);
+        mean_ssim /= n;
+        mean_cs /= n;
+    }
+
+    /**
+     * @brief downsample halves the luminance of src with a 2x2 box filter.
+     * @param src
+     * @param pyramid
+     * @param level
+     * @return
+     */
+    Image *downsample(Image *src, std::vector<Image *> &pyramid, int level)
+    {
+        int width = (src->width + 1) >> 1;
+        int height = (src->height + 1) >> 1;
+
+        if(int(pyramid.size()) <= level) {
+            pyramid.resize(level + 1, NULL);
+        }
+
+        Image *dst = pyramid[level];
+
+        if(dst != NULL && (dst->width != width || dst->height != height)) {
+            delete dst;
+            dst = NULL;
+        }
+
+        if(dst == NULL) {
+            dst = new Image(1, width, height, 1);
+            pyramid[level] = dst;
+        }
+
+        int src_width = src->width;
+        int src_height = src->height;
+
+        runBlocks(height, [src, dst, width, src_width, src_height](int y0, int y1) {
+            std::vector<float> r0(src_width), r1(src_width);
+
+            for(int y = y0; y < y1; y++) {
+                getLuminanceRow(src, y << 1, &r0[0]);
+                getLuminanceRow(src, MIN((y << 1) + 1, src_height - 1), &r1[0]);
+
+                float *out = &dst->data[y * width];
+
+                for(int x = 0; x < width; x++) {
+                    int x0 = x << 1;
+                    int x1 = MIN(x0 + 1, src_width - 1);
+                    out[x] = (r0[x0] + r0[x1] + r1[x0] + r1[x1]) * 0.25f;
+                }
+            }
+        });
+
+        return dst;
+    }
+
+    /**
+     * @brief getConstants
+     * @param ori
+     * @param C0
+     * @param C1
+     */
+    void getConstants(Image *ori, float &C0, float &C1)
+    {
+        float dr = dynamic_range;
+
+        if(dr < 0.0f) {
+            dr = getDynamicRange(ori);
+        }
+
+        C0 = K0 * dr;
+        C0 = C0 * C0;
+
+        C1 = K1 * dr;
+        C1 = C1 * C1;
+    }
+
+public:
+
+    /**
+     * @brief SSIMEngine
+     * @param K0
+     * @param K1
+     * @param sigma_window
+     * @param dynamic_range; if it is negative, it is computed from ori
+     * at each execution.
+     */
+    SSIMEngine(float K0 = 0.01f, float K1 = 0.03f, float sigma_window = 1.5f,
+               float dynamic_range = -1.0f) : pg(sigma_window)
+    {
+        this->K0 = K0;
+        this->K1 = K1;
+        this->dynamic_range = dynamic_range;
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    ~SSIMEngine()
+    {
+        for(unsigned int i = 0; i < pyramid_ori.size(); i++) {
+            if(pyramid_ori[i] != NULL) {
+                delete pyramid_ori[i];
+            }
+        }
+
+        for(unsigned int i = 0; i < pyramid_cmp.size(); i++) {
+            if(pyramid_cmp[i] != NULL) {
+                delete pyramid_cmp[i];
+            }
+        }
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the engine runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief execute computes the SSIM index between ori and cmp.
+     * @param ori
+     * @param cmp
+     * @param ssim_map is a single channel image with the size of ori where
+     * the SSIM map is stored; if it is NULL, the map is not stored.
+     * @return It returns the SSIM index; -2 for invalid images and -1
+     * for images of different types.
+     */
+    float execute(Image *ori, Image *cmp, Image *ssim_map = NULL)
+    {
+        if(ori == NULL || cmp == NULL) {
+            return -2.0f;
+        }
+
+        if(!ori->isSimilarType(cmp)) {
+            return -1.0f;
+        }
+
+        if(ssim_map != NULL) {
+            if(ssim_map->width != ori->width || ssim_map->height != ori->height ||
+               ssim_map->channels != 1) {
+                ssim_map = NULL;
+            }
+        }
+
+        float C0, C1;
+        getConstants(ori, C0, C1);
+
+        double mean_ssim, mean_cs;
+        sweep(ori, cmp, C0, C1, ssim_map, mean_ssim, mean_cs);
+
+        return float(mean_ssim);
+    }
+
+    /**
+     * @brief executeMultiScale computes the MS-SSIM index between ori and cmp.
+     * Each scale halves the previous one with a 2x2 box filter; the constants
+     * are computed once from ori at full resolution.
+     * @param ori
+     * @param cmp
+     * @param nScales is in [1, 5]; the weights of the first nScales scales
+     * are normalized to sum to one.
+     * @return It returns the MS-SSIM index; -2 for invalid images and -1
+     * for images of different types.
+     */
+    float executeMultiScale(Image *ori, Image *cmp, int nScales = 5)
+    {
+        if(ori == NULL || cmp == NULL) {
+            return -2.0f;
+        }
+
+        if(!ori->isSimilarType(cmp)) {
+            return -1.0f;
+        }
+
+        const float weights[] = {0.0448f, 0.2856f, 0.3001f, 0.2363f, 0.1333f};
+
+        nScales = CLAMPi(nScales, 1, 5);
+
+        float sum_weights = 0.0f;
+        for(int i = 0; i < nScales; i++) {
+            sum_weights += weights[i];
+        }
+
+        float C0, C1;
+        getConstants(ori, C0, C1);
+
+        Image *a = ori;
+        Image *b = cmp;
+        double ret = 1.0;
+
+        for(int i = 0; i < nScales; i++) {
+            if(i > 0) {
+                a = downsample(a, pyramid_ori, i - 1);
+                b = downsample(b, pyramid_cmp, i - 1);
+            }
+
+            double mean_ssim, mean_cs;
+            sweep(a, b, C0, C1, NULL, mean_ssim, mean_cs);
+
+            //negative terms are clamped to avoid undefined powers
+            double term = (i == (nScales - 1)) ? mean_ssim : mean_cs;
+            ret *= pow(MAX(term, 0.0), double(weights[i] / sum_weights));
+        }
+
+        return float(ret);
+    }
+};
+
 /**
  * @brief SSIMIndex
  * @param ori
@@ -75,65 +614,42 @@ Image* SSIMIndex(Image *ori, Image *cmp, float &ssim_index, Image *ssim_map = NU
         }
     }
 
-    Image *L_ori = FilterLuminance::Execute(ori, NULL);
-    Image *L_cmp = FilterLuminance::Execute(cmp, NULL);
-
-    if(dynamic_range < 0.0f) {
-        float min_val, max_val;
-        L_ori->getMaxVal(NULL, &max_val);
-        L_ori->getMinVal(NULL, &min_val);
-
-        if(min_val <= 0.0f) {
-            IntCoord coord;
-            IndexedArray::findSimple(L_ori->data, L_ori->size(), IndexedArray::bFuncNotNeg, coord);
-            min_val = IndexedArray::min(L_ori->data, coord);
-
-            if(min_val <= 0.0f) {
-                min_val = 1.0f / 255.0f;
-            }
-        }
-
-        dynamic_range = max_val / min_val;
+    if(ssim_map == NULL) {
+        ssim_map = new Image(1, ori->width, ori->height, 1);
     }
 
-    float C0 = K0 * dynamic_range;
-    C0 = C0 * C0;
-
-    float C1 = K1 * dynamic_range;
-    C1 = C1 * C1;
-
-    Image *img_mu1 = FilterGaussian2D::Execute(L_ori, NULL, sigma_window);
-    Image *img_mu2 = FilterGaussian2D::Execute(L_cmp, NULL, sigma_window);
-
-    Image img_ori_cmp = (*L_ori) * (*L_cmp);
-
-    (*L_ori) *= (*L_ori);
-    (*L_cmp) *= (*L_cmp);
-
-    Image *img_sigma1_sq = FilterGaussian2D::Execute(L_ori, NULL, sigma_window);
-    Image *img_sigma2_sq = FilterGaussian2D::Execute(L_cmp, NULL, sigma_window);
-    Image *img_sigma1_sigma2 = FilterGaussian2D::Execute(&img_ori_cmp, NULL, sigma_window);
-
-    if(C0 > 0.0f && C1 > 0.0f) {
-        FilterSSIM flt_ssim(C0, C1);
-
-        ImageVec src;
-        src.push_back(img_mu1);
-        src.push_back(img_mu2);
-        src.push_back(img_sigma1_sq);
-        src.push_back(img_sigma2_sq);
-        src.push_back(img_sigma1_sigma2);
-
-        ssim_map = flt_ssim.ProcessP(src, ssim_map);
-    } else {
+    SSIMEngine engine(K0, K1, sigma_window, dynamic_range);
+    ssim_index = engine.execute(ori, cmp, ssim_map);
 
+    if(ori_d != NULL) {
+        delete ori_d;
     }
 
-    ssim_map->getMeanVal(NULL, &ssim_index);
+    if(cmp_d != NULL) {
+        delete cmp_d;
+    }
 
     return ssim_map;
 }
 
+/**
+ * @brief MSSSIMIndex computes the multi-scale SSIM index.
+ * @param ori
+ * @param cmp
+ * @param nScales
+ * @param K0
+ * @param K1
+ * @param sigma_window
+ * @param dynamic_range
+ * @return
+ */
+float MSSSIMIndex(Image *ori, Image *cmp, int nScales = 5, float K0 = 0.01f, float K1 = 0.03f,
+                  float sigma_window = 1.5f, float dynamic_range = -1.0f)
+{
+    SSIMEngine engine(K0, K1, sigma_window, dynamic_range);
+    return engine.executeMultiScale(ori, cmp, nScales);
+}
+
 } // end namespace pic
 
 #endif /* PIC_METRICS_SSIM_INDEX_HPP */
@@ -34,6 +34,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
  * \li \c PIC_DISABLE_OPENGL disables the OpenGL support.
  * \li \c PIC_DISABLE_QT disables the QT support. Note that JPEG and PNG files
  * are read using QT, therefore it is required for reading such files.
+ * \li \c PIC_DISABLE_SIMD disables the SSE/AVX code paths (e.g. in pic::FilterConv1D); by default,
+ * the widest instruction set enabled by the compiler flags (e.g. -mavx2) is used.
  * \li \c PIC_ENABLE_OPEN_EXR enables the support for the OpenEXR library. This may be useful to have
  * in the case .exr images are used. Note that you need to manually install OpenEXR on your developing maching in order
  * to enable this flag.
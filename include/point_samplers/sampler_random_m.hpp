@@ -72,6 +72,16 @@ public:
      */
     RandomSampler<N> *getSampler(std::mt19937 *m);
 
+    /**
+     * @brief getSampler gets a sampler given an index
+     * @param index is wrapped to the number of samplers.
+     * @return
+     */
+    RandomSampler<N> *getSampler(unsigned int index)
+    {
+        return samplers[index % nSamplers];
+    }
+
     /**
      * @brief Write saves into an existing file
      * @param name
@@ -27,6 +27,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "tone_mapping/lischinski_minimization.hpp"
 #include "tone_mapping/lischinski_tmo.hpp"
 #include "tone_mapping/reinhard_tmo.hpp"
+#include "tone_mapping/reinhard_tmo_fused.hpp"
 #include "tone_mapping/drago_tmo.hpp"
 #include "tone_mapping/ward_histogram_tmo.hpp"
 #include "tone_mapping/segmentation_tmo_approx.hpp"
@@ -30,9 +30,10 @@ namespace pic {
  * @param imgIn
  * @param imgOut
  * @param target_contrast
+ * @param bGrid if true, the bilateral grid is used for the base layer.
  * @return
  */
-Image *DurandTMO(Image *imgIn, Image *imgOut = NULL, float target_contrast = 5.0f)
+Image *DurandTMO(Image *imgIn, Image *imgOut = NULL, float target_contrast = 5.0f, bool bGrid = false)
 {
     if(imgIn == NULL) {
         return NULL;
@@ -52,7 +53,7 @@ Image *DurandTMO(Image *imgIn, Image *imgOut = NULL, float target_contrast = 5.0
     Image *lum = FilterLuminance::Execute(imgIn, NULL, LT_CIE_LUMINANCE);
 
     //bilateral filter seperation
-    ImageVec *sep = bilateralSeparation(lum);
+    ImageVec *sep = bilateralSeparation(lum, -1.0f, 0.4f, bGrid);
 
     Image *base = sep->at(0);
     Image *detail = sep->at(1);
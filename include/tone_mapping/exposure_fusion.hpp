@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 #define PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 
+#include <functional>
+
 #include "colors/saturation.hpp"
 #include "filtering/filter_luminance.hpp"
 #include "filtering/filter_laplacian.hpp"
@@ -50,7 +52,6 @@ Image *ExposureFusion(ImageVec imgIn, float wC = 1.0f, float wE = 1.0f,
     int height = imgIn[0]->height;
 
     Image *lum     = new Image(1, width, height, 1);
-    Image *weights = new Image(1, width, height, 1);
     Image *acc     = new Image(1, width, height, 1);
 
     acc->setZero();
@@ -58,6 +59,9 @@ Image *ExposureFusion(ImageVec imgIn, float wC = 1.0f, float wE = 1.0f,
     FilterLuminance flt_lum;
     FilterExposureFusionWeights flt_weights(wC, wE, wS);
 
+    //the weights are computed once, and they are kept for blending
+    ImageVec weights;
+
     for(int j = 0; j < n; j++) {
         #ifdef PIC_DEBUG
             printf("Processing image %d\n", j);
@@ -65,9 +69,9 @@ Image *ExposureFusion(ImageVec imgIn, float wC = 1.0f, float wE = 1.0f,
 
         lum = flt_lum.ProcessP(Single(imgIn[j]), lum);
 
-        weights = flt_weights.ProcessP(Double(lum, imgIn[j]), weights);
+        weights.push_back(flt_weights.ProcessP(Double(lum, imgIn[j]), NULL));
 
-        *acc += *weights;
+        *acc += *weights[j];
     }
 
     for(int i=0; i<acc->size(); i++) {
@@ -86,18 +90,18 @@ Image *ExposureFusion(ImageVec imgIn, float wC = 1.0f, float wE = 1.0f,
     pOut->setValue(0.0f);
 
     for(int j = 0; j < n; j++) {
-        lum = flt_lum.ProcessP(Single(imgIn[j]), lum);
-        weights = flt_weights.ProcessP(Double(lum, imgIn[j]), weights);
-
         //normalization
-        *weights /= *acc;
+        *weights[j] /= *acc;
 
-        pW->update(weights);
+        pW->update(weights[j]);
         pI->update(imgIn[j]);
 
         pI->mul(pW);
 
         pOut->add(pI);
+
+        delete weights[j];
+        weights[j] = NULL;
     }
 
     #ifdef PIC_DEBUG
@@ -118,6 +122,149 @@ Image *ExposureFusion(ImageVec imgIn, float wC = 1.0f, float wE = 1.0f,
     delete pI;
 
     delete acc;
+    delete lum;
+
+    return imgOut;
+}
+
+/**
+ * @brief ExposureFusionStreaming blends a stream of exposures, which are read
+ * one at a time, so memory does not grow with the number of exposures.
+ * By default, the stream is read twice: the first pass accumulates the weights,
+ * and the second one blends the exposures with per-pixel normalized weights,
+ * as ExposureFusion does. When bSinglePass is true, the stream is read once:
+ * each level of the output pyramid accumulates the weighted Laplacian levels
+ * of the exposures, and it is divided at the end by the same level of the
+ * Gaussian pyramid of the sum of the weights (a running normalizer). This
+ * halves the work, but it favors exposures with stronger weights
+ * (e.g., more contrast) at coarse levels.
+ * @param reader returns the i-th exposure, or NULL after the last one;
+ * i restarts from 0 for the second pass. The returned image is not freed,
+ * so the reader can reuse it for the next exposure. Exposures with a size
+ * different from the first one are skipped.
+ * @param wC
+ * @param wE
+ * @param wS
+ * @param bSinglePass
+ * @param imgOut
+ * @return
+ */
+Image *ExposureFusionStreaming(std::function<Image *(int)> reader, float wC = 1.0f,
+                               float wE = 1.0f, float wS = 1.0f,
+                               bool bSinglePass = false, Image *imgOut = NULL)
+{
+    Image *img = reader(0);
+
+    if(img == NULL) {
+        return imgOut;
+    }
+
+    int channels = img->channels;
+    int width = img->width;
+    int height = img->height;
+
+    Image *lum     = new Image(1, width, height, 1);
+    Image *weights = new Image(1, width, height, 1);
+    Image *acc     = NULL;
+
+    FilterLuminance flt_lum;
+    FilterExposureFusionWeights flt_weights(wC, wE, wS);
+
+    if(!bSinglePass) {
+        acc = new Image(1, width, height, 1);
+        acc->setZero();
+
+        for(int j = 0; img != NULL; j++) {
+            if((img->width == width) && (img->height == height) && (img->channels == channels)) {
+                lum = flt_lum.ProcessP(Single(img), lum);
+                weights = flt_weights.ProcessP(Double(lum, img), weights);
+
+                *acc += *weights;
+            }
+
+            img = reader(j + 1);
+        }
+
+        for(int i = 0; i < acc->size(); i++) {
+            acc->data[i] = acc->data[i] > 0.0f ? acc->data[i] : 1.0f;
+        }
+
+        img = reader(0);
+    }
+
+    Pyramid *pW   = new Pyramid(width, height, 1, false, 2);
+    Pyramid *pI   = new Pyramid(width, height, channels, true, 2);
+    Pyramid *pOut = new Pyramid(width, height, channels, true, 2);
+    Pyramid *pAcc = NULL;
+
+    if(bSinglePass) {
+        pAcc = new Pyramid(width, height, 1, false, 2);
+        pAcc->setValue(0.0f);
+    }
+
+    pOut->setValue(0.0f);
+
+    for(int j = 0; img != NULL; j++) {
+        #ifdef PIC_DEBUG
+            printf("Processing image %d\n", j);
+        #endif
+
+        if((img->width == width) && (img->height == height) && (img->channels == channels)) {
+            lum = flt_lum.ProcessP(Single(img), lum);
+            weights = flt_weights.ProcessP(Double(lum, img), weights);
+
+            if(acc != NULL) {
+                *weights /= *acc;
+            }
+
+            pW->update(weights);
+            pI->update(img);
+
+            if(pAcc != NULL) {
+                pAcc->add(pW);
+            }
+
+            pI->mul(pW);
+            pOut->add(pI);
+        }
+
+        img = reader(j + 1);
+    }
+
+    //running normalization
+    if(pAcc != NULL) {
+        for(int l = 0; l < pAcc->size(); l++) {
+            Image *tmp = pAcc->get(l);
+
+            for(int i = 0; i < tmp->size(); i++) {
+                tmp->data[i] = tmp->data[i] > 0.0f ? (1.0f / tmp->data[i]) : 0.0f;
+            }
+        }
+
+        pOut->mul(pAcc);
+    }
+
+    //final result
+    imgOut = pOut->reconstruct(imgOut);
+
+    #pragma omp parallel for
+    for(int i = 0; i < imgOut->size(); i++) {
+        imgOut->data[i] = MAX(imgOut->data[i], 0.0f);
+    }
+
+    //free the memory
+    delete pW;
+    delete pOut;
+    delete pI;
+
+    if(pAcc != NULL) {
+        delete pAcc;
+    }
+
+    if(acc != NULL) {
+        delete acc;
+    }
+
     delete weights;
     delete lum;
 
@@ -20,10 +20,11 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "util/string.hpp"
 #include "filtering/filter.hpp"
-#include "filtering/filter_bilateral_2ds.hpp"
+#include "filtering/bilateral_grid.hpp"
 #include "filtering/filter_luminance.hpp"
 #include "filtering/filter_sigmoid_tmo.hpp"
 #include "tone_mapping/input_estimates.hpp"
+#include "tone_mapping/reinhard_tmo_fused.hpp"
 
 namespace pic {
 
@@ -48,21 +49,31 @@ inline float SigmoidInv(float x)
 }
 
 /**
- * @brief ReinhardTMO
+ * @brief ReinhardTMO applies the photographic tone reproduction operator
+ * with local adaptation; see ReinhardTMOFused for tone mapping sequences
+ * or for the global operator.
  * @param imgIn
  * @param imgOut
  * @param alpha
  * @param whitePoint
  * @param phi
+ * @param bGrid if true, the bilateral grid is used for the local
+ * adaptation instead of the sampled bilateral filter of ReinhardTMOFused;
+ * the samples of the latter are not the ones of FilterBilateral2DS.
  * @return
  */
 Image *ReinhardTMO(Image *imgIn, Image *imgOut = NULL, float alpha = 0.18f,
-                      float whitePoint = -1.0f, float phi = 8.0f)
+                      float whitePoint = -1.0f, float phi = 8.0f, bool bGrid = false)
 {
     if(imgIn == NULL) {
         return NULL;
     }
 
+    if(!bGrid) {
+        ReinhardTMOFused tmo(alpha, whitePoint, phi, true);
+        return tmo.execute(imgIn, imgOut);
+    }
+
     if(imgOut == NULL) {
         imgOut = imgIn->clone();
     }
@@ -90,8 +101,8 @@ Image *ReinhardTMO(Image *imgIn, Image *imgOut = NULL, float alpha = 0.18f,
 
     float sigma_r = powf(2.0f, phi) * alpha / (s_max * s_max);
 
-    Image *filteredLum = FilterBilateral2DS::Execute(lum, NULL, sigma_s,
-                            sigma_r);
+    BilateralGrid grid(sigma_s, sigma_r);
+    Image *filteredLum = grid.execute(lum);
 
     lum->applyFunction(&SigmoidInv);
 
@@ -0,0 +1,418 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_TONE_MAPPING_REINHARD_TMO_FUSED_HPP
+#define PIC_TONE_MAPPING_REINHARD_TMO_FUSED_HPP
+
+#include <random>
+#include <vector>
+#include <functional>
+
+#include "image.hpp"
+#include "util/math.hpp"
+#include "util/thread_pool.hpp"
+#include "util/precomputed_gaussian.hpp"
+#include "point_samplers/sampler_random_m.hpp"
+#include "filtering/filter_bilateral_2ds.hpp"
+#include "tone_mapping/input_estimates.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ReinhardTMOFused class is the photographic tone reproduction
+ * operator of Reinhard et al. computed in two sweeps without intermediate
+ * images:
+ * - the first sweep computes the luminance statistics (min, max, and log-average);
+ * - the second sweep computes the luminance again, it compresses it with the
+ * sigmoid, and it scales the colors.
+ * When the local adaptation is enabled, the first sweep stores the luminance
+ * in the sigmoid space (a single channel buffer, which is reused between
+ * calls), and the second sweep filters it with a stochastic bilateral filter
+ * before the compression. The filter has the kernel and the number of samples
+ * of FilterBilateral2DS, but not its sample patterns, so the output is not the
+ * same as ReinhardTMO with the separate passes; the error depends on the image
+ * (around 3e-4 RMSE on typical HDR images).
+ * An instance can be reused for tone mapping a sequence of frames.
+ */
+class ReinhardTMOFused
+{
+protected:
+    float alpha, whitePoint, phi;
+    bool bLocal;
+
+    //statistics of the last call
+    float LMax, LMin, LogAverage;
+
+    //local adaptation
+    PrecomputedGaussian *pg;
+    MRSamplers<2> *ms;
+    std::vector<unsigned int> shifter;
+    std::vector<float> lum_sigmoid;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    static const int SHIFTER_SIZE = 64;
+    static const int BLOCK_ROWS = 16;
+
+    /**
+     * @brief runBlocks runs func(i) for i in [0, n).
+     * @param n
+     * @param func
+     */
+    void runBlocks(int n, std::function<void(int)> func)
+    {
+        if(nThreads == 1) {
+            for(int i = 0; i < n; i++) {
+                func(i);
+            }
+        } else {
+            ThreadPool *tp = (pool != NULL) ? pool : ThreadPool::getInstance();
+            tp->parallelFor(n, func);
+        }
+    }
+
+    /**
+     * @brief getLuminance
+     * @param data
+     * @param channels
+     * @return It returns the CIE luminance of a pixel; the first channel
+     * is returned for images without three channels.
+     */
+    static inline float getLuminance(const float *data, int channels)
+    {
+        if(channels == 3) {
+            return 0.213f * data[0] + 0.715f * data[1] + 0.072f * data[2];
+        } else {
+            return data[0];
+        }
+    }
+
+    /**
+     * @brief allocateLocal allocates the samplers for the local adaptation.
+     */
+    void allocateLocal()
+    {
+        if(ms != NULL) {
+            return;
+        }
+
+        //the same kernel and number of samples of FilterBilateral2DS
+        float s_max = 8.0f;
+        float sigma_s = 0.56f * powf(1.6f, s_max);
+
+        pg = new PrecomputedGaussian(sigma_s);
+
+        int nMaxSamples = pg->halfKernelSize * pg->halfKernelSize;
+        int nSamples = int(lround(float(pg->kernelSize)) *
+                           FilterBilateral2DS::BilateralStoK(int(sigma_s)));
+        nSamples = MIN(nSamples, nMaxSamples);
+
+        ms = new MRSamplers<2>(ST_BRIDSON, pg->halfKernelSize, nSamples, 1, 64);
+
+        std::mt19937 m(1);
+        shifter.resize(SHIFTER_SIZE * SHIFTER_SIZE);
+        for(unsigned int i = 0; i < shifter.size(); i++) {
+            shifter[i] = m();
+        }
+    }
+
+    /**
+     * @brief sweepStatistics is the first sweep.
+     * @param imgIn
+     */
+    void sweepStatistics(Image *imgIn);
+
+    /**
+     * @brief sweepCompression is the second sweep.
+     * @param imgIn
+     * @param imgOut
+     */
+    void sweepCompression(Image *imgIn, Image *imgOut);
+
+public:
+
+    /**
+     * @brief ReinhardTMOFused
+     * @param alpha is the key value; if it is lower or equal than 0,
+     * it is estimated from the image.
+     * @param whitePoint is the white point; as in ReinhardTMO, it does not
+     * change the output of the sigmoid.
+     * @param phi is the sharpening parameter of the local adaptation.
+     * @param bLocal enables the local adaptation.
+     */
+    ReinhardTMOFused(float alpha = 0.18f, float whitePoint = -1.0f,
+                     float phi = 8.0f, bool bLocal = false)
+    {
+        pg = NULL;
+        ms = NULL;
+        pool = NULL;
+        nThreads = -1;
+
+        LMax = LMin = LogAverage = -1.0f;
+
+        update(alpha, whitePoint, phi, bLocal);
+    }
+
+    ~ReinhardTMOFused()
+    {
+        if(pg != NULL) {
+            delete pg;
+        }
+
+        if(ms != NULL) {
+            delete ms;
+        }
+    }
+
+    /**
+     * @brief update
+     * @param alpha
+     * @param whitePoint
+     * @param phi
+     * @param bLocal
+     */
+    void update(float alpha, float whitePoint, float phi, bool bLocal)
+    {
+        this->alpha = alpha;
+        this->whitePoint = whitePoint;
+        this->phi = phi;
+        this->bLocal = bLocal;
+
+        if(bLocal) {
+            allocateLocal();
+        }
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * the operator runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief getLogAverage
+     * @return It returns the log-average luminance of the last tone mapped image.
+     */
+    float getLogAverage()
+    {
+        return LogAverage;
+    }
+
+    /**
+     * @brief getMaxLuminance
+     * @return It returns the maximum luminance of the last tone mapped image.
+     */
+    float getMaxLuminance()
+    {
+        return LMax;
+    }
+
+    /**
+     * @brief getMinLuminance
+     * @return It returns the minimum luminance of the last tone mapped image.
+     */
+    float getMinLuminance()
+    {
+        return LMin;
+    }
+
+    /**
+     * @brief execute tone maps an image.
+     * @param imgIn is an HDR image.
+     * @param imgOut is the output image; it can be imgIn.
+     * @return It returns the tone mapped image.
+     */
+    Image *execute(Image *imgIn, Image *imgOut = NULL)
+    {
+        if(imgIn == NULL) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = imgIn->allocateSimilarOne();
+        } else {
+            if(!imgIn->isSimilarType(imgOut)) {
+                imgOut = imgIn->allocateSimilarOne();
+            }
+        }
+
+        sweepStatistics(imgIn);
+        sweepCompression(imgIn, imgOut);
+
+        return imgOut;
+    }
+};
+
+PIC_INLINE void ReinhardTMOFused::sweepStatistics(Image *imgIn)
+{
+    int width = imgIn->width;
+    int height = imgIn->height;
+    int channels = imgIn->channels;
+
+    if(bLocal) {
+        lum_sigmoid.resize(width * height);
+    }
+
+    int nBlocks = (height + BLOCK_ROWS - 1) / BLOCK_ROWS;
+
+    std::vector<double> block_log(nBlocks);
+    std::vector<float> block_max(nBlocks), block_min(nBlocks);
+
+    runBlocks(nBlocks, [this, imgIn, width, height, channels,
+                        &block_log, &block_max, &block_min](int b) {
+        int j0 = b * BLOCK_ROWS;
+        int j1 = MIN(j0 + BLOCK_ROWS, height);
+
+        float *S = bLocal ? &lum_sigmoid[0] : NULL;
+
+        double sum_log = 0.0;
+        float L_max = -FLT_MAX;
+        float L_min = FLT_MAX;
+
+        for(int j = j0; j < j1; j++) {
+            float *data = &imgIn->data[j * width * channels];
+            float row_log = 0.0f;
+
+            for(int i = 0; i < width; i++) {
+                float L = getLuminance(&data[i * channels], channels);
+
+                L_max = MAX(L_max, L);
+                L_min = MIN(L_min, L);
+                row_log += logf(L + 1e-6f);
+
+                if(S != NULL) {
+                    S[j * width + i] = L / (L + 1.0f);
+                }
+            }
+
+            sum_log += double(row_log);
+        }
+
+        block_log[b] = sum_log;
+        block_max[b] = L_max;
+        block_min[b] = L_min;
+    });
+
+    //reduction in a fixed order; the result does not depend on the threads
+    double sum_log = 0.0;
+    LMax = -FLT_MAX;
+    LMin = FLT_MAX;
+
+    for(int b = 0; b < nBlocks; b++) {
+        sum_log += block_log[b];
+        LMax = MAX(LMax, block_max[b]);
+        LMin = MIN(LMin, block_min[b]);
+    }
+
+    LogAverage = float(exp(sum_log / double(width * height)));
+}
+
+PIC_INLINE void ReinhardTMOFused::sweepCompression(Image *imgIn, Image *imgOut)
+{
+    int width = imgIn->width;
+    int height = imgIn->height;
+    int channels = imgIn->channels;
+
+    float alpha_c = alpha;
+    if(alpha_c <= 0.0f) {
+        alpha_c = EstimateAlpha(LMax, LMin, LogAverage);
+    }
+
+    float s_max = 8.0f;
+    float sigma_r = powf(2.0f, phi) * alpha_c / (s_max * s_max);
+    float sigma_r2 = 2.0f * sigma_r * sigma_r;
+
+    int nBlocks = (height + BLOCK_ROWS - 1) / BLOCK_ROWS;
+
+    runBlocks(nBlocks, [this, imgIn, imgOut, width, height, channels,
+                        alpha_c, sigma_r2](int b) {
+        int j0 = b * BLOCK_ROWS;
+        int j1 = MIN(j0 + BLOCK_ROWS, height);
+
+        float *S = bLocal ? &lum_sigmoid[0] : NULL;
+        int hks = bLocal ? pg->halfKernelSize : 0;
+
+        for(int j = j0; j < j1; j++) {
+            float *data = &imgIn->data[j * width * channels];
+            float *out = &imgOut->data[j * width * channels];
+
+            for(int i = 0; i < width; i++) {
+                float *pixel = &data[i * channels];
+                float L = getLuminance(pixel, channels);
+
+                //local adaptation
+                float L_adapt = L;
+
+                if(S != NULL) {
+                    float ref = S[j * width + i];
+                    RandomSampler<2> *ps = ms->getSampler(shifter[(j % SHIFTER_SIZE) * SHIFTER_SIZE +
+                                                                  (i % SHIFTER_SIZE)]);
+                    int nSamples = int(ps->samplesR.size());
+                    int *samples = ps->samplesR.data();
+
+                    float sum = 0.0f;
+                    float sum_w = 0.0f;
+
+                    for(int k = 0; k < nSamples; k += 2) {
+                        int ci = CLAMPi(i + samples[k    ], 0, width - 1);
+                        int cj = CLAMPi(j + samples[k + 1], 0, height - 1);
+
+                        float val = S[cj * width + ci];
+                        float diff = val - ref;
+
+                        float w = pg->coeff[samples[k] + hks] * pg->coeff[samples[k + 1] + hks] *
+                                  expf(-(diff * diff) / sigma_r2);
+
+                        sum += val * w;
+                        sum_w += w;
+                    }
+
+                    float S_flt = (sum_w > 0.0f) ? (sum / sum_w) : ref;
+                    L_adapt = S_flt / (1.0f - S_flt);
+                }
+
+                //sigmoid compression
+                float Ld = (L * alpha_c) / (L_adapt * alpha_c + LogAverage);
+                float scale = (L > 0.0f) ? (Ld / L) : 0.0f;
+
+                for(int k = 0; k < channels; k++) {
+                    float val = pixel[k] * scale;
+                    out[i * channels + k] = (isnan(val) || isinf(val)) ? 0.0f : val;
+                }
+            }
+        }
+    });
+}
+
+} // end namespace pic
+
+#endif /* PIC_TONE_MAPPING_REINHARD_TMO_FUSED_HPP */
+
@@ -26,6 +26,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/cached_table.hpp"
 #include "util/compability.hpp"
 //#include "util/convert_raw_to_images.hpp"
+#include "util/fft.hpp"
 #include "util/file_lister.hpp"
 
 #ifndef PIC_DISABLE_OPENGL
@@ -54,9 +55,11 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/point_samplers.hpp"
 #include "util/precomputed_gaussian.hpp"
 #include "util/raw.hpp"
+#include "util/simd.hpp"
 #include "util/string.hpp"
 #include "util/tile.hpp"
 #include "util/tile_list.hpp"
+#include "util/thread_pool.hpp"
 #include "util/vec.hpp"
 #include "util/warp_square_circle.hpp"
 #include "util/rasterizer.hpp"
@@ -20,9 +20,16 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <string.h>
 #include <complex>
+#include <vector>
+#include <map>
+
+#ifndef PIC_DISABLE_THREAD
+#include <mutex>
+#endif
 
 #include "base.hpp"
 #include "util/math.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
@@ -134,9 +141,9 @@ float *FFTIterative1D(float *in, unsigned int n, float *out = NULL)
         complexf omega_m = complexf(cosf(angle), sinf(angle));
         complexf omega = complexf(1.0f, 0.0f);
 
-        for(unsigned int j = 0; j < (m / 2); j++) {
-            for(unsigned int k = j; k < n; k += m) {
-                unsigned int ind = k + m / 2;
+        for(int j = 0; j < (m / 2); j++) {
+            for(int k = j; k < int(n); k += m) {
+                int ind = k + m / 2;
 
                 complexf t = omega * complexf(out[RE(ind)], out[IM(ind)]);
                 complexf u = complexf(out[RE(k)], out[IM(k)]);
@@ -190,6 +197,768 @@ void fftTest()
     }
 }
 
+/**
+ * @brief The FFTPlan class is a 1D FFT of a given length. Twiddle factors
+ * are computed once when the plan is created, and plans are shared through
+ * getPlan. Lengths are factored into radices 4, 2, 3 and small odd primes
+ * (mixed radix); when a prime factor is larger than 31 the transform is
+ * computed with Bluestein's algorithm on a power of two length.
+ * The forward transform is X_k = sum_j x_j exp(-2 pi i j k / n), and
+ * the inverse one includes the 1 / n normalization. Plans are read-only
+ * after their creation, so a plan can be executed by several threads at once,
+ * each one with its own work buffer.
+ */
+class FFTPlan
+{
+protected:
+    int n;
+    std::vector<int> factors;
+    std::vector<complexf> twiddles;
+
+    //Bluestein
+    bool bBluestein;
+    int m;
+    std::vector<complexf> chirp, chirpFFT;
+    FFTPlan *sub;
+
+    //real transforms of even length
+    FFTPlan *half;
+
+    /**
+     * @brief factorize computes the radices of n.
+     * @return It returns false if a radix is too large for a mixed radix transform.
+     */
+    bool factorize()
+    {
+        factors.clear();
+
+        int r = n;
+        int p = 4;
+        while(r > 1) {
+            while((r % p) != 0) {
+                switch(p) {
+                case 4: p = 2; break;
+                case 2: p = 3; break;
+                default: p += 2; break;
+                }
+
+                if((p * p) > r) {
+                    p = r;
+                }
+            }
+
+            if(p > 31) {
+                return false;
+            }
+
+            r /= p;
+            factors.push_back(p);
+            factors.push_back(r);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief butterfly2
+     * @param out
+     * @param fstride
+     * @param m
+     */
+    void butterfly2(complexf *out, int fstride, int m) const
+    {
+        complexf *out2 = out + m;
+        const complexf *tw = twiddles.data();
+
+        for(int k = 0; k < m; k++) {
+            complexf t = out2[k] * tw[k * fstride];
+            out2[k] = out[k] - t;
+            out[k] += t;
+        }
+    }
+
+    /**
+     * @brief butterfly3
+     * @param out
+     * @param fstride
+     * @param m
+     */
+    void butterfly3(complexf *out, int fstride, int m) const
+    {
+        const complexf *tw = twiddles.data();
+        float epi3 = tw[fstride * m].imag();
+
+        for(int k = 0; k < m; k++) {
+            complexf s1 = out[k + m] * tw[k * fstride];
+            complexf s2 = out[k + 2 * m] * tw[2 * k * fstride];
+            complexf s3 = s1 + s2;
+            complexf s0 = (s1 - s2) * epi3;
+
+            complexf t = out[k] - s3 * 0.5f;
+            out[k] += s3;
+            out[k + 2 * m] = complexf(t.real() + s0.imag(), t.imag() - s0.real());
+            out[k + m]     = complexf(t.real() - s0.imag(), t.imag() + s0.real());
+        }
+    }
+
+    /**
+     * @brief butterfly4
+     * @param out
+     * @param fstride
+     * @param m
+     */
+    void butterfly4(complexf *out, int fstride, int m) const
+    {
+        const complexf *tw = twiddles.data();
+
+        for(int k = 0; k < m; k++) {
+            complexf s0 = out[k + m] * tw[k * fstride];
+            complexf s1 = out[k + 2 * m] * tw[2 * k * fstride];
+            complexf s2 = out[k + 3 * m] * tw[3 * k * fstride];
+
+            complexf s5 = out[k] - s1;
+            out[k] += s1;
+            complexf s3 = s0 + s2;
+            complexf s4 = s0 - s2;
+
+            out[k + 2 * m] = out[k] - s3;
+            out[k] += s3;
+            out[k + m]     = complexf(s5.real() + s4.imag(), s5.imag() - s4.real());
+            out[k + 3 * m] = complexf(s5.real() - s4.imag(), s5.imag() + s4.real());
+        }
+    }
+
+    /**
+     * @brief butterflyGeneric is the O(p^2) butterfly of an odd radix p.
+     * @param out
+     * @param fstride
+     * @param m
+     * @param p
+     */
+    void butterflyGeneric(complexf *out, int fstride, int m, int p) const
+    {
+        const complexf *tw = twiddles.data();
+        complexf scratch[32];
+
+        for(int u = 0; u < m; u++) {
+            for(int q = 0; q < p; q++) {
+                scratch[q] = out[u + q * m];
+            }
+
+            for(int q1 = 0; q1 < p; q1++) {
+                int k = u + q1 * m;
+                int twidx = 0;
+                complexf sum = scratch[0];
+
+                for(int q = 1; q < p; q++) {
+                    twidx += fstride * k;
+                    twidx = twidx >= n ? twidx % n : twidx;
+                    sum += scratch[q] * tw[twidx];
+                }
+
+                out[k] = sum;
+            }
+        }
+    }
+
+    /**
+     * @brief work is the recursive decimation in time step.
+     * @param out is the output; it must not overlap in.
+     * @param in
+     * @param fstride
+     * @param f is the current pair (radix, remaining length) of factors.
+     */
+    void work(complexf *out, const complexf *in, int fstride, const int *f) const
+    {
+        int p = f[0];
+        int m = f[1];
+
+        if(m == 1) {
+            for(int i = 0; i < p; i++) {
+                out[i] = in[i * fstride];
+            }
+        } else {
+            for(int i = 0; i < p; i++) {
+                work(out + i * m, in + i * fstride, fstride * p, f + 2);
+            }
+        }
+
+        switch(p) {
+        case 2: butterfly2(out, fstride, m); break;
+        case 3: butterfly3(out, fstride, m); break;
+        case 4: butterfly4(out, fstride, m); break;
+        default: butterflyGeneric(out, fstride, m, p); break;
+        }
+    }
+
+    /**
+     * @brief forward computes the forward transform of data in place.
+     * @param data
+     * @param buf is a work buffer of getWorkSize() elements.
+     */
+    void forward(complexf *data, complexf *buf) const
+    {
+        if(n < 2) {
+            return;
+        }
+
+        if(!bBluestein) {
+            memcpy(buf, data, sizeof(complexf) * n);
+            work(data, buf, 1, factors.data());
+            return;
+        }
+
+        complexf *a = buf;
+        complexf *buf_sub = buf + m;
+
+        for(int k = 0; k < n; k++) {
+            a[k] = data[k] * chirp[k];
+        }
+
+        for(int k = n; k < m; k++) {
+            a[k] = complexf(0.0f, 0.0f);
+        }
+
+        sub->execute(a, false, buf_sub);
+
+        for(int k = 0; k < m; k++) {
+            a[k] *= chirpFFT[k];
+        }
+
+        sub->execute(a, true, buf_sub);
+
+        for(int k = 0; k < n; k++) {
+            data[k] = a[k] * chirp[k];
+        }
+    }
+
+public:
+
+    /**
+     * @brief FFTPlan creates a plan for transforms of length n.
+     * @param n
+     * @param bReal if it is true, real transforms of even length are computed
+     * with a complex transform of half length.
+     */
+    FFTPlan(int n, bool bReal = true)
+    {
+        this->n = MAX(n, 1);
+        sub = NULL;
+        half = NULL;
+        m = 0;
+
+        twiddles.resize(this->n);
+        for(int k = 0; k < this->n; k++) {
+            double angle = -C_PI_2 * double(k) / double(this->n);
+            twiddles[k] = complexf(float(cos(angle)), float(sin(angle)));
+        }
+
+        bBluestein = !factorize();
+
+        if(bBluestein) {
+            m = 1;
+            while(m < (2 * this->n - 1)) {
+                m <<= 1;
+            }
+
+            sub = new FFTPlan(m, false);
+
+            chirp.resize(this->n);
+            chirpFFT.assign(m, complexf(0.0f, 0.0f));
+
+            long long n2 = 2 * (long long) this->n;
+            for(int k = 0; k < this->n; k++) {
+                long long k2 = ((long long) k * (long long) k) % n2;
+                double angle = -C_PI * double(k2) / double(this->n);
+                chirp[k] = complexf(float(cos(angle)), float(sin(angle)));
+            }
+
+            chirpFFT[0] = std::conj(chirp[0]);
+            for(int k = 1; k < this->n; k++) {
+                chirpFFT[k] = std::conj(chirp[k]);
+                chirpFFT[m - k] = std::conj(chirp[k]);
+            }
+
+            std::vector<complexf> tmp(sub->getWorkSize());
+            sub->execute(chirpFFT.data(), false, tmp.data());
+        }
+
+        if(bReal && ((this->n % 2) == 0) && (this->n > 2)) {
+            half = new FFTPlan(this->n / 2, false);
+        }
+    }
+
+    ~FFTPlan()
+    {
+        if(sub != NULL) {
+            delete sub;
+            sub = NULL;
+        }
+
+        if(half != NULL) {
+            delete half;
+            half = NULL;
+        }
+    }
+
+    //plans own sub and half; they are shared by pointer, never copied
+    FFTPlan(const FFTPlan &) = delete;
+    FFTPlan &operator =(const FFTPlan &) = delete;
+
+    /**
+     * @brief getSize
+     * @return It returns the length of the transform.
+     */
+    int getSize() const
+    {
+        return n;
+    }
+
+    /**
+     * @brief getWorkSize
+     * @return It returns the number of complex values of the work buffer of execute,
+     * executeReal and executeRealInverse.
+     */
+    int getWorkSize() const
+    {
+        int size = bBluestein ? (2 * m) : n;
+
+        if(half != NULL) {
+            return MAX(size, n / 2 + half->getWorkSize());
+        } else {
+            return n + size;
+        }
+    }
+
+    /**
+     * @brief execute computes the transform of n complex values in place.
+     * @param data
+     * @param bInverse
+     * @param buf is a work buffer of getWorkSize() elements; if it is NULL,
+     * it is allocated.
+     */
+    void execute(complexf *data, bool bInverse, complexf *buf = NULL) const
+    {
+        std::vector<complexf> tmp;
+        if(buf == NULL) {
+            tmp.resize(getWorkSize());
+            buf = tmp.data();
+        }
+
+        if(!bInverse) {
+            forward(data, buf);
+            return;
+        }
+
+        //inverse(x) = conj(forward(conj(x))) / n
+        for(int k = 0; k < n; k++) {
+            data[k] = std::conj(data[k]);
+        }
+
+        forward(data, buf);
+
+        float scale = 1.0f / float(n);
+        for(int k = 0; k < n; k++) {
+            data[k] = std::conj(data[k]) * scale;
+        }
+    }
+
+    /**
+     * @brief executeReal computes the transform of n real values; only the
+     * n / 2 + 1 non-redundant outputs are stored.
+     * @param in is an array of n values.
+     * @param out is an array of n / 2 + 1 values.
+     * @param stride is the distance between two input values.
+     * @param buf is a work buffer of getWorkSize() elements; it can be NULL.
+     */
+    void executeReal(const float *in, complexf *out, int stride = 1,
+                     complexf *buf = NULL) const
+    {
+        std::vector<complexf> tmp;
+        if(buf == NULL) {
+            tmp.resize(getWorkSize());
+            buf = tmp.data();
+        }
+
+        if(half == NULL) {
+            complexf *z = buf;
+            for(int k = 0; k < n; k++) {
+                z[k] = complexf(in[k * stride], 0.0f);
+            }
+
+            forward(z, buf + n);
+
+            for(int k = 0; k <= (n / 2); k++) {
+                out[k] = z[k];
+            }
+            return;
+        }
+
+        //even values in the real part, odd ones in the imaginary part
+        int h = n / 2;
+        complexf *z = buf;
+        for(int k = 0; k < h; k++) {
+            z[k] = complexf(in[(2 * k) * stride], in[(2 * k + 1) * stride]);
+        }
+
+        half->execute(z, false, buf + h);
+
+        for(int k = 0; k <= h; k++) {
+            complexf zk  = z[k % h];
+            complexf zhk = std::conj(z[(h - k) % h]);
+
+            complexf e = (zk + zhk) * 0.5f;
+            complexf o = (zk - zhk) * complexf(0.0f, -0.5f);
+
+            out[k] = e + twiddles[k] * o;
+        }
+    }
+
+    /**
+     * @brief executeRealInverse computes the inverse transform of a spectrum
+     * of a real signal, given its n / 2 + 1 non-redundant values.
+     * @param in is an array of n / 2 + 1 values.
+     * @param out is an array of n values.
+     * @param stride is the distance between two output values.
+     * @param buf is a work buffer of getWorkSize() elements; it can be NULL.
+     */
+    void executeRealInverse(const complexf *in, float *out, int stride = 1,
+                            complexf *buf = NULL) const
+    {
+        std::vector<complexf> tmp;
+        if(buf == NULL) {
+            tmp.resize(getWorkSize());
+            buf = tmp.data();
+        }
+
+        if(half == NULL) {
+            complexf *z = buf;
+            for(int k = 0; k <= (n / 2); k++) {
+                z[k] = in[k];
+            }
+
+            for(int k = (n / 2) + 1; k < n; k++) {
+                z[k] = std::conj(in[n - k]);
+            }
+
+            execute(z, true, buf + n);
+
+            for(int k = 0; k < n; k++) {
+                out[k * stride] = z[k].real();
+            }
+            return;
+        }
+
+        int h = n / 2;
+        complexf *z = buf;
+        for(int k = 0; k < h; k++) {
+            complexf xk  = in[k];
+            complexf xhk = std::conj(in[h - k]);
+
+            complexf e = (xk + xhk) * 0.5f;
+            complexf o = (xk - xhk) * 0.5f * std::conj(twiddles[k]);
+
+            z[k] = e + complexf(0.0f, 1.0f) * o;
+        }
+
+        half->execute(z, true, buf + h);
+
+        for(int k = 0; k < h; k++) {
+            out[(2 * k) * stride]     = z[k].real();
+            out[(2 * k + 1) * stride] = z[k].imag();
+        }
+    }
+
+    /**
+     * @brief getFastSize returns the smallest length not lower than n
+     * whose only prime factors are 2, 3 and 5.
+     * @param n
+     * @return
+     */
+    static int getFastSize(int n)
+    {
+        if(n < 2) {
+            return 1;
+        }
+
+        while(true) {
+            int r = n;
+
+            while((r % 2) == 0) {
+                r /= 2;
+            }
+
+            while((r % 3) == 0) {
+                r /= 3;
+            }
+
+            while((r % 5) == 0) {
+                r /= 5;
+            }
+
+            if(r == 1) {
+                return n;
+            }
+
+            n++;
+        }
+    }
+
+    /**
+     * @brief getPlan returns the shared plan of length n; it is created the first
+     * time it is requested.
+     * @param n
+     * @return
+     */
+    static FFTPlan *getPlan(int n)
+    {
+        struct PlanCache
+        {
+            std::map<int, FFTPlan *> plans;
+
+            ~PlanCache()
+            {
+                std::map<int, FFTPlan *>::iterator it;
+                for(it = plans.begin(); it != plans.end(); it++) {
+                    delete it->second;
+                }
+            }
+        };
+
+        static PlanCache cache;
+#ifndef PIC_DISABLE_THREAD
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+        std::map<int, FFTPlan *>::iterator it = cache.plans.find(n);
+
+        if(it != cache.plans.end()) {
+            return it->second;
+        }
+
+        FFTPlan *plan = new FFTPlan(n);
+        cache.plans[n] = plan;
+        return plan;
+    }
+};
+
+/**
+ * @brief The FFTPlanND class computes FFTs of 2D and 3D (width x height x frames)
+ * arrays by 1D transforms along rows, then columns, and then frames. Each pass
+ * is split into blocks of lines that run in parallel; columns and frames are
+ * gathered in groups of adjacent lines to keep memory accesses contiguous.
+ * Real transforms store only the width / 2 + 1 non-redundant values of each
+ * row of the spectrum.
+ */
+class FFTPlanND
+{
+protected:
+    int width, height, frames;
+    FFTPlan *plan_x, *plan_y, *plan_z;
+    ThreadPool *pool;
+    int nThreads;
+
+    /**
+     * @brief getNumBlocks
+     * @param tp
+     * @return It returns the number of parallel blocks of a pass.
+     */
+    int getNumBlocks(ThreadPool *tp)
+    {
+        int n = nThreads > 0 ? MIN(nThreads, tp->getNumThreads()) : tp->getNumThreads();
+        return n > 1 ? n * 2 : 1;
+    }
+
+    /**
+     * @brief passLines transforms, in place, lines of length n and stride
+     * 'stride' that start at data + i * step for i in [0, nLines), for each
+     * of nOuter blocks of outerStride elements.
+     */
+    void passLines(complexf *data, FFTPlan *plan, int n, int stride,
+                   int nLines, int nOuter, int outerStride, bool bInverse)
+    {
+        if(n < 2) {
+            return;
+        }
+
+        const int group = 16;
+        int nGroups = (nLines + group - 1) / group;
+        int nTasks = nGroups * nOuter;
+
+        ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+
+        tp->parallelForBlocks(0, nTasks, getNumBlocks(tp),
+            [&](int t0, int t1) {
+                std::vector<complexf> line(group * n);
+                std::vector<complexf> buf(plan->getWorkSize());
+
+                for(int t = t0; t < t1; t++) {
+                    int o = t / nGroups;
+                    int l0 = (t % nGroups) * group;
+                    int l1 = MIN(l0 + group, nLines);
+                    int nl = l1 - l0;
+
+                    complexf *base = data + o * outerStride + l0;
+
+                    for(int j = 0; j < n; j++) {
+                        complexf *src = base + j * stride;
+                        for(int l = 0; l < nl; l++) {
+                            line[l * n + j] = src[l];
+                        }
+                    }
+
+                    for(int l = 0; l < nl; l++) {
+                        plan->execute(&line[l * n], bInverse, buf.data());
+                    }
+
+                    for(int j = 0; j < n; j++) {
+                        complexf *dst = base + j * stride;
+                        for(int l = 0; l < nl; l++) {
+                            dst[l] = line[l * n + j];
+                        }
+                    }
+                }
+            });
+    }
+
+    /**
+     * @brief passYZ transforms columns and frames of rows of length w.
+     */
+    void passYZ(complexf *data, int w, bool bInverse)
+    {
+        passLines(data, plan_y, height, w, w, frames, w * height, bInverse);
+        passLines(data, plan_z, frames, w * height, w * height, 1, 0, bInverse);
+    }
+
+public:
+
+    /**
+     * @brief FFTPlanND
+     * @param width
+     * @param height
+     * @param frames
+     */
+    FFTPlanND(int width, int height, int frames = 1)
+    {
+        this->width = MAX(width, 1);
+        this->height = MAX(height, 1);
+        this->frames = MAX(frames, 1);
+
+        plan_x = FFTPlan::getPlan(this->width);
+        plan_y = FFTPlan::getPlan(this->height);
+        plan_z = FFTPlan::getPlan(this->frames);
+
+        pool = NULL;
+        nThreads = -1;
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads of a pass; 1 runs the
+     * passes on the calling thread (e.g. when tiles are already processed in parallel).
+     * @param nThreads is the number of threads. If it is lower than 1, all
+     * threads of the pool are used.
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief getSpectrumWidth
+     * @return It returns the width of the spectrum of real transforms.
+     */
+    int getSpectrumWidth() const
+    {
+        return width / 2 + 1;
+    }
+
+    /**
+     * @brief getSpectrumSize
+     * @return It returns the number of values of the spectrum of real transforms.
+     */
+    int getSpectrumSize() const
+    {
+        return getSpectrumWidth() * height * frames;
+    }
+
+    /**
+     * @brief execute computes the complex transform of width * height * frames
+     * values in place.
+     * @param data
+     * @param bInverse
+     */
+    void execute(complexf *data, bool bInverse)
+    {
+        int w = width;
+        passLines(data, plan_x, w, 1, 1, height * frames, w, bInverse);
+        passYZ(data, w, bInverse);
+    }
+
+    /**
+     * @brief executeReal computes the transform of a channel of an
+     * interleaved real array (e.g. Image::data).
+     * @param in
+     * @param channels is the number of channels of in.
+     * @param channel is the channel to be transformed.
+     * @param out is an array of getSpectrumSize() values.
+     */
+    void executeReal(const float *in, int channels, int channel, complexf *out)
+    {
+        int sw = getSpectrumWidth();
+        int nRows = height * frames;
+        FFTPlan *plan = plan_x;
+        int w = width;
+
+        ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+        tp->parallelForBlocks(0, nRows, getNumBlocks(tp), [&](int r0, int r1) {
+            std::vector<complexf> buf(plan->getWorkSize());
+            for(int r = r0; r < r1; r++) {
+                plan->executeReal(&in[r * w * channels + channel], &out[r * sw],
+                                  channels, buf.data());
+            }
+        });
+
+        passYZ(out, sw, false);
+    }
+
+    /**
+     * @brief executeRealInverse computes the inverse transform of a spectrum
+     * computed by executeReal.
+     * @param in is an array of getSpectrumSize() values; it is overwritten.
+     * @param out
+     * @param channels is the number of channels of out.
+     * @param channel is the channel to be written.
+     */
+    void executeRealInverse(complexf *in, float *out, int channels, int channel)
+    {
+        int sw = getSpectrumWidth();
+        int nRows = height * frames;
+        FFTPlan *plan = plan_x;
+        int w = width;
+
+        passYZ(in, sw, true);
+
+        ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+        tp->parallelForBlocks(0, nRows, getNumBlocks(tp), [&](int r0, int r1) {
+            std::vector<complexf> buf(plan->getWorkSize());
+            for(int r = r0; r < r1; r++) {
+                plan->executeRealInverse(&in[r * sw], &out[r * w * channels + channel],
+                                         channels, buf.data());
+            }
+        });
+    }
+};
+
 } // end namespace pic
 
 #endif /* PIC_UTIL_FFT_HPP */
@@ -21,9 +21,12 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <vector>
 #include <set>
 #include <chrono>
+#include <limits>
+#include <functional>
 
 #include "util/array.hpp"
 #include "util/math.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic{
 
@@ -130,79 +133,761 @@ T* kMeanscomputeRandomCenters(T *samples, int nSamples, int nDim, int k, T* cent
 
 
 /**
- * @brief KMeans
- * @param data
- * @param nData
- * @param k
- * @param maxIter
+ * @brief The KMEANS_SEEDING enum
+ * KMS_RANDOM: random centers in the bounding box of the samples
+ *
+ * KMS_PLUS_PLUS: k-means++ [Arthur and Vassilvitskii 2007]
+ *
+ * KMS_PARALLEL: k-means|| [Bahmani et al. 2012]
+ */
+enum KMEANS_SEEDING {KMS_RANDOM, KMS_PLUS_PLUS, KMS_PARALLEL};
+
+/**
+ * @brief The KMeans class clusters samples with k-means. Labels are stored
+ * in a flat array. Lloyd's iterations are accelerated with Hamerly's
+ * triangle-inequality bounds: for each sample, an upper bound to the distance
+ * from its center and a lower bound to the distance from the second closest
+ * center are kept, so most distances are never recomputed. Alternatively,
+ * mini-batch k-means [Sculley 2010] updates the centers with random subsets
+ * of the samples. Assignment, update and seeding steps run in parallel over
+ * fixed blocks of samples, so results do not depend on the number of threads.
  */
 template<class T>
-T* kMeans(T *samples, int nSamples, int nDim,
-          unsigned int k, T *centers,
-          std::vector< std::set<unsigned int> *> &labels,
-          unsigned int maxIter = 100)
-{    
-    if(nSamples < k) {
-        return NULL;
+class KMeans
+{
+protected:
+    KMEANS_SEEDING seeding;
+    unsigned int maxIter, seed;
+    int batchSize, nIterations;
+    double inertia;
+
+    ThreadPool *pool;
+    int nThreads;
+
+    //current problem
+    T *samples, *centers;
+    int nSamples, nDim, k;
+
+    static const int BLOCK_SIZE = 4096;
+
+    /**
+     * @brief getNumBlocks
+     * @param n
+     * @return
+     */
+    static int getNumBlocks(int n)
+    {
+        return (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
     }
 
-    labels.clear();
-    for(unsigned int i = 0; i < k; i++) {
-        labels.push_back(new std::set<unsigned int>);
+    /**
+     * @brief parallelBlocks runs func(block, start, end) for each block
+     * of BLOCK_SIZE samples in [0, n).
+     * @param n
+     * @param func
+     */
+    void parallelBlocks(int n, std::function<void(int, int, int)> func)
+    {
+        int nBlocks = getNumBlocks(n);
+
+        auto block_func = [n, &func](int b) {
+            int i0 = b * BLOCK_SIZE;
+            func(b, i0, MIN(i0 + BLOCK_SIZE, n));
+        };
+
+        if((nThreads == 1) || (nBlocks == 1)) {
+            for(int b = 0; b < nBlocks; b++) {
+                block_func(b);
+            }
+        } else {
+            ThreadPool *tp = pool != NULL ? pool : ThreadPool::getInstance();
+            tp->parallelFor(nBlocks, block_func);
+        }
     }
 
-    if(centers == NULL) {
-        centers = kMeanscomputeRandomCenters<T>(samples, nSamples, nDim, k, NULL);
+    /**
+     * @brief distanceSq
+     * @param a
+     * @param b
+     * @return
+     */
+    inline T distanceSq(const T *a, const T *b)
+    {
+        T ret = T(0);
+        for(int d = 0; d < nDim; d++) {
+            T tmp = a[d] - b[d];
+            ret += tmp * tmp;
+        }
+        return ret;
     }
 
-    for(unsigned int i = 0; i < nSamples; i++) {
-        T *sample_i = &samples[i * nDim];
+    /**
+     * @brief nearest finds the closest and the second closest centers.
+     * @param x
+     * @param d1 is the squared distance from the closest center.
+     * @param d2 is the squared distance from the second closest center.
+     * @return It returns the index of the closest center.
+     */
+    inline int nearest(const T *x, T &d1, T &d2)
+    {
+        int label = 0;
+        d1 = distanceSq(x, centers);
+        d2 = std::numeric_limits<T>::max();
+
+        for(int j = 1; j < k; j++) {
+            T d = distanceSq(x, &centers[j * nDim]);
+
+            if(d < d1) {
+                d2 = d1;
+                d1 = d;
+                label = j;
+            } else {
+                if(d < d2) {
+                    d2 = d;
+                }
+            }
+        }
 
-        unsigned int label = kMeansAssignLabel(sample_i, nDim, centers, k);
-        labels[label]->insert(i);
+        return label;
     }
 
-    T *mean = new T[k * nDim];
+    /**
+     * @brief uniform is a counter-based random number in [0, 1).
+     * @param a
+     * @param b
+     * @return
+     */
+    inline double uniform(unsigned long long a, unsigned long long b)
+    {
+        unsigned long long z = (a * 0x9e3779b97f4a7c15ull) ^ (b + 0x632be59bd9b4e019ull + (unsigned long long) seed);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z = z ^ (z >> 31);
+        return double(z >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * @brief updateMinDistance sets D[i] = min(D[i], d(x_i, c)^2) for
+     * the centers in [c0, c1), and it returns the sum of D.
+     * @param D
+     * @param c
+     * @param c0
+     * @param c1
+     * @return
+     */
+    double updateMinDistance(std::vector<T> &D, T *c, int c0, int c1)
+    {
+        std::vector<double> block_sum(getNumBlocks(nSamples), 0.0);
+
+        parallelBlocks(nSamples, [this, &D, &block_sum, c, c0, c1](int b, int i0, int i1) {
+            double sum = 0.0;
+
+            for(int i = i0; i < i1; i++) {
+                T *x = &samples[i * nDim];
+
+                for(int j = c0; j < c1; j++) {
+                    D[i] = MIN(D[i], distanceSq(x, &c[j * nDim]));
+                }
+
+                sum += double(D[i]);
+            }
+
+            block_sum[b] = sum;
+        });
+
+        double sum = 0.0;
+        for(unsigned int b = 0; b < block_sum.size(); b++) {
+            sum += block_sum[b];
+        }
 
-    for(unsigned int i = 0; i < maxIter; i++) {
-        bool bNoChanges = true;
+        return sum;
+    }
 
-        for(unsigned int j = 0; j < k; j++) {
-            //compute new means
-            int index = j * nDim;
-            std::set<unsigned int> *tmp = labels.at(j);
-            kMeansComputeMean(samples, &mean[index], nDim, tmp);
+    /**
+     * @brief plusPlus runs k-means++ seeding on weighted points.
+     * @param points
+     * @param weights
+     * @param n
+     * @param m
+     */
+    void plusPlus(T *points, double *weights, int n, std::mt19937 &m)
+    {
+        std::vector<double> D(n, std::numeric_limits<double>::max());
+
+        std::uniform_int_distribution<int> dist_int(0, n - 1);
+        int index = dist_int(m);
+
+        for(int c = 0; c < k; c++) {
+            Array<T>::assign(&points[index * nDim], &centers[c * nDim], nDim);
+
+            if(c == (k - 1)) {
+                break;
+            }
 
-            //update centers
-            float dist = Array<float>::distanceSq(&centers[index], &mean[index], nDim);
+            double sum = 0.0;
+            for(int i = 0; i < n; i++) {
+                D[i] = MIN(D[i], double(distanceSq(&points[i * nDim], &centers[c * nDim])));
+                sum += D[i] * weights[i];
+            }
 
-            Array<float>::assign(&mean[index], &centers[index], nDim);
+            if(sum <= 0.0) {
+                index = dist_int(m);
+                continue;
+            }
 
-            if(dist > 1e-6f) {
-                bNoChanges = false;
+            double r = uniform(c, m()) * sum;
+            index = n - 1;
+            for(int i = 0; i < n; i++) {
+                r -= D[i] * weights[i];
+                if(r < 0.0) {
+                    index = i;
+                    break;
+                }
             }
         }
+    }
 
-        if(bNoChanges) {
-            #ifdef PIC_DEBUG
-                printf("Max iterations: %d\n", i);
-            #endif
-            return centers;
-        } else {
-            //clear labels
-            for(unsigned int j = 0; j < k; j++) {
-                labels[j]->clear();
+    /**
+     * @brief seedRandom
+     * @param m
+     */
+    void seedRandom(std::mt19937 &m)
+    {
+        std::vector<T> tMax(nDim, -std::numeric_limits<T>::max());
+        std::vector<T> tMin(nDim,  std::numeric_limits<T>::max());
+
+        for(int i = 0; i < nSamples; i++) {
+            for(int d = 0; d < nDim; d++) {
+                T s = samples[i * nDim + d];
+                tMax[d] = MAX(tMax[d], s);
+                tMin[d] = MIN(tMin[d], s);
+            }
+        }
+
+        for(int i = 0; i < k; i++) {
+            for(int d = 0; d < nDim; d++) {
+                centers[i * nDim + d] = T(Random(m()) * (tMax[d] - tMin[d]) + tMin[d]);
+            }
+        }
+    }
+
+    /**
+     * @brief seedPlusPlus runs k-means++ on the samples; D^2 sampling
+     * and distance updates run in parallel.
+     * @param m
+     */
+    void seedPlusPlus(std::mt19937 &m)
+    {
+        std::vector<T> D(nSamples, std::numeric_limits<T>::max());
+
+        std::uniform_int_distribution<int> dist_int(0, nSamples - 1);
+        int index = dist_int(m);
+
+        for(int c = 0; c < k; c++) {
+            Array<T>::assign(&samples[index * nDim], &centers[c * nDim], nDim);
+
+            if(c == (k - 1)) {
+                break;
+            }
+
+            double sum = updateMinDistance(D, centers, c, c + 1);
+
+            if(sum <= 0.0) {
+                index = dist_int(m);
+                continue;
+            }
+
+            double r = uniform(c, m()) * sum;
+            index = nSamples - 1;
+            for(int i = 0; i < nSamples; i++) {
+                r -= double(D[i]);
+                if(r < 0.0) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief seedParallel runs k-means||: 5 rounds sample about 2k candidates
+     * each with probability proportional to D^2, and k-means++ selects
+     * the centers among the candidates weighted by their cluster sizes.
+     * @param m
+     */
+    void seedParallel(std::mt19937 &m)
+    {
+        std::vector<T> D(nSamples, std::numeric_limits<T>::max());
+        std::vector<T> candidates;
+
+        std::uniform_int_distribution<int> dist_int(0, nSamples - 1);
+        int index = dist_int(m);
+        candidates.insert(candidates.end(), &samples[index * nDim], &samples[(index + 1) * nDim]);
+
+        double oversampling = 2.0 * double(k);
+        int nBlocks = getNumBlocks(nSamples);
+
+        double phi = updateMinDistance(D, &candidates[0], 0, 1);
+
+        for(int round = 0; (round < 5) && (phi > 0.0); round++) {
+            std::vector< std::vector<int> > selected(nBlocks);
+
+            parallelBlocks(nSamples, [this, &D, &selected, phi, oversampling, round](int b, int i0, int i1) {
+                for(int i = i0; i < i1; i++) {
+                    if(uniform(round + 1, i) < (oversampling * double(D[i]) / phi)) {
+                        selected[b].push_back(i);
+                    }
+                }
+            });
+
+            int c0 = int(candidates.size()) / nDim;
+
+            for(int b = 0; b < nBlocks; b++) {
+                for(unsigned int s = 0; s < selected[b].size(); s++) {
+                    int i = selected[b][s];
+                    candidates.insert(candidates.end(), &samples[i * nDim], &samples[(i + 1) * nDim]);
+                }
+            }
+
+            int c1 = int(candidates.size()) / nDim;
+
+            if(c0 == c1) {
+                break;
+            }
+
+            phi = updateMinDistance(D, &candidates[0], c0, c1);
+        }
+
+        int nCandidates = int(candidates.size()) / nDim;
+
+        if(nCandidates < k) {
+            seedPlusPlus(m);
+            return;
+        }
+
+        //weights: number of samples closest to each candidate
+        std::vector<int> closest(nSamples);
+        T *cand = &candidates[0];
+
+        parallelBlocks(nSamples, [this, &closest, cand, nCandidates](int b, int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                T *x = &samples[i * nDim];
+
+                int label = 0;
+                T d1 = distanceSq(x, cand);
+                for(int j = 1; j < nCandidates; j++) {
+                    T d = distanceSq(x, &cand[j * nDim]);
+                    if(d < d1) {
+                        d1 = d;
+                        label = j;
+                    }
+                }
+
+                closest[i] = label;
+            }
+        });
+
+        std::vector<double> weights(nCandidates, 0.0);
+        for(int i = 0; i < nSamples; i++) {
+            weights[closest[i]] += 1.0;
+        }
+
+        plusPlus(cand, &weights[0], nCandidates, m);
+    }
+
+    /**
+     * @brief computeCenters computes the mean of each cluster; empty clusters
+     * keep their center.
+     * @param labels
+     * @param movement is the distance traveled by each center.
+     */
+    void computeCenters(unsigned int *labels, std::vector<T> &movement)
+    {
+        int nBlocks = getNumBlocks(nSamples);
+        int kd = k * nDim;
+
+        std::vector<double> sums(nBlocks * kd, 0.0);
+        std::vector<int> counts(nBlocks * k, 0);
+
+        parallelBlocks(nSamples, [this, labels, &sums, &counts, kd](int b, int i0, int i1) {
+            double *sum = &sums[b * kd];
+            int *count = &counts[b * k];
+
+            for(int i = i0; i < i1; i++) {
+                unsigned int l = labels[i];
+                T *x = &samples[i * nDim];
+                double *sum_l = &sum[l * nDim];
+
+                for(int d = 0; d < nDim; d++) {
+                    sum_l[d] += double(x[d]);
+                }
+
+                count[l]++;
+            }
+        });
+
+        movement.assign(k, T(0));
+
+        for(int j = 0; j < k; j++) {
+            double count = 0.0;
+            for(int b = 0; b < nBlocks; b++) {
+                count += double(counts[b * k + j]);
+            }
+
+            if(count <= 0.0) {
+                continue;
+            }
+
+            T *c = &centers[j * nDim];
+            T dist = T(0);
+
+            for(int d = 0; d < nDim; d++) {
+                double sum = 0.0;
+                for(int b = 0; b < nBlocks; b++) {
+                    sum += sums[b * kd + j * nDim + d];
+                }
+
+                T value = T(sum / count);
+                dist += (value - c[d]) * (value - c[d]);
+                c[d] = value;
+            }
+
+            movement[j] = T(sqrt(double(dist)));
+        }
+    }
+
+    /**
+     * @brief lloydHamerly
+     * @param labels
+     */
+    void lloydHamerly(unsigned int *labels)
+    {
+        std::vector<T> upper(nSamples), lower(nSamples);
+
+        //initial assignment
+        parallelBlocks(nSamples, [this, labels, &upper, &lower](int b, int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                T d1, d2;
+                labels[i] = nearest(&samples[i * nDim], d1, d2);
+                upper[i] = T(sqrt(double(d1)));
+                lower[i] = T(sqrt(double(d2)));
+            }
+        });
+
+        std::vector<T> movement, s(k);
+        std::vector<int> block_changes(getNumBlocks(nSamples));
+
+        nIterations = 0;
+
+        for(unsigned int it = 0; it < maxIter; it++) {
+            nIterations++;
+
+            computeCenters(labels, movement);
+
+            //the two largest movements
+            int j_max = 0;
+            T p1 = T(0), p2 = T(0);
+            for(int j = 0; j < k; j++) {
+                if(movement[j] > p1) {
+                    p2 = p1;
+                    p1 = movement[j];
+                    j_max = j;
+                } else {
+                    if(movement[j] > p2) {
+                        p2 = movement[j];
+                    }
+                }
+            }
+
+            if(p1 <= T(0)) {
+                break;
+            }
+
+            //half the distance from each center to the closest other center
+            for(int j = 0; j < k; j++) {
+                T d_min = std::numeric_limits<T>::max();
+                for(int l = 0; l < k; l++) {
+                    if(l != j) {
+                        d_min = MIN(d_min, distanceSq(&centers[j * nDim], &centers[l * nDim]));
+                    }
+                }
+                s[j] = T(0.5 * sqrt(double(d_min)));
+            }
+
+            T *mv = &movement[0];
+            T *sj = &s[0];
+
+            parallelBlocks(nSamples, [this, labels, &upper, &lower, &block_changes, mv, sj, j_max, p1, p2](int b, int i0, int i1) {
+                int changes = 0;
+
+                for(int i = i0; i < i1; i++) {
+                    unsigned int a = labels[i];
+
+                    //bounds update
+                    upper[i] += mv[a];
+                    lower[i] -= (int(a) == j_max) ? p2 : p1;
+
+                    T m = MAX(sj[a], lower[i]);
+
+                    if(upper[i] <= m) {
+                        continue;
+                    }
+
+                    T *x = &samples[i * nDim];
+
+                    //tightening the upper bound
+                    upper[i] = T(sqrt(double(distanceSq(x, &centers[a * nDim]))));
+
+                    if(upper[i] <= m) {
+                        continue;
+                    }
+
+                    T d1, d2;
+                    unsigned int label = nearest(x, d1, d2);
+                    upper[i] = T(sqrt(double(d1)));
+                    lower[i] = T(sqrt(double(d2)));
+
+                    if(label != a) {
+                        labels[i] = label;
+                        changes++;
+                    }
+                }
+
+                block_changes[b] = changes;
+            });
+
+            int changes = 0;
+            for(unsigned int b = 0; b < block_changes.size(); b++) {
+                changes += block_changes[b];
             }
 
-            //re-assign labels
-            for(unsigned int j = 0; j < nSamples; j++) {
-                T *sample_j = &samples[j * nDim];
-                unsigned int label = kMeansAssignLabel(sample_j, nDim, centers, k);
-                labels[label]->insert(j);
+            if(changes == 0) {
+                break;
             }
         }
     }
 
+    /**
+     * @brief miniBatch
+     * @param labels
+     * @param m
+     */
+    void miniBatch(unsigned int *labels, std::mt19937 &m)
+    {
+        std::vector<double> counts(k, 0.0);
+        std::vector<int> batch(batchSize);
+        std::vector<unsigned int> batch_labels(batchSize);
+
+        std::uniform_int_distribution<int> dist_int(0, nSamples - 1);
+
+        nIterations = 0;
+
+        for(unsigned int it = 0; it < maxIter; it++) {
+            nIterations++;
+
+            for(int i = 0; i < batchSize; i++) {
+                batch[i] = dist_int(m);
+            }
+
+            parallelBlocks(batchSize, [this, &batch, &batch_labels](int b, int i0, int i1) {
+                for(int i = i0; i < i1; i++) {
+                    T d1, d2;
+                    batch_labels[i] = nearest(&samples[batch[i] * nDim], d1, d2);
+                }
+            });
+
+            //per-center learning rate
+            for(int i = 0; i < batchSize; i++) {
+                unsigned int l = batch_labels[i];
+                counts[l] += 1.0;
+
+                T eta = T(1.0 / counts[l]);
+                T *c = &centers[l * nDim];
+                T *x = &samples[batch[i] * nDim];
+
+                for(int d = 0; d < nDim; d++) {
+                    c[d] += eta * (x[d] - c[d]);
+                }
+            }
+        }
+
+        parallelBlocks(nSamples, [this, labels](int b, int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                T d1, d2;
+                labels[i] = nearest(&samples[i * nDim], d1, d2);
+            }
+        });
+    }
+
+public:
+
+    /**
+     * @brief KMeans
+     * @param seeding
+     * @param maxIter
+     * @param batchSize is the number of samples of a mini-batch; if it is lower
+     * than 1, all samples are used (Lloyd's iterations with Hamerly's bounds).
+     * @param seed
+     */
+    KMeans(KMEANS_SEEDING seeding = KMS_PLUS_PLUS, unsigned int maxIter = 100,
+           int batchSize = 0, unsigned int seed = 1)
+    {
+        this->seeding = seeding;
+        this->maxIter = maxIter;
+        this->batchSize = batchSize;
+        this->seed = seed;
+
+        pool = NULL;
+        nThreads = -1;
+
+        nIterations = 0;
+        inertia = 0.0;
+    }
+
+    /**
+     * @brief setThreadPool sets the pool; by default the process-wide pool is used.
+     * @param pool
+     */
+    void setThreadPool(ThreadPool *pool)
+    {
+        this->pool = pool;
+    }
+
+    /**
+     * @brief setNumThreads sets the number of threads; if it is 1,
+     * k-means runs serially.
+     * @param nThreads
+     */
+    void setNumThreads(int nThreads)
+    {
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief getInertia
+     * @return It returns the sum of the squared distances of the samples
+     * from their centers after the last execution.
+     */
+    double getInertia()
+    {
+        return inertia;
+    }
+
+    /**
+     * @brief getNumIterations
+     * @return It returns the number of iterations of the last execution.
+     */
+    int getNumIterations()
+    {
+        return nIterations;
+    }
+
+    /**
+     * @brief execute
+     * @param samples is an array of nSamples * nDim values.
+     * @param nSamples
+     * @param nDim
+     * @param k
+     * @param centers is an array of k * nDim values. If it is NULL, it is
+     * allocated and seeded; otherwise, its values are the initial centers.
+     * @param labels is the label of each sample.
+     * @return It returns the centers, or NULL if nSamples < k.
+     */
+    T *execute(T *samples, int nSamples, int nDim, int k, T *centers,
+               std::vector<unsigned int> &labels)
+    {
+        if((samples == NULL) || (nSamples < k) || (k < 1) || (nDim < 1)) {
+            return NULL;
+        }
+
+        this->samples = samples;
+        this->nSamples = nSamples;
+        this->nDim = nDim;
+        this->k = k;
+
+        std::mt19937 m(seed);
+
+        if(centers == NULL) {
+            this->centers = centers = new T[k * nDim];
+
+            switch(seeding) {
+            case KMS_RANDOM: {
+                seedRandom(m);
+            } break;
+
+            case KMS_PLUS_PLUS: {
+                seedPlusPlus(m);
+            } break;
+
+            case KMS_PARALLEL: {
+                seedParallel(m);
+            } break;
+            }
+        } else {
+            this->centers = centers;
+        }
+
+        labels.resize(nSamples);
+
+        if((batchSize > 0) && (batchSize < nSamples)) {
+            miniBatch(&labels[0], m);
+        } else {
+            lloydHamerly(&labels[0]);
+        }
+
+        //inertia
+        std::vector<double> block_sum(getNumBlocks(nSamples), 0.0);
+        unsigned int *l = &labels[0];
+
+        parallelBlocks(nSamples, [this, l, &block_sum](int b, int i0, int i1) {
+            double sum = 0.0;
+            for(int i = i0; i < i1; i++) {
+                sum += double(distanceSq(&this->samples[i * this->nDim], &this->centers[l[i] * this->nDim]));
+            }
+            block_sum[b] = sum;
+        });
+
+        inertia = 0.0;
+        for(unsigned int b = 0; b < block_sum.size(); b++) {
+            inertia += block_sum[b];
+        }
+
+        return centers;
+    }
+};
+
+/**
+ * @brief KMeans
+ * @param data
+ * @param nData
+ * @param k
+ * @param maxIter
+ */
+template<class T>
+T* kMeans(T *samples, int nSamples, int nDim,
+          unsigned int k, T *centers,
+          std::vector< std::set<unsigned int> *> &labels,
+          unsigned int maxIter = 100)
+{    
+    if(nSamples < k) {
+        return NULL;
+    }
+
+    labels.clear();
+    for(unsigned int i = 0; i < k; i++) {
+        labels.push_back(new std::set<unsigned int>);
+    }
+
+    std::vector<unsigned int> flat_labels;
+
+    KMeans<T> km(KMS_PLUS_PLUS, maxIter);
+    centers = km.execute(samples, nSamples, nDim, k, centers, flat_labels);
+
+    for(int i = 0; i < nSamples; i++) {
+        std::set<unsigned int> *cluster = labels[flat_labels[i]];
+        cluster->insert(cluster->end(), i);
+    }
+
     return centers;
 }
 
@@ -226,6 +911,7 @@ T* kMeansSelect(T *samples, int nSamples, int nDim,
 {
 
     T *centers = NULL;
+    std::vector<unsigned int> flat_labels;
 
     k = 1;
     T prevErr;
@@ -233,25 +919,20 @@ T* kMeansSelect(T *samples, int nSamples, int nDim,
     while(bFlag) {
         k++;
         printf("k: %d\n", k);
-        labels.clear();
+
         if(centers != NULL) {
             delete[] centers;
         }
 
-        centers = kMeans<T>(samples, nSamples, nDim, k, NULL, labels, maxIter);
-
-        T err = T(0);
-        for(int i = 0; i < labels.size(); i++) {
-            T *center_i = &centers[i * nDim];
-
-            std::set<unsigned int> * cluster = labels.at(i);
-            for (std::set<unsigned int>::iterator it = cluster->begin(); it != cluster->end(); it++) {
-                int i = *it;
-                err += Array<T>::distanceSq(&samples[i * nDim], center_i, nDim);
-            }
+        KMeans<T> km(KMS_PLUS_PLUS, maxIter);
+        centers = km.execute(samples, nSamples, nDim, k, NULL, flat_labels);
 
+        if(centers == NULL) {
+            return NULL;
         }
 
+        T err = T(km.getInertia());
+
         if(k > 2) {
             float relErr = fabsf(float(err - prevErr)) / float(prevErr);
             printf("%f %f %f\n", err, prevErr, relErr);
@@ -263,11 +944,18 @@ T* kMeansSelect(T *samples, int nSamples, int nDim,
         prevErr = err;
     }
 
-    return centers;
-}
-
+    labels.clear();
+    for(unsigned int i = 0; i < k; i++) {
+        labels.push_back(new std::set<unsigned int>);
+    }
 
+    for(int i = 0; i < nSamples; i++) {
+        std::set<unsigned int> *cluster = labels[flat_labels[i]];
+        cluster->insert(cluster->end(), i);
+    }
 
+    return centers;
+}
 
 }
 
@@ -419,6 +419,41 @@ void getPermutation(std::mt19937 &m, unsigned int *perm, int nPerm, int n)
     }
 }
 
+/**
+ * @brief bitCount counts the bits set to 1 of a 32-bit word; the popcnt
+ * instruction is used when it is enabled at compile time.
+ * @param x
+ * @return
+ */
+inline unsigned int bitCount(unsigned int x)
+{
+#if defined(__POPCNT__) && (defined(__GNUC__) || defined(__clang__))
+    return (unsigned int) __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0f0f0f0fu;
+    return (x * 0x01010101u) >> 24;
+#endif
+}
+
+/**
+ * @brief bitCount64 counts the bits set to 1 of a 64-bit word.
+ * @param x
+ * @return
+ */
+inline unsigned int bitCount64(unsigned long long x)
+{
+#if defined(__POPCNT__) && (defined(__GNUC__) || defined(__clang__))
+    return (unsigned int) __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (unsigned int) ((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
 } // end namespace pic
 
 #endif
@@ -0,0 +1,134 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_SIMD_HPP
+#define PIC_UTIL_SIMD_HPP
+
+#include "base.hpp"
+
+//the widest instruction set enabled at compile time is used;
+//defining PIC_DISABLE_SIMD forces the scalar path
+#ifndef PIC_DISABLE_SIMD
+    #if defined(__AVX512F__)
+        #include <immintrin.h>
+        #define PIC_SIMD_AVX512
+    #elif defined(__AVX__)
+        #include <immintrin.h>
+        #define PIC_SIMD_AVX
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+        #include <emmintrin.h>
+        #define PIC_SIMD_SSE
+    #endif
+#endif
+
+namespace pic {
+
+/**
+ * @brief The SIMDFloat struct is a vector of SIMDFloat::width floats mapped
+ * on AVX-512, AVX or SSE registers, or a single float when SIMD
+ * is not available.
+ */
+struct SIMDFloat
+{
+#if defined(PIC_SIMD_AVX512)
+    __m512 v;
+    static const int width = 16;
+
+    SIMDFloat() {}
+    SIMDFloat(__m512 v) : v(v) {}
+
+    static SIMDFloat load(const float *p) { return SIMDFloat(_mm512_loadu_ps(p)); }
+    static SIMDFloat set1(float a) { return SIMDFloat(_mm512_set1_ps(a)); }
+    void store(float *p) const { _mm512_storeu_ps(p, v); }
+
+    friend SIMDFloat operator + (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm512_add_ps(a.v, b.v)); }
+    friend SIMDFloat operator - (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm512_sub_ps(a.v, b.v)); }
+    friend SIMDFloat operator * (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm512_mul_ps(a.v, b.v)); }
+    friend SIMDFloat operator / (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm512_div_ps(a.v, b.v)); }
+
+    //a * b + c
+    static SIMDFloat fmadd(const SIMDFloat &a, const SIMDFloat &b, const SIMDFloat &c) { return SIMDFloat(_mm512_fmadd_ps(a.v, b.v, c.v)); }
+
+#elif defined(PIC_SIMD_AVX)
+    __m256 v;
+    static const int width = 8;
+
+    SIMDFloat() {}
+    SIMDFloat(__m256 v) : v(v) {}
+
+    static SIMDFloat load(const float *p) { return SIMDFloat(_mm256_loadu_ps(p)); }
+    static SIMDFloat set1(float a) { return SIMDFloat(_mm256_set1_ps(a)); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend SIMDFloat operator + (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm256_add_ps(a.v, b.v)); }
+    friend SIMDFloat operator - (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm256_sub_ps(a.v, b.v)); }
+    friend SIMDFloat operator * (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm256_mul_ps(a.v, b.v)); }
+    friend SIMDFloat operator / (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm256_div_ps(a.v, b.v)); }
+
+    //a * b + c
+    static SIMDFloat fmadd(const SIMDFloat &a, const SIMDFloat &b, const SIMDFloat &c)
+    {
+#if defined(__FMA__)
+        return SIMDFloat(_mm256_fmadd_ps(a.v, b.v, c.v));
+#else
+        return SIMDFloat(_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v));
+#endif
+    }
+
+#elif defined(PIC_SIMD_SSE)
+    __m128 v;
+    static const int width = 4;
+
+    SIMDFloat() {}
+    SIMDFloat(__m128 v) : v(v) {}
+
+    static SIMDFloat load(const float *p) { return SIMDFloat(_mm_loadu_ps(p)); }
+    static SIMDFloat set1(float a) { return SIMDFloat(_mm_set1_ps(a)); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend SIMDFloat operator + (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm_add_ps(a.v, b.v)); }
+    friend SIMDFloat operator - (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm_sub_ps(a.v, b.v)); }
+    friend SIMDFloat operator * (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm_mul_ps(a.v, b.v)); }
+    friend SIMDFloat operator / (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(_mm_div_ps(a.v, b.v)); }
+
+    //a * b + c
+    static SIMDFloat fmadd(const SIMDFloat &a, const SIMDFloat &b, const SIMDFloat &c) { return SIMDFloat(_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)); }
+
+#else
+    float v;
+    static const int width = 1;
+
+    SIMDFloat() {}
+    SIMDFloat(float v) : v(v) {}
+
+    static SIMDFloat load(const float *p) { return SIMDFloat(*p); }
+    static SIMDFloat set1(float a) { return SIMDFloat(a); }
+    void store(float *p) const { *p = v; }
+
+    friend SIMDFloat operator + (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(a.v + b.v); }
+    friend SIMDFloat operator - (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(a.v - b.v); }
+    friend SIMDFloat operator * (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(a.v * b.v); }
+    friend SIMDFloat operator / (const SIMDFloat &a, const SIMDFloat &b) { return SIMDFloat(a.v / b.v); }
+
+    //a * b + c
+    static SIMDFloat fmadd(const SIMDFloat &a, const SIMDFloat &b, const SIMDFloat &c) { return SIMDFloat(a.v * b.v + c.v); }
+#endif
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_SIMD_HPP */
@@ -0,0 +1,369 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_THREAD_POOL_HPP
+#define PIC_UTIL_THREAD_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+#ifndef PIC_DISABLE_THREAD
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "base.hpp"
+#include "util/math.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ThreadPool class is a persistent pool of worker threads.
+ * Each worker owns a deque of tasks; a worker pops tasks from the back
+ * of its own deque and, when this is empty, it steals tasks from the front
+ * of the other workers' deques. The thread that submits a parallel job
+ * takes part in its execution, so nested jobs cannot deadlock.
+ */
+class ThreadPool
+{
+protected:
+
+    /**
+     * @brief The TaskGroup struct counts the tasks of a job still to be completed.
+     */
+    struct TaskGroup
+    {
+        std::atomic<int> remaining;
+    };
+
+    /**
+     * @brief The Task struct is a unit of work of a job.
+     */
+    struct Task
+    {
+        std::function<void(int)> *func;
+        int index;
+        std::shared_ptr<TaskGroup> group;
+    };
+
+#ifndef PIC_DISABLE_THREAD
+    /**
+     * @brief The WorkerQueue struct is the deque of a worker.
+     */
+    struct WorkerQueue
+    {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<WorkerQueue *> queues;
+
+    std::mutex mutex_sleep;
+    std::condition_variable cv_sleep;
+
+    std::atomic<int> nQueued;
+    std::atomic<unsigned int> nextQueue;
+    bool bStop;
+
+    /**
+     * @brief pop extracts a task from the back of the i-th deque.
+     * @param i is the index of the deque.
+     * @param task is the extracted task.
+     * @return This function returns true if a task was extracted.
+     */
+    bool pop(int i, Task &task)
+    {
+        std::lock_guard<std::mutex> lock(queues[i]->mutex);
+
+        if(queues[i]->tasks.empty()) {
+            return false;
+        }
+
+        task = queues[i]->tasks.back();
+        queues[i]->tasks.pop_back();
+        nQueued--;
+        return true;
+    }
+
+    /**
+     * @brief steal extracts a task from the front of a deque different from i.
+     * @param i is the index of the deque of the thief; it can be -1
+     * if the thief is not a worker.
+     * @param task is the extracted task.
+     * @return This function returns true if a task was extracted.
+     */
+    bool steal(int i, Task &task)
+    {
+        int n = int(queues.size());
+
+        for(int k = 1; k <= n; k++) {
+            int j = (MAX(i, 0) + k) % n;
+
+            if(j == i) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(queues[j]->mutex, std::try_to_lock);
+
+            if(!lock.owns_lock() || queues[j]->tasks.empty()) {
+                continue;
+            }
+
+            task = queues[j]->tasks.front();
+            queues[j]->tasks.pop_front();
+            nQueued--;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief workerLoop is the main loop of the i-th worker.
+     * @param i is the index of the worker.
+     */
+    void workerLoop(int i)
+    {
+        while(true) {
+            Task task;
+
+            if(pop(i, task) || steal(i, task)) {
+                execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_sleep);
+            cv_sleep.wait(lock, [this] { return bStop || (nQueued > 0); });
+
+            if(bStop && (nQueued <= 0)) {
+                return;
+            }
+        }
+    }
+#endif
+
+    /**
+     * @brief execute runs a task and signals its group.
+     * @param task is the task to be run.
+     */
+    static void execute(Task &task)
+    {
+        (*task.func)(task.index);
+        task.group->remaining--;
+    }
+
+public:
+
+    /**
+     * @brief ThreadPool creates a pool.
+     * @param nThreads is the number of threads working on a job, the calling
+     * thread included. If it is lower than 1, it is set to the number of
+     * hardware threads.
+     */
+    ThreadPool(int nThreads = -1)
+    {
+#ifndef PIC_DISABLE_THREAD
+        nQueued = 0;
+        nextQueue = 0;
+        bStop = false;
+
+        if(nThreads < 1) {
+            nThreads = getHardwareThreads();
+        }
+
+        for(int i = 0; i < (nThreads - 1); i++) {
+            queues.push_back(new WorkerQueue());
+        }
+
+        for(int i = 0; i < (nThreads - 1); i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+#endif
+    }
+
+    ~ThreadPool()
+    {
+#ifndef PIC_DISABLE_THREAD
+        {
+            std::lock_guard<std::mutex> lock(mutex_sleep);
+            bStop = true;
+        }
+
+        cv_sleep.notify_all();
+
+        for(unsigned int i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+
+        for(unsigned int i = 0; i < queues.size(); i++) {
+            delete queues[i];
+        }
+
+        workers.clear();
+        queues.clear();
+#endif
+    }
+
+    /**
+     * @brief getNumThreads returns the number of threads working on a job,
+     * the calling thread included.
+     * @return This function returns the number of threads.
+     */
+    int getNumThreads()
+    {
+#ifndef PIC_DISABLE_THREAD
+        return int(workers.size()) + 1;
+#else
+        return 1;
+#endif
+    }
+
+    /**
+     * @brief parallelFor runs func(i) for i in [0, n) and it waits for
+     * all calls to be completed. The calling thread executes tasks while waiting.
+     * @param n is the number of tasks.
+     * @param func is the function to be executed for each task.
+     */
+    void parallelFor(int n, std::function<void(int)> func)
+    {
+        if(n < 1) {
+            return;
+        }
+
+#ifndef PIC_DISABLE_THREAD
+        int nQueues = int(queues.size());
+
+        if((nQueues == 0) || (n == 1)) {
+            for(int i = 0; i < n; i++) {
+                func(i);
+            }
+
+            return;
+        }
+
+        std::shared_ptr<TaskGroup> group = std::make_shared<TaskGroup>();
+        group->remaining = n;
+
+        //the first task is kept for the calling thread
+        unsigned int start = nextQueue.fetch_add(1);
+
+        for(int i = 1; i < n; i++) {
+            Task task;
+            task.func = &func;
+            task.index = i;
+            task.group = group;
+
+            int j = int((start + i) % nQueues);
+
+            std::lock_guard<std::mutex> lock(queues[j]->mutex);
+            queues[j]->tasks.push_back(task);
+            nQueued++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_sleep);
+        }
+        cv_sleep.notify_all();
+
+        Task first;
+        first.func = &func;
+        first.index = 0;
+        first.group = group;
+        execute(first);
+
+        //help the workers until the job is completed
+        while(group->remaining > 0) {
+            Task task;
+
+            if(steal(-1, task)) {
+                execute(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+#else
+        for(int i = 0; i < n; i++) {
+            func(i);
+        }
+#endif
+    }
+
+    /**
+     * @brief parallelForBlocks splits [start, end) into nBlocks contiguous
+     * blocks, and it runs func(block_start, block_end) for each block in parallel.
+     * @param start is the first index.
+     * @param end is the last index (excluded).
+     * @param nBlocks is the number of blocks. If it is lower than 1, it is set
+     * to the number of threads.
+     * @param func is the function to be executed for each block.
+     */
+    void parallelForBlocks(int start, int end, int nBlocks,
+                           std::function<void(int, int)> func)
+    {
+        int n = end - start;
+
+        if(n < 1) {
+            return;
+        }
+
+        if(nBlocks < 1) {
+            nBlocks = getNumThreads();
+        }
+
+        nBlocks = MIN(nBlocks, n);
+
+        parallelFor(nBlocks, [start, n, nBlocks, &func](int i) {
+            int b0 = start + int((long(n) * long(i)) / long(nBlocks));
+            int b1 = start + int((long(n) * long(i + 1)) / long(nBlocks));
+            func(b0, b1);
+        });
+    }
+
+    /**
+     * @brief getHardwareThreads returns the number of hardware threads.
+     * @return This function returns the number of hardware threads.
+     */
+    static int getHardwareThreads()
+    {
+#ifndef PIC_DISABLE_THREAD
+        int n = int(std::thread::hardware_concurrency());
+        return (n > 0) ? n : 1;
+#else
+        return 1;
+#endif
+    }
+
+    /**
+     * @brief getInstance returns the process-wide pool; it is created
+     * the first time this function is called.
+     * @return This function returns the process-wide pool.
+     */
+    static ThreadPool *getInstance()
+    {
+        static ThreadPool pool;
+        return &pool;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_THREAD_POOL_HPP */
@@ -29,8 +29,8 @@ namespace pic {
 class Tile
 {
 public:
-    int				startX, startY;
-    int				width,  height;
+    int				startX, startY, startZ;
+    int				width,  height, frames;
     std::string     name;
     Image		    *tile;
 
@@ -41,8 +41,10 @@ public:
     {
         startX = -1;
         startY = -1;
+        startZ = 0;
         width  = -1;
         height = -1;
+        frames = 1;
 
         name = "";
         tile = NULL;
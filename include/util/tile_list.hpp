@@ -20,27 +20,31 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "util/tile.hpp"
 
-#include <thread>
-#include <mutex>
+#include <atomic>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
 
 namespace pic {
 
+//The default L2 cache size in bytes when it cannot be queried at runtime
+#ifndef PIC_L2_CACHE_SIZE
+#define PIC_L2_CACHE_SIZE 262144
+#endif
+
 /**
  * @brief The TileList class
  */
 class TileList
 {
 protected:
-    unsigned int    counter;
-
-#ifndef PIC_DISABLE_THREAD
-    std::mutex      mutex;
-#endif
+    std::atomic<unsigned int> counter;
 
 public:
-    int             width, height;
-    int             h_tile, w_tile;
-    int             mod_h, mod_w;
+    int             width, height, frames;
+    int             h_tile, w_tile, f_tile;
+    int             mod_h, mod_w, mod_f;
 
     /**
      * @brief tiles a list of tiles
@@ -60,6 +64,28 @@ public:
      */
     TileList(int tileSize, int width, int height);
 
+    /**
+     * @brief TileList creates a list of rectangular tiles.
+     * @param tileWidth is the width of a tile in pixels.
+     * @param tileHeight is the height of a tile in pixels.
+     * @param width is the horizontal size of the original image in pixels.
+     * @param height is the vertical size of the original image in pixels.
+     */
+    TileList(int tileWidth, int tileHeight, int width, int height);
+
+    /**
+     * @brief TileList creates a list of 3D tiles (bricks) for
+     * temporal/volumetric images.
+     * @param tileWidth is the width of a tile in pixels.
+     * @param tileHeight is the height of a tile in pixels.
+     * @param tileFrames is the number of frames of a tile.
+     * @param width is the horizontal size of the original image in pixels.
+     * @param height is the vertical size of the original image in pixels.
+     * @param frames is the number of frames of the original image.
+     */
+    TileList(int tileWidth, int tileHeight, int tileFrames,
+             int width, int height, int frames);
+
     ~TileList();
 
     /**
@@ -89,6 +115,76 @@ public:
      */
     void create(int tileSize, int width, int height);
 
+    /**
+     * @brief create creates a list of rectangular tiles.
+     * @param tileWidth is the width of a tile in pixels.
+     * @param tileHeight is the height of a tile in pixels.
+     * @param width is the horizontal size of the original image in pixels.
+     * @param height is the vertical size of the original image in pixels.
+     */
+    void create(int tileWidth, int tileHeight, int width, int height);
+
+    /**
+     * @brief create creates a list of 3D tiles (bricks).
+     * @param tileWidth is the width of a tile in pixels.
+     * @param tileHeight is the height of a tile in pixels.
+     * @param tileFrames is the number of frames of a tile.
+     * @param width is the horizontal size of the original image in pixels.
+     * @param height is the vertical size of the original image in pixels.
+     * @param frames is the number of frames of the original image.
+     */
+    void create(int tileWidth, int tileHeight, int tileFrames,
+                int width, int height, int frames);
+
+    /**
+     * @brief getL2CacheSize returns the size of the L2 cache in bytes;
+     * if it cannot be queried, PIC_L2_CACHE_SIZE is returned.
+     * @return This function returns the size of the L2 cache in bytes.
+     */
+    static int getL2CacheSize();
+
+    /**
+     * @brief computeTileSize computes a tile shape such that the input
+     * and output pixels of a tile fit in half of the L2 cache, and
+     * such that there are enough tiles for balancing nThreads threads.
+     * @param width is the horizontal size of the image in pixels.
+     * @param height is the vertical size of the image in pixels.
+     * @param channels is the number of color channels.
+     * @param footprintX is the horizontal support of the kernel in pixels.
+     * @param footprintY is the vertical support of the kernel in pixels.
+     * @param nThreads is the number of threads.
+     * @param bRowStrip enables tiles as wide as the image; this is meant
+     * for separable (horizontal) passes.
+     * @param tileWidth is the output tile width in pixels.
+     * @param tileHeight is the output tile height in pixels.
+     */
+    static void computeTileSize(int width, int height, int channels,
+                                int footprintX, int footprintY,
+                                int nThreads, bool bRowStrip,
+                                int &tileWidth, int &tileHeight);
+
+    /**
+     * @brief computeTileSize computes the shape of 3D tiles (bricks) such that
+     * the input and output pixels of a brick fit in half of the L2 cache, and
+     * such that there are enough bricks for balancing nThreads threads.
+     * @param width is the horizontal size of the image in pixels.
+     * @param height is the vertical size of the image in pixels.
+     * @param frames is the number of frames of the image.
+     * @param channels is the number of color channels.
+     * @param footprintX is the horizontal support of the kernel in pixels.
+     * @param footprintY is the vertical support of the kernel in pixels.
+     * @param footprintZ is the temporal support of the kernel in frames.
+     * @param nThreads is the number of threads.
+     * @param bRowStrip enables tiles as wide as the image and one frame deep.
+     * @param tileWidth is the output tile width in pixels.
+     * @param tileHeight is the output tile height in pixels.
+     * @param tileFrames is the output number of frames of a tile.
+     */
+    static void computeTileSize(int width, int height, int frames, int channels,
+                                int footprintX, int footprintY, int footprintZ,
+                                int nThreads, bool bRowStrip,
+                                int &tileWidth, int &tileHeight, int &tileFrames);
+
     /**
      * @brief read loads a TileList from a file.
      * @param name is the file name.
@@ -117,17 +213,34 @@ PIC_INLINE TileList::TileList()
 {
     counter = 0;
 
+    frames = 1;
+
     w_tile = 0;
     h_tile = 0;
+    f_tile = 0;
 
     mod_h = 0;
     mod_w = 0;
+    mod_f = 0;
 }
 
 PIC_INLINE TileList::TileList(int tileSize, int width, int height)
 {
     counter = 0;
-    create(tileSize, width, height);
+    create(tileSize, tileSize, width, height);
+}
+
+PIC_INLINE TileList::TileList(int tileWidth, int tileHeight, int width, int height)
+{
+    counter = 0;
+    create(tileWidth, tileHeight, width, height);
+}
+
+PIC_INLINE TileList::TileList(int tileWidth, int tileHeight, int tileFrames,
+                              int width, int height, int frames)
+{
+    counter = 0;
+    create(tileWidth, tileHeight, tileFrames, width, height, frames);
 }
 
 PIC_INLINE TileList::~TileList()
@@ -147,41 +260,47 @@ PIC_INLINE BBox *TileList::genBBox(int i, BBox *box)
     box->SetBox(tiles[i].startX,
                 tiles[i].startX + tiles[i].width,
                 tiles[i].startY, tiles[i].startY + tiles[i].height,
-                0, 1, width, height, 1);
+                tiles[i].startZ, tiles[i].startZ + tiles[i].frames,
+                width, height, frames);
 
     return box;
 }
 
 PIC_INLINE unsigned int TileList::getNext()
 {
-    unsigned int ret = 0;
-    {
-#ifndef PIC_DISABLE_THREAD
-        std::lock_guard<std::mutex> lock(mutex);
-#endif
-        ret = counter;
-        counter++;
-    }
-    return ret;
+    return counter.fetch_add(1, std::memory_order_relaxed);
 }
 
 PIC_INLINE void TileList::resetCounter()
 {
-    {
-#ifndef PIC_DISABLE_THREAD
-        std::lock_guard<std::mutex> lock(mutex);
-#endif
-        counter = 0;
-    }
+    counter.store(0);
 }
 
 PIC_INLINE void TileList::create(int tileSize, int width, int height)
+{
+    create(tileSize, tileSize, width, height);
+}
+
+PIC_INLINE void TileList::create(int tileWidth, int tileHeight, int width, int height)
+{
+    create(tileWidth, tileHeight, 1, width, height, 1);
+}
+
+PIC_INLINE void TileList::create(int tileWidth, int tileHeight, int tileFrames,
+                                 int width, int height, int frames)
 {
     resetCounter();
 
+    frames = MAX(frames, 1);
+
+    tileWidth  = MAX(MIN(tileWidth,  width),  1);
+    tileHeight = MAX(MIN(tileHeight, height), 1);
+    tileFrames = MAX(MIN(tileFrames, frames), 1);
+
     if(tiles.size() > 0) {
-        if((tiles[0].width == tileSize) && (this->width == width) &&
-           (this->height == height)) {
+        if((tiles[0].width == tileWidth) && (tiles[0].height == tileHeight) &&
+           (tiles[0].frames == tileFrames) && (this->width == width) &&
+           (this->height == height) && (this->frames == frames)) {
             return;
         }
 
@@ -190,54 +309,158 @@ PIC_INLINE void TileList::create(int tileSize, int width, int height)
 
     this->width = width;
     this->height = height;
+    this->frames = frames;
 
-    h_tile = height / tileSize;
-    w_tile = width  / tileSize;
-    mod_h  = height % tileSize;
-    mod_w  = width  % tileSize;
+    h_tile = height / tileHeight;
+    w_tile = width  / tileWidth;
+    f_tile = frames / tileFrames;
+    mod_h  = height % tileHeight;
+    mod_w  = width  % tileWidth;
+    mod_f  = frames % tileFrames;
 
-    //main blocks
-    bool bWidth = mod_w != 0;
-    for(int i = 0; i < h_tile; i++) {
-        Tile tile;
-        tile.width = tileSize;
-        tile.height = tileSize;
-        tile.startY = i * tileSize;
+    int n_f = f_tile + ((mod_f != 0) ? 1 : 0);
+    int n_h = h_tile + ((mod_h != 0) ? 1 : 0);
+    int n_w = w_tile + ((mod_w != 0) ? 1 : 0);
 
-        for(int j = 0; j < w_tile; j++) {
-            tile.startX = j * tileSize;
-            tiles.push_back(tile);
+    for(int k = 0; k < n_f; k++) {
+        Tile tile;
+        tile.startZ = k * tileFrames;
+        tile.frames = (k < f_tile) ? tileFrames : mod_f;
+
+        for(int i = 0; i < n_h; i++) {
+            tile.startY = i * tileHeight;
+            tile.height = (i < h_tile) ? tileHeight : mod_h;
+
+            for(int j = 0; j < n_w; j++) {
+                tile.startX = j * tileWidth;
+                tile.width  = (j < w_tile) ? tileWidth : mod_w;
+                tiles.push_back(tile);
+            }
         }
+    }
+}
+
+PIC_INLINE int TileList::getL2CacheSize()
+{
+    static int l2Size = -1;
+
+    if(l2Size < 0) {
+        int tmp = -1;
+
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+        tmp = int(sysconf(_SC_LEVEL2_CACHE_SIZE));
+#endif
+
+        l2Size = (tmp > 0) ? tmp : PIC_L2_CACHE_SIZE;
+    }
 
-        //extra blocks
-        if(bWidth) {
-            tile.startX = w_tile * tileSize;
-            tile.width  = mod_w;
-            tiles.push_back(tile);
+    return l2Size;
+}
+
+PIC_INLINE void TileList::computeTileSize(int width, int height, int channels,
+                                          int footprintX, int footprintY,
+                                          int nThreads, bool bRowStrip,
+                                          int &tileWidth, int &tileHeight)
+{
+    int tileFrames;
+    computeTileSize(width, height, 1, channels, footprintX, footprintY, 1,
+                    nThreads, bRowStrip, tileWidth, tileHeight, tileFrames);
+}
+
+PIC_INLINE void TileList::computeTileSize(int width, int height, int frames, int channels,
+                                          int footprintX, int footprintY, int footprintZ,
+                                          int nThreads, bool bRowStrip,
+                                          int &tileWidth, int &tileHeight, int &tileFrames)
+{
+    //granularity and bounds of adaptive tiles
+    const int step = 16;
+    const int minSize = 16;
+    const int maxSize = 512;
+
+    frames     = MAX(frames, 1);
+    footprintX = MAX(footprintX, 1);
+    footprintY = MAX(footprintY, 1);
+    footprintZ = MAX(footprintZ, 1);
+    nThreads   = MAX(nThreads, 1);
+
+    //half of the L2 cache is left for the rest of the working set
+    long budget = long(getL2CacheSize() / 2);
+    long bpp = long(MAX(channels, 1) * sizeof(float));
+
+    //at least four tiles per thread for load balancing
+    long minTiles = long(nThreads) * 4;
+
+    if(bRowStrip) {
+        tileWidth = width;
+        tileFrames = 1;
+
+        int rows = 1;
+        while(rows < height) {
+            int next = rows + 1;
+            long ws = (long(width + footprintX - 1) * long(next + footprintY - 1) * long(footprintZ) +
+                       long(width) * long(next)) * bpp;
+
+            if(ws > budget) {
+                break;
+            }
+
+            rows = next;
         }
+
+        long maxRows = (long(height) * long(frames) + minTiles - 1) / minTiles;
+        tileHeight = MAX(MIN(rows, int(MIN(maxRows, long(height)))), 1);
+        return;
     }
 
-    //fixed height strip blocks
-    if(mod_h != 0) {
-        int i = h_tile;
+    //the largest square section and then the deepest brick fitting in the budget
+    int size = maxSize;
+    int depth = MIN(frames, maxSize);
 
-        Tile tile;
-        tile.startY = i * tileSize;
-        tile.width  = tileSize;
+    while(true) {
+        long ws = (long(size + footprintX - 1) * long(size + footprintY - 1) * long(depth + footprintZ - 1) +
+                   long(size) * long(size) * long(depth)) * bpp;
 
-        for(int j = 0; j < w_tile; j++) {
-            tile.startX = j * tileSize;
-            tile.height  = mod_h;
-            tiles.push_back(tile);
+        if(ws <= budget) {
+            break;
         }
 
-        if(bWidth) {
-            tile.startX = w_tile * tileSize;
-            tile.width  = mod_w;
-            tile.height  = mod_h;
-            tiles.push_back(tile);
+        if(depth > 1 && depth >= (size / step)) {
+            depth = (depth + 1) >> 1;
+        } else {
+            if(size > minSize) {
+                size -= step;
+            } else {
+                if(depth > 1) {
+                    depth = (depth + 1) >> 1;
+                } else {
+                    break;
+                }
+            }
         }
     }
+
+    while(true) {
+        long nTiles = long((width + size - 1) / size) * long((height + size - 1) / size) *
+                      long((frames + depth - 1) / depth);
+
+        if(nTiles >= minTiles) {
+            break;
+        }
+
+        if(depth > 1) {
+            depth = (depth + 1) >> 1;
+        } else {
+            if(size > minSize) {
+                size -= step;
+            } else {
+                break;
+            }
+        }
+    }
+
+    tileWidth  = size;
+    tileHeight = size;
+    tileFrames = depth;
 }
 
 PIC_INLINE void TileList::writeIntoMemory(Image *output)
@@ -251,12 +474,31 @@ PIC_INLINE void TileList::writeIntoMemory(Image *output)
     }
 
     for(unsigned int i = 0; i < tiles.size(); i++) { //for each tile
-        if(tiles[i].tile != NULL) {
-            output->copySubImage(tiles[i].tile, tiles[i].startX, tiles[i].startY);
+        Image *tile = tiles[i].tile;
+
+        if(tile == NULL) {
+            continue;
+        }
+
+        if((tile->frames == 1) && (tiles[i].startZ == 0)) {
+            output->copySubImage(tile, tiles[i].startX, tiles[i].startY);
+        } else {
+            //3D tiles are copied frame by frame
+            int frames = MIN(tile->frames, output->frames - tiles[i].startZ);
+
+            for(int t = 0; t < frames; t++) {
+                Image tile_t(1, tile->width, tile->height, tile->channels,
+                             tile->data + t * tile->tstride);
+
+                Image output_t(1, output->width, output->height, output->channels,
+                               output->data + (tiles[i].startZ + t) * output->tstride);
+
+                output_t.copySubImage(&tile_t, tiles[i].startX, tiles[i].startY);
+            }
         }
 
         #ifdef PIC_DEBUG
-            printf("Tile x: %d y: %d\n", tiles[i].startX, tiles[i].startY);
+            printf("Tile x: %d y: %d z: %d\n", tiles[i].startX, tiles[i].startY, tiles[i].startZ);
         #endif
     }
 }
@@ -282,10 +524,14 @@ PIC_INLINE bool TileList::read(std::string name, bool flag)
     fscanf(file, "%s", tmp);
     fscanf(file, "%s", txt);
 
-    Tile tmpTile;
     char tmp_name[128];
 
+    //Tile copies share the Image; no reallocation while pushing
+    tiles.reserve(tiles.size() + n);
+
     for(int i = 0; i < n; i++) { //for each tile
+        Tile tmpTile;
+
         fscanf(file, "%s", tmp);
         fscanf(file, "%s", tmp_name);
 
@@ -301,14 +547,37 @@ PIC_INLINE bool TileList::read(std::string name, bool flag)
         fscanf(file, "%s", tmp);
         fscanf(file, "%d", &tmpTile.height);
 
+        //StartZ and Frames are optional; files of 2D lists do not have them
+        while(true) {
+            long pos = ftell(file);
+
+            if(fscanf(file, "%s", tmp) != 1) {
+                break;
+            }
+
+            if(strcmp(tmp, "StartZ:") == 0) {
+                fscanf(file, "%d", &tmpTile.startZ);
+            } else {
+                if(strcmp(tmp, "Frames:") == 0) {
+                    fscanf(file, "%d", &tmpTile.frames);
+                } else {
+                    fseek(file, pos, SEEK_SET);
+                    break;
+                }
+            }
+        }
+
         tmpTile.name = tmp_name;
+
+        //tmpTile.tile is NULL; the Image is allocated in place
+        tiles.push_back(tmpTile);
+
+        Tile &tile = tiles.back();
         if(flag) {
-            tmpTile.tile = new Image(tmpTile.name);
+            tile.tile = new Image(tile.name);
         } else {
-            tmpTile.tile = new Image(1, tmpTile.width, tmpTile.height, 3);
+            tile.tile = new Image(tile.frames, tile.width, tile.height, 3);
         }
-
-        tiles.push_back(tmpTile);
     }
 
     fclose(file);
@@ -345,6 +614,9 @@ PIC_INLINE bool TileList::write(std::string name)
         fprintf(file, "Width: %d\n", tiles[i].width);
         fprintf(file, "Height: %d\n", tiles[i].height);
 
+        fprintf(file, "StartZ: %d\n", tiles[i].startZ);
+        fprintf(file, "Frames: %d\n", tiles[i].frames);
+
         if(bName && tiles[i].tile != NULL) {
             tiles[i].tile->Write(tiles[i].name);
         }